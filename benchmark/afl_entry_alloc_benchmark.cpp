@@ -0,0 +1,58 @@
+#include <atomic>
+#include <new>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Heap allocations per afl_custom_fuzz / afl_custom_post_process call in steady state.
+ * @details The global operator new of this executable counts every allocation made through it,
+ *          the mutator library included. AFL++ fuzzes one queue entry many times in a row, so the
+ *          same input is passed again and again, as here.
+ */
+static std::atomic<uint64_t> heap_allocs{0};
+
+void* operator new(size_t size) {
+    heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+int main(int argc, char *argv[]){
+    const int WARMUP = 2000, ROUNDS = 20000;
+    AFLCustomHepler* helper = afl_custom_init(nullptr, 1);
+    Root msg1, msg2;
+    int remain_size = MAX_BINARY_INPUT_SIZE;
+    createRandomMessage(&msg1, remain_size);
+    remain_size = MAX_BINARY_INPUT_SIZE;
+    createRandomMessage(&msg2, remain_size);
+    string data1 = msg1.SerializeAsString(), data2 = msg2.SerializeAsString();
+
+    uint64_t fuzz_allocs = 0, post_allocs = 0;
+    double fuzz_ns = 0, post_ns = 0;
+    for (int i = 0; i < WARMUP + ROUNDS; i++) {
+        bool measured = i >= WARMUP;
+        uint8_t *out_buf = nullptr, *post_out = nullptr;
+        uint64_t before = heap_allocs.load();
+        BenchTimer timer;
+        int new_size = afl_custom_fuzz(helper, (uint8_t*)data1.data(), data1.size(), &out_buf,
+                                       (uint8_t*)data2.data(), data2.size(), MAX_BINARY_INPUT_SIZE);
+        if (measured) fuzz_ns += timer.ElapsedNs(), fuzz_allocs += heap_allocs.load() - before;
+
+        before = heap_allocs.load();
+        timer.Reset();
+        afl_custom_post_process(helper, out_buf, new_size, &post_out);
+        if (measured) post_ns += timer.ElapsedNs(), post_allocs += heap_allocs.load() - before;
+    }
+    printf("%14s %14s %14s\n", "entry point", "allocs/call", "ns/call");
+    printf("%14s %14.2f %14.0f\n", "fuzz", (double)fuzz_allocs / ROUNDS, fuzz_ns / ROUNDS);
+    printf("%14s %14.2f %14.0f\n", "post_process", (double)post_allocs / ROUNDS, post_ns / ROUNDS);
+    printf("arena: %lu heap blocks, %lu resets\n",
+           (unsigned long)AFLCustomHepler::ArenaHeapBlocks(), (unsigned long)helper->ArenaResets());
+    afl_custom_deinit(helper);
+    return 0;
+}
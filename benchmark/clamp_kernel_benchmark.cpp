@@ -0,0 +1,70 @@
+#include <cstring>
+#include "bench_util.h"
+#include "clamp_kernels.h"
+
+/**
+ * @brief The clamping of dataList / weights and srcs in PostProcessMessage(), scalar against the kernel
+ *        detectClampKernel() picks on this CPU.
+ * @details A mutant has most of its values in range already, the share of values out of range is varied.
+ *          Both kernels run on copies of the same input and their results are compared bit by bit.
+ */
+namespace {
+    const vector<double> RANGE = {-1, 1};
+    const uint32_t DATA_NUM = 6;
+
+    template<class T, class Clamp>
+    double Time(const vector<T>& input, int rounds, vector<T>* out, Clamp clamp) {
+        double ns = 0;
+        for (int i = 0; i < rounds; i++) {
+            *out = input;
+            BenchTimer timer;
+            clamp(out->data(), (int)out->size());
+            ns += timer.ElapsedNs();
+        }
+        return ns / rounds / input.size();
+    }
+
+    void Report(const char* name, int size, int percent, double scalar, double kernel, bool same) {
+        printf("%-8s %8d %6d%% %12.2f %12.2f %9.1fx %6s\n", name, size, percent, scalar, kernel, scalar / kernel,
+               same ? "yes" : "NO");
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int ROUNDS = 200;
+    ClampKernel best = detectClampKernel();
+    getRandEngine()->Seed(1);
+    printf("kernel: %s\n", best == ClampKernel::AVX2 ? "avx2" : "scalar");
+    printf("%-8s %8s %7s %12s %12s %10s %6s\n", "field", "elements", "out", "scalar(ns)", "kernel(ns)", "speedup",
+           "same");
+    for (int size : {64, 1024, 16384}) {
+        for (int percent : {0, 10, 100}) {
+            vector<double> data(size);
+            vector<uint32_t> srcs(size);
+            for (int i = 0; i < size; i++) {
+                bool out = (int)GetRandomIndex(99) < percent;
+                data[i] = out ? GetRandomNum(-1e6, 1e6) : GetRandomNum(-1.0, 1.0);
+                srcs[i] = out ? (uint32_t)GetRandomNum(DATA_NUM, UINT32_MAX) : (uint32_t)GetRandomIndex(DATA_NUM - 1);
+            }
+            vector<double> data_scalar, data_kernel;
+            double scalar = Time(data, ROUNDS, &data_scalar, [](double* d, int n) {
+                clampArrayToRange(d, n, RANGE, ClampKernel::Scalar);
+            });
+            double kernel = Time(data, ROUNDS, &data_kernel, [&](double* d, int n) {
+                clampArrayToRange(d, n, RANGE, best);
+            });
+            Report("dataList", size, percent, scalar, kernel,
+                   !memcmp(data_scalar.data(), data_kernel.data(), size * sizeof(double)));
+
+            vector<uint32_t> srcs_scalar, srcs_kernel;
+            scalar = Time(srcs, ROUNDS, &srcs_scalar, [](uint32_t* d, int n) {
+                apiSrcAndDstClampArray(d, n, DATA_NUM, ClampKernel::Scalar);
+            });
+            kernel = Time(srcs, ROUNDS, &srcs_kernel, [&](uint32_t* d, int n) {
+                apiSrcAndDstClampArray(d, n, DATA_NUM, best);
+            });
+            Report("srcs", size, percent, scalar, kernel, srcs_scalar == srcs_kernel);
+        }
+    }
+    return 0;
+}
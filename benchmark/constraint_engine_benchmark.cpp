@@ -0,0 +1,199 @@
+#include "bench_util.h"
+#include "constraint_engine.h"
+#include "protobuf_mutator/typed_mutator.h"
+
+/**
+ * @brief The field constraints of PostProcessMessage(): the hand-written pass they replace, against
+ *        ConstraintEngine::Apply() with the generated typed constraints and with its reflection table.
+ * @details The legacy pass is the single-field part of PostProcessMessage() before the constraints moved into
+ *          openfhe_ckks.proto, kept here as it was for the comparison. A share of the values is pushed out of range.
+ *          Typed and reflection results are compared byte by byte; the legacy pass draws other random numbers
+ *          for ksTech and securityLevel, so it is only timed. Without typed constraints linked for Root, only the
+ *          legacy pass and the reflection table are timed, the speedup is then the one of the reflection table.
+ */
+namespace {
+    using namespace OpenFHE;
+    const vector<uint32_t> multiplicativeDepth_range = {1, 5};
+    const vector<uint32_t> batchSize_range = {8, 2048};
+    const vector<uint32_t> ksTech_range = {1, 2};
+    const vector<uint32_t> preMode_range = {0, 1};
+    const vector<float> standardDeviation_range = {-1e8, 1e8};
+    const vector<uint32_t> scalTech_range = {1, 3};
+    const vector<uint32_t> firstModSize_range = {40, 60};
+    const vector<uint32_t> scalingModSize_range = {40, 59};
+    const vector<uint32_t> securityLevel_range = {0, 1};
+    const vector<int32_t> rotateIndex_range = {(int)-2e4, (int)2e4};
+    const int rotateIndexed_maxNum = 1;
+    const vector<double> evalData_range = {-1, 1};
+
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value, T>::type
+    clampToRange(const T value, const vector<T>& range) {
+        if(range[0] <= value && value <= range[1])
+            return value;
+        T len = range[1] - range[0] + 1;
+        return NotNegMod(value, len) + range[0];
+    }
+
+    template<typename T>
+    inline typename std::enable_if<std::is_floating_point<T>::value, T>::type
+    clampToRange(const T value, const vector<T>& range) {
+        if(range[0] <= value && value <= range[1])
+            return value;
+        T len = range[1] - range[0];
+        T integer = floor(value);
+        T decimal = value - integer;
+        return fmod(fmod(integer, len) + len, len) + range[0] + decimal;
+    }
+
+    inline uint32_t reduceToPowerOfTwo(uint32_t value) {
+        if((value & (value - 1)) == 0) return value;
+        uint32_t res = 1;
+        while (res <= value) {
+            auto temp = res;
+            res <<= 1;
+            if(res < temp) return temp;
+        }
+        return res >> 1;
+    }
+
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value, T>::type
+    apiSrcAndDstClampToRange(const T value, uint32_t dataNum) {
+        if(dataNum == 0) return value;
+        return clampToRange(value, {0, dataNum - 1});
+    }
+
+    // the single-field part of PostProcessMessage() as it was written by hand
+    void LegacyConstraints(Root* msg) {
+        auto param = msg->mutable_param();
+        if(param->has_multiplicativedepth())
+            param->set_multiplicativedepth(clampToRange(param->multiplicativedepth(), multiplicativeDepth_range));
+        if(param->has_batchsize())
+            param->set_batchsize(reduceToPowerOfTwo(clampToRange(param->batchsize(), batchSize_range)));
+        if(param->has_kstech() && param->kstech() == KeySwitchTechnique::INVALID_KS_TECH)
+            param->set_kstech((KeySwitchTechnique)GetRandomNum(ksTech_range[0], ksTech_range[1]));
+        if(param->has_premode())
+            param->set_premode((ProxyReEncryptionMode)clampToRange((uint32_t)param->premode(), preMode_range));
+        if(param->has_standarddeviation())
+            param->set_standarddeviation(clampToRange(param->standarddeviation(), standardDeviation_range));
+        if(param->has_scaltech())
+            param->set_scaltech((ScalingTechnique)clampToRange((uint32_t)param->scaltech(), scalTech_range));
+        if(param->has_firstmodsize())
+            param->set_firstmodsize(clampToRange(param->firstmodsize(), firstModSize_range));
+        if(param->has_scalingmodsize())
+            param->set_scalingmodsize(clampToRange(param->scalingmodsize(), scalingModSize_range));
+        param->set_numlargedigits(0);
+        if(param->securitylevel() == SecurityLevel::HEStd_NotSet ||
+            param->securitylevel() == SecurityLevel::HEStd_256_classic)
+            param->set_securitylevel((SecurityLevel)GetRandomNum(securityLevel_range[0], securityLevel_range[1]));
+        param->set_ringdim(0);
+        auto apiList = msg->mutable_apisequence()->mutable_apilist();
+        for(auto& api : *apiList)
+            if(api.has_rotateonelist())
+                api.mutable_rotateonelist()->set_index(clampToRange(api.rotateonelist().index(), rotateIndex_range));
+        while(param->rotateindexes_size() > rotateIndexed_maxNum)
+            param->mutable_rotateindexes()->RemoveLast();
+        for(auto& index : *param->mutable_rotateindexes())
+            index = clampToRange(index, rotateIndex_range);
+        param->set_encryptiontechnique(STANDARD);
+
+        for(auto& dataList : *msg->mutable_evaldata()->mutable_alldatalists())
+            clampArrayToRange(dataList.mutable_datalist()->mutable_data(), dataList.datalist_size(), evalData_range);
+
+        uint32_t dataNum = msg->evaldata().alldatalists_size();
+        for(auto& api : *apiList){
+            api.set_dst(apiSrcAndDstClampToRange(api.dst(), dataNum));
+            if(api.has_addtwolist()){
+                api.mutable_addtwolist()->set_src1(apiSrcAndDstClampToRange(api.addtwolist().src1(), dataNum));
+                api.mutable_addtwolist()->set_src2(apiSrcAndDstClampToRange(api.addtwolist().src2(), dataNum));
+            }else if(api.has_addconstant()){
+                api.mutable_addconstant()->set_src(apiSrcAndDstClampToRange(api.addconstant().src(), dataNum));
+                api.mutable_addconstant()->set_num(clampToRange(api.addconstant().num(), evalData_range));
+            }else if(api.has_addmanylist()){
+                auto srcs = api.mutable_addmanylist()->mutable_srcs();
+                apiSrcAndDstClampArray(srcs->mutable_data(), srcs->size(), dataNum);
+            }else if(api.has_subtwolist()){
+                api.mutable_subtwolist()->set_src1(apiSrcAndDstClampToRange(api.subtwolist().src1(), dataNum));
+                api.mutable_subtwolist()->set_src2(apiSrcAndDstClampToRange(api.subtwolist().src2(), dataNum));
+            }else if(api.has_subconstant()){
+                api.mutable_subconstant()->set_src(apiSrcAndDstClampToRange(api.subconstant().src(), dataNum));
+                api.mutable_subconstant()->set_num(clampToRange(api.subconstant().num(), evalData_range));
+            }else if(api.has_multwolist()){
+                api.mutable_multwolist()->set_src1(apiSrcAndDstClampToRange(api.multwolist().src1(), dataNum));
+                api.mutable_multwolist()->set_src2(apiSrcAndDstClampToRange(api.multwolist().src2(), dataNum));
+            }else if(api.has_mulconstant()){
+                api.mutable_mulconstant()->set_src(apiSrcAndDstClampToRange(api.mulconstant().src(), dataNum));
+                api.mutable_mulconstant()->set_num(clampToRange(api.mulconstant().num(), evalData_range));
+            }else if(api.has_mulmanylist()){
+                auto srcs = api.mutable_mulmanylist()->mutable_srcs();
+                apiSrcAndDstClampArray(srcs->mutable_data(), srcs->size(), dataNum);
+            }else if(api.has_linearweightedsum()){
+                auto srcs = api.mutable_linearweightedsum()->mutable_srcs();
+                apiSrcAndDstClampArray(srcs->mutable_data(), srcs->size(), dataNum);
+                auto weights = api.mutable_linearweightedsum()->mutable_weights();
+                clampArrayToRange(weights->mutable_data(), weights->size(), evalData_range);
+            }else if(api.has_rotateonelist())
+                api.mutable_rotateonelist()->set_src(apiSrcAndDstClampToRange(api.rotateonelist().src(), dataNum));
+        }
+    }
+
+    // a mutant: most values in range, some far out of it
+    void PushOutOfRange(Root* msg) {
+        for (auto& dataList : *msg->mutable_evaldata()->mutable_alldatalists())
+            for (auto& value : *dataList.mutable_datalist())
+                if (GetRandomIndex(9) == 0) value *= 1e3;
+        for (auto& api : *msg->mutable_apisequence()->mutable_apilist())
+            if (GetRandomIndex(3) == 0) api.set_dst(api.dst() + 100);
+    }
+
+    // ns per message, every run on a fresh copy of base seeded the same way; the last result is left in out
+    template<class Pass>
+    double Time(const Root& base, int rounds, Root* out, Pass pass) {
+        double ns = 0;
+        for (int i = 0; i < rounds; i++) {
+            out->Clear();
+            out->MergeFrom(base);
+            getRandEngine()->Seed(i);
+            BenchTimer timer;
+            pass(out);
+            ns += timer.ElapsedNs();
+        }
+        return ns / rounds;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int ROUNDS = 200;
+    const ConstraintEngine* engine = GetConstraintEngine(Root::descriptor());
+    bool typed_linked = FindTypedConstraints(Root::descriptor()) != nullptr;
+    if (!typed_linked)
+        printf("no typed constraints are linked for %s, the typed run is skipped\n", Root::descriptor()->full_name().c_str());
+    getRandEngine()->Seed(1);
+    printf("%4s %6s %8s %12s %12s %14s %9s %6s\n", "apis", "data", "bytes", "legacy(ns)", "typed(ns)", "reflection(ns)",
+           "speedup", "same");
+    for (int scale : {1, 4, 16}) {
+        Root base;
+        CreateScaledMessage(&base, 4 * scale, 32 * scale);
+        // index_into needs more than one data list
+        for (int i = 0; i < scale; i++)
+            *base.mutable_evaldata()->add_alldatalists() = base.evaldata().alldatalists(0);
+        PushOutOfRange(&base);
+
+        Root legacy_out, typed_out, reflection_out;
+        double legacy = Time(base, ROUNDS, &legacy_out, LegacyConstraints);
+        SetTypedMutatorsEnabled(false);
+        double reflection = Time(base, ROUNDS, &reflection_out, [&](Root* msg) { engine->Apply(msg); });
+        SetTypedMutatorsEnabled(true);
+        if (!typed_linked) {
+            printf("%4d %6d %8zu %12.0f %12s %14.0f %8.1fx %6s\n", 4 * scale, 32 * scale, base.ByteSizeLong(), legacy,
+                   "-", reflection, legacy / reflection, "-");
+            continue;
+        }
+        double typed = Time(base, ROUNDS, &typed_out, [&](Root* msg) { engine->Apply(msg); });
+        printf("%4d %6d %8zu %12.0f %12.0f %14.0f %8.1fx %6s\n", 4 * scale, 32 * scale, base.ByteSizeLong(), legacy,
+               typed, reflection, legacy / typed,
+               typed_out.SerializeAsString() == reflection_out.SerializeAsString() ? "yes" : "NO");
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief What the donor pool costs and how much more of the corpus the crossovers reach with it.
+ * @details Every entry of a corpus is reported through afl_custom_queue_new_entry(), then the custom mutator stage
+ *          of AFL++ runs over the corpus, the partner of an entry is always the next one. Without the pool the
+ *          FHEParameter and OneAPI messages of a mutant come from its parent, its partner or a mutation; with it from
+ *          anywhere in the corpus. params and apis are the distinct messages of other entries than the parent and the
+ *          partner that the mutants of one batch hold whole. add(ns) is the time of afl_custom_queue_new_entry() per
+ *          entry, file read included; draw(ns) the time of DonorPool::Draw().
+ */
+namespace {
+    const int ENTRIES = 64;
+    const int BATCHES = 64;
+
+    // the messages of a set of entries
+    struct Material {
+        std::set<string> params, apis;
+        void Add(const Root& entry) {
+            params.insert(entry.param().SerializeAsString());
+            for (const auto& api : entry.apisequence().apilist()) apis.insert(api.SerializeAsString());
+        }
+    };
+
+    // The messages of mutant that are in corpus but not in local, added to reached.
+    void Reach(const Root& mutant, const Material& corpus, const Material& local, Material* reached) {
+        auto foreign = [&](const std::set<string>& all, const std::set<string>& own, const string& msg) {
+            return all.count(msg) && !own.count(msg);
+        };
+        string param = mutant.param().SerializeAsString();
+        if (foreign(corpus.params, local.params, param)) reached->params.insert(param);
+        for (const auto& api : mutant.apisequence().apilist()) {
+            string data = api.SerializeAsString();
+            if (foreign(corpus.apis, local.apis, data)) reached->apis.insert(data);
+        }
+    }
+
+    void Run(const vector<string>& corpus, const vector<string>& files, const char* donors) {
+        Material material;
+        for (const string& data : corpus) {
+            Root entry;
+            entry.ParseFromString(data);
+            material.Add(entry);
+        }
+        if (donors) setenv(DONORS_ENV, donors, 1);
+        else unsetenv(DONORS_ENV);
+        AFLCustomHepler *m = afl_custom_init(nullptr, 1);
+        BenchTimer timer;
+        for (const string& file : files) afl_custom_queue_new_entry(m, (const unsigned char*)file.c_str(), nullptr);
+        double add_ns = timer.ElapsedNs() / files.size();
+        double draw_ns = 0;
+        if (!m->GetDonors()->empty()) {
+            ContextScope scope(m->GetContext());
+            const Descriptor* type = OpenFHE::FHEParameter::descriptor();
+            const int DRAWS = 1 << 20;
+            uint64_t sink = 0;
+            timer.Reset();
+            for (int i = 0; i < DRAWS; i++) sink += (uintptr_t)m->GetDonors()->Draw(type);
+            draw_ns = timer.ElapsedNs() / DRAWS + (sink == 1);
+        }
+        double reached_params = 0, reached_apis = 0;
+        for (int b = 0; b < BATCHES; b++) {
+            const string& entry = corpus[b % corpus.size()];
+            const string& partner = corpus[(b + 1) % corpus.size()];
+            unsigned int count = afl_custom_fuzz_count(m, (unsigned char*)entry.data(), entry.size());
+            Material local, reached;
+            for (const string* data : {&entry, &partner}) {
+                Root msg;
+                msg.ParseFromString(*data);
+                local.Add(msg);
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                unsigned char *out;
+                size_t size = afl_custom_fuzz(m, (unsigned char*)entry.data(), entry.size(), &out,
+                                              (unsigned char*)partner.data(), partner.size(), MAX_BINARY_INPUT_SIZE);
+                Root mutant;
+                if (size && mutant.ParseFromArray(out, size)) Reach(mutant, material, local, &reached);
+            }
+            reached_params += reached.params.size();
+            reached_apis += reached.apis.size();
+        }
+        const DonorPool::Stats& stats = m->GetDonors()->stats();
+        printf("%-8s %8llu %8llu %10llu %10.0f %9.1f %12.1f %12.1f\n", donors ? donors : "off",
+               (unsigned long long)(stats.added - stats.evicted), (unsigned long long)stats.interned,
+               (unsigned long long)stats.bytes, add_ns, draw_ns, reached_params / BATCHES, reached_apis / BATCHES);
+        afl_custom_deinit(m);
+    }
+}
+
+int main(int argc, char *argv[]){
+    getRandEngine()->Seed(1);
+    vector<string> corpus, files;
+    const char* dir = getenv("TMPDIR");
+    for (int i = 0; i < ENTRIES; i++) {
+        Root entry;
+        CreateScaledMessage(&entry, 1 + i % 8, 1 + i % 16);
+        // a corpus shares much of its material, half of the entries repeat the parameters of another one
+        if (i % 2) {
+            Root other;
+            other.ParseFromString(corpus[i / 2]);
+            *entry.mutable_param() = other.param();
+        }
+        corpus.push_back(entry.SerializeAsString());
+        files.push_back(string(dir ? dir : "/tmp") + "/donor_pool_benchmark_" + std::to_string(i));
+        std::ofstream(files.back(), std::ios::binary) << corpus.back();
+    }
+    printf("%d entries, %d batches of %d mutants, the partner of an entry is the next one\n", ENTRIES, BATCHES,
+           FUZZ_BATCH_SIZE);
+    printf("%-8s %8s %8s %10s %10s %9s %12s %12s\n", "donors", "pool", "interned", "bytes", "add(ns)", "draw(ns)",
+           "params/batch", "apis/batch");
+    Run(corpus, files, nullptr);
+    Run(corpus, files, "64");
+    Run(corpus, files, "1024");
+    unsetenv(DONORS_ENV);
+    for (const string& file : files) remove(file.c_str());
+    return 0;
+}
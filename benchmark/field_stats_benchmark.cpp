@@ -0,0 +1,75 @@
+#include "bench_util.h"
+#include "protobuf_mutator/mutator_context.h"
+
+/**
+ * @brief Whether SampleWeighting::Productive learns the fields a synthetic target rewards, and what crediting costs.
+ * @details The loop stands in for a fuzzing campaign in sampled mode: batches of mutants of one parent, the FieldIndex
+ *          is built once per batch like in afl_custom_fuzz_count(). A mutant that changed rotateIndexes is a new queue
+ *          entry more often than the others, and every new entry is credited by FieldStats::Credit(), the diff
+ *          against its parent. Per epoch of the statistics the share of mutants that changed rotateIndexes should grow,
+ *          with uniform sampling it stays where it is. dataList is shown as a field that is not rewarded.
+ */
+namespace {
+    const int BATCH = 256;
+
+    const FieldPlan* FindField(const Descriptor* desc, const char* name) {
+        for (const auto& entry : GetMessagePlan(desc)->fields)
+            if (entry.field->name() == name) return &entry;
+        return nullptr;
+    }
+
+    bool ChangedHot(const Root& parent, const Root& mutant) {
+        const auto &a = parent.param().rotateindexes(), &b = mutant.param().rotateindexes();
+        return a.size() != b.size() || !std::equal(a.begin(), a.end(), b.begin());
+    }
+
+    void Run(const Root& parent, int batches, SampleWeighting weighting) {
+        MutatorContext context;
+        ContextScope scope(&context);
+        getRandEngine()->Seed(1);
+        GetMutator()->SetSampleOptions({4, weighting});
+        const FieldPlan* fields[] = {FindField(OpenFHE::FHEParameter::descriptor(), "rotateIndexes"),
+                                     FindField(OpenFHE::EvalData::OneDataList::descriptor(), "dataList")};
+        printf("\n%s\n%6s %8s %8s %10s %9s %9s\n", weighting == SampleWeighting::Productive ? "productive" : "uniform",
+               "epoch", "mutants", "hot", "credit(ns)", "rotIdx", "dataList");
+        FieldIndex index;
+        Root mutant;
+        int mutants = 0, hot = 0, credits = 0;
+        double credit_ns = 0;
+        uint64_t epoch = 0;
+        for (int batch = 0; batch < batches; batch++) {
+            index.Build(parent, weighting);
+            for (int i = 0; i < BATCH; i++) {
+                mutant.CopyFrom(parent);
+                int max_size = 1 << 20;
+                GetMutator()->Mutate(&mutant, max_size, &index);
+                bool changed = ChangedHot(parent, mutant);
+                mutants++;
+                hot += changed;
+                if (GetRandomIndex(changed ? 4 : 99)) continue;
+                BenchTimer timer;
+                GetFieldStats()->Credit(parent, mutant);
+                credit_ns += timer.ElapsedNs();
+                credits++;
+            }
+            if (GetFieldStats()->epochs() == epoch && batch + 1 < batches) continue;
+            epoch = GetFieldStats()->epochs();
+            printf("%6llu %8d %7.1f%% %10.0f", (unsigned long long)epoch, mutants, 100.0 * hot / mutants,
+                   credits ? credit_ns / credits : 0.0);
+            for (const FieldPlan* field : fields) printf(" %9.3f", GetFieldStats()->Weight(*field));
+            printf("\n");
+            mutants = hot = credits = 0;
+            credit_ns = 0;
+        }
+    }
+}
+
+int main(int argc, char *argv[]){
+    getRandEngine()->Seed(1);
+    Root parent;
+    CreateScaledMessage(&parent, 16, 64);
+    printf("parent of %zu bytes, K = 4, mutants that change rotateIndexes are rewarded\n", parent.ByteSizeLong());
+    Run(parent, 256, SampleWeighting::Uniform);
+    Run(parent, 256, SampleWeighting::Productive);
+    return 0;
+}
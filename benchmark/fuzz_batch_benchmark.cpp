@@ -0,0 +1,100 @@
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Per mutant cost of afl_custom_fuzz with and without afl_custom_fuzz_count batches, and of MutateBatch.
+ * @details A batch parses the parent once, every mutant starts from a copy of it. The serialization of a
+ *          mutant is needed either way. Without the parse cache every call parses its input, with it a call
+ *          hashes and compares the input before it copies the cached message. All runs use the same seed,
+ *          so they have to produce the same mutants.
+ */
+namespace {
+    struct RunResult {
+        double ns_per_mutant;
+        size_t output_hash;
+    };
+
+    RunResult RunAFL(AFLCustomHepler* helper, const std::vector<string>& queue, bool cached, bool batched) {
+        // seed and configure the instance, not the context of this thread
+        ContextScope scope(helper->GetContext());
+        GetParseCache()->SetLimits(cached ? PARSE_CACHE_MAX_ENTRIES : 0, PARSE_CACHE_MAX_BYTES);
+        getRandEngine()->Seed(1);
+        std::vector<uint8_t> buf(MAX_BINARY_INPUT_SIZE);
+        size_t output_hash = 0, calls = 0;
+        BenchTimer timer;
+        for (size_t entry = 0; entry < queue.size(); entry++) {
+            const string& data = queue[entry];
+            const string& add = queue[(entry + 1) % queue.size()];
+            // AFL++ does not call afl_custom_fuzz_count() if the mutator does not export it
+            int count = batched ? afl_custom_fuzz_count(helper, (const uint8_t*)data.data(), data.size()) : FUZZ_BATCH_SIZE;
+            for (int i = 0; i < count; i++, calls++) {
+                // AFL++ restores the entry before every call
+                memcpy(buf.data(), data.data(), data.size());
+                uint8_t* out_buf = nullptr;
+                int out_size = afl_custom_fuzz(helper, buf.data(), data.size(), &out_buf, (uint8_t*)add.data(), add.size(),
+                                               MAX_BINARY_INPUT_SIZE);
+                output_hash = output_hash * 31 + std::hash<std::string_view>()({(const char*)out_buf, (size_t)out_size});
+            }
+        }
+        return {timer.ElapsedNs() / calls, output_hash};
+    }
+
+    template<class F>
+    double NsPerCall(int rounds, F f) {
+        BenchTimer timer;
+        for (int i = 0; i < rounds; i++) f();
+        return timer.ElapsedNs() / rounds;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int QUEUE_SIZE = 32, ROUNDS = 20000;
+    AFLCustomHepler* helper = afl_custom_init(nullptr, 1);
+    std::vector<string> queue;
+    getRandEngine()->Seed(1);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        Root msg;
+        int remain_size = MAX_BINARY_INPUT_SIZE;
+        createRandomMessage(&msg, remain_size);
+        queue.push_back(msg.SerializeAsString());
+    }
+
+    // what a batch saves per mutant: a parse, replaced by a copy of the parent
+    Root parent, mutant;
+    uint8_t out[MAX_BINARY_INPUT_SIZE * 2];
+    const string& data = queue[0];
+    parent.ParseFromString(data);
+    double parse_ns = NsPerCall(ROUNDS, [&] { ParseBinaryMessage((const uint8_t*)data.data(), data.size(), &mutant); });
+    double copy_ns = NsPerCall(ROUNDS, [&] { mutant.Clear(); mutant.MergeFrom(parent); });
+    double serialize_ns = NsPerCall(ROUNDS, [&] { SaveMessageAsBinary(mutant, out, sizeof(out)); });
+    printf("per mutant: parse %.0f ns, parent copy %.0f ns, serialize %.0f ns (%zu bytes)\n",
+           parse_ns, copy_ns, serialize_ns, data.size());
+
+    RunResult uncached = RunAFL(helper, queue, false, false);
+    RunResult cached = RunAFL(helper, queue, true, false);
+    RunResult batched = RunAFL(helper, queue, true, true);
+    printf("%24s %14s %12s\n", "afl_custom_fuzz", "ns/mutant", "same output");
+    printf("%24s %14.0f %12s\n", "parse every call", uncached.ns_per_mutant, "-");
+    printf("%24s %14.0f %12s\n", "parse cache", cached.ns_per_mutant, cached.output_hash == uncached.output_hash ? "yes" : "NO");
+    printf("%24s %14.0f %12s\n", "fuzz_count batch", batched.ns_per_mutant, batched.output_hash == uncached.output_hash ? "yes" : "NO");
+
+    // the generic API against one CustomProtoMutate() per mutant
+    const int BATCH = 64;
+    std::unique_ptr<OutputBuffer[]> outputs(new OutputBuffer[BATCH]);
+    for (int i = 0; i < BATCH; i++) outputs[i].Reserve(MAX_BINARY_INPUT_SIZE);
+    std::vector<int> sizes(BATCH);
+    GetParseCache()->SetLimits(0, PARSE_CACHE_MAX_BYTES);
+    double single_ns = NsPerCall(ROUNDS / BATCH, [&] {
+        for (int i = 0; i < BATCH; i++) {
+            memcpy(outputs[i].data(), data.data(), data.size());
+            CustomProtoMutate(true, outputs[i].data(), data.size(), MAX_BINARY_INPUT_SIZE, &mutant);
+        }
+    }) / BATCH;
+    double batch_ns = NsPerCall(ROUNDS / BATCH, [&] {
+        MutateBatch(true, parent, BATCH, MAX_BINARY_INPUT_SIZE, outputs.get(), sizes.data(), &mutant);
+    }) / BATCH;
+    printf("CustomProtoMutate %.0f ns/mutant, MutateBatch %.0f ns/mutant, speedup %.2f\n",
+           single_ns, batch_ns, single_ns / batch_ns);
+    afl_custom_deinit(helper);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdio>
+#include "protobuf_mutator/mutator.h"
+#include "proto/proto_setting.h"
+
+using namespace protobuf_mutator;
+
+/**
+ * @brief Wall clock timer in nanoseconds.
+ */
+class BenchTimer {
+public:
+    BenchTimer() : start_(std::chrono::steady_clock::now()) {}
+    void Reset() { start_ = std::chrono::steady_clock::now(); }
+    double ElapsedNs() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Build a random Root with api_num entries in apiList and data_num doubles in one dataList,
+ *        so the size of a test case can be scaled without changing its shape.
+ */
+inline void CreateScaledMessage(Root* msg, int api_num, int data_num) {
+    msg->Clear();
+    int remain_size = 1 << 30;
+    createRandomMessage(msg->mutable_param(), remain_size);
+    auto apiList = msg->mutable_apisequence()->mutable_apilist();
+    for (int i = 0; i < api_num; i++)
+        createRandomMessage(apiList->Add(), remain_size);
+    auto dataList = msg->mutable_evaldata()->add_alldatalists();
+    for (int i = 0; i < data_num; i++)
+        dataList->add_datalist(GetRandomNum(-1.0, 1.0));
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include <thread>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Throughput of afl_custom_fuzz + afl_custom_post_process with one mutator instance per thread.
+ * @details The instances share no state, so the throughput should grow with the threads up to the number
+ *          of cores, and every thread has to produce the same mutants as its instance does on its own.
+ */
+namespace {
+    // fuzz and post-process calls of one instance, returns a hash of all outputs
+    size_t RunInstance(unsigned int seed, const std::vector<string>& queue, int calls) {
+        AFLCustomHepler* helper = afl_custom_init(nullptr, seed);
+        std::vector<uint8_t> buf(MAX_BINARY_INPUT_SIZE);
+        size_t output_hash = 0;
+        for (int i = 0; i < calls; i++) {
+            const string& data = queue[i % queue.size()];
+            const string& add = queue[(i + 1) % queue.size()];
+            memcpy(buf.data(), data.data(), data.size());
+            uint8_t *out_buf = nullptr, *post_out = nullptr;
+            int out_size = afl_custom_fuzz(helper, buf.data(), data.size(), &out_buf, (uint8_t*)add.data(), add.size(),
+                                           MAX_BINARY_INPUT_SIZE);
+            out_size = afl_custom_post_process(helper, out_buf, out_size, &post_out);
+            output_hash = output_hash * 31 + std::hash<std::string_view>()({(const char*)post_out, (size_t)out_size});
+        }
+        afl_custom_deinit(helper);
+        return output_hash;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int QUEUE_SIZE = 32, CALLS = 20000;
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<string> queue;
+    getRandEngine()->Seed(1);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        Root msg;
+        int remain_size = MAX_BINARY_INPUT_SIZE;
+        createRandomMessage(&msg, remain_size);
+        queue.push_back(msg.SerializeAsString());
+    }
+
+    // reference: every seed on its own
+    std::vector<size_t> expected(2 * cores);
+    for (unsigned int t = 0; t < expected.size(); t++) expected[t] = RunInstance(t + 1, queue, CALLS);
+
+    printf("%d cores\n%8s %16s %10s %12s\n", cores, "threads", "calls/s", "scaling", "same output");
+    double single = 0;
+    for (unsigned int threads = 1; threads <= 2 * cores; threads *= 2) {
+        std::vector<size_t> hashes(threads);
+        std::vector<std::thread> workers;
+        BenchTimer timer;
+        for (unsigned int t = 0; t < threads; t++)
+            workers.emplace_back([&, t] { hashes[t] = RunInstance(t + 1, queue, CALLS); });
+        for (auto& worker : workers) worker.join();
+        double calls_per_s = threads * CALLS / (timer.ElapsedNs() / 1e9);
+        if (threads == 1) single = calls_per_s;
+        bool same = std::equal(hashes.begin(), hashes.end(), expected.begin());
+        printf("%8u %16.0f %10.2f %12s\n", threads, calls_per_s, calls_per_s / single, same ? "yes" : "NO");
+    }
+    return 0;
+}
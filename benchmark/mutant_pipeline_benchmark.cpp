@@ -0,0 +1,65 @@
+#include <thread>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Throughput of afl_custom_fuzz_count + afl_custom_fuzz + afl_custom_post_process with and without a
+ *        producer thread, against a target that sleeps for every execution.
+ * @details With the pipeline the mutants are made while the target runs, a call only pops one. A stall is
+ *          a call that found no mutant ready and made one by itself.
+ */
+namespace {
+    double RunAFL(const std::vector<string>& queue, int per_entry, int exec_us, size_t depth) {
+        AFLCustomHepler* helper = afl_custom_init(nullptr, 1);
+        if (depth) helper->EnablePipeline(depth, 1);
+        std::vector<uint8_t> buf(MAX_BINARY_INPUT_SIZE);
+        size_t calls = 0;
+        BenchTimer timer;
+        for (size_t entry = 0; entry < queue.size(); entry++) {
+            const string& data = queue[entry];
+            const string& add = queue[(entry + 1) % queue.size()];
+            afl_custom_fuzz_count(helper, (const uint8_t*)data.data(), data.size());
+            for (int i = 0; i < per_entry; i++, calls++) {
+                memcpy(buf.data(), data.data(), data.size());
+                uint8_t *out_buf = nullptr, *post_out = nullptr;
+                int out_size = afl_custom_fuzz(helper, buf.data(), data.size(), &out_buf, (uint8_t*)add.data(),
+                                               add.size(), MAX_BINARY_INPUT_SIZE);
+                afl_custom_post_process(helper, out_buf, out_size, &post_out);
+                // the target
+                std::this_thread::sleep_for(std::chrono::microseconds(exec_us));
+            }
+        }
+        double calls_per_s = calls / (timer.ElapsedNs() / 1e9);
+        if (MutantPipeline* pipeline = helper->GetPipeline()) {
+            MutantPipeline::Stats stats = pipeline->stats();
+            printf("    produced %lu popped %lu stalls %lu stale %lu producer waits %lu depth avg %.2f max %lu\n",
+                   stats.produced, stats.popped, stats.stalls, stats.stale, stats.producer_waits,
+                   stats.AverageDepth(), stats.max_depth);
+        }
+        afl_custom_deinit(helper);
+        return calls_per_s;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int QUEUE_SIZE = 16, PER_ENTRY = 256;
+    std::vector<string> queue;
+    getRandEngine()->Seed(1);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        Root msg;
+        int remain_size = MAX_BINARY_INPUT_SIZE;
+        createRandomMessage(&msg, remain_size);
+        queue.push_back(msg.SerializeAsString());
+    }
+
+    for (int exec_us : {0, 50, 200}) {
+        printf("target %d us per execution\n", exec_us);
+        double sync = RunAFL(queue, PER_ENTRY, exec_us, 0);
+        printf("  %-12s %12.0f calls/s\n", "synchronous", sync);
+        for (size_t depth : {4, 16}) {
+            double piped = RunAFL(queue, PER_ENTRY, exec_us, depth);
+            printf("  depth %-6zu %12.0f calls/s %8.2fx\n", depth, piped, piped / sync);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "bench_util.h"
+
+/**
+ * @brief Cost of one Mutate / Crossover pass as the test case grows.
+ * @details Each field edit charges its size change to the budget instead of re-measuring the message,
+ *          so the cost per byte should stay roughly flat when apiList and dataList grow.
+ */
+int main(int argc, char *argv[]){
+    const int ROUNDS = 2000;
+    Mutator mutator;
+    getRandEngine()->Seed(1);
+    printf("%8s %10s %14s %12s %14s %12s\n", "apiNum", "bytes", "mutate(ns)", "ns/byte", "crossover(ns)", "ns/byte");
+    for (int api_num = 16; api_num <= 2048; api_num *= 2) {
+        Root base, other, msg;
+        CreateScaledMessage(&base, api_num, api_num * 4);
+        CreateScaledMessage(&other, api_num, api_num * 4);
+        int bytes = base.ByteSizeLong();
+        int rounds = std::max(20, ROUNDS * 16 / api_num);
+
+        double mutate_ns = 0, crossover_ns = 0;
+        for (int i = 0; i < rounds; i++) {
+            msg.CopyFrom(base);
+            int max_size = bytes * 2;
+            BenchTimer timer;
+            mutator.Mutate(&msg, max_size);
+            mutate_ns += timer.ElapsedNs();
+
+            msg.CopyFrom(base);
+            max_size = bytes * 2;
+            timer.Reset();
+            mutator.Crossover(&msg, &other, max_size);
+            crossover_ns += timer.ElapsedNs();
+        }
+        mutate_ns /= rounds;
+        crossover_ns /= rounds;
+        printf("%8d %10d %14.0f %12.2f %14.0f %12.2f\n", api_num, bytes, 
+               mutate_ns, mutate_ns / bytes, crossover_ns, crossover_ns / bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "bench_util.h"
+#include "protobuf_mutator/mutator_context.h"
+
+/**
+ * @brief Cost of the operator scheduler per mutant, and whether it learns the operator a synthetic target rewards.
+ * @details The loop stands in for afl_custom_fuzz() and afl_custom_queue_new_entry(): every mutant is a mutation or
+ *          crossover pass on a copy of the parent, and a mutant whose chain used the rewarded operator is "added to the
+ *          queue" (credited) more often than the others. The weight of the rewarded operator should grow epoch by
+ *          epoch. Without a scheduler only the cost per mutant is measured. Each mode runs in a context of its own.
+ */
+namespace {
+    const OperatorGroup GROUP = OperatorGroup::Mutation;
+    const int REWARDED = static_cast<int>(FieldMuationType::Shuffle);
+
+    struct Result {
+        double mutant_ns = 0;
+        std::string table;
+    };
+
+    Result Run(const Root& parent, const Root& donor, int count, bool schedule) {
+        MutatorContext context;
+        ContextScope scope(&context);
+        getRandEngine()->Seed(1);
+        OperatorScheduler* scheduler = GetScheduler();
+        if (schedule) scheduler->Enable();
+        Result result;
+        Root mutant;
+        for (int i = 0; i < count; i++) {
+            mutant.CopyFrom(parent);
+            int max_size = 1 << 20;
+            BenchTimer timer;
+            if (schedule) scheduler->BeginMutant();
+            if (PickCrossover()) GetMutator()->Crossover(&mutant, &donor, max_size);
+            else GetMutator()->Mutate(&mutant, max_size);
+            result.mutant_ns += timer.ElapsedNs();
+            if (!schedule) continue;
+            timer.Reset();
+            scheduler->EndMutant();
+            result.mutant_ns += timer.ElapsedNs();
+            // the target: 1 in 10 mutants that shuffled is new coverage, 1 in 100 of the others
+            bool rewarded = scheduler->LastChain().count[static_cast<int>(GROUP)][REWARDED];
+            if (GetRandomIndex(rewarded ? 9 : 99) == 0) scheduler->Credit();
+        }
+        result.mutant_ns /= count;
+        if (schedule) result.table = scheduler->Describe();
+        return result;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int COUNT = 16 * SCHEDULE_EPOCH;
+    getRandEngine()->Seed(1);
+    Root parent, donor;
+    CreateScaledMessage(&parent, 16, 64);
+    CreateScaledMessage(&donor, 16, 64);
+    printf("%d mutants of a %zu byte parent, %s is rewarded\n", COUNT, parent.ByteSizeLong(),
+           OperatorScheduler::ArmName(GROUP, REWARDED));
+    for (bool schedule : {false, true}) {
+        Result r = Run(parent, donor, COUNT, schedule);
+        printf("\nscheduler %-3s  %8.0f ns/mutant\n%s", schedule ? "on" : "off", r.mutant_ns, r.table.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "bench_util.h"
+
+/**
+ * @brief afl_custom_fuzz-like calls with and without the parse cache.
+ * @details Like AFL++, every queue entry is fuzzed many times in a row, and the splice partner is drawn
+ *          from a small hot set of the queue. A parsed message is the same whether it comes from the cache
+ *          or not, so both runs have to produce the same mutants.
+ */
+namespace {
+    struct RunResult {
+        double ns_per_call;
+        size_t output_hash;
+        ParsedMessageCache::Stats stats;
+    };
+
+    RunResult Run(const std::vector<string>& queue, int calls_per_entry, int hot_set, bool cached) {
+        auto cache = GetParseCache();
+        cache->SetLimits(cached ? PARSE_CACHE_MAX_ENTRIES : 0, PARSE_CACHE_MAX_BYTES);
+        cache->ResetStats();
+        getRandEngine()->Seed(1);
+        Root input1, input2;
+        std::vector<uint8_t> out(MAX_BINARY_INPUT_SIZE);
+        size_t output_hash = 0, calls = 0;
+        BenchTimer timer;
+        for (size_t entry = 0; entry < queue.size(); entry++) {
+            const string& buf = queue[entry];
+            for (int i = 0; i < calls_per_entry; i++, calls++) {
+                int out_size;
+                if (GetRandomIndex(10) <= 5) {
+                    memcpy(out.data(), buf.data(), buf.size());
+                    out_size = CustomProtoMutate(true, out.data(), buf.size(), MAX_BINARY_INPUT_SIZE, &input1);
+                } else {
+                    const string& add_buf = queue[GetRandomIndex(hot_set - 1)];
+                    out_size = CustomProtoCrossOver(true, (const uint8_t*)buf.data(), buf.size(), (const uint8_t*)add_buf.data(),
+                                                    add_buf.size(), out.data(), MAX_BINARY_INPUT_SIZE, &input1, &input2);
+                }
+                output_hash = output_hash * 31 + std::hash<std::string_view>()({(const char*)out.data(), (size_t)out_size});
+            }
+        }
+        return {timer.ElapsedNs() / calls, output_hash, cache->stats()};
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int QUEUE_SIZE = 64, HOT_SET = 8;
+    std::vector<string> queue;
+    getRandEngine()->Seed(1);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        Root msg;
+        int remain_size = MAX_BINARY_INPUT_SIZE;
+        createRandomMessage(&msg, remain_size);
+        queue.push_back(msg.SerializeAsString());
+    }
+
+    printf("%10s %14s %14s %10s %10s %12s\n", "calls/entry", "uncached(ns)", "cached(ns)", "speedup", "hit rate", "same output");
+    for (int calls_per_entry = 16; calls_per_entry <= 1024; calls_per_entry *= 4) {
+        RunResult uncached = Run(queue, calls_per_entry, HOT_SET, false);
+        RunResult cached = Run(queue, calls_per_entry, HOT_SET, true);
+        printf("%10d %14.0f %14.0f %10.2f %9.1f%% %12s\n", calls_per_entry, uncached.ns_per_call, cached.ns_per_call,
+               uncached.ns_per_call / cached.ns_per_call, cached.stats.HitRate() * 100,
+               uncached.output_hash == cached.output_hash ? "yes" : "NO");
+    }
+    auto stats = GetParseCache()->stats();
+    printf("cache: %zu entries, %zu bytes, %lu evictions\n", stats.entries, stats.bytes, (unsigned long)stats.evictions);
+    return 0;
+}
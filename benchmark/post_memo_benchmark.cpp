@@ -0,0 +1,48 @@
+#include <string>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Whether afl_custom_post_process() is a pure function of its input, and what its memo saves on calibration.
+ * @details Two instances with different seeds post-process the same entries; the outputs must be the same, and the
+ *          same as on the next run of the entry. Every entry is then run like AFL++ calibrates a new queue entry:
+ *          CALIBRATION_RUNS executions in a row, the first one post-processes, the others hit the memo.
+ */
+namespace {
+    const int ENTRIES = 256;
+    const int CALIBRATION_RUNS = 8;
+}
+
+int main(int argc, char *argv[]){
+    getRandEngine()->Seed(1);
+    vector<string> corpus;
+    for (int i = 0; i < ENTRIES; i++) {
+        Root entry;
+        CreateScaledMessage(&entry, 1 + i % 16, 1 + i % 64);
+        corpus.push_back(entry.SerializeAsString());
+    }
+    AFLCustomHepler *a = afl_custom_init(nullptr, 1), *b = afl_custom_init(nullptr, 2);
+    int same = 0;
+    double first_ns = 0, repeat_ns = 0;
+    for (const string& entry : corpus) {
+        unsigned char *out;
+        int size = afl_custom_post_process(b, (unsigned char*)entry.data(), entry.size(), &out);
+        string expected((char*)out, size);
+        bool pure = true;
+        for (int run = 0; run < CALIBRATION_RUNS; run++) {
+            BenchTimer timer;
+            size = afl_custom_post_process(a, (unsigned char*)entry.data(), entry.size(), &out);
+            (run ? repeat_ns : first_ns) += timer.ElapsedNs();
+            pure &= string((char*)out, size) == expected;
+        }
+        same += pure;
+    }
+    printf("%d entries, %d runs each: %d post-processed the same in both instances and on every run\n", ENTRIES,
+           CALIBRATION_RUNS, same);
+    printf("first run %.0f ns, later runs %.0f ns (memo hits %llu, misses %llu)\n", first_ns / ENTRIES,
+           repeat_ns / (ENTRIES * (CALIBRATION_RUNS - 1)), (unsigned long long)a->GetPostState()->memo_hits,
+           (unsigned long long)a->GetPostState()->memo_misses);
+    afl_custom_deinit(a);
+    afl_custom_deinit(b);
+    return 0;
+}
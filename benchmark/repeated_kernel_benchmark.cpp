@@ -0,0 +1,112 @@
+#include "bench_util.h"
+#include "protobuf_mutator/repeated_kernels.h"
+
+/**
+ * @brief Repeated field edits through reflection, before and after the bulk kernels of repeated_kernels.h.
+ * @details dataList holds thousands of doubles, apiList hundreds of messages. The legacy versions are kept
+ *          here for the comparison: delete by adjacent swaps, shuffle through a vector, pick by shuffling all
+ *          indices. Every edit runs on a fresh copy, the copy is not timed.
+ */
+namespace {
+    // DeleteRepeatedField() before: every removed element is swapped to the end one position at a time.
+    void LegacyDelete(Message* msg, const FieldDescriptor* field, int& remain_size) {
+        auto ref = msg->GetReflection();
+        int len = ref->FieldSize(*msg, field);
+        vector<int> idx(len);
+        for (int i = 0; i < len; i++) idx[i] = i;
+        RandomShuffle(idx.begin(), idx.end());
+        int cnt = MAX_NEW_REPEATED_SIZE / 2;
+        std::sort(idx.begin(), idx.begin() + cnt);
+        while (cnt--) {
+            for (int j = idx[cnt]; j + 1 < len; j++) ref->SwapElements(msg, field, j, j + 1);
+            ref->RemoveLast(msg, field);
+            len--;
+        }
+    }
+
+    // ShuffleRepeatedField() before: doubles are copied out and back, messages get len random swaps.
+    void LegacyShuffle(Message* msg, const FieldDescriptor* field, int& remain_size) {
+        auto ref = msg->GetReflection();
+        int len = ref->FieldSize(*msg, field);
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            for (int i = 0; i < len; i++)
+                ref->SwapElements(msg, field, GetRandomIndex(len - 1), GetRandomIndex(len - 1));
+            return;
+        }
+        vector<double> values(len);
+        for (int i = 0; i < len; i++) values[i] = ref->GetRepeatedDouble(*msg, field, i);
+        RandomShuffle(values.begin(), values.end());
+        for (int i = 0; i < len; i++) ref->SetRepeatedDouble(msg, field, i, values[i]);
+    }
+
+    // The pick of ReplaceRepeatedField() / CrossoverAddRepeatedField() before: all indices are shuffled.
+    void LegacyPick(Message* msg, const FieldDescriptor* field, int& remain_size) {
+        int len = msg->GetReflection()->FieldSize(*msg, field);
+        vector<int> idx(len);
+        for (int i = 0; i < len; i++) idx[i] = i;
+        RandomShuffle(idx.begin(), idx.end());
+        remain_size += idx[0];
+    }
+
+    void Pick(Message* msg, const FieldDescriptor* field, int& remain_size) {
+        int idx[MAX_REPLACE_REPEATED_SIZE];
+        SampleIndices(msg->GetReflection()->FieldSize(*msg, field), MAX_REPLACE_REPEATED_SIZE, idx);
+        remain_size += idx[0];
+    }
+
+    // ns per edit of field in the copies of base, parent selects the message that owns the field
+    template<class Edit, class Parent>
+    double Time(const Root& base, Parent parent, const FieldDescriptor* field, int rounds, Edit edit) {
+        Root msg;
+        double ns = 0;
+        for (int i = 0; i < rounds; i++) {
+            msg.Clear();
+            msg.MergeFrom(base);
+            int remain_size = 1 << 30;
+            BenchTimer timer;
+            edit(parent(&msg), field, remain_size);
+            ns += timer.ElapsedNs();
+        }
+        return ns / rounds;
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int ROUNDS = 200;
+    getRandEngine()->Seed(1);
+    auto data_parent = [](Root* msg) -> Message* { return msg->mutable_evaldata()->mutable_alldatalists(0); };
+    auto api_parent = [](Root* msg) -> Message* { return msg->mutable_apisequence(); };
+    Root probe;
+    CreateScaledMessage(&probe, 1, 1);
+    const FieldDescriptor* data_field = data_parent(&probe)->GetDescriptor()->FindFieldByName("dataList");
+    const FieldDescriptor* api_field = api_parent(&probe)->GetDescriptor()->FindFieldByName("apiList");
+
+    printf("%-10s %8s %-8s %14s %14s %10s\n", "field", "elements", "edit", "legacy(ns)", "kernel(ns)", "speedup");
+    auto report = [](const char* name, int elements, const char* edit, double legacy, double kernel) {
+        printf("%-10s %8d %-8s %14.0f %14.0f %9.1fx\n", name, elements, edit, legacy, kernel, legacy / kernel);
+    };
+    for (int scale : {1, 4, 16}) {
+        int api_num = 16 * scale, data_num = 256 * scale;
+        Root base;
+        CreateScaledMessage(&base, api_num, data_num);
+        struct { const char* name; int elements; const FieldDescriptor* field; bool data; } fields[] = {
+            {"dataList", data_num, data_field, true},
+            {"apiList", api_num, api_field, false},
+        };
+        for (auto& f : fields) {
+            auto time = [&](auto edit) {
+                return f.data ? Time(base, data_parent, f.field, ROUNDS, edit) : Time(base, api_parent, f.field, ROUNDS, edit);
+            };
+            report(f.name, f.elements, "delete", time(LegacyDelete), time([](Message* m, const FieldDescriptor* d, int& r) {
+                // the largest count DeleteRepeatedField() removes
+                int len = m->GetReflection()->FieldSize(*m, d), cnt = MAX_NEW_REPEATED_SIZE / 2, idx[MAX_NEW_REPEATED_SIZE / 2];
+                SampleIndices(len, cnt, idx);
+                std::sort(idx, idx + cnt);
+                VisitRepeatedField(m, d, [&](auto elements) { EraseSorted(elements, idx, cnt); });
+            }));
+            report(f.name, f.elements, "shuffle", time(LegacyShuffle), time(ShuffleRepeatedField));
+            report(f.name, f.elements, "pick", time(LegacyPick), time(Pick));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "bench_util.h"
+
+/**
+ * @brief The random numbers the mutators draw, with the engine before wyrand and with RandomEngine.
+ * @details LegacyEngine is the previous engine: minstd_rand for integers and mt19937 for reals, with a
+ *          distribution constructed on every call as GetRandomNum/GetRandomIndex did.
+ */
+namespace {
+    struct LegacyEngine {
+        std::minstd_rand long_engine;
+        std::mt19937 double_engine;
+        void Seed(unsigned int seed) {
+            long_engine.seed(seed);
+            double_engine.seed(seed);
+        }
+        template<typename T>
+        T Num(T mi, T ma) {
+            std::uniform_int_distribution<T> distribution(mi, ma);
+            return distribution(long_engine);
+        }
+        double Real(double mi, double ma) {
+            std::uniform_real_distribution<double> distribution(mi, ma);
+            return distribution(double_engine);
+        }
+    };
+
+    LegacyEngine legacy;
+    volatile uint64_t sink;
+
+    template<class F>
+    double NsPerCall(int rounds, F f) {
+        uint64_t acc = 0;
+        BenchTimer timer;
+        for (int i = 0; i < rounds; i++) acc += f();
+        double ns = timer.ElapsedNs() / rounds;
+        sink = acc;
+        return ns;
+    }
+
+    void Report(const char* name, double legacy_ns, double new_ns) {
+        printf("%28s %12.2f %12.2f %10.2f\n", name, legacy_ns, new_ns, legacy_ns / new_ns);
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int ROUNDS = 10000000, FILL = 1000, SHUFFLE = 64;
+    legacy.Seed(1);
+    getRandEngine()->Seed(1);
+
+    printf("%28s %12s %12s %10s\n", "ns/call", "legacy", "wyrand", "speedup");
+    Report("GetRandomIndex(10)",
+           NsPerCall(ROUNDS, [] { return legacy.Num(0, 10); }),
+           NsPerCall(ROUNDS, [] { return GetRandomIndex(10); }));
+    Report("GetRandomNum(int64 range)",
+           NsPerCall(ROUNDS, [] { return (uint64_t)legacy.Num(INT64_MIN, INT64_MAX); }),
+           NsPerCall(ROUNDS, [] { return (uint64_t)GetRandomNum(INT64_MIN, INT64_MAX); }));
+    Report("GetRandomNum(-1.0, 1.0)",
+           NsPerCall(ROUNDS, [] { return (uint64_t)(legacy.Real(-1.0, 1.0) * 1e9); }),
+           NsPerCall(ROUNDS, [] { return (uint64_t)(GetRandomNum(-1.0, 1.0) * 1e9); }));
+    Report("CanMutate()",
+           NsPerCall(ROUNDS, [] { return (uint64_t)(legacy.Num(1, MUTATE_PROBABILITY) == 1); }),
+           NsPerCall(ROUNDS, [] { return (uint64_t)CanMutate(); }));
+
+    std::vector<double> data(FILL);
+    Report("1000 doubles (per double)",
+           NsPerCall(ROUNDS / FILL, [&] {
+               for (auto& d : data) d = legacy.Real(-1.0, 1.0);
+               return (uint64_t)(data[0] * 1e9);
+           }) / FILL,
+           NsPerCall(ROUNDS / FILL, [&] {
+               GetRandomNums(data.data(), data.size(), -1.0, 1.0);
+               return (uint64_t)(data[0] * 1e9);
+           }) / FILL);
+
+    std::vector<int> list(SHUFFLE);
+    for (int i = 0; i < SHUFFLE; i++) list[i] = i;
+    Report("shuffle 64 elements",
+           NsPerCall(ROUNDS / SHUFFLE, [&] {
+               std::shuffle(list.begin(), list.end(), legacy.long_engine);
+               return (uint64_t)list[0];
+           }),
+           NsPerCall(ROUNDS / SHUFFLE, [&] {
+               RandomShuffle(list.begin(), list.end());
+               return (uint64_t)list[0];
+           }));
+
+    // the same seed gives the same numbers
+    auto draw = [] {
+        getRandEngine()->Seed(1234);
+        uint64_t hash = 0;
+        for (int i = 0; i < 1000; i++)
+            hash = hash * 31 + GetRandomIndex(i) + (uint64_t)GetRandomNum(INT32_MIN, INT32_MAX);
+        return hash;
+    };
+    printf("reproducible from the seed: %s\n", draw() == draw() ? "yes" : "NO");
+    return 0;
+}
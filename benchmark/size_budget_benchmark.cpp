@@ -0,0 +1,35 @@
+#include "bench_util.h"
+
+/**
+ * @brief Mutate passes under a tight size budget.
+ * @details Every edit predicts its size change before it is applied, a value that does not fit is replaced
+ *          by another candidate. Reports the cost of a pass, the average size change of a mutant and how
+ *          many mutants ended up over their budget.
+ */
+int main(int argc, char *argv[]){
+    const int ROUNDS = 20000;
+    Mutator mutator;
+    getRandEngine()->Seed(1);
+    Root base;
+    CreateScaledMessage(&base, 64, 256);
+    int bytes = base.ByteSizeLong();
+    printf("%d bytes\n%8s %12s %10s %14s\n", bytes, "slack", "mutate(ns)", "growth", "over budget");
+    for (int slack : {0, 4, 16, 64, 1024}) {
+        Root msg;
+        double mutate_ns = 0, growth = 0;
+        int over = 0;
+        for (int i = 0; i < ROUNDS; i++) {
+            msg.Clear();
+            msg.MergeFrom(base);
+            int max_size = bytes + slack;
+            BenchTimer timer;
+            mutator.Mutate(&msg, max_size);
+            mutate_ns += timer.ElapsedNs();
+            int size = msg.ByteSizeLong();
+            over += size > bytes + slack;
+            growth += size - bytes;
+        }
+        printf("%8d %12.0f %10.1f %14d\n", slack, mutate_ns / ROUNDS, growth / ROUNDS, over);
+    }
+    return 0;
+}
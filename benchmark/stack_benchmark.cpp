@@ -0,0 +1,72 @@
+#include <unordered_set>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief Stacked mode: distinct mutants per serialization and cost per mutant for several K.
+ * @details Every call of afl_custom_fuzz serializes one mutant. A mutant equal to its parent or to an earlier
+ *          mutant is wasted work for the fuzzer, so the useful output is the number of distinct mutants.
+ */
+namespace {
+    struct RunResult {
+        double ns_per_mutant;
+        double distinct_ratio;
+        StackStats stats;
+    };
+
+    RunResult Run(AFLCustomHepler* helper, const std::vector<string>& queue, int calls_per_entry, const StackOptions& options) {
+        ContextScope scope(helper->GetContext());
+        helper->SetStackOptions(options);
+        helper->GetStackStats() = StackStats();
+        getRandEngine()->Seed(1);
+        std::vector<uint8_t> buf(MAX_BINARY_INPUT_SIZE);
+        std::unordered_set<size_t> distinct;
+        size_t calls = 0;
+        double ns = 0;
+        for (size_t entry = 0; entry < queue.size(); entry++) {
+            const string& data = queue[entry];
+            const string& add = queue[(entry + 1) % queue.size()];
+            afl_custom_fuzz_count(helper, (const uint8_t*)data.data(), data.size());
+            // the parent itself is not a new mutant
+            distinct.insert(std::hash<std::string_view>()(data));
+            for (int i = 0; i < calls_per_entry; i++, calls++) {
+                memcpy(buf.data(), data.data(), data.size());
+                uint8_t* out_buf = nullptr;
+                BenchTimer timer;
+                int out_size = afl_custom_fuzz(helper, buf.data(), data.size(), &out_buf, (uint8_t*)add.data(), add.size(),
+                                               MAX_BINARY_INPUT_SIZE);
+                ns += timer.ElapsedNs();
+                distinct.insert(std::hash<std::string_view>()({(const char*)out_buf, (size_t)out_size}));
+            }
+        }
+        return {ns / calls, (double)(distinct.size() - queue.size()) / calls, helper->GetStackStats()};
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int QUEUE_SIZE = 32, CALLS_PER_ENTRY = 512;
+    AFLCustomHepler* helper = afl_custom_init(nullptr, 1);
+    std::vector<string> queue;
+    getRandEngine()->Seed(1);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        Root msg;
+        int remain_size = MAX_BINARY_INPUT_SIZE;
+        createRandomMessage(&msg, remain_size);
+        queue.push_back(msg.SerializeAsString());
+    }
+
+    printf("%8s %4s %12s %16s %12s %14s %12s\n", "dist", "K", "ns/mutant", "distinct/mutant", "passes", "changed fields", "unchanged");
+    std::vector<StackOptions> configs;
+    for (int k : {1, 2, 4, 8, 16}) configs.push_back({k, StackDistribution::PowerOfTwo});
+    for (int k : {4, 8, 16}) configs.push_back({k, StackDistribution::Uniform});
+    for (const auto& options : configs) {
+        RunResult result = Run(helper, queue, CALLS_PER_ENTRY, options);
+        double stacks = result.stats.stacks ? result.stats.stacks : 1;
+        printf("%8s %4d %12.0f %16.3f %12.2f %14.2f %11.1f%%\n",
+               options.distribution == StackDistribution::Uniform ? "uniform" : "pow2", options.max_passes,
+               result.ns_per_mutant, result.distinct_ratio, result.stats.passes / stacks,
+               result.stats.changed_fields / stacks, result.stats.unchanged * 100 / stacks);
+    }
+    afl_custom_deinit(helper);
+    return 0;
+}
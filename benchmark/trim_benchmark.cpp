@@ -0,0 +1,79 @@
+#include <set>
+#include "bench_util.h"
+#include "postprocess/postprocess.h"
+
+/**
+ * @brief How much afl_custom_trim() removes from a corpus, and what a trimming step costs the mutator.
+ * @details The loop is the one of AFL++ (trim_case_custom()): init_trim, then trim and post_trim until the last step.
+ *          The target is a stand-in: its "coverage" is the set of API kinds in apiList, the scaling and key switching
+ *          techniques and whether any data list has elements, so a candidate succeeds if it keeps all of them.
+ *          An execution of the real target costs about one FHE operation per API, so the APIs per entry before and
+ *          after trimming are the figure to look at. step(ns) is the time of trim + post_trim, without the target.
+ */
+namespace {
+    std::set<int> Coverage(const Root& msg) {
+        std::set<int> cover;
+        for (const auto& api : msg.apisequence().apilist()) cover.insert(api.api_case());
+        cover.insert(100 + msg.param().scaltech());
+        cover.insert(200 + msg.param().kstech());
+        for (const auto& list : msg.evaldata().alldatalists())
+            if (list.datalist_size()) cover.insert(300);
+        return cover;
+    }
+
+    struct Shape {
+        double bytes = 0, apis = 0, lists = 0, values = 0;
+        void Add(const Root& msg) {
+            bytes += msg.ByteSizeLong();
+            apis += msg.apisequence().apilist_size();
+            lists += msg.evaldata().alldatalists_size();
+            for (const auto& list : msg.evaldata().alldatalists()) values += list.datalist_size();
+        }
+    };
+}
+
+int main(int argc, char *argv[]){
+    const int ENTRIES = 200;
+    AFLCustomHepler *m = afl_custom_init(nullptr, 1);
+    Shape before, after;
+    double steps = 0, successes = 0, step_ns = 0;
+    getRandEngine()->Seed(1);
+    for (int e = 0; e < ENTRIES; e++) {
+        Root entry;
+        {
+            ContextScope scope(m->GetContext());
+            CreateScaledMessage(&entry, 4 + e % 32, 8 + e % 64);
+        }
+        std::string data = entry.SerializeAsString();
+        std::set<int> cover = Coverage(entry);
+        before.Add(entry);
+        BenchTimer timer;
+        int stage_max = afl_custom_init_trim(m, (unsigned char*)data.data(), data.size());
+        step_ns += timer.ElapsedNs();
+        for (int stage = 0; stage < stage_max; ) {
+            unsigned char *out;
+            timer.Reset();
+            size_t size = afl_custom_trim(m, &out);
+            step_ns += timer.ElapsedNs();
+            Root candidate;
+            bool success = size <= data.size() && candidate.ParseFromArray(out, size) && Coverage(candidate) == cover;
+            if (success) data.assign((char*)out, size);
+            timer.Reset();
+            stage = afl_custom_post_trim(m, success);
+            step_ns += timer.ElapsedNs();
+            steps++;
+            successes += success;
+        }
+        entry.ParseFromString(data);
+        after.Add(entry);
+    }
+    afl_custom_deinit(m);
+    printf("%d entries, %.1f steps and %.1f removals per entry, %.0f ns per step\n", ENTRIES, steps / ENTRIES,
+           successes / ENTRIES, step_ns / steps);
+    printf("%-8s %10s %10s %10s %10s\n", "", "bytes", "apis", "lists", "values");
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", "before", before.bytes / ENTRIES, before.apis / ENTRIES,
+           before.lists / ENTRIES, before.values / ENTRIES);
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", "after", after.bytes / ENTRIES, after.apis / ENTRIES,
+           after.lists / ENTRIES, after.values / ENTRIES);
+    return 0;
+}
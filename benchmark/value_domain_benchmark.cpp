@@ -0,0 +1,77 @@
+#include <unordered_set>
+#include "bench_util.h"
+#include "constraint_engine.h"
+#include "protobuf_mutator/mutator_context.h"
+
+/**
+ * @brief Mutants of one parent with the values drawn freely and then clamped by ConstraintEngine::Apply(), against
+ *        values drawn inside the value domains of the same constraints (value_domain.h).
+ * @details For each mode: the mutants that Apply() still has to change, the mutants whose edits of param (mostly
+ *          narrow ranges) it turns back into the parameters of the parent, the distinct inputs and the distinct param
+ *          messages that are left after Apply() (what the target executes), and the time of a mutation and of Apply().
+ *          Each mode has a context of its own, domains are only registered for the second one.
+ */
+namespace {
+    struct Result {
+        int changed = 0, undone = 0;
+        size_t executed = 0, params = 0;
+        double mutate_ns = 0, apply_ns = 0;
+    };
+
+    Result Run(const Root& parent, int count, int max_size) {
+        MutatorContext context;
+        ContextScope scope(&context);
+        getRandEngine()->Seed(1);
+        const ConstraintEngine* engine = GetConstraintEngine(Root::descriptor());
+        string original = parent.param().SerializeAsString();
+        std::unordered_set<string> executed, params;
+        Result result;
+        Root mutant;
+        for (int i = 0; i < count; i++) {
+            mutant.CopyFrom(parent);
+            int size = max_size;
+            BenchTimer timer;
+            GetMutator()->Mutate(&mutant, size);
+            result.mutate_ns += timer.ElapsedNs();
+            string raw = mutant.SerializeAsString(), raw_param = mutant.param().SerializeAsString();
+            timer.Reset();
+            engine->Apply(&mutant);
+            result.apply_ns += timer.ElapsedNs();
+            string processed = mutant.SerializeAsString();
+            result.changed += raw != processed;
+            result.undone += raw_param != original && mutant.param().SerializeAsString() == original;
+            executed.insert(std::move(processed));
+            params.insert(mutant.param().SerializeAsString());
+        }
+        result.executed = executed.size();
+        result.params = params.size();
+        result.mutate_ns /= count;
+        result.apply_ns /= count;
+        return result;
+    }
+
+    void Print(const char* mode, int count, const Result& r) {
+        printf("%-8s %8d %9.1f%% %8d %8zu %9zu %12.0f %10.0f\n", mode, count, 100.0 * r.changed / count, r.undone,
+               r.executed, r.params, r.mutate_ns, r.apply_ns);
+    }
+}
+
+int main(int argc, char *argv[]){
+    const int COUNT = 20000;
+    const int MAX_SIZE = 4096;
+    getRandEngine()->Seed(1);
+    // a valid parent with a few data lists for the indices to point to
+    Root parent;
+    CreateScaledMessage(&parent, 8, 16);
+    for (int i = 0; i < 3; i++)
+        *parent.mutable_evaldata()->add_alldatalists() = parent.evaldata().alldatalists(0);
+    const ConstraintEngine* engine = GetConstraintEngine(Root::descriptor());
+    engine->Apply(&parent);
+
+    printf("%-8s %8s %10s %8s %8s %9s %12s %10s\n", "values", "mutants", "clamped", "undone", "executed", "params",
+           "mutate(ns)", "apply(ns)");
+    Print("free", COUNT, Run(parent, COUNT, MAX_SIZE));
+    RegisterValueDomains(engine->BuildValueDomains());
+    Print("domains", COUNT, Run(parent, COUNT, MAX_SIZE));
+    return 0;
+}
@@ -86,6 +86,8 @@ int main(int argc, char *argv[]){
     
     // 
     AFLCustomHepler* mutatorHelper = afl_custom_init(nullptr, seed);
+    // the messages below are created with the seeded random engine of the instance
+    ContextScope scope(mutatorHelper->GetContext());
     print_words({"-------------------", "original message1", "-------------------"}, 2, NO_STAR_LINE);
     createRandomMessage(&msg1, remain_size);
     msg1.PrintDebugString();
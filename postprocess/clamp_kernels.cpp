@@ -0,0 +1,123 @@
+#include "clamp_kernels.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLAMP_KERNELS_X86 1
+#endif
+
+namespace {
+    void clampArrayScalar(double* data, int size, double lo, double hi) {
+        for(int i = 0; i < size; i++)
+            data[i] = clampDouble(data[i], lo, hi);
+    }
+
+    void clampIndicesScalar(uint32_t* data, int size, uint32_t dataNum) {
+        for(int i = 0; i < size; i++)
+            data[i] = clampIndex(data[i], dataNum);
+    }
+
+    // The vector fmod() below is exact when dividing by len is a scaling by a power of two.
+    bool isPowerOfTwo(double len) {
+        int exp;
+        return std::isfinite(len) && len > 0 && frexp(len, &exp) == 0.5 && exp > -500 && exp < 500;
+    }
+
+#ifdef CLAMP_KERNELS_X86
+    /**
+     * Four doubles at a time. For |value| < 2^52 floor(), the scaling by 1 / len and x - trunc(x / len) * len are
+     * exact, so is fmod(). The inner fmod() may return +0 where the scalar one returns -0, adding len makes them
+     * equal again; the additions after it are the ones of the scalar code in the same order. Larger values,
+     * infinities and NaNs go through the scalar code.
+     */
+    __attribute__((target("avx2")))
+    void clampArrayAVX2(double* data, int size, double lo, double hi) {
+        const __m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+        const __m256d len = _mm256_set1_pd(hi - lo), inv = _mm256_set1_pd(1 / (hi - lo));
+        const __m256d exact = _mm256_set1_pd(4503599627370496.0);  // 2^52
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        int i = 0;
+        for(; i + 4 <= size; i += 4) {
+            __m256d value = _mm256_loadu_pd(data + i);
+            __m256d in_range = _mm256_and_pd(_mm256_cmp_pd(vlo, value, _CMP_LE_OQ), _mm256_cmp_pd(value, vhi, _CMP_LE_OQ));
+            int in_mask = _mm256_movemask_pd(in_range);
+            if(in_mask == 0xF) continue;
+            __m256d small = _mm256_cmp_pd(_mm256_andnot_pd(sign, value), exact, _CMP_LT_OQ);
+            if((_mm256_movemask_pd(small) | in_mask) != 0xF) {
+                clampArrayScalar(data + i, 4, lo, hi);
+                continue;
+            }
+            __m256d integer = _mm256_floor_pd(value);
+            __m256d decimal = _mm256_sub_pd(value, integer);
+            __m256d quotient = _mm256_round_pd(_mm256_mul_pd(integer, inv), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            __m256d mod = _mm256_add_pd(_mm256_sub_pd(integer, _mm256_mul_pd(quotient, len)), len);
+            quotient = _mm256_round_pd(_mm256_mul_pd(mod, inv), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            mod = _mm256_sub_pd(mod, _mm256_mul_pd(quotient, len));
+            __m256d clamped = _mm256_add_pd(_mm256_add_pd(mod, vlo), decimal);
+            _mm256_storeu_pd(data + i, _mm256_blendv_pd(clamped, value, in_range));
+        }
+        clampArrayScalar(data + i, size - i, lo, hi);
+    }
+
+    // uint32 -> double of four lanes, AVX2 only converts signed integers
+    __attribute__((target("avx2")))
+    inline __m256d toDouble(__m128i value) {
+        __m128i flipped = _mm_xor_si128(value, _mm_set1_epi32(INT32_MIN));
+        return _mm256_add_pd(_mm256_cvtepi32_pd(flipped), _mm256_set1_pd(2147483648.0));
+    }
+
+    // value % dataNum of four lanes: the quotient of two 32-bit integers rounds to the right integer in double
+    __attribute__((target("avx2")))
+    inline __m128i modDouble(__m128i value, __m256d num) {
+        __m256d v = toDouble(value);
+        __m256d quotient = _mm256_round_pd(_mm256_div_pd(v, num), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        return _mm256_cvttpd_epi32(_mm256_sub_pd(v, _mm256_mul_pd(quotient, num)));
+    }
+
+    /**
+     * Eight indices at a time. NotNegMod(value, dataNum) is value % dataNum for dataNum <= 2^31, the caller
+     * checks it; the remainder is then below 2^31 and converts back as a signed integer.
+     */
+    __attribute__((target("avx2")))
+    void clampIndicesAVX2(uint32_t* data, int size, uint32_t dataNum) {
+        const __m256i max_index = _mm256_set1_epi32((int)(dataNum - 1));
+        const __m256d num = _mm256_set1_pd(dataNum);
+        int i = 0;
+        for(; i + 8 <= size; i += 8) {
+            __m256i value = _mm256_loadu_si256((const __m256i*)(data + i));
+            __m256i in_range = _mm256_cmpeq_epi32(_mm256_max_epu32(value, max_index), max_index);
+            if(_mm256_movemask_epi8(in_range) == -1) continue;
+            __m256i mod = _mm256_set_m128i(modDouble(_mm256_extracti128_si256(value, 1), num),
+                                           modDouble(_mm256_castsi256_si128(value), num));
+            _mm256_storeu_si256((__m256i*)(data + i), _mm256_blendv_epi8(mod, value, in_range));
+        }
+        clampIndicesScalar(data + i, size - i, dataNum);
+    }
+#endif
+}
+
+ClampKernel detectClampKernel() {
+#ifdef CLAMP_KERNELS_X86
+    static const ClampKernel best = __builtin_cpu_supports("avx2") ? ClampKernel::AVX2 : ClampKernel::Scalar;
+    return best;
+#else
+    return ClampKernel::Scalar;
+#endif
+}
+
+void clampArrayToRange(double* data, int size, double lo, double hi, ClampKernel kernel) {
+    assert(lo <= hi);
+#ifdef CLAMP_KERNELS_X86
+    if(kernel == ClampKernel::AVX2 && isPowerOfTwo(hi - lo))
+        return clampArrayAVX2(data, size, lo, hi);
+#endif
+    clampArrayScalar(data, size, lo, hi);
+}
+
+void apiSrcAndDstClampArray(uint32_t* data, int size, uint32_t dataNum, ClampKernel kernel) {
+    // If there is no data to be computed, the API will not be invoked.
+    if(dataNum == 0) return;
+#ifdef CLAMP_KERNELS_X86
+    if(kernel == ClampKernel::AVX2 && dataNum <= (1u << 31))
+        return clampIndicesAVX2(data, size, dataNum);
+#endif
+    clampIndicesScalar(data, size, dataNum);
+}
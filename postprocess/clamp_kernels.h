@@ -0,0 +1,50 @@
+#ifndef CLAMP_KERNELS_H_
+#define CLAMP_KERNELS_H_
+#include <cmath>
+#include <vector>
+#include "protobuf_mutator/mutate_util.h"
+
+/**
+ * Clamping of the contiguous repeated fields of a message (dataList, weights, srcs) in one call per field.
+ * The results are bit-identical to clampToRange() of openfhe_ckks_postprocess.h element by element, whatever
+ * kernel runs: lanes the AVX2 kernel can not compute exactly are left to the scalar code.
+ */
+enum class ClampKernel { Scalar, AVX2 };
+
+// The fastest kernel this CPU supports, detected once.
+ClampKernel detectClampKernel();
+
+/**
+ * @brief clampToRange() of every value in data[0, size)
+ * @details AVX2 is used if hi - lo is a power of two, the fmod() of the scalar code is then
+ *          exact in vector arithmetic. Other ranges always use the scalar kernel.
+ */
+void clampArrayToRange(double* data, int size, double lo, double hi, ClampKernel kernel = detectClampKernel());
+
+inline void clampArrayToRange(double* data, int size, const std::vector<double>& range,
+                              ClampKernel kernel = detectClampKernel()) {
+    clampArrayToRange(data, size, range[0], range[1], kernel);
+}
+
+/**
+ * @brief clampToRange() of every index in data[0, size) into [0, dataNum - 1], nothing if dataNum is 0
+ */
+void apiSrcAndDstClampArray(uint32_t* data, int size, uint32_t dataNum, ClampKernel kernel = detectClampKernel());
+
+// the scalar code, element by element
+inline double clampDouble(double value, double lo, double hi) {
+    if(lo <= value && value <= hi)
+        return value;
+    double len = hi - lo;
+    double integer = floor(value);
+    double decimal = value - integer;
+    return fmod(fmod(integer, len) + len, len) + lo + decimal;
+}
+
+inline uint32_t clampIndex(uint32_t value, uint32_t dataNum) {
+    if(dataNum == 0 || value <= dataNum - 1)
+        return value;
+    return protobuf_mutator::NotNegMod(value, dataNum);
+}
+
+#endif
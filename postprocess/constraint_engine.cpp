@@ -0,0 +1,348 @@
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <google/protobuf/reflection.h>
+#include "constraint_engine.h"
+#include "protobuf_mutator/typed_mutator.h"
+
+namespace {
+    using Action = ConstraintEngine::Action;
+    using ActionKind = ConstraintEngine::ActionKind;
+
+    // Reflection access of a singular field by C++ type, enums are accessed by their numbers.
+    template<class T> struct Access;
+    #define CONSTRAINT_ACCESS(TYPE, NAME)                                                                   \
+        template<> struct Access<TYPE> {                                                                    \
+            static TYPE Get(const Reflection* ref, const Message& msg, const FieldDescriptor* field) {       \
+                return ref->Get##NAME(msg, field);                                                          \
+            }                                                                                               \
+            static void Set(const Reflection* ref, Message* msg, const FieldDescriptor* field, TYPE value) { \
+                ref->Set##NAME(msg, field, value);                                                          \
+            }                                                                                               \
+        };
+    CONSTRAINT_ACCESS(int32_t, Int32)
+    CONSTRAINT_ACCESS(int64_t, Int64)
+    CONSTRAINT_ACCESS(uint32_t, UInt32)
+    CONSTRAINT_ACCESS(uint64_t, UInt64)
+    CONSTRAINT_ACCESS(double, Double)
+    CONSTRAINT_ACCESS(float, Float)
+    struct EnumAccess {
+        static int32_t Get(const Reflection* ref, const Message& msg, const FieldDescriptor* field) {
+            return ref->GetEnumValue(msg, field);
+        }
+        static void Set(const Reflection* ref, Message* msg, const FieldDescriptor* field, int32_t value) {
+            ref->SetEnumValue(msg, field, value);
+        }
+    };
+
+    template<class T>
+    void ApplyValues(T* data, int size, const Action& action, const uint32_t* sizes) {
+        switch (action.kind) {
+            case ActionKind::Range:
+                RangeValues(data, size, action.range[0], action.range[1]);
+                break;
+            case ActionKind::PowerOfTwo:
+                if constexpr (std::is_unsigned<T>::value) PowerOfTwoValues(data, size);
+                break;
+            case ActionKind::IndexInto:
+                if constexpr (std::is_integral<T>::value) IndexValues(data, size, sizes[action.source]);
+                break;
+            case ActionKind::EnumIn:
+                if constexpr (std::is_same<T, int32_t>::value)
+                    EnumValues(data, size, action.enum_in.data(), action.enum_in.size());
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The contiguous storage of a repeated scalar field, GetMutableRepeatedFieldRef() has no access to it.
+    template<class T>
+    protobuf::RepeatedField<T>* MutableRepeatedData(const Reflection* ref, Message* msg, const FieldDescriptor* field) {
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        return ref->MutableRepeatedField<T>(msg, field);
+        #pragma GCC diagnostic pop
+    }
+
+    template<class T, class A = Access<T>>
+    void ApplyField(Message* msg, const Reflection* ref, const Action& action, const uint32_t* sizes) {
+        if (!action.repeated) {
+            if (action.has_presence && !ref->HasField(*msg, action.field)) return;
+            T old_value = A::Get(ref, *msg, action.field), value = old_value;
+            ApplyValues(&value, 1, action, sizes);
+            if (memcmp(&value, &old_value, sizeof(T))) A::Set(ref, msg, action.field, value);
+        } else if constexpr (std::is_same<A, EnumAccess>::value) {
+            // repeated enums are only stored as int, one by one
+            auto values = ref->GetMutableRepeatedFieldRef<int32_t>(msg, action.field);
+            for (int i = 0; i < values.size(); i++) {
+                int32_t value = values.Get(i);
+                ApplyValues(&value, 1, action, sizes);
+                values.Set(i, value);
+            }
+        } else {
+            auto values = MutableRepeatedData<T>(ref, msg, action.field);
+            ApplyValues(values->mutable_data(), values->size(), action, sizes);
+        }
+    }
+
+    // a range can be converted to the type of the field
+    template<class T>
+    bool RangeFits(double min, double max) {
+        return min >= (double)std::numeric_limits<T>::lowest() && max <= (double)std::numeric_limits<T>::max();
+    }
+
+    bool RangeFits(FieldDescriptor::CppType type, double min, double max) {
+        switch (type) {
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_ENUM:   return RangeFits<int32_t>(min, max);
+            case FieldDescriptor::CPPTYPE_INT64:  return RangeFits<int64_t>(min, max);
+            case FieldDescriptor::CPPTYPE_UINT32: return RangeFits<uint32_t>(min, max);
+            case FieldDescriptor::CPPTYPE_UINT64: return RangeFits<uint64_t>(min, max);
+            case FieldDescriptor::CPPTYPE_FLOAT:  return RangeFits<float>(min, max);
+            case FieldDescriptor::CPPTYPE_DOUBLE: return true;
+            default:                              return false;
+        }
+    }
+
+    bool IsIntegral(FieldDescriptor::CppType type) {
+        return type == FieldDescriptor::CPPTYPE_INT32 || type == FieldDescriptor::CPPTYPE_INT64 ||
+               type == FieldDescriptor::CPPTYPE_UINT32 || type == FieldDescriptor::CPPTYPE_UINT64;
+    }
+}
+
+ConstraintEngine::ConstraintEngine(const Descriptor* root) : descriptor_(root) {
+    root_ = Compile(root);
+    auto typed = FindTypedConstraints(root);
+    // the sizes of more paths than the table can take do not fit
+    if (typed && typed->source_count <= MAX_INDEX_SOURCES) typed_ = typed;
+}
+
+const ConstraintEngine::Table* ConstraintEngine::Compile(const Descriptor* desc) {
+    auto it = tables_.find(desc);
+    // A message type that is being compiled (a recursive type) has no actions yet, its recursive
+    // occurrences are not constrained.
+    if (it != tables_.end()) return it->second->actions.empty() ? nullptr : it->second.get();
+    auto table = new Table;
+    tables_[desc].reset(table);
+    for (int i = 0; i < desc->field_count(); i++) {
+        auto field = desc->field(i);
+        const auto& options = field->options();
+        if (options.HasExtension(protobuf_mutator::constraint))
+            AddFieldActions(field, options.GetExtension(protobuf_mutator::constraint), table);
+        if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) continue;
+        const Table* embedded = Compile(field->message_type());
+        if (!embedded) continue;
+        if (auto oneof = field->containing_oneof()) {
+            // one action for the whole group, at the position of its first constrained member
+            auto group = std::find_if(table->actions.begin(), table->actions.end(),
+                                      [&](const Action& action) { return action.oneof == oneof; });
+            if (group == table->actions.end()) {
+                Action action;
+                action.kind = ActionKind::Oneof;
+                action.oneof = oneof;
+                action.cpp_type = FieldDescriptor::CPPTYPE_MESSAGE;
+                action.members.assign(oneof->field_count(), nullptr);
+                table->actions.push_back(action);
+                group = table->actions.end() - 1;
+            }
+            group->members[field->index_in_oneof()] = embedded;
+        } else {
+            Action action;
+            action.kind = ActionKind::Message;
+            action.field = field;
+            action.cpp_type = FieldDescriptor::CPPTYPE_MESSAGE;
+            action.repeated = field->is_repeated();
+            action.table = embedded;
+            table->actions.push_back(action);
+        }
+    }
+    return table->actions.empty() ? nullptr : table;
+}
+
+void ConstraintEngine::AddFieldActions(const FieldDescriptor* field, const FieldConstraint& constraint, Table* table) {
+    Action base;
+    base.field = field;
+    base.cpp_type = field->cpp_type();
+    base.repeated = field->is_repeated();
+    base.has_presence = field->has_presence();
+    auto ignore = [&](const char* reason) {
+        fprintf(stderr, "constraint of %s ignored: %s\n", field->full_name().c_str(), reason);
+    };
+    auto add = [&](ActionKind kind) -> Action& {
+        table->actions.push_back(base);
+        table->actions.back().kind = kind;
+        return table->actions.back();
+    };
+
+    if (constraint.has_max_size()) {
+        if (!field->is_repeated()) ignore("max_size of a field that is not repeated");
+        else add(ActionKind::MaxSize).max_size = constraint.max_size();
+    }
+    if (constraint.enum_in_size()) {
+        if (base.cpp_type != FieldDescriptor::CPPTYPE_ENUM) ignore("enum_in of a field that is not an enum");
+        else add(ActionKind::EnumIn).enum_in.assign(constraint.enum_in().begin(), constraint.enum_in().end());
+    }
+    if (constraint.has_min() || constraint.has_max()) {
+        if (!constraint.has_min() || !constraint.has_max() || !(constraint.min() <= constraint.max()))
+            ignore("a range needs min <= max");
+        else if (!RangeFits(base.cpp_type, constraint.min(), constraint.max()))
+            ignore("the range does not fit the type of the field");
+        else
+            add(ActionKind::Range).range = {constraint.min(), constraint.max()};
+    }
+    if (constraint.power_of_two()) {
+        if (base.cpp_type != FieldDescriptor::CPPTYPE_UINT32 && base.cpp_type != FieldDescriptor::CPPTYPE_UINT64)
+            ignore("power_of_two of a field that is not unsigned");
+        else
+            add(ActionKind::PowerOfTwo);
+    }
+    if (!constraint.index_into().empty()) {
+        int source = IsIntegral(base.cpp_type) ? AddSource(field, constraint.index_into()) : -1;
+        if (!IsIntegral(base.cpp_type)) ignore("index_into of a field that is not an integer");
+        else if (source >= 0) add(ActionKind::IndexInto).source = source;
+    }
+}
+
+int ConstraintEngine::AddSource(const FieldDescriptor* field, const string& path) {
+    vector<const FieldDescriptor*> fields;
+    const Descriptor* desc = descriptor_;
+    for (size_t begin = 0; begin <= path.size(); ) {
+        size_t end = std::min(path.find('.', begin), path.size());
+        const FieldDescriptor* next = desc ? desc->FindFieldByName(path.substr(begin, end - begin)) : nullptr;
+        if (!next) {
+            fprintf(stderr, "constraint of %s ignored: %s is not a field path of %s\n",
+                    field->full_name().c_str(), path.c_str(), descriptor_->full_name().c_str());
+            return -1;
+        }
+        fields.push_back(next);
+        // only the last field may be repeated
+        desc = next->is_repeated() || next->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE ? nullptr : next->message_type();
+        begin = end + 1;
+    }
+    if (!fields.back()->is_repeated()) {
+        fprintf(stderr, "constraint of %s ignored: %s is not a repeated field\n", field->full_name().c_str(), path.c_str());
+        return -1;
+    }
+    auto it = std::find(sources_.begin(), sources_.end(), fields);
+    if (it != sources_.end()) return it - sources_.begin();
+    if (sources_.size() == MAX_INDEX_SOURCES) {
+        fprintf(stderr, "constraint of %s ignored: more than %d index_into paths\n", field->full_name().c_str(),
+                MAX_INDEX_SOURCES);
+        return -1;
+    }
+    sources_.push_back(fields);
+    return sources_.size() - 1;
+}
+
+std::unique_ptr<ValueDomainTable> ConstraintEngine::BuildValueDomains() const {
+    std::unique_ptr<ValueDomainTable> domains(new ValueDomainTable(descriptor_));
+    // in the same order, so the positions of the paths stay the same
+    for (const auto& path : sources_) domains->AddSource(path);
+    for (const auto& table : tables_)
+        for (const Action& action : table.second->actions) {
+            if (action.kind == ActionKind::Message || action.kind == ActionKind::Oneof) continue;
+            auto found = domains->Find(action.field);
+            ValueDomain domain = found ? *found : ValueDomain();
+            switch (action.kind) {
+                case ActionKind::MaxSize:    domain.max_size = action.max_size; break;
+                case ActionKind::EnumIn:     domain.enum_in = action.enum_in; break;
+                case ActionKind::PowerOfTwo: domain.power_of_two = true; break;
+                case ActionKind::IndexInto:  domain.source = action.source; break;
+                case ActionKind::Range:
+                    domain.has_range = true;
+                    domain.min = action.range[0];
+                    domain.max = action.range[1];
+                    break;
+                default: break;
+            }
+            domains->Set(action.field, domain);
+        }
+    return domains;
+}
+
+void ConstraintEngine::Apply(Message* msg) const {
+    if (!root_) return;
+    assert(msg->GetDescriptor() == descriptor_);
+    uint32_t sizes[MAX_INDEX_SOURCES];
+    if (typed_ && TypedMutatorsEnabled()) {
+        typed_->sizes(msg, sizes);
+        typed_->apply(msg, sizes);
+        return;
+    }
+    for (size_t i = 0; i < sources_.size(); i++) {
+        const Message* parent = msg;
+        const auto& path = sources_[i];
+        for (size_t j = 0; j + 1 < path.size(); j++)
+            parent = &parent->GetReflection()->GetMessage(*parent, path[j]);
+        sizes[i] = parent->GetReflection()->FieldSize(*parent, path.back());
+    }
+    ApplyTable(msg, root_, sizes);
+}
+
+void ConstraintEngine::ApplyTable(Message* msg, const Table* table, const uint32_t* sizes) const {
+    auto ref = msg->GetReflection();
+    for (const Action& action : table->actions) {
+        switch (action.kind) {
+            case ActionKind::Message:
+                if (action.repeated) {
+                    int size = ref->FieldSize(*msg, action.field);
+                    for (int i = 0; i < size; i++)
+                        ApplyTable(ref->MutableRepeatedMessage(msg, action.field, i), action.table, sizes);
+                } else if (ref->HasField(*msg, action.field)) {
+                    ApplyTable(ref->MutableMessage(msg, action.field), action.table, sizes);
+                }
+                continue;
+            case ActionKind::Oneof:
+                if (auto member = ref->GetOneofFieldDescriptor(*msg, action.oneof))
+                    if (auto embedded = action.members[member->index_in_oneof()])
+                        ApplyTable(ref->MutableMessage(msg, member), embedded, sizes);
+                continue;
+            case ActionKind::MaxSize:
+                for (int size = ref->FieldSize(*msg, action.field); size > (int)action.max_size; size--)
+                    ref->RemoveLast(msg, action.field);
+                continue;
+            default:
+                break;
+        }
+        switch (action.cpp_type) {
+            case FieldDescriptor::CPPTYPE_INT32:  ApplyField<int32_t>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_INT64:  ApplyField<int64_t>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_UINT32: ApplyField<uint32_t>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_UINT64: ApplyField<uint64_t>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_DOUBLE: ApplyField<double>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_FLOAT:  ApplyField<float>(msg, ref, action, sizes); break;
+            case FieldDescriptor::CPPTYPE_ENUM:   ApplyField<int32_t, EnumAccess>(msg, ref, action, sizes); break;
+            default: break;
+        }
+    }
+}
+
+const ConstraintEngine* GetConstraintEngine(const Descriptor* root) {
+    static std::mutex mutex;
+    static std::unordered_map<const Descriptor*, std::unique_ptr<ConstraintEngine>> engines;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& engine = engines[root];
+    if (!engine) engine.reset(new ConstraintEngine(root));
+    return engine.get();
+}
+
+namespace protobuf_mutator {
+    namespace {
+        // Function-local static, so that registration from static initializers of other units is safe.
+        std::unordered_map<const Descriptor*, TypedConstraintsEntry>* GetTypedConstraints() {
+            static std::unordered_map<const Descriptor*, TypedConstraintsEntry> entries;
+            return &entries;
+        }
+    }
+
+    bool RegisterTypedConstraints(const Descriptor* desc, const TypedConstraintsEntry& entry) {
+        return GetTypedConstraints()->emplace(desc, entry).second;
+    }
+
+    const TypedConstraintsEntry* FindTypedConstraints(const Descriptor* desc) {
+        auto entries = GetTypedConstraints();
+        auto it = entries->find(desc);
+        return it == entries->end() ? nullptr : &it->second;
+    }
+}
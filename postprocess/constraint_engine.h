@@ -0,0 +1,86 @@
+#ifndef CONSTRAINT_ENGINE_H_
+#define CONSTRAINT_ENGINE_H_
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "protobuf_mutator/mutate_util.h"
+#include "constraints.pb.h"
+#include "typed_constraints.h"
+using namespace protobuf_mutator;
+
+// index_into paths of one root type, the value domains of the mutator take the same paths
+#define MAX_INDEX_SOURCES MAX_DOMAIN_SOURCES
+
+/**
+ * @brief Applies the FieldConstraint options of proto/constraints.proto to messages of one root type.
+ * @details The options are compiled once into a flat table of actions per message type, message types without
+ *          any constrained field below them get no table and are never visited. Apply() walks the message once
+ *          and runs the actions of every field in the order MaxSize, EnumIn, Range, PowerOfTwo, IndexInto.
+ *          The sizes of the index_into fields are taken before the walk.
+ *          If protoc-gen-typed_mutator (or typed_mutator_gen) generated typed constraints for the root type
+ *          (typed_constraints.h), they replace the walk while typed mutators are enabled: same kernels, same fields,
+ *          same order. Only they are faster than the hand-written pass they replaced, the walk costs a few
+ *          reflection calls per field.
+ */
+class ConstraintEngine {
+public:
+    enum class ActionKind : uint8_t {
+        MaxSize,
+        EnumIn,
+        Range,
+        PowerOfTwo,
+        IndexInto,
+        Message,  // a singular or repeated embedded message with constraints
+        Oneof     // the message members of a oneof group with constraints
+    };
+    struct Table;
+    struct Action {
+        const FieldDescriptor* field = nullptr;
+        const OneofDescriptor* oneof = nullptr;      // Oneof
+        ActionKind kind = ActionKind::Message;
+        FieldDescriptor::CppType cpp_type = FieldDescriptor::CPPTYPE_MESSAGE;
+        bool repeated = false;
+        bool has_presence = false;
+        vector<double> range;                        // Range: {min, max}
+        uint32_t max_size = 0;                       // MaxSize
+        int source = 0;                              // IndexInto: position in the sizes taken by Apply()
+        vector<int32_t> enum_in;                     // EnumIn
+        const Table* table = nullptr;                // Message
+        vector<const Table*> members;                // Oneof, by FieldDescriptor::index_in_oneof()
+    };
+    struct Table {
+        vector<Action> actions;
+    };
+
+    explicit ConstraintEngine(const Descriptor* root);
+    ConstraintEngine(const ConstraintEngine&) = delete;
+    ConstraintEngine& operator=(const ConstraintEngine&) = delete;
+
+    // Apply all constraints to msg, a message of the root type. Enum subsets draw from the random engine.
+    void Apply(Message* msg) const;
+    // no field of the root type has a constraint
+    bool Empty() const { return root_ == nullptr; }
+    // The constraints as value domains for the mutator (protobuf_mutator/value_domain.h): values drawn inside them
+    // already satisfy Apply(), which then only has to verify them.
+    std::unique_ptr<ValueDomainTable> BuildValueDomains() const;
+
+private:
+    // the table of desc, nullptr if nothing below desc is constrained
+    const Table* Compile(const Descriptor* desc);
+    void AddFieldActions(const FieldDescriptor* field, const FieldConstraint& constraint, Table* table);
+    int AddSource(const FieldDescriptor* field, const string& path);
+    void ApplyTable(Message* msg, const Table* table, const uint32_t* sizes) const;
+
+    const Descriptor* descriptor_;
+    const Table* root_ = nullptr;
+    std::unordered_map<const Descriptor*, std::unique_ptr<Table>> tables_;
+    // index_into paths from the root, the last field is the repeated one
+    vector<vector<const FieldDescriptor*>> sources_;
+    // the generated constraints of the root type, nullptr if there are none
+    const TypedConstraintsEntry* typed_ = nullptr;
+};
+
+// The engine of a root type, compiled on first use. Engines never change once built and are shared by all threads.
+const ConstraintEngine* GetConstraintEngine(const Descriptor* root);
+
+#endif
@@ -1,18 +1,321 @@
+#include <string_view>
 #include "postprocess.h"
 
+namespace {
+    uint64_t arena_heap_blocks = 0;
+
+    // Blocks beyond the first one come from the heap, count them so that steady state can be checked.
+    void* AllocArenaBlock(size_t size) {
+        arena_heap_blocks++;
+        return malloc(size);
+    }
+
+    void FreeArenaBlock(void* block, size_t /*size*/) { free(block); }
+
+    google::protobuf::ArenaOptions MakeArenaOptions(char* block) {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = ARENA_BLOCK_SIZE;
+        options.block_alloc = AllocArenaBlock;
+        options.block_dealloc = FreeArenaBlock;
+        return options;
+    }
+
+    // like a parse in afl_custom_fuzz(), an input that can not be parsed leaves an empty message
+    void ParseEntry(const unsigned char *buf, size_t buf_size, Root* msg) {
+        if(USE_BINARY_PROTO)
+            ParseBinaryMessage(buf, buf_size, msg);
+        else
+            ParseTextMessage(buf, buf_size, msg);
+    }
+
+    uint64_t HashBytes(const unsigned char* buf, size_t buf_size) {
+        return std::hash<std::string_view>()({(const char*)buf, buf_size});
+    }
+
+    // the paths of a parsed entry in sampled mode, once per parse
+    void IndexEntry(const Root& msg, FieldIndex* index) {
+        if(GetMutator()->Sampling())
+            index->Build(msg, GetMutator()->GetSampleOptions().weighting);
+        else
+            index->Clear();
+    }
+}
+
+// Everything the producer thread touches, it has a context and messages of its own.
+struct PipelineProducer {
+    MutatorContext context;
+    Root parent, input1, input2, post_input;
+    FieldIndex index;
+    PostProcessState post_state;
+    StackOptions stack_options;
+    uint64_t generation = 0;
+
+    // the same mutation afl_custom_fuzz() makes without a pipeline, followed by afl_custom_post_process()
+    void Produce(uint64_t entry, const string& data, const string& partner, MutantPipeline::Slot* slot) {
+        ContextScope scope(&context);
+        if(entry != generation){
+            ParseEntry((const unsigned char*)data.data(), data.size(), &parent);
+            IndexEntry(parent, &index);
+            generation = entry;
+        }
+        slot->mutant_size = slot->processed_size = 0;
+        uint8_t* out = slot->mutant.Reserve(MAX_BINARY_INPUT_SIZE);
+        if(!out) return;
+        const uint8_t* add = (const uint8_t*)partner.data();
+        if(stack_options.max_passes > 1)
+            slot->mutant_size = CustomProtoStack(USE_BINARY_PROTO, parent, add, partner.size(), out,
+                                                 MAX_BINARY_INPUT_SIZE, &input1, &input2, stack_options, nullptr,
+                                                 index.Root() ? &index : nullptr);
+        else if(!PickCrossover())
+            slot->mutant_size = CustomProtoMutate(USE_BINARY_PROTO, parent, out, MAX_BINARY_INPUT_SIZE, &input1,
+                                                  index.Root() ? &index : nullptr);
+        else
+            slot->mutant_size = CustomProtoCrossOver(USE_BINARY_PROTO, parent, add, partner.size(), out,
+                                                     MAX_BINARY_INPUT_SIZE, &input1, &input2);
+        unsigned char* processed;
+        slot->processed_size = PostProcessInput(out, slot->mutant_size, &post_input, &processed, &slot->processed,
+                                                &post_state);
+    }
+};
+
+AFLCustomHepler::AFLCustomHepler(int s)
+    : arena_block_(new char[ARENA_BLOCK_SIZE]), arena_(MakeArenaOptions(arena_block_.get())) {
+    CreateRoots();
+}
+
+AFLCustomHepler::~AFLCustomHepler(){
+    // stop the producer before its state goes
+    pipeline_.reset();
+    // the cached message may live on arena_
+    context_.last_mutation.Reset();
+}
+
+void AFLCustomHepler::EnablePipeline(size_t depth, unsigned int seed) {
+    pipeline_.reset();
+    producer_.reset(new PipelineProducer);
+    // a stream of its own, the consumer keeps the one of seed for the mutants it makes itself
+    producer_->context.rng.Seed(seed ^ 0x9e3779b9u);
+    producer_->context.mutator.SetSampleOptions(GetMutator()->GetSampleOptions());
+    producer_->stack_options = stack_options_;
+    PipelineProducer* producer = producer_.get();
+    pipeline_.reset(new MutantPipeline(depth, [producer](uint64_t generation, const string& data,
+                                                         const string& partner, MutantPipeline::Slot* slot) {
+        producer->Produce(generation, data, partner, slot);
+    }));
+}
+
+const MutantPipeline::Slot* AFLCustomHepler::PopPipelined(bool in_batch, const unsigned char *add_buf,
+                                                          size_t add_buf_size) {
+    // the producer only mutates the entry of the current batch
+    if(!in_batch) return ready_slot_ = nullptr;
+    // the partner of the first call of a batch is kept for the whole batch
+    if(!pipeline_->HasPartner()) pipeline_->SetPartner(add_buf, add_buf_size);
+    return ready_slot_ = pipeline_->Pop();
+}
+
+void AFLCustomHepler::CreateRoots() {
+    for(int i = 0; i < ROOT_POOL_SIZE; i++)
+        roots_[i] = google::protobuf::Arena::CreateMessage<Root>(&arena_);
+}
+
+void AFLCustomHepler::RecycleArena() {
+    if(arena_.SpaceUsed() < ARENA_RECYCLE_SIZE) return;
+    context_.last_mutation.Reset();
+    arena_.Reset();
+    CreateRoots();
+    arena_resets_++;
+}
+
+uint64_t AFLCustomHepler::ArenaHeapBlocks() { return arena_heap_blocks; }
+
+void AFLCustomHepler::NoteMutant(const unsigned char *buf, size_t buf_size, bool in_batch) {
+    // a failed mutation has no buffer
+    last_mutant_ = {buf_size ? HashBytes(buf, buf_size) : 0, buf_size, buf_size > 0};
+    last_processed_.valid = false;
+    last_in_batch_ = in_batch;
+    dedup_pending_ = buf_size > 0;
+}
+
+void AFLCustomHepler::NoteProcessed(const unsigned char *buf, size_t buf_size) {
+    last_processed_ = {buf_size ? HashBytes(buf, buf_size) : 0, buf_size, buf_size > 0};
+}
+
+void AFLCustomHepler::QueueNewEntry(const unsigned char *buf, size_t buf_size) {
+    uint64_t hash = HashBytes(buf, buf_size);
+    auto matches = [&](const Fingerprint& print){ return print.valid && print.size == buf_size && print.hash == hash; };
+    if(!matches(last_mutant_) && !matches(last_processed_)) return;
+    // a mutant is credited once, even if AFL++ reports it again
+    last_mutant_.valid = last_processed_.valid = false;
+    if(OperatorScheduler* scheduler = ActiveScheduler()) scheduler->Credit();
+    // the parent of a mutant outside a batch is not kept
+    if(GetMutator()->TracksFields() && last_in_batch_ && batch_valid_){
+        Root* entry = GetRoot(POST_INPUT);
+        if(LoadProtoInput(USE_BINARY_PROTO, buf, buf_size, entry))
+            GetFieldStats()->Credit(batch_parent_, *entry);
+    }
+}
+
+int AFLCustomHepler::Deduplicate(const unsigned char *buf, size_t buf_size, unsigned char **out_buf, int out_size) {
+    if(!out_size) return out_size;
+    uint64_t hash = HashBytes(*out_buf, out_size);
+    // calibration, trimming and the stages of AFL++ itself run what they ask for, only a mutant of afl_custom_fuzz()
+    // is replaced, and only on its first execution
+    bool mutant = dedup_pending_ && last_mutant_.valid && last_mutant_.size == buf_size &&
+                  last_mutant_.hash == HashBytes(buf, buf_size);
+    dedup_pending_ = false;
+    if(!mutant){
+        dedup_.Add(hash);
+        return out_size;
+    }
+    if(!dedup_.CheckMutant(hash)) return out_size;
+    for(int retry = 0; retry < DEDUP_RETRIES; retry++){
+        dedup_.stats().retries++;
+        int size = Remutate(buf, buf_size, out_buf);
+        if(!size) continue;
+        out_size = size;
+        if(!dedup_.CheckMutant(HashBytes(*out_buf, size))){
+            dedup_.stats().saved++;
+            return out_size;
+        }
+    }
+    dedup_.stats().executed++;
+    return out_size;
+}
+
+int AFLCustomHepler::Remutate(const unsigned char *buf, size_t buf_size, unsigned char **out_buf) {
+    uint8_t* out = dedup_out_.Reserve(MAX(buf_size, MAX_BINARY_INPUT_SIZE));
+    if(!out) return 0;
+    // a mutation of the parent of the batch, or of the duplicate outside a batch; a crossover would need add_buf
+    OperatorScheduler* scheduler = ActiveScheduler();
+    if(scheduler) scheduler->BeginMutant();
+    int size;
+    if(last_in_batch_ && batch_valid_)
+        size = CustomProtoMutate(USE_BINARY_PROTO, batch_parent_, out, MAX_BINARY_INPUT_SIZE, GetRoot(FUZZ_INPUT1),
+                                 BatchIndex());
+    else{
+        memcpy(out, buf, buf_size);
+        size = CustomProtoMutate(USE_BINARY_PROTO, out, buf_size, MAX_BINARY_INPUT_SIZE, GetRoot(FUZZ_INPUT1));
+    }
+    if(scheduler) scheduler->EndMutant();
+    // the feedback credits the mutant that is run
+    if(WantsFeedback()) NoteMutant(out, size, last_in_batch_);
+    dedup_pending_ = false;
+    if(!size) return 0;
+    return PostProcessInput(out, size, GetRoot(POST_INPUT), out_buf, &post_out_, &post_state_);
+}
+
+void AFLCustomHepler::AddDonors(const unsigned char *buf, size_t buf_size) {
+    Root* entry = GetRoot(POST_INPUT);
+    if(LoadProtoInput(USE_BINARY_PROTO, buf, buf_size, entry))
+        donors_.Add(*entry);
+}
+
+int AFLCustomHepler::InitTrim(const unsigned char *buf, size_t buf_size) {
+    Root* input = GetRoot(POST_INPUT);
+    if(!LoadProtoInput(USE_BINARY_PROTO, buf, buf_size, input)) return 0;
+    // the text format is not trimmed; a binary candidate must not be longer than the entry, so the entry has to be
+    // in its canonical form (it is unless it comes from outside the mutator)
+    if(!USE_BINARY_PROTO || input->ByteSizeLong() > buf_size) return 0;
+    return trimmer_.Begin(*input);
+}
+
+size_t AFLCustomHepler::Trim(unsigned char **out_buf) {
+    const Message* candidate = trimmer_.Next();
+    // AFL++ asks for a candidate only before the last step, the current message is the safe answer otherwise
+    if(!candidate) candidate = trimmer_.current();
+    int size = candidate ? SerializeToBuffer(*candidate, &trim_out_) : 0;
+    *out_buf = trim_out_.data();
+    return size;
+}
+
+int AFLCustomHepler::PostTrim(bool success) { return trimmer_.Commit(success); }
+
+void AFLCustomHepler::BeginBatch(const unsigned char *buf, size_t buf_size) {
+    batch_data_.assign(buf, buf + buf_size);
+    ParseEntry(buf, buf_size, &batch_parent_);
+    IndexEntry(batch_parent_, &batch_index_);
+    batch_valid_ = true;
+    if(pipeline_) pipeline_->SetParent(buf, buf_size);
+}
+
+int PostProcessInput(const unsigned char *buf, size_t buf_size, Root* input, unsigned char **out_buf,
+                     OutputBuffer *out, PostProcessState *state) {
+    uint64_t hash = HashBytes(buf, buf_size);
+    PostProcessState::MemoEntry& entry = state->memo[hash % POST_MEMO_SIZE];
+    if(entry.valid && entry.hash == hash && entry.input.size() == buf_size &&
+       !memcmp(entry.input.data(), buf, buf_size)){
+        state->memo_hits++;
+        uint8_t* data = out->Reserve(entry.output.size());
+        if(!data) return 0;
+        memcpy(data, entry.output.data(), entry.output.size());
+        *out_buf = data;
+        GetTraceLogger()->Record(TraceKind::PostProcessed, ++state->index, data, entry.output.size());
+        return entry.output.size();
+    }
+    state->memo_misses++;
+    if(!LoadProtoInput(USE_BINARY_PROTO, buf, buf_size, input)) return 0;
+    RandomEngine* rng = getRandEngine();
+    RandomEngine saved = *rng;
+    rng->SeedKey(hash);
+    int size = PostProcessMessage(*input, out_buf, out, state);
+    *rng = saved;
+    entry.hash = hash;
+    entry.input.assign((const char*)buf, buf_size);
+    entry.output.assign((const char*)*out_buf, size);
+    entry.valid = size > 0;
+    return size;
+}
+
 int MutationOrCrossoverOnProtobuf(AFLCustomHepler *m, bool binary, unsigned char *buf, int buf_size, 
                             unsigned char **out_buf, unsigned char *add_buf, int add_buf_size, 
                                        int max_size, Message* input1, Message* input2) {
-    int now = GetRandomIndex(10), out_size;
-    if(now <= 5){
-        memcpy(m->GetOutBuf(), buf, buf_size);
-        out_size = CustomProtoMutate(binary, m->GetOutBuf(), buf_size, max_size, input1);
-        *out_buf = m->GetOutBuf();
+    // buf is mutated in place, a queue entry may be larger than max_size
+    uint8_t* out = m->GetOutBuf()->Reserve(MAX(buf_size, max_size));
+    if(!out) return 0;
+    // inside a batch buf has been parsed by afl_custom_fuzz_count(), the mutant starts from a copy of it
+    const Root* parent = m->BatchParent(buf, buf_size);
+    // pipeline mode: a mutant the producer has made while the target ran, the consumer mutates by itself
+    // only when it has none ready
+    if(m->GetPipeline()){
+        if(const MutantPipeline::Slot* slot = m->PopPipelined(parent != nullptr, add_buf, add_buf_size)){
+            *out_buf = slot->mutant.data();
+            return slot->mutant_size;
+        }
+    }
+    *out_buf = out;
+    if(m->GetStackOptions().max_passes > 1){
+        // stacked mode: several passes, then a single serialization
+        StackEffect effect;
+        int out_size = parent ? CustomProtoStack(binary, *parent, add_buf, add_buf_size, out, max_size, input1, input2,
+                                                 m->GetStackOptions(), &effect, m->BatchIndex())
+                              : CustomProtoStack(binary, buf, buf_size, add_buf, add_buf_size, out, max_size, input1, input2,
+                                                 m->GetStackOptions(), &effect);
+        m->GetStackStats().Add(effect);
+        return out_size;
+    }
+    uint64_t picked = PickedOpCount();
+    bool crossover = PickCrossover();
+    int out_size;
+    if(!crossover){
+        if(parent)
+            out_size = CustomProtoMutate(binary, *parent, out, max_size, input1, m->BatchIndex());
+        else{
+            memcpy(out, buf, buf_size);
+            out_size = CustomProtoMutate(binary, out, buf_size, max_size, input1);
+        }
     }else{
-        // Crossover buf and add_buf and store the outbuf to m.buf_
-        out_size = CustomProtoCrossOver(binary, buf, buf_size, add_buf, add_buf_size, m->GetOutBuf(), 
-                                        max_size, input1, input2);
-        *out_buf = m->GetOutBuf();
+        // a donor of the whole corpus in place of add_buf, add_buf if there is no site for one
+        bool donor = parent && !m->GetDonors()->empty() && GetRandomIndex(3) < DONOR_SPLICE_SHARE;
+        out_size = donor ? CustomProtoSplice(binary, *parent, *m->GetDonors(), out, max_size, input1) : 0;
+        // Crossover buf and add_buf and store the outbuf to the fuzz output buffer of m
+        if(!out_size && parent)
+            out_size = CustomProtoCrossOver(binary, *parent, add_buf, add_buf_size, out, max_size, input1, input2);
+        else if(!out_size)
+            out_size = CustomProtoCrossOver(binary, buf, buf_size, add_buf, add_buf_size, out, 
+                                            max_size, input1, input2);
     }
+    // a single pass is a stack of one, so that both modes report their effect
+    m->GetStackStats().Add({1, crossover, (int)(PickedOpCount() - picked)});
     return out_size;
 }
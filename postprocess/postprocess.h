@@ -4,30 +4,156 @@
 #include <fstream>
 #include <tuple>
 #include "openfhe_ckks_postprocess.h"
+#include "protobuf_mutator/mutator_context.h"
+#include "protobuf_mutator/mutant_pipeline.h"
+#include "protobuf_mutator/message_trimmer.h"
+#include "protobuf_mutator/duplicate_filter.h"
 
 // #define INITIAL_SIZE (500)
 #define MAX(x, y) ( ((x) > (y)) ? (x) : y )
 #define USE_BINARY_PROTO true
+// Initial capacity of the output buffers, post-processing may grow a message beyond MAX_BINARY_INPUT_SIZE.
+#define OUTPUT_BUFFER_SIZE (2 * MAX_BINARY_INPUT_SIZE)
+// The Root messages live in this block, it is allocated once and never returned to the heap.
+#define ARENA_BLOCK_SIZE (1 << 20)
+// The arena is reset once it has used this much, so that it never has to grow beyond its first block.
+#define ARENA_RECYCLE_SIZE (ARENA_BLOCK_SIZE / 2)
 
-// Embedding buf_ in class MutateHelper here to prevent memory fragmentation caused by frequent memory allocation.
+// Mutants per queue entry returned by afl_custom_fuzz_count(), the parent is parsed once for all of them.
+#define FUZZ_BATCH_SIZE (256)
+
+// State of the producer thread in pipeline mode, see postprocess.cpp.
+struct PipelineProducer;
+
+// Messages of the pool, one per use in the entry points.
+enum RootSlot { FUZZ_INPUT1, FUZZ_INPUT2, POST_INPUT, ROOT_POOL_SIZE };
+
+// Embedding the output buffers in class MutateHelper here to prevent memory fragmentation caused by frequent memory allocation.
+// For the same reason the Root messages are allocated on arena_ and reused by every call: parsing clears a message
+// but keeps its sub-messages and repeated fields, so in steady state no message memory is allocated.
 class AFLCustomHepler {
 public: 
-    AFLCustomHepler(int s){
-        buf_  = static_cast<uint8_t*>(calloc(1, MAX_BINARY_INPUT_SIZE + 3));
-        if(!buf_) perror("MutateHelper init");
-        temp = new char[MAX_BINARY_INPUT_SIZE + 3];
+    AFLCustomHepler(int s);
+    ~AFLCustomHepler();
+    // for out_buf in afl_custom_fuzz() 
+    OutputBuffer* GetOutBuf() { return &fuzz_out_; }
+    // for out_buf in afl_custom_post_process()
+    OutputBuffer* GetPostOutBuf() { return &post_out_; }
+
+    Root* GetRoot(RootSlot slot) { return roots_[slot]; }
+
+    // Random engine, caches and trace of this instance, every entry point binds it to the calling thread,
+    // so instances in one process (or one per thread) do not share any state.
+    MutatorContext* GetContext() { return &context_; }
+    PostProcessState* GetPostState() { return &post_state_; }
+
+    // Pipeline mode, see mutant_pipeline.h: a producer thread makes and post-processes depth mutants
+    // of the current batch ahead of time. GetPipeline() is nullptr unless it is enabled.
+    void EnablePipeline(size_t depth, unsigned int seed);
+    MutantPipeline* GetPipeline() { return pipeline_.get(); }
+    // The next ready mutant of the current batch, nullptr if there is none or the call is not part of the batch.
+    // add_buf becomes the splice partner of the batch if it has none yet.
+    const MutantPipeline::Slot* PopPipelined(bool in_batch, const unsigned char *add_buf, size_t add_buf_size);
+    // The mutant PopPipelined() has handed out last if buf is that mutant, nullptr otherwise.
+    const MutantPipeline::Slot* PipelinedSlot(const unsigned char *buf, size_t buf_size) const {
+        if(!ready_slot_ || buf_size != (size_t)ready_slot_->mutant_size ||
+           (buf != ready_slot_->mutant.data() && memcmp(buf, ready_slot_->mutant.data(), buf_size))) return nullptr;
+        return ready_slot_;
     }
-    ~AFLCustomHepler(){
-        free(buf_);
-        delete temp;
+
+    // Parse the queue entry AFL++ is about to fuzz FUZZ_BATCH_SIZE times.
+    void BeginBatch(const unsigned char *buf, size_t buf_size);
+    // The parsed parent if buf is the entry of the current batch, nullptr otherwise.
+    const Root* BatchParent(const unsigned char *buf, size_t buf_size) const {
+        if(!batch_valid_ || buf_size != batch_data_.size() || memcmp(buf, batch_data_.data(), buf_size)) return nullptr;
+        return &batch_parent_;
     }
-    uint8_t* GetOutBuf() { return buf_; }
-    char *temp;
+    // The paths of the parent for sampled mode, nullptr unless the mutator samples, see FieldIndex.
+    const FieldIndex* BatchIndex() const { return batch_index_.Root() ? &batch_index_ : nullptr; }
+    // Queue feedback, for the operator scheduler and the field statistics. The last mutant of afl_custom_fuzz() and its
+    // post-processed form are kept by hash (AFL++ may save either one); a new queue entry that is one of them credits
+    // the operators of the mutant and the fields in which it differs from the parent of the batch.
+    bool WantsFeedback() const { return ActiveScheduler() || GetMutator()->TracksFields(); }
+    void NoteMutant(const unsigned char *buf, size_t buf_size, bool in_batch);
+    void NoteProcessed(const unsigned char *buf, size_t buf_size);
+    void QueueNewEntry(const unsigned char *buf, size_t buf_size);
+    // Duplicate filtering, see DuplicateFilter. afl_custom_fuzz() keeps the fingerprint of its mutant for it as well.
+    DuplicateFilter* GetDuplicateFilter() { return &dedup_; }
+    bool TracksMutants() const { return WantsFeedback() || dedup_.enabled(); }
+    // out_buf is buf post-processed. If buf is the last mutant and the target has run out_buf recently, a new mutant
+    // takes its place, DEDUP_RETRIES times at most. Returns the size of *out_buf.
+    int Deduplicate(const unsigned char *buf, size_t buf_size, unsigned char **out_buf, int out_size);
+    // Donor pool of the corpus, see DonorPool: every new queue entry adds its embedded messages, and a share of the
+    // crossovers of a batch splices one of them instead of the partner AFL++ hands over. The pipeline producer does
+    // not use it, the pool changes under it.
+    DonorPool* GetDonors() { return &donors_; }
+    void AddDonors(const unsigned char *buf, size_t buf_size);
+    // Structure-aware trimming of a queue entry, see MessageTrimmer. InitTrim() returns the number of steps, 0 if the
+    // entry is not trimmed; Trim() the next candidate; PostTrim() the number of the next step.
+    int InitTrim(const unsigned char *buf, size_t buf_size);
+    size_t Trim(unsigned char **out_buf);
+    int PostTrim(bool success);
+    // Called at the end of every entry point. Sub-messages replaced by a oneof switch stay on the arena
+    // until it is reset, so reset it (and rebuild the pool) once it has used ARENA_RECYCLE_SIZE.
+    void RecycleArena();
+
+    // Stacked mode, see StackOptions. One pass per mutant unless K > 1.
+    const StackOptions& GetStackOptions() const { return stack_options_; }
+    void SetStackOptions(const StackOptions& options) { stack_options_ = options; }
+    StackStats& GetStackStats() { return stack_stats_; }
+
+    // Statistics: blocks the arena had to allocate from the heap beyond its first one, and the number of resets.
+    static uint64_t ArenaHeapBlocks();
+    uint64_t ArenaResets() const { return arena_resets_; }
     
 private:
-    uint8_t *buf_;  // for out_buf in afl_custom_fuzz() 
+    void CreateRoots();
+    // A new mutant in place of a duplicate, post-processed into *out_buf. Returns its size, 0 if there is none.
+    int Remutate(const unsigned char *buf, size_t buf_size, unsigned char **out_buf);
+
+    OutputBuffer fuzz_out_{OUTPUT_BUFFER_SIZE};
+    OutputBuffer post_out_{OUTPUT_BUFFER_SIZE};
+    OutputBuffer trim_out_;
+    OutputBuffer dedup_out_;
+    DuplicateFilter dedup_;
+    DonorPool donors_;
+    MessageTrimmer trimmer_;
+    // declared before arena_, the arena still uses its first block while it is destroyed
+    std::unique_ptr<char[]> arena_block_;
+    google::protobuf::Arena arena_;
+    Root* roots_[ROOT_POOL_SIZE];
+    uint64_t arena_resets_ = 0;
+    // its last mutation cache may hold a message on arena_, the destructor resets it first
+    MutatorContext context_;
+    PostProcessState post_state_;
+    // declared before pipeline_, the producer thread uses it until the pipeline is destroyed
+    std::unique_ptr<PipelineProducer> producer_;
+    std::unique_ptr<MutantPipeline> pipeline_;
+    const MutantPipeline::Slot* ready_slot_ = nullptr;
+    // on the heap, the parent outlives arena resets during its batch
+    Root batch_parent_;
+    FieldIndex batch_index_;
+    std::vector<unsigned char> batch_data_;
+    bool batch_valid_ = false;
+    struct Fingerprint {
+        uint64_t hash = 0;
+        size_t size = 0;
+        bool valid = false;
+    };
+    Fingerprint last_mutant_, last_processed_;
+    bool last_in_batch_ = false;
+    bool dedup_pending_ = false;  // the last mutant has not been looked up yet
+    StackOptions stack_options_ = StackOptions::FromEnv();
+    StackStats stack_stats_;
 };
 
+// PostProcessMessage() of the input buf as a pure function of its bytes: its random numbers come from a stream seeded
+// with the hash of buf (the stream of the mutator is left as it was), so a queue entry is run the same way on
+// calibration, re-runs and crash replay. The last inputs are memoized in state, a hit is only a copy into out.
+// input is the message buf is parsed into. Returns the size of *out_buf, 0 if buf can not be parsed.
+int PostProcessInput(const unsigned char *buf, size_t buf_size, Root* input, unsigned char **out_buf,
+                     OutputBuffer *out, PostProcessState *state);
+
 //Implementation of Crossover and Mutation of test cases in AFL_CustomProtoMutator.
 int MutationOrCrossoverOnProtobuf(AFLCustomHepler *m, bool binary, unsigned char *buf, int buf_size, 
                             unsigned char **out_buf, unsigned char *add_buf, 
@@ -36,6 +162,19 @@ int MutationOrCrossoverOnProtobuf(AFLCustomHepler *m, bool binary, unsigned char
 extern "C"{
     AFLCustomHepler *afl_custom_init(void *afl, unsigned int s){                                              
         AFLCustomHepler *mutate_helper = new AFLCustomHepler(s);                                                 
+        ContextScope scope(mutate_helper->GetContext());
+        // Build the mutation plans of all message types once, instead of on the first mutation.
+        GetMessagePlan(Root::descriptor());
+        // New and mutated values are drawn inside the field constraints, PostProcessMessage() then only verifies them.
+        RegisterValueDomains(GetConstraintEngine(Root::descriptor())->BuildValueDomains());
+        // opt-in, see trace_logger.h
+        GetTraceLogger()->StartFromEnv(Root::descriptor());
+        // opt-in, see operator_scheduler.h
+        GetScheduler()->StartFromEnv();
+        // opt-in, see duplicate_filter.h
+        mutate_helper->GetDuplicateFilter()->StartFromEnv();
+        // opt-in, see donor_pool.h
+        mutate_helper->GetDonors()->StartFromEnv();
         std::ofstream seed_of("seed.txt", std::ios::trunc);                                                
         seed_of << s << std::endl;                                                                         
         seed_of.close();             
@@ -43,27 +182,97 @@ extern "C"{
             getRandEngine()->Seed(USE_SEED);     
         else                                                                                             
             getRandEngine()->Seed(s);                                                       
+        // opt-in, see mutant_pipeline.h
+        if(const char* depth = getenv(PIPELINE_DEPTH_ENV))
+            if(atoi(depth) > 0)
+                mutate_helper->EnablePipeline(atoi(depth), USE_SEED ? USE_SEED : s);
         return mutate_helper;                                                                              
     } 
 
+    // Called by AFL++ before the custom mutator stage of a queue entry, returns the number of afl_custom_fuzz() calls.
+    unsigned int afl_custom_fuzz_count(AFLCustomHepler *m, const unsigned char *buf, size_t buf_size){
+        ContextScope scope(m->GetContext());
+        m->BeginBatch(buf, buf_size);
+        return FUZZ_BATCH_SIZE;
+    }
+
     // Deinitialize everything                                                               
-    void afl_custom_deinit(AFLCustomHepler *m){ delete m; }
+    void afl_custom_deinit(AFLCustomHepler *m){
+        m->GetContext()->trace.Stop();
+        m->GetContext()->scheduler.WriteStats();
+        m->GetDuplicateFilter()->WriteStats();
+        delete m;
+    }
     
     int afl_custom_fuzz(AFLCustomHepler *m, unsigned char *buf, int buf_size, unsigned char **out_buf,
                     unsigned char *add_buf, int add_buf_size, int max_size) {                 
-        Root input1;                                                                                        
-        Root input2;                                    
         // m->of << "max_size: " << max_size << std::endl;                                                    
-        return MutationOrCrossoverOnProtobuf(m, USE_BINARY_PROTO, buf, buf_size, out_buf,                                 
-                                    add_buf, add_buf_size, MAX_BINARY_INPUT_SIZE, &input1, &input2);                      
+        ContextScope scope(m->GetContext());
+        OperatorScheduler* scheduler = ActiveScheduler();
+        if(scheduler) scheduler->BeginMutant();
+        int out_size = MutationOrCrossoverOnProtobuf(m, USE_BINARY_PROTO, buf, buf_size, out_buf, add_buf, add_buf_size,
+                                    MAX_BINARY_INPUT_SIZE, m->GetRoot(FUZZ_INPUT1), m->GetRoot(FUZZ_INPUT2));
+        // the operators of a pipelined mutant are not known, its chain is empty
+        if(scheduler) scheduler->EndMutant();
+        if(m->TracksMutants()) m->NoteMutant(*out_buf, out_size, m->BatchParent(buf, buf_size) != nullptr);
+        m->RecycleArena();
+        return out_size;
+    }
+
+    // Called by AFL++ once per new queue entry unless AFL_DISABLE_TRIM is set, returns the number of trimming steps.
+    int32_t afl_custom_init_trim(AFLCustomHepler *m, unsigned char *buf, size_t buf_size){
+        ContextScope scope(m->GetContext());
+        int steps = m->InitTrim(buf, buf_size);
+        m->RecycleArena();
+        return steps;
+    }
+
+    // The next candidate of the trimming, the entry without some elements of a repeated field.
+    size_t afl_custom_trim(AFLCustomHepler *m, unsigned char **out_buf){
+        ContextScope scope(m->GetContext());
+        return m->Trim(out_buf);
+    }
+
+    // success: the candidate has the coverage of the entry. Returns the next step, the number of steps once done.
+    int32_t afl_custom_post_trim(AFLCustomHepler *m, unsigned char success){
+        ContextScope scope(m->GetContext());
+        return m->PostTrim(success);
     }
 
     // A post-processing function to use right before AFL++ writes the test case to disk in order to execute the target.
     int afl_custom_post_process(AFLCustomHepler *m, unsigned char *buf, int buf_size, unsigned char**out_buf) {                                                                             
-        Root input;                                                                              
-        if (LoadProtoInput(USE_BINARY_PROTO, buf, buf_size, &input))                                                         
-            return PostProcessMessage(input, out_buf, m->temp);                                                      
-        return 0;                                                                                                       
+        ContextScope scope(m->GetContext());
+        int out_size = 0;
+        // pipeline mode: the producer has post-processed the mutant already
+        if(auto slot = m->PipelinedSlot(buf, buf_size)){
+            *out_buf = slot->processed.data();
+            out_size = slot->processed_size;
+            GetTraceLogger()->Record(TraceKind::PostProcessed, ++m->GetPostState()->index, slot->processed.data(),
+                                     slot->processed_size);
+        }else{
+            out_size = PostProcessInput(buf, buf_size, m->GetRoot(POST_INPUT), out_buf, m->GetPostOutBuf(),
+                                        m->GetPostState());
+        }
+        // opt-in: a mutant that post-processes into an input the target has run recently is not run again
+        if(m->GetDuplicateFilter()->enabled()) out_size = m->Deduplicate(buf, buf_size, out_buf, out_size);
+        // AFL++ saves the post-processed input to its queue unless AFL_POST_PROCESS_KEEP_ORIGINAL is set
+        if(m->WantsFeedback()) m->NoteProcessed(*out_buf, out_size);
+        m->RecycleArena();
+        return out_size;
+    }
+
+    // Called by AFL++ for every new queue entry: if it is the last mutant, its operators and fields are credited,
+    // and its embedded messages join the donor pool. Returns false, the file is not changed.
+    uint8_t afl_custom_queue_new_entry(AFLCustomHepler *m, const unsigned char *filename_new_queue,
+                                       const unsigned char * /*filename_orig_queue*/){
+        ContextScope scope(m->GetContext());
+        if((!m->WantsFeedback() && !m->GetDonors()->enabled()) || !filename_new_queue) return 0;
+        std::ifstream in((const char*)filename_new_queue, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if(m->WantsFeedback()) m->QueueNewEntry((const unsigned char*)data.data(), data.size());
+        if(m->GetDonors()->enabled()) m->AddDonors((const unsigned char*)data.data(), data.size());
+        m->RecycleArena();
+        return 0;
     }
 }                                                                 
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef TYPED_CONSTRAINTS_H_
+#define TYPED_CONSTRAINTS_H_
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include "protobuf_mutator/value_domain.h"
+#include "clamp_kernels.h"
+
+namespace protobuf_mutator {
+    // ----------------------Value kernels------------------------
+    // The constraints of proto/constraints.proto on the values of one field, the reflection path of
+    // ConstraintEngine and the generated typed constraints share them. ClampValue() and ReduceToPowerOfTwo()
+    // are in protobuf_mutator/value_domain.h, the mutator draws inside the same domains.
+
+    // range: {min, max} converted to T, doubles (dataList and weights) use clamp_kernels.h
+    template<class T>
+    void RangeValues(T* data, int size, double min, double max) {
+        if constexpr (std::is_same<T, double>::value) {
+            // a single value does not pay for the kernel call
+            if (size == 1) data[0] = clampDouble(data[0], min, max);
+            else clampArrayToRange(data, size, min, max);
+        } else {
+            T lo = (T)min, hi = (T)max;
+            for (int i = 0; i < size; i++) data[i] = ClampValue(data[i], lo, hi);
+        }
+    }
+
+    template<class T>
+    void PowerOfTwoValues(T* data, int size) {
+        for (int i = 0; i < size; i++) data[i] = ReduceToPowerOfTwo(data[i]);
+    }
+
+    // index_into: [0, source_size - 1], src / dst indices use clamp_kernels.h
+    template<class T>
+    void IndexValues(T* data, int size, uint32_t source_size) {
+        if constexpr (std::is_same<T, uint32_t>::value) {
+            if (size == 1) data[0] = clampIndex(data[0], source_size);
+            else apiSrcAndDstClampArray(data, size, source_size);
+        } else {
+            // If there is no data to be computed, the API will not be invoked.
+            if (source_size == 0) return;
+            T last = (T)(source_size - 1);
+            for (int i = 0; i < size; i++) data[i] = ClampValue(data[i], (T)0, last);
+        }
+    }
+
+    // enum_in: a value that is not allowed is replaced by a random allowed one
+    inline void EnumValues(int32_t* data, int size, const int32_t* allowed, int count) {
+        for (int i = 0; i < size; i++)
+            if (std::find(allowed, allowed + count, data[i]) == allowed + count)
+                data[i] = allowed[GetRandomIndex(count - 1)];
+    }
+
+    // ----------------------Typed constraints------------------------
+    /**
+     * @brief Reflection-free constraints of one message type, specialized by protoc-gen-typed_mutator for the
+     *        message types of a file that have constraints below them.
+     * @details The generated code runs the same kernels on the same fields in the same order as the action
+     *          table of ConstraintEngine and draws the same random numbers. sizes[i] is the size of the i-th
+     *          index_into path of the file, Sizes() takes them from a message of type T used as the root:
+     *          a path that does not start at T has size 0, the indices into it are left as they are.
+     */
+    template<class T>
+    struct TypedConstraints;
+    // static void Sizes(const T& msg, uint32_t* sizes);
+    // static void Apply(T* msg, const uint32_t* sizes);
+
+    struct TypedConstraintsEntry {
+        void (*sizes)(const Message* msg, uint32_t* sizes);
+        void (*apply)(Message* msg, const uint32_t* sizes);
+        int source_count;             // number of index_into paths of the file
+    };
+
+    template<class T>
+    TypedConstraintsEntry MakeTypedConstraintsEntry(int source_count) {
+        return {[](const Message* msg, uint32_t* sizes) { TypedConstraints<T>::Sizes(*static_cast<const T*>(msg), sizes); },
+                [](Message* msg, const uint32_t* sizes) { TypedConstraints<T>::Apply(static_cast<T*>(msg), sizes); },
+                source_count};
+    }
+
+    // Called by the generated code during static initialization.
+    bool RegisterTypedConstraints(const Descriptor* desc, const TypedConstraintsEntry& entry);
+    // nullptr if no typed constraints are linked for the type, ConstraintEngine then uses its action table.
+    const TypedConstraintsEntry* FindTypedConstraints(const Descriptor* desc);
+
+    // ----------------------Field kernels------------------------
+    // F is the traits struct of a field, see typed_mutator.h; repeated scalar fields are the ones with kPacked.
+    template<class F, class = void>
+    struct IsRepeatedTraits : std::false_type {};
+    template<class F>
+    struct IsRepeatedTraits<F, std::void_t<decltype(F::kPacked)>> : std::true_type {};
+
+    // values(data, size) on all values of a repeated field, or on the value of a singular one: a field with
+    // presence only when it is set
+    template<class F, class Values>
+    inline void ConstrainValues(typename F::MessageType* msg, Values values) {
+        using T = typename F::ValueType;
+        if constexpr (IsRepeatedTraits<F>::value) {
+            auto field = F::Mutable(msg);
+            values(field->mutable_data(), field->size());
+        } else {
+            if constexpr (F::kHasPresence)
+                if (!F::Has(*msg)) return;
+            T old_value = F::Get(*msg), value = old_value;
+            values(&value, 1);
+            if (memcmp(&value, &old_value, sizeof(T))) F::Set(msg, value);
+        }
+    }
+
+    template<class F>
+    inline void ConstrainMaxSize(typename F::MessageType* msg, int max_size) {
+        auto field = F::Mutable(msg);
+        while (field->size() > max_size) field->RemoveLast();
+    }
+
+    template<class F>
+    inline void ConstrainEnumIn(typename F::MessageType* msg, std::initializer_list<int32_t> allowed) {
+        ConstrainValues<F>(msg, [&](int32_t* data, int size) { EnumValues(data, size, allowed.begin(), allowed.size()); });
+    }
+
+    template<class F>
+    inline void ConstrainRange(typename F::MessageType* msg, double min, double max) {
+        ConstrainValues<F>(msg, [&](typename F::ValueType* data, int size) { RangeValues(data, size, min, max); });
+    }
+
+    template<class F>
+    inline void ConstrainPowerOfTwo(typename F::MessageType* msg) {
+        ConstrainValues<F>(msg, [](typename F::ValueType* data, int size) { PowerOfTwoValues(data, size); });
+    }
+
+    template<class F>
+    inline void ConstrainIndexInto(typename F::MessageType* msg, uint32_t source_size) {
+        ConstrainValues<F>(msg, [&](typename F::ValueType* data, int size) { IndexValues(data, size, source_size); });
+    }
+
+    // the constraints of an embedded message
+    template<class F>
+    inline void ConstrainMessage(typename F::MessageType* msg, const uint32_t* sizes) {
+        if (F::Has(*msg)) TypedConstraints<typename F::SubType>::Apply(F::Mutable(msg), sizes);
+    }
+
+    template<class F>
+    inline void ConstrainRepeatedMessage(typename F::MessageType* msg, const uint32_t* sizes) {
+        for (auto& sub : *F::Mutable(msg)) TypedConstraints<typename F::SubType>::Apply(&sub, sizes);
+    }
+}  // namespace protobuf_mutator
+
+#endif
@@ -19,6 +19,8 @@ int main(int argc, char *argv[]){
     random_device rd;
     uint seed = rd();
     AFLCustomHepler* mutatorHelper = afl_custom_init(nullptr, seed);
+    // the messages below are created with the seeded random engine of the instance
+    ContextScope scope(mutatorHelper->GetContext());
     if(argv[1][0] == 'c'){
         
         for(int i = 0;i < SEED_NUM;i++){
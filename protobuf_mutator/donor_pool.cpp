@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <string_view>
+#include "donor_pool.h"
+#include "mutate_util.h"
+
+namespace protobuf_mutator {
+    bool DonorPool::StartFromEnv() {
+        const char* per_type = getenv(DONORS_ENV);
+        if (!per_type || atoll(per_type) <= 0) return false;
+        Enable(atoll(per_type));
+        return true;
+    }
+
+    int DonorPool::Add(const Message& entry) {
+        int added = 0;
+        stats_.entries++;
+        Collect(entry, added);
+        return added;
+    }
+
+    const Message* DonorPool::Draw(const Descriptor* type) const {
+        auto it = buckets_.find(type);
+        if (it == buckets_.end() || it->second.donors.empty()) return nullptr;
+        const auto& donors = it->second.donors;
+        return donors[GetRandomIndex(donors.size() - 1)].message.get();
+    }
+
+    void DonorPool::Collect(const Message& msg, int& added) {
+        auto desc = msg.GetDescriptor();
+        auto ref = msg.GetReflection();
+        for (int i = 0; i < desc->field_count(); i++) {
+            auto field = desc->field(i);
+            if (!IsMessageType(field)) continue;
+            if (field->is_repeated()) {
+                int size = ref->FieldSize(msg, field);
+                for (int j = 0; j < size; j++) {
+                    const Message& sub = ref->GetRepeatedMessage(msg, field, j);
+                    added += Intern(sub);
+                    Collect(sub, added);
+                }
+            } else if (ref->HasField(msg, field)) {
+                const Message& sub = ref->GetMessage(msg, field);
+                added += Intern(sub);
+                Collect(sub, added);
+            }
+        }
+    }
+
+    bool DonorPool::Intern(const Message& msg) {
+        stats_.messages++;
+        scratch_.clear();
+        msg.SerializeToString(&scratch_);
+        uint64_t hash = std::hash<std::string_view>()(scratch_);
+        Bucket& bucket = buckets_[msg.GetDescriptor()];
+        auto found = bucket.slots.find(hash);
+        // a different message with the same hash is not kept, the next one of its kind may be
+        if (found != bucket.slots.end()) {
+            stats_.interned += bucket.donors[found->second].bytes == scratch_;
+            return false;
+        }
+        size_t slot = bucket.donors.size();
+        if (slot < per_type_) {
+            bucket.donors.push_back({hash, "", std::unique_ptr<Message>(msg.New())});
+        } else {
+            slot = GetRandomIndex(per_type_ - 1);
+            Donor& old = bucket.donors[slot];
+            bucket.slots.erase(old.hash);
+            stats_.bytes -= old.bytes.size();
+            stats_.evicted++;
+        }
+        Donor& donor = bucket.donors[slot];
+        donor.hash = hash;
+        donor.bytes.swap(scratch_);
+        donor.message->CopyFrom(msg);
+        bucket.slots[hash] = slot;
+        stats_.bytes += donor.bytes.size();
+        stats_.added++;
+        return true;
+    }
+}  // namespace protobuf_mutator
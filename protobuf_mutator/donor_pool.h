@@ -0,0 +1,82 @@
+#ifndef SRC_DONOR_POOL_H_
+#define SRC_DONOR_POOL_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "proto_util.h"
+
+namespace protobuf_mutator {
+    /**
+     * The donor pool is opt-in, it is configured by an environment variable:
+     *   PROTOBUF_MUTATOR_DONORS   donors kept per message type (default 0, no pool)
+     */
+    #define DONORS_ENV         "PROTOBUF_MUTATOR_DONORS"
+    // crossovers of a batch that splice a donor of the pool instead of the partner of AFL++, in 4
+    #define DONOR_SPLICE_SHARE (2)
+
+    /**
+     * @brief Embedded messages of the whole corpus by type, for Mutator::SpliceDonor().
+     * @details Add() walks a new queue entry and interns every embedded message (FHEParameter, OneAPI, OneDataList,
+     *          ...; not the entry itself): identical messages are kept once, by the hash of their serialization,
+     *          which is deterministic without map fields. A type keeps at most per_type donors; a new one then takes
+     *          the place of a random one, so the pool stays a sample of the whole campaign. Draw() is a hash lookup
+     *          of the type and one random number.
+     */
+    class DonorPool {
+    public:
+        struct Stats {
+            uint64_t entries = 0;    // messages Add() has walked
+            uint64_t messages = 0;   // embedded messages seen
+            uint64_t interned = 0;   // of them already in the pool
+            uint64_t added = 0;
+            uint64_t evicted = 0;
+            size_t bytes = 0;        // serialized size of the donors in the pool
+        };
+
+        DonorPool() = default;
+        DonorPool(const DonorPool&) = delete;
+        DonorPool& operator=(const DonorPool&) = delete;
+
+        // Enable if DONORS_ENV is a positive number.
+        bool StartFromEnv();
+        void Enable(size_t per_type) { per_type_ = per_type; }
+        bool enabled() const { return per_type_ > 0; }
+        bool empty() const { return stats_.added == stats_.evicted; }
+
+        // Interns the embedded messages of entry. Returns the number of new donors.
+        int Add(const Message& entry);
+        bool Has(const Descriptor* type) const {
+            auto it = buckets_.find(type);
+            return it != buckets_.end() && !it->second.donors.empty();
+        }
+        // A random donor of type, nullptr if there is none.
+        const Message* Draw(const Descriptor* type) const;
+        size_t Count(const Descriptor* type) const {
+            auto it = buckets_.find(type);
+            return it == buckets_.end() ? 0 : it->second.donors.size();
+        }
+        const Stats& stats() const { return stats_; }
+
+    private:
+        struct Donor {
+            uint64_t hash;
+            std::string bytes;
+            std::unique_ptr<Message> message;
+        };
+        struct Bucket {
+            std::vector<Donor> donors;
+            std::unordered_map<uint64_t, size_t> slots;  // hash of a donor -> its index in donors
+        };
+        void Collect(const Message& msg, int& added);
+        bool Intern(const Message& msg);
+
+        size_t per_type_ = 0;
+        std::unordered_map<const Descriptor*, Bucket> buckets_;
+        std::string scratch_;
+        Stats stats_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_DONOR_POOL_H_
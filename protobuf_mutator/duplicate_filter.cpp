@@ -0,0 +1,81 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "duplicate_filter.h"
+
+namespace protobuf_mutator {
+    namespace {
+        // the second hash of double hashing, odd so that the probes of one input are distinct
+        uint64_t MixHash(uint64_t x) {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdull;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53ull;
+            x ^= x >> 33;
+            return x | 1;
+        }
+    }
+
+    bool DuplicateFilter::StartFromEnv() {
+        const char* capacity = getenv(DEDUP_ENV);
+        if (!capacity || atoll(capacity) <= 0) return false;
+        const char* stats_path = getenv(DEDUP_STATS_ENV);
+        Enable(atoll(capacity), stats_path ? stats_path : "");
+        return true;
+    }
+
+    void DuplicateFilter::Enable(size_t capacity, const std::string& stats_path) {
+        size_t bits = 64;
+        while (bits < capacity * DEDUP_BITS_PER_INPUT) bits *= 2;
+        words_ = bits / 64;
+        mask_ = bits - 1;
+        for (auto& filter : bits_) filter.assign(words_, 0);
+        capacity_ = capacity;
+        added_ = 0;
+        current_ = 0;
+        stats_path_ = stats_path;
+    }
+
+    bool DuplicateFilter::Contains(uint64_t hash) const {
+        if (!enabled()) return false;
+        uint64_t step = MixHash(hash);
+        for (const auto& filter : bits_) {
+            uint64_t bit = hash;
+            int probe = 0;
+            for (; probe < DEDUP_PROBES; probe++, bit += step)
+                if (!(filter[(bit & mask_) / 64] >> (bit & 63) & 1)) break;
+            if (probe == DEDUP_PROBES) return true;
+        }
+        return false;
+    }
+
+    void DuplicateFilter::Add(uint64_t hash) {
+        if (!enabled()) return;
+        if (added_ >= capacity_) {
+            // the older generation is forgotten
+            current_ ^= 1;
+            bits_[current_].assign(words_, 0);
+            added_ = 0;
+        }
+        uint64_t step = MixHash(hash), bit = hash;
+        for (int probe = 0; probe < DEDUP_PROBES; probe++, bit += step)
+            bits_[current_][(bit & mask_) / 64] |= 1ull << (bit & 63);
+        added_++;
+    }
+
+    std::string DuplicateFilter::Describe() const {
+        std::ostringstream out;
+        out << "mutants " << stats_.checked << " duplicates " << stats_.duplicates << " ("
+            << 100 * stats_.DuplicateRate() << "%)\n"
+            << "retries " << stats_.retries << " executions saved " << stats_.saved << " duplicates executed "
+            << stats_.executed << "\n"
+            << "capacity " << capacity_ << " inputs, " << MemoryBytes() << " bytes\n";
+        return out.str();
+    }
+
+    void DuplicateFilter::WriteStats() const {
+        if (stats_path_.empty()) return;
+        std::ofstream out(stats_path_, std::ios::trunc);
+        out << Describe();
+    }
+}  // namespace protobuf_mutator
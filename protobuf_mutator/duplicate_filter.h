@@ -0,0 +1,78 @@
+#ifndef SRC_DUPLICATE_FILTER_H_
+#define SRC_DUPLICATE_FILTER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace protobuf_mutator {
+    /**
+     * Duplicate filtering is opt-in, it is configured by environment variables:
+     *   PROTOBUF_MUTATOR_DEDUP         number of recently executed inputs to remember (default 0, no filter)
+     *   PROTOBUF_MUTATOR_DEDUP_STATS   file the statistics are written to by afl_custom_deinit() (see Describe())
+     */
+    #define DEDUP_ENV            "PROTOBUF_MUTATOR_DEDUP"
+    #define DEDUP_STATS_ENV      "PROTOBUF_MUTATOR_DEDUP_STATS"
+    // 10 bits and 7 probes per input: about 1% false positives in a full generation
+    #define DEDUP_BITS_PER_INPUT (10)
+    #define DEDUP_PROBES         (7)
+    // new mutants tried in place of a duplicate before the duplicate is executed after all
+    #define DEDUP_RETRIES        (4)
+
+    /**
+     * @brief Memory-bounded set of the inputs executed recently, by hash.
+     * @details Two Bloom filters of DEDUP_BITS_PER_INPUT bits per input: inputs are added to the current one and looked
+     *          up in both. Once the current one holds capacity inputs the older one is cleared and becomes the current
+     *          one, so the last capacity to 2 * capacity inputs are remembered in 2 * capacity * DEDUP_BITS_PER_INPUT
+     *          bits. The probes come from the 64-bit hash by double hashing. A false positive only costs a new mutant.
+     */
+    class DuplicateFilter {
+    public:
+        struct Stats {
+            uint64_t checked = 0;      // mutants looked up
+            uint64_t duplicates = 0;   // mutants that had been executed already, retries included
+            uint64_t retries = 0;      // new mutants made in place of a duplicate
+            uint64_t saved = 0;        // duplicates replaced by a new input, executions of the target saved
+            uint64_t executed = 0;     // duplicates executed after DEDUP_RETRIES retries
+            double DuplicateRate() const { return checked ? (double)duplicates / checked : 0; }
+        };
+
+        // Enable if DEDUP_ENV is a positive number of inputs.
+        bool StartFromEnv();
+        void Enable(size_t capacity, const std::string& stats_path = "");
+        bool enabled() const { return capacity_ > 0; }
+
+        // Whether the input of hash has been added recently.
+        bool Contains(uint64_t hash) const;
+        void Add(uint64_t hash);
+        // Contains() and Add() of a mutant, counted in the statistics.
+        bool CheckMutant(uint64_t hash) {
+            stats_.checked++;
+            bool seen = Contains(hash);
+            if (seen) stats_.duplicates++;
+            else Add(hash);
+            return seen;
+        }
+
+        Stats& stats() { return stats_; }
+        const Stats& stats() const { return stats_; }
+        // Memory of the two filters in bytes.
+        size_t MemoryBytes() const { return 2 * words_ * sizeof(uint64_t); }
+        // The statistics as text: mutants, duplicate rate, retries and executions saved.
+        std::string Describe() const;
+        // Describe() into the DEDUP_STATS_ENV file, if there is one.
+        void WriteStats() const;
+
+    private:
+        std::vector<uint64_t> bits_[2];
+        size_t words_ = 0;
+        uint64_t mask_ = 0;          // bits per filter - 1, a power of two
+        size_t capacity_ = 0;
+        size_t added_ = 0;           // inputs in the current filter
+        int current_ = 0;
+        std::string stats_path_;
+        Stats stats_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_DUPLICATE_FILTER_H_
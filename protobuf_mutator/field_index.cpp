@@ -0,0 +1,88 @@
+#include "field_index.h"
+#include "field_stats.h"
+
+namespace protobuf_mutator {
+    SampleOptions SampleOptions::FromEnv() {
+        SampleOptions options;
+        if (const char* fields = getenv(SAMPLE_FIELDS_ENV))
+            options.fields = std::max(0, atoi(fields));
+        if (const char* weight = getenv(SAMPLE_WEIGHT_ENV))
+            options.weighting = !strcmp(weight, "field")      ? SampleWeighting::PerField
+                              : !strcmp(weight, "productive") ? SampleWeighting::Productive
+                                                              : SampleWeighting::Uniform;
+        return options;
+    }
+
+    void FieldIndex::Build(const Message& root, SampleWeighting weighting) {
+        Clear();
+        root_ = root.GetDescriptor();
+        root.ByteSizeLong();
+        Add(root, *GetMessagePlan(root_), AddNode(-1, -1, nullptr, root), 0);
+        if (weighting == SampleWeighting::Uniform || sites_.empty()) return;
+        cumulative_.resize(sites_.size());
+        double sum = 0;
+        if (weighting == SampleWeighting::Productive) {
+            const FieldStats* stats = GetFieldStats();
+            for (size_t i = 0; i < sites_.size(); i++)
+                cumulative_[i] = sum += stats->Weight(*sites_[i].entry);
+            return;
+        }
+        std::unordered_map<const FieldPlan*, int> paths;
+        for (const auto& site : sites_) paths[site.entry]++;
+        for (size_t i = 0; i < sites_.size(); i++)
+            cumulative_[i] = sum += 1.0 / paths[sites_[i].entry];
+    }
+
+    void FieldIndex::Clear() {
+        root_ = nullptr;
+        nodes_.clear();
+        sites_.clear();
+        cumulative_.clear();
+    }
+
+    int FieldIndex::Draw() const {
+        if (cumulative_.empty()) return GetRandomIndex(sites_.size() - 1);
+        double point = GetRandomNum(0.0, cumulative_.back());
+        int i = std::upper_bound(cumulative_.begin(), cumulative_.end(), point) - cumulative_.begin();
+        return std::min(i, (int)sites_.size() - 1);
+    }
+
+    // The fields MessageMutation() visits, in the same order. A string field has no operations.
+    void FieldIndex::Add(const Message& msg, const MessagePlan& plan, int node, int depth) {
+        auto ref = msg.GetReflection();
+        bool deeper = depth < MAX_INDEX_DEPTH;
+        for (const auto& entry : plan.fields) {
+            auto field = entry.field;
+            switch (entry.kind) {
+                case FieldKind::Oneof:
+                    sites_.push_back({node, &plan, &entry});
+                    if (auto member = ref->GetOneofFieldDescriptor(msg, entry.oneof))
+                        if (deeper && IsMessageType(member)) {
+                            const Message& sub = ref->GetMessage(msg, member);
+                            Add(sub, *plan.Embedded(member), AddNode(node, -1, member, sub), depth + 1);
+                        }
+                    break;
+                case FieldKind::Repeated:
+                    if (entry.cpp_type != FieldDescriptor::CPPTYPE_STRING) sites_.push_back({node, &plan, &entry});
+                    if (entry.message_plan && deeper) {
+                        int field_size = ref->FieldSize(msg, field);
+                        for (int i = 0; i < field_size; i++) {
+                            const Message& sub = ref->GetRepeatedMessage(msg, field, i);
+                            Add(sub, *entry.message_plan, AddNode(node, i, field, sub), depth + 1);
+                        }
+                    }
+                    break;
+                case FieldKind::Message:
+                    // an unset message is visited as well, the walk creates it
+                    if (deeper) {
+                        const Message& sub = ref->GetMessage(msg, field);
+                        Add(sub, *entry.message_plan, AddNode(node, -1, field, sub), depth + 1);
+                    }
+                    break;
+                case FieldKind::Scalar:
+                    if (entry.cpp_type != FieldDescriptor::CPPTYPE_STRING) sites_.push_back({node, &plan, &entry});
+                    break;
+            }
+        }
+    }
+}  // namespace protobuf_mutator
@@ -0,0 +1,81 @@
+#ifndef SRC_FIELD_INDEX_H_
+#define SRC_FIELD_INDEX_H_
+
+#include "mutation_plan.h"
+
+namespace protobuf_mutator {
+    /**
+     * Sampled mode, configured by environment variables:
+     *   PROTOBUF_MUTATOR_SAMPLE          K, the number of field paths edited per mutation (default 0, the full walk)
+     *   PROTOBUF_MUTATOR_SAMPLE_WEIGHT   how paths are drawn: "uniform" (default), "field" or "productive"
+     */
+    #define SAMPLE_FIELDS_ENV "PROTOBUF_MUTATOR_SAMPLE"
+    #define SAMPLE_WEIGHT_ENV "PROTOBUF_MUTATOR_SAMPLE_WEIGHT"
+    // Embedded messages deeper than this are not indexed, an unset message of a recursive type would never end.
+    #define MAX_INDEX_DEPTH (64)
+
+    enum class SampleWeighting {
+        Uniform,   // every path equally likely, a repeated message dominates with its elements
+        PerField,  // every field of the plans equally likely, the paths of one field share its weight
+        Productive // every path weighted by how productive the edits of its field have been, see FieldStats
+    };
+
+    struct SampleOptions {
+        int fields = 0;  // K, 0 walks the whole message
+        SampleWeighting weighting = SampleWeighting::Uniform;
+        static SampleOptions FromEnv();
+    };
+
+    /**
+     * @brief Flattened index of the mutable field paths of one message.
+     * @details A node is an embedded message, reached from its parent node through a field (and an element index
+     *          for a repeated field); node 0 is the root. A site is a field (or oneof group) of a node that the walk of
+     *          Mutator::MessageMutation() would roll an operation for. It is built once per parsed message, so that
+     *          a mutation edits K sites in O(K) instead of visiting every field. The members of a set oneof are
+     *          indexed as well, the walk only reaches them through the Mutate operation of the group.
+     *          Every node keeps the encoded size of its message, so a copy of the indexed message is mutated
+     *          without measuring it again.
+     */
+    class FieldIndex {
+    public:
+        struct Node {
+            int parent;                        // -1 for the root
+            int index;                         // element of a repeated field, -1 for a singular one
+            const FieldDescriptor* field;      // nullptr for the root
+            int size;                          // ByteSizeLong() of the message when it was indexed
+        };
+        struct Site {
+            int node;
+            const MessagePlan* plan;           // plan of the message of the node
+            const FieldPlan* entry;
+        };
+
+        void Build(const Message& root, SampleWeighting weighting);
+        void Clear();
+
+        const Descriptor* Root() const { return root_; }
+        bool Empty() const { return sites_.empty(); }
+        size_t size() const { return sites_.size(); }
+        int RootSize() const { return nodes_[0].size; }
+        const Node& node(int i) const { return nodes_[i]; }
+        const Site& site(int i) const { return sites_[i]; }
+        // a random site, Empty() must be false
+        int Draw() const;
+
+    private:
+        void Add(const Message& msg, const MessagePlan& plan, int node, int depth);
+        // the sizes have been cached in the messages by the ByteSizeLong() of the root
+        int AddNode(int parent, int index, const FieldDescriptor* field, const Message& msg) {
+            nodes_.push_back({parent, index, field, msg.GetCachedSize()});
+            return nodes_.size() - 1;
+        }
+
+        const Descriptor* root_ = nullptr;
+        vector<Node> nodes_;
+        vector<Site> sites_;
+        // running sum of the weights, empty when the sites are drawn uniformly
+        vector<double> cumulative_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_FIELD_INDEX_H_
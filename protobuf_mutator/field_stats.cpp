@@ -0,0 +1,109 @@
+#include <cstring>
+#include "field_stats.h"
+
+namespace protobuf_mutator {
+    namespace {
+        template<typename T>
+        bool SameBits(T a, T b) { return !memcmp(&a, &b, sizeof(T)); }
+
+        // element index of a repeated field, -1 for a singular one; floating point values are compared bit by bit
+        bool SameValue(const Message& a, const Message& b, const FieldDescriptor* field, int index) {
+            # define SAME_VALUE(Type)  (index < 0 ? SameBits(ref->Get##Type(a, field), ref->Get##Type(b, field)) \
+                                              : SameBits(ref->GetRepeated##Type(a, field, index),              \
+                                                         ref->GetRepeated##Type(b, field, index)))
+            auto ref = a.GetReflection();
+            switch (field->cpp_type()) {
+                case FieldDescriptor::CPPTYPE_INT32:  return SAME_VALUE(Int32);
+                case FieldDescriptor::CPPTYPE_INT64:  return SAME_VALUE(Int64);
+                case FieldDescriptor::CPPTYPE_UINT32: return SAME_VALUE(UInt32);
+                case FieldDescriptor::CPPTYPE_UINT64: return SAME_VALUE(UInt64);
+                case FieldDescriptor::CPPTYPE_DOUBLE: return SAME_VALUE(Double);
+                case FieldDescriptor::CPPTYPE_FLOAT:  return SAME_VALUE(Float);
+                case FieldDescriptor::CPPTYPE_BOOL:   return SAME_VALUE(Bool);
+                case FieldDescriptor::CPPTYPE_ENUM:   return SAME_VALUE(EnumValue);
+                case FieldDescriptor::CPPTYPE_STRING:
+                    return index < 0 ? ref->GetString(a, field) == ref->GetString(b, field)
+                                     : ref->GetRepeatedString(a, field, index) == ref->GetRepeatedString(b, field, index);
+                case FieldDescriptor::CPPTYPE_MESSAGE:
+                    break;
+            }
+            return true;
+            # undef SAME_VALUE
+        }
+    }
+
+    int FieldStats::Credit(const Message& parent, const Message& entry) {
+        int credited = 0;
+        Diff(parent, entry, *GetMessagePlan(parent.GetDescriptor()), credited);
+        return credited;
+    }
+
+    // A field that differs is credited once, an embedded message is compared field by field instead. A repeated
+    // message field of another size is credited itself, as the elements cannot be paired.
+    void FieldStats::Diff(const Message& a, const Message& b, const MessagePlan& plan, int& credited) {
+        auto ref = a.GetReflection();
+        for (const auto& entry : plan.fields) {
+            auto field = entry.field;
+            switch (entry.kind) {
+                case FieldKind::Oneof: {
+                    auto member = ref->GetOneofFieldDescriptor(a, entry.oneof);
+                    if (member != ref->GetOneofFieldDescriptor(b, entry.oneof)) CreditField(entry, credited);
+                    else if (member && IsMessageType(member))
+                        Diff(ref->GetMessage(a, member), ref->GetMessage(b, member), *plan.Embedded(member), credited);
+                    else if (member && !SameValue(a, b, member, -1)) CreditField(entry, credited);
+                    break;
+                }
+                case FieldKind::Repeated: {
+                    int size = ref->FieldSize(a, field);
+                    if (size != ref->FieldSize(b, field)) {
+                        CreditField(entry, credited);
+                        break;
+                    }
+                    if (entry.message_plan) {
+                        for (int i = 0; i < size; i++)
+                            Diff(ref->GetRepeatedMessage(a, field, i), ref->GetRepeatedMessage(b, field, i),
+                                 *entry.message_plan, credited);
+                        break;
+                    }
+                    for (int i = 0; i < size; i++)
+                        if (!SameValue(a, b, field, i)) {
+                            CreditField(entry, credited);
+                            break;
+                        }
+                    break;
+                }
+                case FieldKind::Message:
+                    // the default instances of a recursive type never end
+                    if (ref->HasField(a, field) || ref->HasField(b, field))
+                        Diff(ref->GetMessage(a, field), ref->GetMessage(b, field), *entry.message_plan, credited);
+                    break;
+                case FieldKind::Scalar:
+                    if (ref->HasField(a, field) != ref->HasField(b, field) || !SameValue(a, b, field, -1))
+                        CreditField(entry, credited);
+                    break;
+            }
+        }
+    }
+
+    void FieldStats::Update() {
+        double edits = 0, credits = 0;
+        for (size_t id = 0; id < edits_.size(); id++) {
+            edits += edits_[id];
+            credits += credits_[id];
+        }
+        weights_.assign(edits_.size(), 1.0f);
+        if (edits > 0 && credits > 0) {
+            double average = credits / edits;
+            for (size_t id = 0; id < edits_.size(); id++) {
+                double rate = (credits_[id] + FIELD_STATS_PRIOR * average) / (edits_[id] + FIELD_STATS_PRIOR);
+                weights_[id] = std::min(std::max(rate / average, FIELD_STATS_MIN_WEIGHT), FIELD_STATS_MAX_WEIGHT);
+            }
+        }
+        for (size_t id = 0; id < edits_.size(); id++) {
+            edits_[id] *= FIELD_STATS_DECAY;
+            credits_[id] *= FIELD_STATS_DECAY;
+        }
+        epoch_edits_ = 0;
+        epochs_++;
+    }
+}  // namespace protobuf_mutator
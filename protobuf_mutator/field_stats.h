@@ -0,0 +1,67 @@
+#ifndef SRC_FIELD_STATS_H_
+#define SRC_FIELD_STATS_H_
+
+#include "mutation_plan.h"
+
+namespace protobuf_mutator {
+    // sampled edits between two updates of the weights
+    #define FIELD_STATS_EPOCH      (4096)
+    // edits and credits of older epochs fade by this factor per epoch
+    #define FIELD_STATS_DECAY      (0.9)
+    // pseudo edits at the average rate, a field with few edits keeps a weight close to 1
+    #define FIELD_STATS_PRIOR      (16.0)
+    // bounds of a weight, no field is starved and no field takes over
+    #define FIELD_STATS_MIN_WEIGHT (0.1)
+    #define FIELD_STATS_MAX_WEIGHT (10.0)
+
+    /**
+     * @brief How productive the edits of every field have been, for SampleWeighting::Productive.
+     * @details Counters are compact arrays indexed by FieldPlan::id. An edit is counted when sampled mode edits the
+     *          field; a credit when a new queue entry differs from its parent in the field (see Credit()). The rate
+     *          of a field is credits / edits, shrunk towards the average rate by FIELD_STATS_PRIOR pseudo edits.
+     *          Every FIELD_STATS_EPOCH edits the weights become rate / average rate, clamped, and all counters decay.
+     *          A FieldIndex reads the weights when it is built, so they apply to the entries parsed after an update.
+     */
+    class FieldStats {
+    public:
+        void NoteEdit(const FieldPlan& entry) {
+            Grow(entry.id);
+            edits_[entry.id]++;
+            if (++epoch_edits_ >= FIELD_STATS_EPOCH) Update();
+        }
+        // Credits the fields in which entry differs from parent, both of the same type. Returns how many.
+        int Credit(const Message& parent, const Message& entry);
+        // Weight of a field when a site is drawn, 1 for a field without any data.
+        double Weight(const FieldPlan& entry) const {
+            return entry.id < (int)weights_.size() ? weights_[entry.id] : 1.0;
+        }
+        double edits(int id) const { return id < (int)edits_.size() ? edits_[id] : 0; }
+        double credits(int id) const { return id < (int)credits_.size() ? credits_[id] : 0; }
+        uint64_t epochs() const { return epochs_; }
+
+        // New weights from the counters, then the counters decay.
+        void Update();
+
+    private:
+        void Grow(int id) {
+            if (id < (int)edits_.size()) return;
+            edits_.resize(id + 1, 0);
+            credits_.resize(id + 1, 0);
+        }
+        void Diff(const Message& a, const Message& b, const MessagePlan& plan, int& credited);
+        void CreditField(const FieldPlan& entry, int& credited) {
+            Grow(entry.id);
+            credits_[entry.id]++;
+            credited++;
+        }
+
+        std::vector<float> edits_, credits_, weights_;
+        int epoch_edits_ = 0;
+        uint64_t epochs_ = 0;
+    };
+
+    // The field statistics of the context of the calling thread, see mutator_context.h.
+    FieldStats* GetFieldStats();
+}  // namespace protobuf_mutator
+
+#endif  // SRC_FIELD_STATS_H_
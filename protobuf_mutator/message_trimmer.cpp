@@ -0,0 +1,113 @@
+#include "message_trimmer.h"
+#include "repeated_kernels.h"
+
+namespace protobuf_mutator {
+    int MessageTrimmer::Begin(const Message& message) {
+        current_.reset(message.New());
+        current_->CopyFrom(message);
+        candidate_.reset(message.New());
+        units_.clear();
+        vector<std::pair<const FieldDescriptor*, int>> path;
+        Collect(*current_, path, units_);
+        unit_ = 0;
+        chunk_ = pos_ = 0;
+        changed_ = false;
+        // the whole field, then 2, 4, ... chunks: a field of n elements takes about 2n steps
+        int64_t planned = 0;
+        for (const auto& unit : units_) {
+            const Message* msg = Resolve(current_.get(), unit);
+            if (int len = msg->GetReflection()->FieldSize(*msg, unit.field)) planned += 2 * len - 1;
+        }
+        step_ = 0;
+        steps_ = std::min<int64_t>(planned, MAX_TRIM_STEPS);
+        if (!Prepare()) steps_ = 0;
+        return steps_;
+    }
+
+    const Message* MessageTrimmer::Next() { return prepared_ ? candidate_.get() : nullptr; }
+
+    int MessageTrimmer::Commit(bool success) {
+        if (!prepared_) return step_ = steps_;
+        if (success) {
+            // the chunk at the same position is tried next
+            current_.swap(candidate_);
+            changed_ = true;
+        } else {
+            pos_ += chunk_;
+        }
+        if (++step_ < steps_ && !Prepare()) step_ = steps_;
+        if (step_ >= steps_) prepared_ = false;
+        return step_;
+    }
+
+    bool MessageTrimmer::Prepare() {
+        prepared_ = false;
+        while (unit_ < units_.size()) {
+            const Unit& unit = units_[unit_];
+            Message* msg = Resolve(current_.get(), unit);
+            int len = msg->GetReflection()->FieldSize(*msg, unit.field);
+            if (!chunk_) {
+                chunk_ = len;
+                pos_ = 0;
+            } else if (pos_ >= len) {
+                chunk_ /= 2;
+                pos_ = 0;
+            }
+            if (!chunk_ || !len) {
+                NextUnit();
+                continue;
+            }
+            candidate_->CopyFrom(*current_);
+            int pos = pos_, count = std::min(chunk_, len - pos_);
+            VisitRepeatedField(Resolve(candidate_.get(), unit), unit.field,
+                               [pos, count](auto field) { EraseRange(field, pos, count); });
+            return prepared_ = true;
+        }
+        return false;
+    }
+
+    void MessageTrimmer::NextUnit() {
+        unit_++;
+        chunk_ = pos_ = 0;
+        if (!changed_) return;
+        // the units up to unit_ are where they were, the ones inside the removed elements are gone
+        units_.clear();
+        vector<std::pair<const FieldDescriptor*, int>> path;
+        Collect(*current_, path, units_);
+        changed_ = false;
+    }
+
+    void MessageTrimmer::Collect(const Message& msg, vector<std::pair<const FieldDescriptor*, int>>& path,
+                                 vector<Unit>& units) {
+        auto desc = msg.GetDescriptor();
+        auto ref = msg.GetReflection();
+        for (int i = 0; i < desc->field_count(); i++) {
+            auto field = desc->field(i);
+            if (field->is_repeated()) {
+                // an empty field is a unit as well, so that emptying one does not move the units after it
+                if (field->cpp_type() != FieldDescriptor::CPPTYPE_STRING) units.push_back({path, field});
+                if (!IsMessageType(field)) continue;
+                int size = ref->FieldSize(msg, field);
+                for (int j = 0; j < size; j++) {
+                    path.push_back({field, j});
+                    Collect(ref->GetRepeatedMessage(msg, field, j), path, units);
+                    path.pop_back();
+                }
+            } else if (IsMessageType(field) && ref->HasField(msg, field)) {
+                path.push_back({field, -1});
+                Collect(ref->GetMessage(msg, field), path, units);
+                path.pop_back();
+            }
+        }
+    }
+
+    Message* MessageTrimmer::Resolve(Message* root, const Unit& unit) {
+        Message* msg = root;
+        for (const auto& step : unit.path) {
+            auto ref = msg->GetReflection();
+            msg = step.second >= 0 ? ref->MutableRepeatedMessage(msg, step.first, step.second)
+                                   : ref->MutableMessage(msg, step.first);
+        }
+        return msg;
+    }
+}  // namespace protobuf_mutator
@@ -0,0 +1,57 @@
+#ifndef SRC_MESSAGE_TRIMMER_H_
+#define SRC_MESSAGE_TRIMMER_H_
+
+#include "proto_util.h"
+
+namespace protobuf_mutator {
+    // Steps of one trim at most, each one is an execution of the target.
+    #define MAX_TRIM_STEPS (1024)
+
+    /**
+     * @brief Structure-aware trimming of a message for afl_custom_init_trim()/afl_custom_trim()/afl_custom_post_trim().
+     * @details The units are the repeated fields of the message, outer ones first: a field is trimmed before the
+     *          fields inside its elements, so removing an element never wastes the steps spent inside it. Every unit
+     *          is trimmed in a binary-search schedule: the whole field, then halves, quarters and so on down to single
+     *          elements. A candidate is the current message without one chunk; if the target behaves the same on it
+     *          (AFL++ compares the coverage), it becomes the current message and the chunk at the same position is
+     *          tried next, otherwise the next chunk. String fields are not trimmed.
+     */
+    class MessageTrimmer {
+    public:
+        // Start trimming message. Returns the number of steps planned, at most MAX_TRIM_STEPS; 0 if nothing can go.
+        int Begin(const Message& message);
+        // The next candidate, nullptr once every unit is done.
+        const Message* Next();
+        // Whether the target behaved the same on the last candidate. Returns the number of the next step, which is
+        // the planned number once trimming is done.
+        int Commit(bool success);
+
+        bool done() const { return step_ >= steps_; }
+        const Message* current() const { return current_.get(); }
+
+    private:
+        struct Unit {
+            // the message of the field: (field, element index or -1) from the root
+            vector<std::pair<const FieldDescriptor*, int>> path;
+            const FieldDescriptor* field;
+        };
+        // the repeated fields of msg and of its embedded messages, in pre-order
+        static void Collect(const Message& msg, vector<std::pair<const FieldDescriptor*, int>>& path,
+                            vector<Unit>& units);
+        static Message* Resolve(Message* root, const Unit& unit);
+        // Build the next candidate into candidate_, false if every unit is done.
+        bool Prepare();
+        // Go on with the next unit. The units are collected again if elements have been removed.
+        void NextUnit();
+
+        std::unique_ptr<Message> current_, candidate_;
+        vector<Unit> units_;
+        size_t unit_ = 0;
+        int chunk_ = 0, pos_ = 0;              // chunk_ 0: the unit has not been started
+        bool changed_ = false;                 // an element of the current unit has been removed
+        bool prepared_ = false;
+        int step_ = 0, steps_ = 0;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_MESSAGE_TRIMMER_H_
@@ -0,0 +1,107 @@
+#include "mutant_pipeline.h"
+
+namespace protobuf_mutator {
+    MutantPipeline::MutantPipeline(size_t depth, ProduceFn produce)
+        : produce_(std::move(produce)), slots_(depth + 1) {
+        // one more slot than depth, the consumer holds the last one it has popped
+        producer_ = std::thread(&MutantPipeline::ProducerLoop, this);
+    }
+
+    MutantPipeline::~MutantPipeline() {
+        running_ = false;
+        Wake();
+        producer_.join();
+    }
+
+    void MutantPipeline::SetParent(const uint8_t* data, size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            parent_.assign(reinterpret_cast<const char*>(data), size);
+            partner_.clear();
+            has_partner_ = false;
+            generation_.fetch_add(1, std::memory_order_relaxed);
+        }
+        Wake();
+    }
+
+    void MutantPipeline::SetPartner(const uint8_t* data, size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            partner_.assign(reinterpret_cast<const char*>(data), size);
+            has_partner_ = true;
+        }
+        Wake();
+    }
+
+    const MutantPipeline::Slot* MutantPipeline::Pop() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (holding_) {
+            // the mutant handed out last time has been used
+            tail_.store(++tail, std::memory_order_release);
+            holding_ = false;
+            Wake();
+        }
+        uint64_t generation = generation_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        stats_.depth_sum += head - tail;
+        stats_.max_depth = std::max<uint64_t>(stats_.max_depth, head - tail);
+        for (; tail != head; tail_.store(++tail, std::memory_order_release)) {
+            Slot& slot = slots_[tail % slots_.size()];
+            if (slot.generation == generation) {
+                holding_ = true;
+                stats_.popped++;
+                return &slot;
+            }
+            stats_.stale++;
+        }
+        Wake();
+        stats_.stalls++;
+        return nullptr;
+    }
+
+    void MutantPipeline::Wake() {
+        // taking the mutex orders the change before the check of a producer that is about to wait
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        wake_.notify_one();
+    }
+
+    void MutantPipeline::Wait(size_t tail, uint64_t generation, bool has_partner) {
+        producer_waits_.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait_for(lock, std::chrono::microseconds(PIPELINE_WAIT_US), [&] {
+            return !running_.load(std::memory_order_relaxed) || tail_.load(std::memory_order_acquire) != tail ||
+                   generation_.load(std::memory_order_relaxed) != generation || has_partner_ != has_partner;
+        });
+    }
+
+    void MutantPipeline::ProducerLoop() {
+        uint64_t generation = 0;
+        bool ready = false;
+        string parent, partner;
+        while (running_.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                uint64_t current = generation_.load(std::memory_order_relaxed);
+                if (current != generation || !ready) {
+                    generation = current;
+                    ready = has_partner_;
+                    if (ready) {
+                        parent = parent_;
+                        partner = partner_;
+                    }
+                }
+            }
+            size_t head = head_.load(std::memory_order_relaxed);
+            size_t tail = tail_.load(std::memory_order_acquire);
+            if (!ready || head - tail >= slots_.size()) {
+                Wait(tail, generation, ready);
+                continue;
+            }
+            Slot& slot = slots_[head % slots_.size()];
+            slot.generation = generation;
+            produce_(generation, parent, partner, &slot);
+            head_.store(head + 1, std::memory_order_release);
+            produced_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}  // namespace protobuf_mutator
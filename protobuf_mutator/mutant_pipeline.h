@@ -0,0 +1,102 @@
+#ifndef SRC_MUTANT_PIPELINE_H_
+#define SRC_MUTANT_PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "proto_util.h"
+
+namespace protobuf_mutator {
+    /**
+     * Pipeline mode is opt-in, it is configured by an environment variable:
+     *   PROTOBUF_MUTATOR_PIPELINE   number of mutants made ahead of time (default 0, no pipeline)
+     * Which mutants are used depends on the timing of the two threads, so a run is only
+     * reproducible from the seed without the pipeline.
+     */
+    #define PIPELINE_DEPTH_ENV "PROTOBUF_MUTATOR_PIPELINE"
+    // the producer waits at most this long for a free slot or a new queue entry
+    #define PIPELINE_WAIT_US (1000)
+
+    /**
+     * @brief Mutants of the current queue entry, made by a producer thread while the target runs.
+     * @details The consumer (the fuzzer thread) sets the queue entry and its splice partner, the producer
+     *          fills a single-producer single-consumer ring of slots. Every entry starts a new generation,
+     *          slots of an older generation are dropped by Pop(). The consumer holds the slot it has popped
+     *          until the next Pop(), so its buffers can be handed out without a copy.
+     */
+    class MutantPipeline {
+    public:
+        struct Slot {
+            OutputBuffer mutant;
+            int mutant_size = 0;
+            OutputBuffer processed;  // the mutant after post-processing, if the producer does it
+            int processed_size = 0;
+            uint64_t generation = 0;
+        };
+        struct Stats {
+            uint64_t produced = 0;
+            uint64_t popped = 0;          // served from the ring
+            uint64_t stalls = 0;          // the ring was empty, the consumer mutated by itself
+            uint64_t stale = 0;           // dropped, made for an earlier queue entry
+            uint64_t producer_waits = 0;  // the ring was full or there was nothing to mutate
+            uint64_t depth_sum = 0;       // ready slots seen by every Pop()
+            uint64_t max_depth = 0;
+            double AverageDepth() const { return popped + stalls ? (double)depth_sum / (popped + stalls) : 0; }
+        };
+        // Runs in the producer thread: make one mutant of parent (partner is the splice partner) into slot.
+        using ProduceFn = std::function<void(uint64_t generation, const string& parent, const string& partner, Slot* slot)>;
+
+        MutantPipeline(size_t depth, ProduceFn produce);
+        MutantPipeline(const MutantPipeline&) = delete;
+        MutantPipeline& operator=(const MutantPipeline&) = delete;
+        ~MutantPipeline();
+
+        // Consumer: a new queue entry, the producer waits for its partner.
+        void SetParent(const uint8_t* data, size_t size);
+        // Consumer: the splice partner of the current entry, the producer starts.
+        void SetPartner(const uint8_t* data, size_t size);
+        bool HasPartner() const { return has_partner_; }
+
+        // Consumer: the next mutant of the current entry, nullptr if none is ready. Valid until the next Pop().
+        const Slot* Pop();
+
+        Stats stats() const {
+            Stats stats = stats_;
+            // the producer counters are read while it runs
+            stats.produced = produced_.load(std::memory_order_relaxed);
+            stats.producer_waits = producer_waits_.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+    private:
+        void ProducerLoop();
+        // producer: sleep until the ring, the queue entry or its partner changes
+        void Wait(size_t tail, uint64_t generation, bool has_partner);
+        void Wake();
+
+        ProduceFn produce_;
+        std::vector<Slot> slots_;
+        // positions only grow, the slot is position % slots_.size()
+        alignas(64) std::atomic<size_t> head_{0};  // written by the producer
+        alignas(64) std::atomic<size_t> tail_{0};  // written by the consumer, the held slot included
+        bool holding_ = false;
+
+        // input of the producer, guarded by mutex_
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        string parent_;
+        string partner_;
+        std::atomic<uint64_t> generation_{0};
+        bool has_partner_ = false;
+
+        std::atomic<bool> running_{true};
+        std::atomic<uint64_t> produced_{0};
+        std::atomic<uint64_t> producer_waits_{0};
+        Stats stats_;
+        std::thread producer_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_MUTANT_PIPELINE_H_
@@ -1,4 +1,8 @@
 #include "mutate_util.h"
+#include "mutation_plan.h"
+#include "repeated_kernels.h"
+#include "typed_mutator.h"
+#include "value_domain.h"
 
 namespace protobuf_mutator {
     namespace{
@@ -27,280 +31,296 @@ namespace protobuf_mutator {
         void mutate(bool* value) { RepeatMutate(value, std::bind(MutateBool, _1)); }
     }
 
-    RandomEngine* getRandEngine(){
-        static RandomEngine randEngine;
-        return &randEngine;
+
+    void MutateValue(int32_t* value) { mutate(value); }
+    void MutateValue(int64_t* value) { mutate(value); }
+    void MutateValue(uint32_t* value) { mutate(value); }
+    void MutateValue(uint64_t* value) { mutate(value); }
+    void MutateValue(float* value) { mutate(value); }
+    void MutateValue(double* value) { mutate(value); }
+    void MutateValue(bool* value) { mutate(value); }
+
+    int RepeatedElementSize(const Message* msg, const FieldDescriptor* field, int index){
+        auto ref = msg->GetReflection();
+        switch (field->cpp_type()){
+            case FieldDescriptor::CPPTYPE_INT32:
+                return ScalarValueSize(field, ref->GetRepeatedInt32(*msg, field, index));
+            case FieldDescriptor::CPPTYPE_INT64:
+                return ScalarValueSize(field, ref->GetRepeatedInt64(*msg, field, index));
+            case FieldDescriptor::CPPTYPE_UINT32:
+                return ScalarValueSize(field, ref->GetRepeatedUInt32(*msg, field, index));
+            case FieldDescriptor::CPPTYPE_UINT64:
+                return ScalarValueSize(field, ref->GetRepeatedUInt64(*msg, field, index));
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+            case FieldDescriptor::CPPTYPE_FLOAT:
+            case FieldDescriptor::CPPTYPE_BOOL:
+                return FixedValueSize(field);
+            case FieldDescriptor::CPPTYPE_ENUM:
+                return ScalarValueSize(field, ref->GetRepeatedEnumValue(*msg, field, index));
+            case FieldDescriptor::CPPTYPE_MESSAGE:{
+                int len = GetMessageSize(&ref->GetRepeatedMessage(*msg, field, index));
+                return VarintSize(len) + len;
+            }case FieldDescriptor::CPPTYPE_STRING:
+                // not support
+                break;
+        }
+        return 0;
+    }
+
+    RepeatedFieldSize::RepeatedFieldSize(const Message* msg, const FieldDescriptor* field)
+        : packed_(field->is_packed()), tag_size_(TagSize(field)), payload_(0) {
+        count_ = msg->GetReflection()->FieldSize(*msg, field);
+        if(!packed_) return;
+        if(int fixed_size = FixedValueSize(field))
+            payload_ = count_ * fixed_size;
+        else
+            for(int i = 0; i < count_; i++) payload_ += RepeatedElementSize(msg, field, i);
     }
 
     void createRandomMessage(Message* msg, int& remain_size){
-        auto desc = msg->GetDescriptor();
+        if(auto typed = FindTypedMutator(msg->GetDescriptor()))
+            typed->create(msg, remain_size);
+        else
+            createRandomMessage(msg, *GetMessagePlan(msg->GetDescriptor()), remain_size);
+    }
+
+    void createRandomMessage(Message* msg, const MessagePlan& plan, int& remain_size){
+        for (const auto& entry : plan.fields)
+            CreateRandomField(msg, plan, entry, remain_size);
+    }
+
+    void CreateRandomField(Message* msg, const MessagePlan& plan, const FieldPlan& entry, int& remain_size){
         auto ref = msg->GetReflection();
-        auto field_count = desc->field_count();
-        for (int i = 0; i < field_count; i++){
-            auto field = desc->field(i);
-            if (field->is_repeated())
-                AddRepeatedField(msg, field, remain_size, 5);
-            else if(auto oneof_desc = field->containing_oneof()){
-                // Handle entire oneof group on the first field.
-                if(field->index_in_oneof() != 0) continue;
-                auto new_field = oneof_desc->field(GetRandomIndex(oneof_desc->field_count() - 1));
-                if(IsMessageType(new_field)){
-                    auto new_msg = ref->GetMessage(*msg, new_field).New();
-                    remain_size -= GetMessageSize(new_msg);
-                    createRandomMessage(new_msg, remain_size);
-                    ref->SetAllocatedMessage(msg, new_msg, new_field);
-                }else
-                    AddUnsetField(msg, new_field, remain_size);
+        if (entry.kind == FieldKind::Repeated)
+            AddRepeatedField(msg, entry.field, remain_size, MIN_CREATE_REPEATED_SIZE);
+        else if(entry.kind == FieldKind::Oneof){
+            auto oneof_desc = entry.oneof;
+            auto new_field = oneof_desc->field(GetRandomIndex(oneof_desc->field_count() - 1));
+            if(IsMessageType(new_field)){
+                int msg_remain_size = EmbeddedBudget(TagSize(new_field), remain_size);
+                if(msg_remain_size < 0) return;
+                int old_remain = msg_remain_size;
+                createRandomMessage(ref->MutableMessage(msg, new_field), *plan.Embedded(new_field), msg_remain_size);
+                int len = old_remain - msg_remain_size;
+                remain_size -= EmbeddedOverhead(new_field, len) + len;
             }else
-                AddUnsetField(msg, field, remain_size);
-        }
+                AddUnsetField(msg, new_field, remain_size);
+        }else
+            AddUnsetField(msg, entry.field, remain_size);
     }
 
     void AddRepeatedField(Message* msg, const FieldDescriptor* field, int& remain_size, int min_new_size){
         auto ref = msg->GetReflection();
-        auto oldLen = ref->FieldSize(*msg, field);
         // newLen in [1, MAX_NEW_REPEATED_SIZE]
         auto newLen = GetRandomNum(min_new_size, MAX_NEW_REPEATED_SIZE);
-        auto max_size = GetMessageSize(msg) + remain_size;
+        RepeatedFieldSize size(msg, field);
+        FieldDomain domain_storage;
+        const FieldDomain* domain = FindFieldDomain(field, &domain_storage);
+        newLen = std::min(newLen, RoomInDomain(domain, ref->FieldSize(*msg, field)));
+        // The size of a new scalar element is known before it is added, values are drawn until one fits.
+        auto fits = [&](auto value){ return FitsBudget(size.AddDelta(ScalarValueSize(field, value)), remain_size); };
+        #define ADD_FITTING_ELEMENT(Add, type, draw)                                          \
+            do{                                                                               \
+                type value;                                                                   \
+                if(!DrawFittingDomainValue(&value, domain, [&]{ return (type)(draw); }, fits)) return; \
+                ref->Add(msg, field, value);                                                  \
+                elem_size = ScalarValueSize(field, value);                                    \
+            }while(0)
         for(int i = 1; i <= newLen; i++){
+            int elem_size = 0;
             // add random field
             switch (field->cpp_type()){
                 case FieldDescriptor::CPPTYPE_INT32:
-                    ref->AddInt32(msg, field, GetRandomNum(INT32_MIN, INT32_MAX));
+                    ADD_FITTING_ELEMENT(AddInt32, int32_t, GetRandomNum(INT32_MIN, INT32_MAX));
                     break;
                 case FieldDescriptor::CPPTYPE_INT64:
-                    ref->AddInt64(msg, field, GetRandomNum(INT64_MIN, INT64_MAX));
+                    ADD_FITTING_ELEMENT(AddInt64, int64_t, GetRandomNum(INT64_MIN, INT64_MAX));
                     break;
                 case FieldDescriptor::CPPTYPE_UINT32:
-                    ref->AddUInt32(msg, field, GetRandomIndex(UINT32_MAX));
+                    ADD_FITTING_ELEMENT(AddUInt32, uint32_t, GetRandomIndex(UINT32_MAX));
                     break;
                 case FieldDescriptor::CPPTYPE_UINT64:
-                    ref->AddUInt64(msg, field, GetRandomIndex(UINT64_MAX));
+                    ADD_FITTING_ELEMENT(AddUInt64, uint64_t, GetRandomIndex(UINT64_MAX));
                     break;
                 case FieldDescriptor::CPPTYPE_DOUBLE:
                     // small real number
-                    ref->AddDouble(msg, field, GetRandomNum(-1.0, 1.0));
+                    ADD_FITTING_ELEMENT(AddDouble, double, GetRandomNum(-1.0, 1.0));
                     break;
                 case FieldDescriptor::CPPTYPE_FLOAT:
-                    ref->AddFloat(msg, field, GetRandomNum(-1.0, 1.0));
+                    ADD_FITTING_ELEMENT(AddFloat, float, GetRandomNum(-1.0, 1.0));
                     break;
                 case FieldDescriptor::CPPTYPE_BOOL:
-                    ref->AddBool(msg, field, GetRandomIndex(1));
+                    ADD_FITTING_ELEMENT(AddBool, bool, GetRandomIndex(1));
                     break;
                 case FieldDescriptor::CPPTYPE_ENUM:
-                    ref->AddEnum(msg, field, field->enum_type()->value(GetRandomIndex(field->enum_type()->value_count() - 1)));
+                    ADD_FITTING_ELEMENT(AddEnumValue, int,
+                                        field->enum_type()->value(GetRandomIndex(field->enum_type()->value_count() - 1))->number());
                     break;
                 case FieldDescriptor::CPPTYPE_MESSAGE:{
-                    auto newMsg = ref->AddMessage(msg, field);
-                    int msg_max_size = max_size - GetMessageSize(msg);
-                    createRandomMessage(newMsg, msg_max_size);
+                    // the content is created within the budget left after the tag and the length prefix
+                    int msg_remain_size = EmbeddedBudget(TagSize(field), remain_size);
+                    if(msg_remain_size < 0) return;
+                    int old_remain = msg_remain_size;
+                    createRandomMessage(ref->AddMessage(msg, field), msg_remain_size);
+                    int len = old_remain - msg_remain_size;
+                    elem_size = VarintSize(len) + len;
                     break;
                 }
                 case FieldDescriptor::CPPTYPE_STRING:
                     // not support
-                    break;
+                    return;
             }
-            // check size
-            remain_size = max_size - GetMessageSize(msg);
-            if(remain_size < 0) {
-                ref->RemoveLast(msg, field);
-                remain_size = max_size - GetMessageSize(msg);
-                return;
-            }      
+            remain_size -= size.Add(elem_size);
         }
+        #undef ADD_FITTING_ELEMENT
     }
 
     void AddUnsetField(Message* msg, const FieldDescriptor* field, int& remain_size){
         auto ref = msg->GetReflection();
-        auto max_size = GetMessageSize(msg) + remain_size;
+        auto old_size = SingularFieldSize(msg, field);
         // Special judgment for oneof fields
-        if(auto oneof_desc = field->containing_oneof()){
-            auto new_field = oneof_desc->field(GetRandomIndex(oneof_desc->field_count() - 1));
-            if(IsMessageType(new_field)){
-                auto new_msg = ref->GetMessage(*msg, new_field).New();
-                remain_size -= GetMessageSize(new_msg);
-                createRandomMessage(new_msg, remain_size);
-                ref->SetAllocatedMessage(msg, new_msg, new_field);
-                return;
-            }
-            else field = new_field;
+        if(auto oneof_desc = field->containing_oneof())
+            field = oneof_desc->field(GetRandomIndex(oneof_desc->field_count() - 1));
+        if(IsMessageType(field)){
+            // the old member (of a oneof group) is replaced, so its bytes are available to the new one
+            int msg_remain_size = EmbeddedBudget(TagSize(field), remain_size + old_size);
+            if(msg_remain_size < 0) return;
+            int old_remain = msg_remain_size;
+            createRandomMessage(ref->MutableMessage(msg, field), msg_remain_size);
+            int len = old_remain - msg_remain_size;
+            remain_size -= EmbeddedOverhead(field, len) + len - old_size;
+            return;
         }
+        // A new value replaces old_size bytes with tag + value, values are drawn until one fits,
+        // inside the value domain of the field if it has one.
+        FieldDomain domain_storage;
+        const FieldDomain* domain = FindFieldDomain(field, &domain_storage);
+        auto fits = [&](auto value){ return FitsBudget(ScalarFieldSize(field, value) - old_size, remain_size); };
+        #define ADD_FITTING_VALUE(Set, type, draw)                                            \
+            do{                                                                               \
+                type value;                                                                   \
+                if(!DrawFittingDomainValue(&value, domain, [&]{ return (type)(draw); }, fits)) break; \
+                ref->Set(msg, field, value);                                                  \
+                remain_size -= ScalarFieldSize(field, value) - old_size;     \
+            }while(0)
         switch (field->cpp_type()){
             case FieldDescriptor::CPPTYPE_INT32:
-                ref->SetInt32(msg, field, GetRandomNum(INT32_MIN, INT32_MAX));
+                ADD_FITTING_VALUE(SetInt32, int32_t, GetRandomNum(INT32_MIN, INT32_MAX));
                 break;
             case FieldDescriptor::CPPTYPE_INT64:
-                ref->SetInt64(msg, field, GetRandomNum(INT64_MIN, INT64_MAX));
+                ADD_FITTING_VALUE(SetInt64, int64_t, GetRandomNum(INT64_MIN, INT64_MAX));
                 break;
             case FieldDescriptor::CPPTYPE_UINT32:
-                ref->SetUInt32(msg, field, GetRandomIndex(UINT32_MAX));
+                ADD_FITTING_VALUE(SetUInt32, uint32_t, GetRandomIndex(UINT32_MAX));
                 break;
             case FieldDescriptor::CPPTYPE_UINT64:
-                ref->SetUInt64(msg, field, GetRandomIndex(UINT64_MAX));
+                ADD_FITTING_VALUE(SetUInt64, uint64_t, GetRandomIndex(UINT64_MAX));
                 break;
             case FieldDescriptor::CPPTYPE_DOUBLE:
                 // small real number
-                ref->SetDouble(msg, field, GetRandomNum(-1.0, 1.0));
+                ADD_FITTING_VALUE(SetDouble, double, GetRandomNum(-1.0, 1.0));
                 break;
             case FieldDescriptor::CPPTYPE_FLOAT:
-                ref->SetFloat(msg, field, GetRandomNum(-1.0, 1.0));
+                ADD_FITTING_VALUE(SetFloat, float, GetRandomNum(-1.0, 1.0));
                 break;
             case FieldDescriptor::CPPTYPE_BOOL:
-                ref->SetBool(msg, field, GetRandomIndex(1));
+                ADD_FITTING_VALUE(SetBool, bool, GetRandomIndex(1));
                 break;
             case FieldDescriptor::CPPTYPE_ENUM:
-                ref->SetEnum(msg, field, field->enum_type()->value(GetRandomIndex(field->enum_type()->value_count() - 1)));
+                ADD_FITTING_VALUE(SetEnumValue, int,
+                                  field->enum_type()->value(GetRandomIndex(field->enum_type()->value_count() - 1))->number());
                 break;
-            case FieldDescriptor::CPPTYPE_MESSAGE:{
-                auto newMsg = ref->MutableMessage(msg, field);
-                int msg_max_size = max_size - GetMessageSize(msg);
-                createRandomMessage(newMsg, msg_max_size);
-                break;
-            }case FieldDescriptor::CPPTYPE_STRING:
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+            case FieldDescriptor::CPPTYPE_STRING:
                 // not support
                 break;
         }
-        // check size
-        remain_size = max_size - GetMessageSize(msg);
-        if(remain_size < 0) {
-            ref->ClearField(msg, field);
-            remain_size = max_size - GetMessageSize(msg);
-        }
+        #undef ADD_FITTING_VALUE
     }
 
     void DeleteRepeatedField(Message* msg, const FieldDescriptor* field, int& remain_size){
         auto ref = msg->GetReflection();
-        auto type = field->cpp_type();
         auto len = ref->FieldSize(*msg, field);
         if(len <= MAX_NEW_REPEATED_SIZE) return;
-        auto max_size = GetMessageSize(msg) + remain_size;
-        vector<int> idx(len);
-        for(int i = 0; i < len; i++) idx[i] = i;
-        shuffle(idx.begin(), idx.end(), getRandEngine()->randLongEngine);
         auto cnt = GetRandomIndex(min(len / 2, MAX_NEW_REPEATED_SIZE / 2));
         if(cnt == 0) return;
-        sort(idx.begin(), idx.begin() + cnt);
-        // O (n ^ 2) implementation
-        while(cnt --){
-            for(int j = idx[cnt]; j + 1 < len; j++)
-                ref->SwapElements(msg, field, j, j + 1);
-            ref->RemoveLast(msg, field);
-            len--;
-        }
-        remain_size = max_size - GetMessageSize(msg);
+        int idx[MAX_NEW_REPEATED_SIZE / 2];
+        SampleIndices(len, cnt, idx);
+        std::sort(idx, idx + cnt);
+        RepeatedFieldSize size(msg, field);
+        for(int i = 0; i < cnt; i++)
+            remain_size -= size.Remove(RepeatedElementSize(msg, field, idx[i]));
+        // a single compaction pass
+        VisitRepeatedField(msg, field, [&](auto elements){ EraseSorted(elements, idx, cnt); });
     }
     
     void DeleteSetField(Message* msg, const FieldDescriptor* field, int& remain_size){
         if(!CanDeleteSimpleField()) return;
         auto ref = msg->GetReflection();
-        auto type = field->cpp_type();
-        auto max_size = GetMessageSize(msg) + remain_size;
+        remain_size += SingularFieldSize(msg, field);
         // Special judgment for oneof fields
         if(auto oneof_desc = field->containing_oneof())
             ref->ClearOneof(msg, oneof_desc);
         else
             ref->ClearField(msg, field);
-        
-        remain_size = max_size - GetMessageSize(msg);
     }
 
     void MutateRepeatedField(Message* msg, const FieldDescriptor* field, int& remain_size){
         auto ref = msg->GetReflection();
         auto len = ref->FieldSize(*msg, field);
-        auto max_size = GetMessageSize(msg) + remain_size;
+        RepeatedFieldSize size(msg, field);
+        int enum_count = field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM ? field->enum_type()->value_count() : 0;
+        FieldDomain domain_storage;
+        const FieldDomain* domain = FindFieldDomain(field, &domain_storage);
+        // A fixed width value always fits, the change of a varint value is predicted from the two values
+        // before it is set, including the change of the packed length prefix.
+        #define MUTATE_REPEATED_VALUE(GetRepeated, SetRepeated)                                        \
+            for(int i = 0; i < len; i++){                                                              \
+                if(!CanMutate()) continue;                                                             \
+                auto now = ref->GetRepeated(*msg, field, i);                                           \
+                int old_elem = ScalarValueSize(field, now);                                            \
+                if(!MutateFittingValue(&now, enum_count, domain, [&](decltype(now) candidate){         \
+                        return FitsBudget(size.ResizeDelta(old_elem, ScalarValueSize(field, candidate)), remain_size); \
+                    })) continue;                                                                      \
+                ref->SetRepeated(msg, field, i, now);                                                  \
+                remain_size -= size.Resize(old_elem, ScalarValueSize(field, now));                     \
+            }
         switch (field->cpp_type()){
             case FieldDescriptor::CPPTYPE_INT32:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedInt32(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedInt32(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedInt32(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedInt32, SetRepeatedInt32);
                 break;
             case FieldDescriptor::CPPTYPE_INT64:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;                    
-                    auto now = ref->GetRepeatedInt64(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedInt64(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedInt64(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedInt64, SetRepeatedInt64);
                 break;
             case FieldDescriptor::CPPTYPE_UINT32:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedUInt32(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedUInt32(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedUInt32(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedUInt32, SetRepeatedUInt32);
                 break;
             case FieldDescriptor::CPPTYPE_UINT64:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedUInt64(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedUInt64(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedUInt64(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedUInt64, SetRepeatedUInt64);
                 break;
             case FieldDescriptor::CPPTYPE_DOUBLE:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedDouble(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedDouble(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedDouble(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedDouble, SetRepeatedDouble);
                 break;
             case FieldDescriptor::CPPTYPE_FLOAT:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedFloat(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedFloat(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedFloat(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedFloat, SetRepeatedFloat);
                 break;
             case FieldDescriptor::CPPTYPE_BOOL:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedBool(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    ref->SetRepeatedInt32(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedInt32(msg, field, i, temp);
-                }
+                MUTATE_REPEATED_VALUE(GetRepeatedBool, SetRepeatedBool);
                 break;
             case FieldDescriptor::CPPTYPE_ENUM:
-                for(int i = 0; i < len; i++){
-                    if(!CanMutate()) continue;
-                    auto now = ref->GetRepeatedEnumValue(*msg, field, i);
-                    auto temp = now;
-                    mutate(&now);
-                    now = NotNegMod(now, field->enum_type()->value_count());
-                    ref->SetRepeatedEnumValue(msg, field, i, now);
-                    if(max_size - GetMessageSize(msg) < 0) ref->SetRepeatedEnumValue(msg, field, i, temp);
-                }              
+                MUTATE_REPEATED_VALUE(GetRepeatedEnumValue, SetRepeatedEnumValue);
                 break;
             case FieldDescriptor::CPPTYPE_MESSAGE:
             case FieldDescriptor::CPPTYPE_STRING:
                 // not support
                 break;
         }
-        remain_size = max_size - GetMessageSize(msg);
+        #undef MUTATE_REPEATED_VALUE
     }
 
     void MutateSetField(Message* msg, const FieldDescriptor* field, int& remain_size){
         auto ref = msg->GetReflection();
-        auto max_size = GetMessageSize(msg) + remain_size;
+        auto old_size = SingularFieldSize(msg, field);
         // Special judgment for oneof fields
         if(auto oneof_desc = field->containing_oneof()){
             int index = field->index_in_oneof();
@@ -311,151 +331,69 @@ namespace protobuf_mutator {
             if(index == newIndex) return;
             auto new_field = oneof_desc->field(newIndex);
             if(IsMessageType(new_field)){
-                auto new_msg = ref->GetMessage(*msg, new_field).New();
-                // XXX: Unable to get the byte size of the field
-                createRandomMessage(new_msg, remain_size);
+                // the old member is replaced, so its bytes are available to the new one
+                int msg_remain_size = EmbeddedBudget(TagSize(new_field), remain_size + old_size);
+                if(msg_remain_size < 0) return;
+                auto new_msg = ref->GetMessage(*msg, new_field).New(msg->GetArena());
+                int old_remain = msg_remain_size;
+                createRandomMessage(new_msg, msg_remain_size);
                 ref->SetAllocatedMessage(msg, new_msg, new_field);
-                remain_size = max_size - GetMessageSize(msg);
+                int len = old_remain - msg_remain_size;
+                remain_size -= EmbeddedOverhead(new_field, len) + len - old_size;
                 return;
             }
             else field = new_field; 
         }
+        // The new value replaces old_size bytes (of another member if the edit switches a oneof group)
+        // with tag + value, so its size is known before it is set.
+        int enum_count = field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM ? field->enum_type()->value_count() : 0;
+        FieldDomain domain_storage;
+        const FieldDomain* domain = FindFieldDomain(field, &domain_storage);
+        auto fits = [&](auto now){ return FitsBudget(ScalarFieldSize(field, now) - old_size, remain_size); };
+        #define MUTATE_SET_VALUE(Get, Set)                                                 \
+            do{                                                                            \
+                auto now = ref->Get(*msg, field);                                          \
+                if(!MutateFittingValue(&now, enum_count, domain, fits)) break;             \
+                ref->Set(msg, field, now);                                                 \
+                remain_size -= ScalarFieldSize(field, now) - old_size;    \
+            }while(0)
         switch (field->cpp_type()){
-            case FieldDescriptor::CPPTYPE_INT32:{
-                auto now = ref->GetInt32(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetInt32(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetInt32(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_INT64:{
-                auto now = ref->GetInt64(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetInt64(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetInt64(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_UINT32:{
-                auto now = ref->GetUInt32(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetUInt32(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetUInt32(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_UINT64:{
-                auto now = ref->GetUInt64(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetUInt64(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetUInt64(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_DOUBLE:{
-                auto now = ref->GetDouble(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetDouble(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetDouble(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_FLOAT:{
-                auto now = ref->GetFloat(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetFloat(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetFloat(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_BOOL:{
-                auto now = ref->GetBool(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                ref->SetBool(msg, field, now);
-                if(max_size - GetMessageSize(msg) < 0) ref->SetBool(msg, field, temp);
-                break;
-            } case FieldDescriptor::CPPTYPE_ENUM:{
-                auto now = ref->GetEnumValue(*msg, field);
-                auto temp = now;
-                mutate(&now);
-                now = NotNegMod(now, field->enum_type()->value_count());
-                ref->SetEnumValue(msg, field, now);     
-                if(max_size - GetMessageSize(msg) < 0) ref->SetEnumValue(msg, field, temp);                   
-                break;
-            } 
+            case FieldDescriptor::CPPTYPE_INT32:
+                MUTATE_SET_VALUE(GetInt32, SetInt32);
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                MUTATE_SET_VALUE(GetInt64, SetInt64);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                MUTATE_SET_VALUE(GetUInt32, SetUInt32);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                MUTATE_SET_VALUE(GetUInt64, SetUInt64);
+                break;
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                MUTATE_SET_VALUE(GetDouble, SetDouble);
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                MUTATE_SET_VALUE(GetFloat, SetFloat);
+                break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                MUTATE_SET_VALUE(GetBool, SetBool);
+                break;
+            case FieldDescriptor::CPPTYPE_ENUM:
+                MUTATE_SET_VALUE(GetEnumValue, SetEnumValue);
+                break;
             case FieldDescriptor::CPPTYPE_MESSAGE:
             case FieldDescriptor::CPPTYPE_STRING:
                 // not support
                 break;
         }
-        remain_size = max_size - GetMessageSize(msg);
+        #undef MUTATE_SET_VALUE
     }
 
-    void ShuffleRepeatedField(Message* msg, const FieldDescriptor* field, int& remain_size){
-        auto ref = msg->GetReflection();
-        auto max_size = GetMessageSize(msg) + remain_size;
-        auto len = ref->FieldSize(*msg, field);
-        switch (field->cpp_type()){
-            case FieldDescriptor::CPPTYPE_INT32:{
-                vector<int32_t> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedInt32(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedInt32(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_INT64:{
-                vector<int64_t> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedInt64(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedInt64(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_UINT32:{
-                vector<uint32_t> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedUInt32(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedUInt32(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_UINT64:{
-                vector<uint64_t> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedUInt64(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedUInt64(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_DOUBLE:{
-                vector<double> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedDouble(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedDouble(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_FLOAT:{
-                vector<float> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedFloat(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedFloat(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_BOOL:{
-                vector<bool> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedBool(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedBool(msg, field, i, shuffleList[i]); 
-                break;
-            } case FieldDescriptor::CPPTYPE_ENUM:{
-                vector<int> shuffleList(len);
-                for(int i = 0; i < len; i++) shuffleList[i] = ref->GetRepeatedEnumValue(*msg, field, i);
-                shuffle(shuffleList.begin(), shuffleList.end(), getRandEngine()->randLongEngine);
-                for(int i = 0; i < len; i++) ref->SetRepeatedEnumValue(msg, field, i, shuffleList[i]);
-                break;
-            } case FieldDescriptor::CPPTYPE_MESSAGE:{
-                // Due to the limitations of the protobuf API, the only way to shuffle 
-                // the order of embedded message repeated fields is to randomly swap two messages
-                if(len == 1) return;
-                for(int i = 0; i < len; i++){
-                    auto idx1 = GetRandomIndex(len - 1);
-                    auto idx2 = GetRandomIndex(len - 1);
-                    ref->SwapElements(msg, field, idx1, idx2);
-                }
-                break;
-            } case FieldDescriptor::CPPTYPE_STRING:
-                // not support
-                break;
-        }
-        // Assume that shuffling the repeated field will not affect its size
-        remain_size = max_size - GetMessageSize(msg);
+    void ShuffleRepeatedField(Message* msg, const FieldDescriptor* field, int& /*remain_size*/){
+        // Shuffling only reorders the elements, so the encoded size (and remain_size) does not change.
+        // Elements are swapped in place, a message by its pointer.
+        VisitRepeatedField(msg, field, [](auto elements){ ShuffleElements(elements); });
     }
     
     void ReplaceRepeatedField(Message* msg1, const Message* msg2, 
@@ -465,93 +403,58 @@ namespace protobuf_mutator {
         auto len1 = ref1->FieldSize(*msg1, field1);
         auto len2 = ref2->FieldSize(*msg2, field2);
         if(len1 == 0 || len2 == 0) return;
-        auto max_size = msg1->ByteSizeLong() + remain_size;
-        vector<int> idx1(len1);
-        for(int i = 0; i < len1; i++) idx1[i] = i;
-        shuffle(idx1.begin(), idx1.end(), getRandEngine()->randLongEngine);
+        RepeatedFieldSize size(msg1, field1);
         auto cnt = GetRandomIndex(min(len1 - 1, MAX_REPLACE_REPEATED_SIZE));
+        int idx1[MAX_REPLACE_REPEATED_SIZE];
+        SampleIndices(len1, cnt, idx1);
         for(int i = 0; i < cnt; i++){
             auto idx2 = GetRandomIndex(len2 - 1);
+            // The new element has the same encoded size as its source in message2
+            int old_elem = RepeatedElementSize(msg1, field1, idx1[i]);
+            int new_elem = RepeatedElementSize(msg2, field2, idx2);
+            if(remain_size < size.ResizeDelta(old_elem, new_elem))
+                continue;
             switch (field1->cpp_type()){
-                case FieldDescriptor::CPPTYPE_INT32:{
-                    auto temp = ref1->GetRepeatedInt32(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_INT32:
                     ref1->SetRepeatedInt32(msg1, field1, idx1[i], ref2->GetRepeatedInt32(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedInt32(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_INT64:{
-                    auto temp = ref1->GetRepeatedInt64(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_INT64:
                     ref1->SetRepeatedInt64(msg1, field1, idx1[i], ref2->GetRepeatedInt64(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedInt64(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_UINT32:{
-                    auto temp = ref1->GetRepeatedUInt32(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_UINT32:
                     ref1->SetRepeatedUInt32(msg1, field1, idx1[i], ref2->GetRepeatedUInt32(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedUInt32(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_UINT64:{
-                    auto temp = ref1->GetRepeatedUInt64(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_UINT64:
                     ref1->SetRepeatedUInt64(msg1, field1, idx1[i], ref2->GetRepeatedUInt64(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedUInt64(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_DOUBLE:{
-                    auto temp = ref1->GetRepeatedDouble(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_DOUBLE:
                     ref1->SetRepeatedDouble(msg1, field1, idx1[i], ref2->GetRepeatedDouble(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedDouble(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_FLOAT:{
-                    auto temp = ref1->GetRepeatedFloat(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_FLOAT:
                     ref1->SetRepeatedFloat(msg1, field1, idx1[i], ref2->GetRepeatedFloat(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedFloat(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_BOOL:{
-                    auto temp = ref1->GetRepeatedBool(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_BOOL:
                     ref1->SetRepeatedBool(msg1, field1, idx1[i], ref2->GetRepeatedBool(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedBool(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_ENUM:{
-                    auto temp = ref1->GetRepeatedEnumValue(*msg1, field1, idx1[i]);
+                case FieldDescriptor::CPPTYPE_ENUM:
                     ref1->SetRepeatedEnumValue(msg1, field1, idx1[i], ref2->GetRepeatedEnumValue(*msg2, field2, idx2));
-                    if(max_size - msg1->ByteSizeLong() < 0)
-                        ref1->SetRepeatedEnumValue(msg1, field1, idx1[i], temp);
                     break;
-                }
-                case FieldDescriptor::CPPTYPE_MESSAGE:{
-                    // Do not replace if replacement would cause exceeding the maximum size
-                    if(remain_size + ref1->GetRepeatedMessage(*msg1, field1, idx1[i]).ByteSizeLong() 
-                                   - ref2->GetRepeatedMessage(*msg2, field2, idx2).ByteSizeLong() < 0)
-                        break;
+                case FieldDescriptor::CPPTYPE_MESSAGE:
                     ref1->MutableRepeatedMessage(msg1, field1, idx1[i])->CopyFrom(ref2->GetRepeatedMessage(*msg2, field2, idx2));
                     break;
-                }
                 case FieldDescriptor::CPPTYPE_STRING:
                     // not support
-                    break;
+                    continue;
             }
-            remain_size = max_size - msg1->ByteSizeLong();
+            remain_size -= size.Resize(old_elem, new_elem);
         }
     }
 
-    void ReplaceSetField(Message* msg1, const Message* msg2, 
-         const FieldDescriptor* field1, const FieldDescriptor* field2, int& remain_size){
+    // Copy a set field of message2 into message1, the oneof member is taken from message2.
+    static void CopySetField(Message* msg1, const Message* msg2, 
+                const FieldDescriptor* field1, const FieldDescriptor* field2){
         auto ref1 = msg1->GetReflection();
         auto ref2 = msg2->GetReflection();
-        auto max_size = msg1->ByteSizeLong() + remain_size;
-        Message* temp = msg1->New();
-        temp->CopyFrom(*msg1);
         // Special judgment for oneof fields
         if(auto oneof_desc1 = field1->containing_oneof())
             field1 = oneof_desc1->field(field2->index_in_oneof());
@@ -587,115 +490,75 @@ namespace protobuf_mutator {
                 // not support
                 break;
         }
-        // XXX: To avoid dealing with the complex situation of oneof field, 
-        // just copy the whole original message to the crossover one in case of exceeding the maximum size
-        remain_size = max_size - msg1->ByteSizeLong();
-        if(remain_size < 0){
-            msg1->CopyFrom(*temp);
-            remain_size = max_size - msg1->ByteSizeLong();
-        }
-        delete temp;
+    }
+
+    void ReplaceSetField(Message* msg1, const Message* msg2, 
+         const FieldDescriptor* field1, const FieldDescriptor* field2, int& remain_size){
+        // After the copy the field has the same encoded size as in message2, 
+        // so the replacement is skipped up front instead of copying and restoring the whole message.
+        int delta = SingularFieldSize(msg2, field2) - SingularFieldSize(msg1, field1);
+        if(remain_size < delta) return;
+        CopySetField(msg1, msg2, field1, field2);
+        remain_size -= delta;
     }
 
     void CrossoverAddRepeatedField(Message* msg1, const Message* msg2, 
                    const FieldDescriptor* field1, const FieldDescriptor* field2, int& remain_size){
         auto ref1 = msg1->GetReflection();
         auto ref2 = msg2->GetReflection();
-        auto len1 = ref1->FieldSize(*msg1, field1);
         auto len2 = ref2->FieldSize(*msg2, field2);
-        auto max_size = msg1->ByteSizeLong() + remain_size;
         auto newLen = GetRandomIndex(min(len2, MAX_NEW_REPEATED_SIZE));
-        vector<int> idx2(len2);
-        for(int i = 0; i < len2; i++) idx2[i] = i;
-        shuffle(idx2.begin(), idx2.end(), getRandEngine()->randLongEngine);
-        for(int i = 0; i < newLen; i++){
+        FieldDomain domain;
+        newLen = std::min(newLen, RoomInDomain(FindFieldDomain(field1, &domain), ref1->FieldSize(*msg1, field1)));
+        if(newLen == 0 || field1->cpp_type() == FieldDescriptor::CPPTYPE_STRING) return;
+        // Range splice: a run of message2 keeps the order of its elements (a sequence of API calls stays one),
+        // as much of it as fits the budget is appended.
+        int begin = GetRandomIndex(len2 - newLen);
+        RepeatedFieldSize size(msg1, field1);
+        int end = begin + FitRange(newLen, size, remain_size,
+                                   [&](int i){ return RepeatedElementSize(msg2, field2, begin + i); });
+        for(int i = begin; i < end; i++){
             switch (field1->cpp_type()){
                 case FieldDescriptor::CPPTYPE_INT32:
-                    ref1->AddInt32(msg1, field1, ref2->GetRepeatedInt32(*msg2, field2, idx2[i]));
+                    ref1->AddInt32(msg1, field1, ref2->GetRepeatedInt32(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_INT64:
-                    ref1->AddInt64(msg1, field1, ref2->GetRepeatedInt64(*msg2, field2, idx2[i]));
+                    ref1->AddInt64(msg1, field1, ref2->GetRepeatedInt64(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_UINT32:
-                    ref1->AddUInt32(msg1, field1, ref2->GetRepeatedUInt32(*msg2, field2, idx2[i]));
+                    ref1->AddUInt32(msg1, field1, ref2->GetRepeatedUInt32(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_UINT64:
-                    ref1->AddUInt64(msg1, field1, ref2->GetRepeatedUInt64(*msg2, field2, idx2[i]));
+                    ref1->AddUInt64(msg1, field1, ref2->GetRepeatedUInt64(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_DOUBLE:
-                    ref1->AddDouble(msg1, field1, ref2->GetRepeatedDouble(*msg2, field2, idx2[i]));
+                    ref1->AddDouble(msg1, field1, ref2->GetRepeatedDouble(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_FLOAT:
-                    ref1->AddFloat(msg1, field1, ref2->GetRepeatedFloat(*msg2, field2, idx2[i]));
+                    ref1->AddFloat(msg1, field1, ref2->GetRepeatedFloat(*msg2, field2, i));
                     break;  
                 case FieldDescriptor::CPPTYPE_BOOL:
-                    ref1->AddBool(msg1, field1, ref2->GetRepeatedBool(*msg2, field2, idx2[i]));
+                    ref1->AddBool(msg1, field1, ref2->GetRepeatedBool(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_ENUM:
-                    ref1->AddEnumValue(msg1, field1, ref2->GetRepeatedEnumValue(*msg2, field2, idx2[i]));
+                    ref1->AddEnumValue(msg1, field1, ref2->GetRepeatedEnumValue(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_MESSAGE:
-                    ref1->AddMessage(msg1, field1)->CopyFrom(ref2->GetRepeatedMessage(*msg2, field2, idx2[i]));
+                    ref1->AddMessage(msg1, field1)->CopyFrom(ref2->GetRepeatedMessage(*msg2, field2, i));
                     break;
                 case FieldDescriptor::CPPTYPE_STRING:  
                     // not support
-                    break;
+                    return;
             }
-            // check size
-            remain_size = max_size - GetMessageSize(msg1);
-            if(remain_size < 0) {
-                ref1->RemoveLast(msg1, field1);
-                remain_size = max_size - GetMessageSize(msg1);
-                return;
-            }      
         }
     }
 
     void CrossoverAddUnsetField(Message* msg1, const Message* msg2, 
                 const FieldDescriptor* field1, const FieldDescriptor* field2, int& remain_size){
-        auto ref1 = msg1->GetReflection();
-        auto ref2 = msg2->GetReflection();
-        auto max_size = msg1->ByteSizeLong() + remain_size;
-        // Special judgment for oneof fields
-        if(auto oneof_desc1 = field1->containing_oneof())
-            field1 = oneof_desc1->field(field2->index_in_oneof());
-        switch (field1->cpp_type()){
-            case FieldDescriptor::CPPTYPE_INT32:
-                ref1->SetInt32(msg1, field1, ref2->GetInt32(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_INT64: 
-                ref1->SetInt64(msg1, field1, ref2->GetInt64(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_UINT32:
-                ref1->SetUInt32(msg1, field1, ref2->GetUInt32(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_UINT64:
-                ref1->SetUInt64(msg1, field1, ref2->GetUInt64(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_DOUBLE:
-                ref1->SetDouble(msg1, field1, ref2->GetDouble(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_FLOAT:
-                ref1->SetFloat(msg1, field1, ref2->GetFloat(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_BOOL:
-                ref1->SetBool(msg1, field1, ref2->GetBool(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_ENUM:
-                ref1->SetEnumValue(msg1, field1, ref2->GetEnumValue(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_MESSAGE:
-                ref1->MutableMessage(msg1, field1)->CopyFrom(ref2->GetMessage(*msg2, field2));
-                break;
-            case FieldDescriptor::CPPTYPE_STRING:
-                // not support
-                break;
-        }
         // check size
-        remain_size = max_size - GetMessageSize(msg1);
-        if(remain_size < 0) {
-            ref1->ClearField(msg1, field1);
-            remain_size = max_size - GetMessageSize(msg1);
-        }
+        int delta = SingularFieldSize(msg2, field2) - SingularFieldSize(msg1, field1);
+        if(remain_size < delta) return;
+        CopySetField(msg1, msg2, field1, field2);
+        remain_size -= delta;
     }
 }
\ No newline at end of file
@@ -9,24 +9,70 @@ namespace protobuf_mutator {
     #define DELETE_REPEATED_FIELD_PROBABILITY 4
     #define DELETE_SIMPLE_FIELD_PROBABILITY 2 
     #define MUTATE_PROBABILITY 3 
+    // a repeated field of a newly created message gets at least this many elements
+    #define MIN_CREATE_REPEATED_SIZE 5
+    // an edit draws at most this many values before it gives up on a field that is short of budget
+    #define MAX_SIZE_CANDIDATES 4
     
     using std::min;
     using std::placeholders::_1;
     using std::vector;
-    using std::shuffle;
     using std::cout;
     using std::endl;
+    using protobuf::internal::WireFormat;
+    using protobuf::internal::WireFormatLite;
+    using protobuf::io::CodedOutputStream;
+    /**
+     * @brief wyrand: a 64-bit counter passed through a multiply-mix, one add and one 128-bit multiply per number.
+     * @details The sequence only depends on the seed, so a run is reproducible on every platform.
+     *          It is a UniformRandomBitGenerator as well, for the std algorithms.
+     */
     class RandomEngine{
     public:
+        using result_type = uint64_t;
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT64_MAX; }
+
         void Seed(unsigned int seed) {
             seed_ = seed;
-            randLongEngine.seed(seed);
-            randomDoubleEngine.seed(seed);
+            state_ = seed;
         }
-        unsigned int seed_;
-        std::minstd_rand randLongEngine;
-        std::random_device randDevice;
-        std::mt19937 randomDoubleEngine;
+        // The stream of a 64-bit key, such as the hash of an input.
+        void SeedKey(uint64_t key) {
+            seed_ = (unsigned int)key;
+            state_ = key;
+        }
+
+        result_type operator()() {
+            state_ += 0xa0761d6478bd642full;
+            __uint128_t t = (__uint128_t)state_ * (state_ ^ 0xe7037ed1a0b428dbull);
+            return (uint64_t)(t >> 64) ^ (uint64_t)t;
+        }
+
+        /**
+         * @brief Uniform in [0, range), range == 0 stands for the whole 64-bit range.
+         * @details Lemire's multiply-shift: the high half of x * range is the result, the division that
+         *          rejects the biased values only runs when the low half is below range.
+         */
+        uint64_t Bounded(uint64_t range) {
+            uint64_t x = (*this)();
+            if (range == 0) return x;
+            __uint128_t m = (__uint128_t)x * range;
+            if ((uint64_t)m < range) {
+                uint64_t threshold = -range % range;
+                while ((uint64_t)m < threshold)
+                    m = (__uint128_t)(*this)() * range;
+            }
+            return m >> 64;
+        }
+
+        // Uniform in [0, 1), 53 random bits.
+        double UniformDouble() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+        unsigned int seed_ = 0;
+
+    private:
+        uint64_t state_ = 0;
     };
 
     RandomEngine* getRandEngine();
@@ -38,16 +84,29 @@ namespace protobuf_mutator {
     inline typename std::enable_if<std::is_integral<T>::value, T>::type 
     GetRandomNum(T mi, T ma){
         assert(mi <= ma);
-        std::uniform_int_distribution<T> distribution(mi, ma);
-        return distribution(getRandEngine()->randLongEngine);
+        using U = typename std::make_unsigned<T>::type;
+        // wraps to 0 for the whole 64-bit range
+        uint64_t range = (uint64_t)(U)((U)ma - (U)mi) + 1;
+        return (T)((U)mi + (U)getRandEngine()->Bounded(range));
     }
 
+    // [mi, ma) like std::uniform_real_distribution
     template <typename T>
     inline typename std::enable_if<std::is_floating_point<T>::value, T>::type 
     GetRandomNum(T mi, T ma){
         assert(mi <= ma);
-        std::uniform_real_distribution<T> distribution(mi, ma);
-        return distribution(getRandEngine()->randomDoubleEngine);
+        return (T)(mi + (ma - mi) * getRandEngine()->UniformDouble());
+    }
+
+    /**
+     * @brief Fill out with n random doubles in [mi, ma), the same numbers as n calls of GetRandomNum(mi, ma).
+     */
+    inline void GetRandomNums(double* out, size_t n, double mi, double ma){
+        assert(mi <= ma);
+        RandomEngine* engine = getRandEngine();
+        double scale = ma - mi;
+        for (size_t i = 0; i < n; i++)
+            out[i] = mi + scale * engine->UniformDouble();
     }
 
     /**
@@ -57,12 +116,18 @@ namespace protobuf_mutator {
     inline typename std::enable_if<std::is_integral<T>::value, T>::type
     GetRandomIndex(T ma){
         assert(ma >= 0);
-        std::uniform_int_distribution<T> distribution(0, ma);
-        return distribution(getRandEngine()->randLongEngine);
+        return (T)getRandEngine()->Bounded((uint64_t)ma + 1);
+    }
+
+    // Fisher-Yates with the bounded draws of the engine, the order does not depend on the standard library.
+    template <class RandomIt>
+    inline void RandomShuffle(RandomIt first, RandomIt last){
+        for (auto i = last - first - 1; i > 0; i--)
+            std::iter_swap(first + i, first + getRandEngine()->Bounded((uint64_t)i + 1));
     }
 
     inline void flipBit(size_t size, uint8_t* bytes) {
-        size_t bit = GetRandomIndex(size * 8);
+        size_t bit = GetRandomIndex(size * 8 - 1);
         bytes[bit / 8] ^= (1u << (bit % 8));
     }
 
@@ -83,9 +148,206 @@ namespace protobuf_mutator {
     template<typename T>
     inline T NotNegMod(T a, const T mod) { return (a % mod + mod) % mod; }
 
+    // ----------------------Size accounting------------------------
+    // Every edit charges the exact change of the encoded size to remain_size, 
+    // so the budget stays correct without re-measuring the whole message after each field.
+    inline int VarintSize(uint32_t value) { return CodedOutputStream::VarintSize32(value); }
+    inline int TagSize(const FieldDescriptor* field) { return WireFormat::TagSize(field->number(), field->type()); }
+    // Tag and length prefix of an embedded message with len bytes of content.
+    inline int EmbeddedOverhead(const FieldDescriptor* field, int len) { return TagSize(field) + VarintSize(len); }
+    // Whether an edit that changes the size by delta fits. One that does not grow the message always does,
+    // even if the input is over the budget already.
+    inline bool FitsBudget(int delta, int remain_size) { return delta <= 0 || delta <= remain_size; }
+    // Content budget of an embedded message that has budget bytes for its tag, length prefix and content.
+    // The prefix is charged for the largest content, so the message fits whatever it is filled with. Negative if
+    // not even an empty message fits.
+    inline int EmbeddedBudget(int tag_size, int budget) {
+        int left = budget - tag_size;
+        return left - VarintSize(std::max(left, 0));
+    }
+
+    // Encoded size of one value of a fixed width type, 0 for varint and length-delimited types.
+    constexpr int FixedTypeSize(FieldDescriptor::Type type){
+        switch (type){
+            case FieldDescriptor::TYPE_BOOL:     return WireFormatLite::kBoolSize;
+            case FieldDescriptor::TYPE_FIXED32:
+            case FieldDescriptor::TYPE_SFIXED32:
+            case FieldDescriptor::TYPE_FLOAT:    return 4;
+            case FieldDescriptor::TYPE_FIXED64:
+            case FieldDescriptor::TYPE_SFIXED64:
+            case FieldDescriptor::TYPE_DOUBLE:   return 8;
+            default:                             return 0;
+        }
+    }
+    inline int FixedValueSize(const FieldDescriptor* field) { return FixedTypeSize(field->type()); }
+
+    /**
+     * @brief Encoded size of one scalar value of the type (tag and packed length prefix excluded).
+     * @details The switch folds away when type is a compile time constant, as in the typed mutators.
+     */
+    template<typename T>
+    inline int WireValueSize(FieldDescriptor::Type type, T value){
+        switch (type){
+            case FieldDescriptor::TYPE_INT32:    return WireFormatLite::Int32Size(static_cast<int32_t>(value));
+            case FieldDescriptor::TYPE_SINT32:   return WireFormatLite::SInt32Size(static_cast<int32_t>(value));
+            case FieldDescriptor::TYPE_UINT32:   return WireFormatLite::UInt32Size(static_cast<uint32_t>(value));
+            case FieldDescriptor::TYPE_ENUM:     return WireFormatLite::EnumSize(static_cast<int>(value));
+            case FieldDescriptor::TYPE_INT64:    return WireFormatLite::Int64Size(static_cast<int64_t>(value));
+            case FieldDescriptor::TYPE_SINT64:   return WireFormatLite::SInt64Size(static_cast<int64_t>(value));
+            case FieldDescriptor::TYPE_UINT64:   return WireFormatLite::UInt64Size(static_cast<uint64_t>(value));
+            default:                             return FixedTypeSize(type);
+        }
+    }
+    template<typename T>
+    inline int ScalarValueSize(const FieldDescriptor* field, T value) { return WireValueSize(field->type(), value); }
+
+    // Presence of a proto3 field without has_xxx(): a floating point value is compared bitwise, like reflection does.
+    template<typename T>
+    inline bool IsNonZero(T value) {
+        if constexpr (std::is_floating_point<T>::value) {
+            typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits;
+            memcpy(&bits, &value, sizeof(value));
+            return bits != 0;
+        } else
+            return value != 0;
+    }
+
+    // Encoded size of a singular scalar field once it holds value, tag included. The size of a new value
+    // is known before it is set: a proto3 field without presence is not serialized while it is zero.
+    template<typename T>
+    inline int ScalarFieldSize(const FieldDescriptor* field, T value){
+        if(!field->has_presence() && !IsNonZero(value)) return 0;
+        return TagSize(field) + ScalarValueSize(field, value);
+    }
+
+    /**
+     * @brief Encoded size of a singular field, tag included. 
+     * @details For a oneof member the size of the member that is currently set is returned,
+     *          because setting one member clears the others. Only embedded messages are walked.
+     */
+    inline int SingularFieldSize(const Message* msg, const FieldDescriptor* field){
+        if(auto oneof = field->containing_oneof())
+            field = msg->GetReflection()->GetOneofFieldDescriptor(*msg, oneof);
+        // FieldByteSize() still counts the value of a field that is not serialized
+        if(!field || !msg->GetReflection()->HasField(*msg, field)) return 0;
+        return (int)WireFormat::FieldByteSize(field, *msg);
+    }
+
+    // Encoded size of the element at index of a repeated field, tag excluded.
+    int RepeatedElementSize(const Message* msg, const FieldDescriptor* field, int index);
+
+    /**
+     * @brief Tracks the encoded size of one repeated field across element edits.
+     * @details Unpacked: every element costs tag + payload (embedded message: length prefix + content).
+     *          Packed:   tag + varint(payload) + payload for the whole field, nothing when it is empty,
+     *                    so the total payload is kept to charge changes of the length prefix.
+     *          The *Delta() functions only predict the change, Add/Remove/Resize also record it.
+     */
+    class RepeatedFieldSize {
+    public:
+        RepeatedFieldSize(const Message* msg, const FieldDescriptor* field);
+        RepeatedFieldSize(bool packed, int tag_size, int count, int payload)
+            : packed_(packed), tag_size_(tag_size), count_(count), payload_(payload) {}
+        int AddDelta(int elem_size) const { return Size(count_ + 1, payload_ + elem_size) - Size(count_, payload_); }
+        int RemoveDelta(int elem_size) const { return Size(count_ - 1, payload_ - elem_size) - Size(count_, payload_); }
+        int ResizeDelta(int old_size, int new_size) const { return Size(count_, payload_ - old_size + new_size) - Size(count_, payload_); }
+        int Add(int elem_size) { int d = AddDelta(elem_size); count_++; payload_ += elem_size; return d; }
+        int Remove(int elem_size) { int d = RemoveDelta(elem_size); count_--; payload_ -= elem_size; return d; }
+        int Resize(int old_size, int new_size) { int d = ResizeDelta(old_size, new_size); payload_ += new_size - old_size; return d; }
+
+    private:
+        int Size(int count, int payload) const {
+            if(!packed_) return count * tag_size_ + payload;
+            return count ? tag_size_ + VarintSize(payload) + payload : 0;
+        }
+        bool packed_;
+        int tag_size_;
+        int count_;
+        int payload_;   // only maintained for packed fields
+    };
+
+    /**
+     * @brief Bytes to hold back from the content budget of an embedded message for the growth of its tag and
+     *        length prefix: the content grows by remain_size at most, overhead is what tag and prefix take now.
+     */
+    inline int EmbeddedReserve(int tag_size, int old_size, int overhead, int remain_size){
+        int max_overhead = tag_size + VarintSize(std::max(old_size + remain_size, 0));
+        return std::max(max_overhead - overhead, 0);
+    }
+
+    /**
+     * @brief Run edit(sub_msg, remain_size) on an embedded message and charge its size change.
+     * @details The edit charges the change of the content itself; the change of the tag and length 
+     *          prefix is only visible from the parent and is added here. The edit gets the budget left after
+     *          the largest prefix, so the prefix never outgrows it. index is ignored for singular fields.
+     *          size(sub) returns the current size of the embedded message, GetMessageSize() unless the caller knows it.
+     */
+    template<class F, class Size>
+    inline void EditEmbeddedMessage(Message* msg, const FieldDescriptor* field, int index, int& remain_size, F edit, Size size){
+        auto ref = msg->GetReflection();
+        bool present = field->is_repeated() || ref->HasField(*msg, field);
+        Message* sub = field->is_repeated() ? ref->MutableRepeatedMessage(msg, field, index) : ref->MutableMessage(msg, field);
+        int old_size = size(sub);
+        int overhead = present ? EmbeddedOverhead(field, old_size) : 0;
+        int sub_remain = remain_size - EmbeddedReserve(TagSize(field), old_size, overhead, remain_size);
+        int old_remain = sub_remain;
+        edit(sub, sub_remain);
+        int len = old_remain - sub_remain;
+        remain_size -= len + EmbeddedOverhead(field, old_size + len) - overhead;
+    }
+
+    template<class F>
+    inline void EditEmbeddedMessage(Message* msg, const FieldDescriptor* field, int index, int& remain_size, F edit){
+        EditEmbeddedMessage(msg, field, index, remain_size, edit, GetMessageSize);
+    }
+
+    // Flip bits of the value until it changes (at most 10 times), a bool is negated.
+    void MutateValue(int32_t* value);
+    void MutateValue(int64_t* value);
+    void MutateValue(uint32_t* value);
+    void MutateValue(uint64_t* value);
+    void MutateValue(float* value);
+    void MutateValue(double* value);
+    void MutateValue(bool* value);
+
+    /**
+     * @brief Size-predictive edit: draw() candidates until fits(candidate) accepts one, at most MAX_SIZE_CANDIDATES.
+     * @details fits() predicts the size change of the candidate in closed form, so a value is only applied once
+     *          it is known to fit and is never rolled back. Returns false, *value unchanged, if no candidate fits.
+     */
+    template<class T, class Draw, class Fits>
+    inline bool DrawFittingValue(T* value, Draw draw, Fits fits){
+        for(int i = 0; i < MAX_SIZE_CANDIDATES; i++){
+            T candidate = draw();
+            if(fits(candidate)){
+                *value = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+    // DrawFittingValue() of mutations of *value, every draw starts from the old value. 
+    // A mutated enum value is folded into [0, enum_count).
+    template<class T, class Fits>
+    inline bool MutateFittingValue(T* value, int enum_count, Fits fits){
+        T old = *value;
+        return DrawFittingValue(value, [old, enum_count]{
+            T now = old;
+            MutateValue(&now);
+            if constexpr (std::is_integral<T>::value)
+                if(enum_count) now = NotNegMod(now, (T)enum_count);
+            return now;
+        }, fits);
+    }
+
     // ----------------------Mutate functions------------------------
+    struct MessagePlan;
+    struct FieldPlan;
     // recursive create a message with random value
     void createRandomMessage(Message* msg, int& remain_size);
+    void createRandomMessage(Message* msg, const MessagePlan& plan, int& remain_size);
+    // Fill one field (or oneof group) of a newly created message.
+    void CreateRandomField(Message* msg, const MessagePlan& plan, const FieldPlan& entry, int& remain_size);
     // Add some new fields (including simple fields, enums, messages) with random values to a repeated field.
     void AddRepeatedField(Message* msg, const FieldDescriptor* field, int& remain_size, int min_new_size = 1);
     // Add an unset field with random values.
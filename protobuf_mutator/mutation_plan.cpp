@@ -0,0 +1,107 @@
+#include "mutation_plan.h"
+
+namespace protobuf_mutator {
+    namespace {
+        template<typename Ops, typename Bitset, typename Type>
+        Ops ToOps(const Bitset& allowed) {
+            Ops ops;
+            for (int pos = allowed._Find_first(); pos < (int)allowed.size(); pos = allowed._Find_next(pos))
+                ops.Add(static_cast<Type>(pos));
+            return ops;
+        }
+        MutationOps ToMutationOps(const MutationBitset& b) { return ToOps<MutationOps, MutationBitset, FieldMuationType>(b); }
+        CrossoverOps ToCrossoverOps(const CrossoverBitset& b) { return ToOps<CrossoverOps, CrossoverBitset, CrossoverType>(b); }
+    }
+
+    MutationPlanCache* GetPlanCache() {
+        static MutationPlanCache cache;
+        return &cache;
+    }
+
+    const MessagePlan* MutationPlanCache::Get(const Descriptor* desc) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Build(desc);
+    }
+
+    const MessagePlan* MutationPlanCache::Build(const Descriptor* desc) {
+        # define MUTATION_ADD     allowed_mutations.set((int)FieldMuationType::MutationAdd)
+        # define MUTATION_DELETE  allowed_mutations.set((int)FieldMuationType::Delete)
+        # define MUTATION_MUTATE  allowed_mutations.set((int)FieldMuationType::Mutate)
+        # define MUTATION_SHUFFLE allowed_mutations.set((int)FieldMuationType::Shuffle)
+        # define CROSSOVER_REPLACE allowed_crossovers.set((int)CrossoverType::Replace)
+        # define CROSSOVER_ADD     allowed_crossovers.set((int)CrossoverType::CrossoverAdd)
+        # define RESTORE_BITSETS   (allowed_mutations.reset(), allowed_mutations.set((int)FieldMuationType::None), \
+                                    allowed_crossovers.reset(), allowed_crossovers.set((int)CrossoverType::None))
+        auto it = plans_.find(desc);
+        if (it != plans_.end()) return it->second.get();
+        // Register the plan before building the embedded ones, so that recursive message types terminate.
+        auto plan = new MessagePlan;
+        plans_[desc].reset(plan);
+        plan->descriptor = desc;
+        int field_count = desc->field_count();
+        plan->embedded.assign(field_count, nullptr);
+        for (int i = 0; i < field_count; i++) {
+            auto field = desc->field(i);
+            if (IsMessageType(field)) plan->embedded[i] = Build(field->message_type());
+        }
+
+        MutationBitset allowed_mutations;
+        CrossoverBitset allowed_crossovers;
+        for (int i = 0; i < field_count; i++) {
+            auto field = desc->field(i);
+            FieldPlan entry{};
+            entry.field = field;
+            entry.cpp_type = field->cpp_type();
+            entry.message_plan = plan->embedded[i];
+            if (auto oneof = field->containing_oneof()) {
+                // Handle entire oneof group on the first field.
+                if (field->index_in_oneof() != 0) continue;
+                entry.kind = FieldKind::Oneof;
+                entry.oneof = oneof;
+                // the members may have different types, they are looked up in MessagePlan::embedded
+                entry.message_plan = nullptr;
+                RESTORE_BITSETS;
+                MUTATION_ADD;
+                CROSSOVER_ADD;
+                entry.unset_mutations = ToMutationOps(allowed_mutations);
+                entry.unset_crossovers = ToCrossoverOps(allowed_crossovers);
+                RESTORE_BITSETS;
+                // do not delete oneof field
+                MUTATION_MUTATE;
+                CROSSOVER_REPLACE;
+                entry.set_mutations = ToMutationOps(allowed_mutations);
+                entry.set_crossovers = ToCrossoverOps(allowed_crossovers);
+            } else if (field->is_repeated()) {
+                entry.kind = FieldKind::Repeated;
+                RESTORE_BITSETS;
+                MUTATION_ADD;
+                MUTATION_DELETE;
+                // Embedded message should be mutated recursively
+                if (!IsMessageType(field)) MUTATION_MUTATE;
+                MUTATION_SHUFFLE;
+                CROSSOVER_ADD;
+                CROSSOVER_REPLACE;
+                entry.set_mutations = ToMutationOps(allowed_mutations);
+                entry.set_crossovers = ToCrossoverOps(allowed_crossovers);
+            } else if (IsMessageType(field)) {
+                entry.kind = FieldKind::Message;
+            } else {
+                entry.kind = FieldKind::Scalar;
+                RESTORE_BITSETS;
+                MUTATION_ADD;
+                CROSSOVER_ADD;
+                entry.unset_mutations = ToMutationOps(allowed_mutations);
+                entry.unset_crossovers = ToCrossoverOps(allowed_crossovers);
+                RESTORE_BITSETS;
+                MUTATION_DELETE;
+                MUTATION_MUTATE;
+                CROSSOVER_REPLACE;
+                entry.set_mutations = ToMutationOps(allowed_mutations);
+                entry.set_crossovers = ToCrossoverOps(allowed_crossovers);
+            }
+            entry.id = next_field_id_++;
+            plan->fields.push_back(entry);
+        }
+        return plan;
+    }
+}  // namespace protobuf_mutator
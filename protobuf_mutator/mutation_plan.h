@@ -0,0 +1,216 @@
+#ifndef SRC_MUTATION_PLAN_H_
+#define SRC_MUTATION_PLAN_H_
+
+#include <unordered_map>
+#include <mutex>
+#include "mutate_util.h"
+
+namespace protobuf_mutator {
+    /**
+     * @brief Types of mutation on field in proto3
+     * @details 
+     * 1. Field include simple field, enum field, oneof field and repeated field.
+     * 2. Simple field, enum field, oneof field need to be checked whether they are set or unset.
+     *    Unset for simple field: has_xxx() returns false and DebugString() shows nothing.
+     * 3. An optional field is considered unset when it has no value, 
+     *    while a singular field is considered unset when it has the default value. 
+     * 4. Oneof field needs to be specially handled, and it can't be repeated.
+     */
+    enum class FieldMuationType : uint8_t {
+        // 1. Add an unset field with random values.
+        // 2. Add some new fields (including simple fields, enums, oneof) with random values to a repeated field.
+        //    The total length of the newly added fields will not exceed MAX_NEW_REPEATED_SIZE.
+        MutationAdd  ,                
+        // 1. Deletes a set field.
+        // 2. Iterate each field in a repeated field and delete it with a certain probability
+        Delete       ,                
+        // Similar to the "delete" process, but byte mutation is used instead. 
+        // Not used for mutate embedded message.
+        Mutate       ,                
+        Shuffle      ,         // Shuffle the order of the fields in a repeated field.
+        None         ,         // Do nothing.
+        END = None             // used to count the number of fieldMuationType.
+    };
+
+    /**
+     * @brief Types of crossover on field in proto3
+     * @details 
+     *    After crossover the messages, do not perform recursive crossover on this message.
+     */ 
+    enum class CrossoverType : uint8_t {
+        // 1. Replace some set fields in message1 with the fields from message2.
+        // 2. Replace some fields within a repeated field in message1 with message2.
+        Replace     ,  
+        // 1. Add some new simple fields from message2 to the corresponding unset fields in message1.
+        // 2. Add some new fields from message2 to a repeated field in message1. 
+        CrossoverAdd,     
+        None        ,  // Do nothing. But recursive crossover for embedded message types.
+        END = None     // used to count the number of crossoverType
+    };
+    using MutationBitset = bitset<static_cast<int>(FieldMuationType::END) + 1>;
+    using CrossoverBitset = bitset<static_cast<int>(CrossoverType::END) + 1>;
+    /**
+     * @brief How the traversal visits a field.
+     * @details 
+     * 1. Oneof: the whole oneof group, stored once at the position of its first field.
+     * 2. Repeated: a repeated field, embedded message elements are visited recursively.
+     * 3. Message: a singular embedded message, always visited recursively.
+     * 4. Scalar: a singular simple field or enum field.
+     */
+    enum class FieldKind : uint8_t {
+        Oneof,
+        Repeated,
+        Message,
+        Scalar
+    };
+
+    struct MessagePlan;
+
+    /**
+     * @brief Operations that may be picked for a field in one state, in bit order.
+     * @details Picking follows TryMutateField: an index in [0, count] is drawn and
+     *          the last one (index == count) means None as well.
+     */
+    template<typename Type, int N>
+    struct OpList {
+        Type ops[N];
+        int count = 0;
+        void Add(Type op) { ops[count++] = op; }
+    };
+    using MutationOps = OpList<FieldMuationType, static_cast<int>(FieldMuationType::END) + 1>;
+    using CrossoverOps = OpList<CrossoverType, static_cast<int>(CrossoverType::END) + 1>;
+
+    // Operations other than None picked so far by both the typed and the reflection path, per context.
+    uint64_t& PickedOpCount();
+
+    // Operator scheduling, see operator_scheduler.h. nullptr unless the context of the thread learns operator weights.
+    class OperatorScheduler;
+    OperatorScheduler* ActiveScheduler();
+    // One of the operations of allowed other than None, by the learned weights.
+    FieldMuationType ScheduleOp(OperatorScheduler* scheduler, const MutationOps& allowed);
+    CrossoverType ScheduleOp(OperatorScheduler* scheduler, const CrossoverOps& allowed);
+
+    template<typename Type, int N>
+    inline Type PickOp(const OpList<Type, N>& allowed) {
+        // The last index (== count) falls outside the list and means None as well.
+        int order = GetRandomIndex(allowed.count);
+        Type op = order < allowed.count ? allowed.ops[order] : Type::None;
+        if (op != Type::None) {
+            PickedOpCount()++;
+            // None is picked as often as without a scheduler, it only decides which operation is applied
+            if (OperatorScheduler* scheduler = ActiveScheduler()) op = ScheduleOp(scheduler, allowed);
+        }
+        return op;
+    }
+
+    // PickOp() for a field that has been chosen to be edited: one of the operations other than None.
+    template<typename Type, int N>
+    inline Type PickEdit(const OpList<Type, N>& allowed) {
+        // None is the last operation of the list if it is there
+        int count = allowed.count - (allowed.count && allowed.ops[allowed.count - 1] == Type::None);
+        if (!count) return Type::None;
+        PickedOpCount()++;
+        if (OperatorScheduler* scheduler = ActiveScheduler()) return ScheduleOp(scheduler, allowed);
+        return allowed.ops[GetRandomIndex(count - 1)];
+    }
+
+    /**
+     * @brief Everything the traversal needs to know about a field, computed once per descriptor.
+     */
+    struct FieldPlan {
+        const FieldDescriptor* field;
+        const OneofDescriptor* oneof;             // only set for FieldKind::Oneof
+        const MessagePlan* message_plan;          // plan of the embedded message type, nullptr for other types
+        FieldKind kind;
+        FieldDescriptor::CppType cpp_type;
+        // dense id of the field among the plans of all message types, for per-field counters (see FieldStats)
+        int id;
+        // allowed operations when the field (or oneof group) is unset / set, a repeated field only uses set_*
+        MutationOps unset_mutations;
+        MutationOps set_mutations;
+        CrossoverOps unset_crossovers;
+        CrossoverOps set_crossovers;
+    };
+
+    /**
+     * @brief Flat table of the fields of one message type, in the order of the descriptor.
+     */
+    struct MessagePlan {
+        const Descriptor* descriptor;
+        vector<FieldPlan> fields;
+        // plan of the embedded message type of every field, indexed by FieldDescriptor::index()
+        vector<const MessagePlan*> embedded;
+        const MessagePlan* Embedded(const FieldDescriptor* field) const { return embedded[field->index()]; }
+    };
+
+    using FieldMutationFn = void (*)(Message* msg, const FieldDescriptor* field, int& remain_size);
+    using FieldCrossoverFn = void (*)(Message* msg1, const Message* msg2, const FieldDescriptor* field1, 
+                                      const FieldDescriptor* field2, int& remain_size);
+
+    inline void AddRepeatedFieldFn(Message* msg, const FieldDescriptor* field, int& remain_size) {
+        AddRepeatedField(msg, field, remain_size);
+    }
+
+    /**
+     * @brief Field operations indexed by (operation, cpp_type, is_repeated).
+     *        nullptr means that the operation is not supported for that kind of field.
+     */
+    struct DispatchTable {
+        FieldMutationFn mutation[static_cast<int>(FieldMuationType::END)][FieldDescriptor::MAX_CPPTYPE + 1][2] = {};
+        FieldCrossoverFn crossover[static_cast<int>(CrossoverType::END)][FieldDescriptor::MAX_CPPTYPE + 1][2] = {};
+    };
+
+    constexpr DispatchTable BuildDispatchTable() {
+        DispatchTable t;
+        for (int type = FieldDescriptor::CPPTYPE_INT32; type <= FieldDescriptor::MAX_CPPTYPE; type++) {
+            // string is not supported
+            if (type == FieldDescriptor::CPPTYPE_STRING) continue;
+            bool is_message = type == FieldDescriptor::CPPTYPE_MESSAGE;
+            t.mutation[static_cast<int>(FieldMuationType::MutationAdd)][type][0] = AddUnsetField;
+            t.mutation[static_cast<int>(FieldMuationType::MutationAdd)][type][1] = AddRepeatedFieldFn;
+            t.mutation[static_cast<int>(FieldMuationType::Delete)][type][0]      = DeleteSetField;
+            t.mutation[static_cast<int>(FieldMuationType::Delete)][type][1]      = DeleteRepeatedField;
+            // an embedded message is only "mutated" as a oneof member, which switches the member
+            t.mutation[static_cast<int>(FieldMuationType::Mutate)][type][0]      = MutateSetField;
+            t.mutation[static_cast<int>(FieldMuationType::Mutate)][type][1]      = is_message ? nullptr : MutateRepeatedField;
+            t.mutation[static_cast<int>(FieldMuationType::Shuffle)][type][1]     = ShuffleRepeatedField;
+            t.crossover[static_cast<int>(CrossoverType::Replace)][type][0]       = ReplaceSetField;
+            t.crossover[static_cast<int>(CrossoverType::Replace)][type][1]       = ReplaceRepeatedField;
+            t.crossover[static_cast<int>(CrossoverType::CrossoverAdd)][type][0]  = CrossoverAddUnsetField;
+            t.crossover[static_cast<int>(CrossoverType::CrossoverAdd)][type][1]  = CrossoverAddRepeatedField;
+        }
+        return t;
+    }
+    inline constexpr DispatchTable kDispatchTable = BuildDispatchTable();
+
+    inline FieldMutationFn GetMutationFn(FieldMuationType type, const FieldDescriptor* field) {
+        return kDispatchTable.mutation[static_cast<int>(type)][field->cpp_type()][field->is_repeated()];
+    }
+    inline FieldCrossoverFn GetCrossoverFn(CrossoverType type, const FieldDescriptor* field) {
+        return kDispatchTable.crossover[static_cast<int>(type)][field->cpp_type()][field->is_repeated()];
+    }
+
+    /**
+     * @brief Plans of all message types reachable from the types that have been requested.
+     * @details Plans never change once built, so pointers handed out stay valid for the lifetime of the cache.
+     */
+    class MutationPlanCache {
+    public:
+        // Build (if needed) and return the plan of the message type, including all embedded types.
+        // Shared by all threads, a built plan is never changed or freed.
+        const MessagePlan* Get(const Descriptor* desc);
+
+    private:
+        const MessagePlan* Build(const Descriptor* desc);
+
+        std::mutex mutex_;
+        std::unordered_map<const Descriptor*, std::unique_ptr<MessagePlan>> plans_;
+        int next_field_id_ = 0;
+    };
+
+    MutationPlanCache* GetPlanCache();
+    // Plan lookup through the context of the calling thread, see mutator_context.h.
+    const MessagePlan* GetMessagePlan(const Descriptor* desc);
+}  // namespace protobuf_mutator
+
+#endif  // SRC_MUTATION_PLAN_H_
@@ -1,8 +1,9 @@
 #include "mutator.h"
+#include "typed_mutator.h"
+#include "value_domain.h"
+#include "field_stats.h"
 namespace protobuf_mutator {
     using std::placeholders::_1;
-    void restoreMutationBitset(MutationBitset& b) { b.reset(); b.set((int)FieldMuationType::None);}
-    void restoreCrossoverBitset(CrossoverBitset& b) { b.reset(); b.set((int)CrossoverType::None);}
     inline string DebugEnumStr(FieldMuationType type){
         switch (type){
             case FieldMuationType::MutationAdd:
@@ -55,223 +56,334 @@ namespace protobuf_mutator {
         }
     }
 
-    void Mutator::Mutate(Message* message, int& max_size) {
+    void Mutator::Mutate(Message* message, int& max_size, const FieldIndex* index) {
+        // new and mutated values stay inside the value domains of the root type, if it has any
+        DomainScope domains(*message);
+        if(Sampling()){
+            // K paths of the index instead of a walk over every field, the message is not measured again
+            if(!index || index->Root() != message->GetDescriptor()){
+                own_index_.Build(*message, sample_options_.weighting);
+                index = &own_index_;
+            }
+            int remain_size = max_size - index->RootSize();
+            MutateSampled(message, *index, sample_options_.fields, remain_size);
+            max_size = remain_size;
+            return;
+        }
         int remain_size = max_size - message->ByteSizeLong();
-        MessageMutation(message, remain_size);
+        // Generated typed mutators behave the same as the reflection path, but skip the reflection calls.
+        if(auto typed = FindTypedMutator(message->GetDescriptor()))
+            typed->mutate(message, remain_size);
+        else
+            MessageMutation(message, *GetMessagePlan(message->GetDescriptor()), remain_size);
         max_size = remain_size;
     }
 
-    void Mutator::MessageMutation(Message *msg, int& remain_size){
-        # define MUTATION_ADD     allowed_mutations.set((int)FieldMuationType::MutationAdd)
-        # define MUTATION_DELETE  allowed_mutations.set((int)FieldMuationType::Delete)
-        # define MUTATION_MUTATE  allowed_mutations.set((int)FieldMuationType::Mutate)
-        # define MUTATION_SHUFFLE allowed_mutations.set((int)FieldMuationType::Shuffle)
-        # define TRY_MUTATE_FIELD TryMutateField(msg, field, allowed_mutations, remain_size)
-        auto desc = msg->GetDescriptor();
+    void Mutator::MessageMutation(Message *msg, const MessagePlan& plan, int& remain_size){
+        // Each edit has already charged its size change to remain_size.
+        for (const auto& entry : plan.fields)
+            MutateField(msg, plan, entry, remain_size);
+    }
+
+    void Mutator::MutateField(Message *msg, const MessagePlan& plan, const FieldPlan& entry, int& remain_size){
+        # define TRY_MUTATE_FIELD(ops)      TryMutateField(msg, plan, entry, ops, remain_size)
+        # define MUTATE_EMBEDDED(f, i, p)   EditEmbeddedMessage(msg, f, i, remain_size, \
+                                                [this, sub_plan = (p)](Message* sub, int& r){ MessageMutation(sub, *sub_plan, r); })
         auto ref = msg->GetReflection();
-        auto max_size = msg->ByteSizeLong() + remain_size;
-        MutationBitset allowed_mutations;
-        restoreMutationBitset(allowed_mutations);
-        int field_count = desc->field_count();
-        for (int i = 0; i < field_count; i++) {
-            auto field = desc->field(i);
-            if (auto oneof = field->containing_oneof()) {
-                // Handle entire oneof group on the first field.
-                if (field->index_in_oneof() == 0) {
-                    const FieldDescriptor* current_field = ref->GetOneofFieldDescriptor(*msg, oneof);
-                    if(!current_field){
-                        MUTATION_ADD;
-                        TRY_MUTATE_FIELD;
-                    }else{
-                        // do not delete oneof field
-                        // MUTATION_DELETE;
-                        MUTATION_MUTATE;
-                        TRY_MUTATE_FIELD;
-                    }
-                }
-            }
-            else if (field->is_repeated()) {
-                MUTATION_ADD;
-                MUTATION_DELETE;
+        auto field = entry.field;
+        switch (entry.kind){
+            case FieldKind::Oneof:
+                if(!ref->GetOneofFieldDescriptor(*msg, entry.oneof))
+                    TRY_MUTATE_FIELD(entry.unset_mutations);
+                else
+                    TRY_MUTATE_FIELD(entry.set_mutations);
+                break;
+            case FieldKind::Repeated:
+                TRY_MUTATE_FIELD(entry.set_mutations);
                 // Embedded message should be mutated recursively
-                if(!IsMessageType(field)) MUTATION_MUTATE;
-                MUTATION_SHUFFLE;
-                TRY_MUTATE_FIELD;
-                if(IsMessageType(field)){
+                if(entry.message_plan){
                     int field_size = ref->FieldSize(*msg, field);
                     for(int i = 0; i < field_size; i++) 
-                        MessageMutation(ref->MutableRepeatedMessage(msg, field, i), remain_size);
-                }
-            }else{
-                if(IsMessageType(field))
-                    MessageMutation(ref->MutableMessage(msg, field), remain_size);
-                else if(ref->HasField(*msg, field)){
-                    MUTATION_DELETE;
-                    MUTATION_MUTATE;
-                    TRY_MUTATE_FIELD;
-                }else{
-                    MUTATION_ADD;
-                    TRY_MUTATE_FIELD;
+                        MUTATE_EMBEDDED(field, i, entry.message_plan);
                 }
-            }
-            // std::cout<<field->name()<<" "<<msg->ByteSizeLong()<<std::endl;
-            remain_size = max_size - msg->ByteSizeLong();
+                break;
+            case FieldKind::Message:
+                MUTATE_EMBEDDED(field, -1, entry.message_plan);
+                break;
+            case FieldKind::Scalar:
+                if(ref->HasField(*msg, field))
+                    TRY_MUTATE_FIELD(entry.set_mutations);
+                else
+                    TRY_MUTATE_FIELD(entry.unset_mutations);
+                break;
         }
     }
 
-    void Mutator::TryMutateField(Message* msg, const FieldDescriptor* field, MutationBitset& allowed_mutations, int& remain_size){
-        int tot = allowed_mutations.count();
-        int order = GetRandomIndex(tot);
-        int pos = allowed_mutations._Find_first();
-        for(int i = 0; i < order; i++)
-            pos = allowed_mutations._Find_next(pos);
-        restoreMutationBitset(allowed_mutations);
-        
-        FieldMuationType mutationType = (FieldMuationType)pos;
-        auto ref = msg->GetReflection();
+    void Mutator::TryMutateField(Message* msg, const MessagePlan& plan, const FieldPlan& entry, 
+                                 const MutationOps& allowed_mutations, int& remain_size){
+        FieldMuationType mutationType = PickOp(allowed_mutations);
         if(mutationType >= FieldMuationType::None) return;
+        auto field = entry.field;
         printMutation(mutationType, field, msg);
-        switch (mutationType){
-            case FieldMuationType::MutationAdd:
-                if(field->is_repeated())
-                    AddRepeatedField(msg, field, remain_size);
-                else
-                    AddUnsetField(msg, field, remain_size);
-                break;
-            case FieldMuationType::Delete:
-                if(field->is_repeated())
-                    DeleteRepeatedField(msg, field, remain_size);
-                else
-                    DeleteSetField(msg, field, remain_size);
-                break;
-            case FieldMuationType::Mutate:
-                if(field->is_repeated())
-                    MutateRepeatedField(msg, field, remain_size);
-                else{
-                    if(auto oneof = field->containing_oneof()){
-                        auto old_oneField = ref->GetOneofFieldDescriptor(*msg, oneof);
-                        int old_index = old_oneField->index_in_oneof();
-                        MutateSetField(msg, old_oneField, remain_size);
-                        // If the index does not change, then mutate the field itself 
-                        if(old_index == ref->GetOneofFieldDescriptor(*msg, oneof)->index_in_oneof() && IsMessageType(old_oneField))
-                            MessageMutation(ref->MutableMessage(msg, old_oneField), remain_size);
-                    }else
-                        MutateSetField(msg, field, remain_size);
-                }
-                break;
-            case FieldMuationType::Shuffle:
-                if(field->is_repeated())
-                    ShuffleRepeatedField(msg, field, remain_size);
-                break;
-            default:
-                break;
+        if(mutationType == FieldMuationType::Mutate && entry.kind == FieldKind::Oneof){
+            auto ref = msg->GetReflection();
+            auto old_oneField = ref->GetOneofFieldDescriptor(*msg, entry.oneof);
+            int old_index = old_oneField->index_in_oneof();
+            MutateSetField(msg, old_oneField, remain_size);
+            // If the index does not change, then mutate the field itself 
+            if(old_index == ref->GetOneofFieldDescriptor(*msg, entry.oneof)->index_in_oneof() && IsMessageType(old_oneField))
+                MUTATE_EMBEDDED(old_oneField, -1, plan.Embedded(old_oneField));
+            return;
+        }
+        if(auto mutate = GetMutationFn(mutationType, field))
+            mutate(msg, field, remain_size);
+    }
+
+    void Mutator::MutateSampled(Message* root, const FieldIndex& index, int k, int& remain_size){
+        if(index.Empty()) return;
+        sampled_sizes_.clear();
+        sampled_moved_.clear();
+        int chain[MAX_INDEX_DEPTH + 1];
+        FieldStats* stats = TracksFields() ? GetFieldStats() : nullptr;
+        for(int edits = 0, draws = 0; edits < k && draws < 2 * k; draws++){
+            const auto& site = index.site(index.Draw());
+            int depth = 0;
+            for(int node = site.node; node > 0; node = index.node(node).parent)
+                chain[depth++] = node;
+            if(!MutateAt(root, index, site, chain, depth, remain_size)) continue;
+            edits++;
+            if(stats) stats->NoteEdit(*site.entry);
         }
     }
 
+    bool Mutator::MutateAt(Message* msg, const FieldIndex& index, const FieldIndex::Site& site, const int* chain,
+                           int depth, int& remain_size){
+        if(!depth){
+            if(!MutateSite(msg, *site.entry, remain_size)) return false;
+            // a message of the field may have been added, removed or moved: the nodes below msg no longer name the
+            // messages they were indexed for, a later descent measures the ones it passes (see SampledSize())
+            if(site.entry->kind == FieldKind::Oneof || IsMessageType(site.entry->field)){
+                ForgetSampledSizes(index, site.node);
+                if(std::find(sampled_moved_.begin(), sampled_moved_.end(), site.node) == sampled_moved_.end())
+                    sampled_moved_.push_back(site.node);
+            }
+            return true;
+        }
+        int node_id = chain[depth - 1], old_size = 0;
+        const auto& node = index.node(node_id);
+        auto ref = msg->GetReflection();
+        // an earlier edit of this mutation may have deleted the element or switched the oneof member
+        if(node.index >= 0 ? node.index >= ref->FieldSize(*msg, node.field)
+                           : node.field->containing_oneof() && !ref->HasField(*msg, node.field))
+            return false;
+        bool edited = false;
+        // charges the size change of the embedded message to remain_size like the walk does
+        EditEmbeddedMessage(msg, node.field, node.index, remain_size, [&](Message* sub, int& r){
+            int before = r;
+            edited = MutateAt(sub, index, site, chain, depth - 1, r);
+            SetSampledSize(node_id, old_size + before - r);
+        }, [&](const Message* sub){ return old_size = SampledSize(index, node_id, sub); });
+        return edited;
+    }
+
+    int Mutator::SampledSize(const FieldIndex& index, int node, const Message* msg) const {
+        for(const auto& entry : sampled_sizes_)
+            if(entry.first == node) return entry.second;
+        // only this message is measured, the caller records its size with SetSampledSize()
+        for(int n = index.node(node).parent; n >= 0; n = index.node(n).parent)
+            if(std::find(sampled_moved_.begin(), sampled_moved_.end(), n) != sampled_moved_.end())
+                return GetMessageSize(msg);
+        return index.node(node).size;
+    }
+
+    void Mutator::SetSampledSize(int node, int size) {
+        for(auto& entry : sampled_sizes_)
+            if(entry.first == node){
+                entry.second = size;
+                return;
+            }
+        sampled_sizes_.push_back({node, size});
+    }
+
+    void Mutator::ForgetSampledSizes(const FieldIndex& index, int node) {
+        auto below = [&](int n){
+            for(n = index.node(n).parent; n >= 0; n = index.node(n).parent)
+                if(n == node) return true;
+            return false;
+        };
+        sampled_sizes_.erase(std::remove_if(sampled_sizes_.begin(), sampled_sizes_.end(),
+                                            [&](const std::pair<int, int>& entry){ return below(entry.first); }),
+                             sampled_sizes_.end());
+    }
+
+    bool Mutator::MutateSite(Message* msg, const FieldPlan& entry, int& remain_size){
+        auto ref = msg->GetReflection();
+        auto field = entry.field;
+        const FieldDescriptor* member = nullptr;
+        const MutationOps* allowed_mutations = &entry.set_mutations;
+        if(entry.kind == FieldKind::Oneof){
+            if(!(member = ref->GetOneofFieldDescriptor(*msg, entry.oneof)))
+                allowed_mutations = &entry.unset_mutations;
+        }else if(entry.kind == FieldKind::Scalar && !ref->HasField(*msg, field))
+            allowed_mutations = &entry.unset_mutations;
+        FieldMuationType mutationType = PickEdit(*allowed_mutations);
+        if(mutationType >= FieldMuationType::None) return false;
+        printMutation(mutationType, field, msg);
+        // the fields of the member are sites of their own, so a oneof only switches its member
+        if(mutationType == FieldMuationType::Mutate && member)
+            MutateSetField(msg, member, remain_size);
+        else if(auto mutate = GetMutationFn(mutationType, field))
+            mutate(msg, field, remain_size);
+        return true;
+    }
+
     void Mutator::Crossover(Message* message1, const Message* message2, int& max_size) {
         int remain_size = max_size - message1->ByteSizeLong();
-        MessageCrossover(message1, message2, remain_size);
+        // a splice does not grow a repeated field beyond its domain
+        DomainScope domains(*message1);
+        if(auto typed = FindTypedMutator(message1->GetDescriptor()))
+            typed->crossover(message1, message2, remain_size);
+        else
+            MessageCrossover(message1, message2, *GetMessagePlan(message1->GetDescriptor()), remain_size);
         max_size = remain_size;       
     }
 
-    void Mutator::MessageCrossover(Message* msg1, const Message* msg2, int& remain_size){
-        # define CROSSOVER_REPLACE              allowed_crossovers.set((int)CrossoverType::Replace)
-        # define CROSSOVER_ADD                  allowed_crossovers.set((int)CrossoverType::CrossoverAdd)
-        # define TRY_CROSSOVER_FIELD(f1, f2)    TryCrossoverField(msg1, msg2, f1, f2, allowed_crossovers, remain_size)
-        # define NO_CROSSOVER                   allowed_crossovers.test((int)CrossoverType::None)
-        auto desc1 = msg1->GetDescriptor();
-        auto desc2 = msg2->GetDescriptor();
+    void Mutator::MessageCrossover(Message* msg1, const Message* msg2, const MessagePlan& plan, int& remain_size){
+        for (const auto& entry : plan.fields)
+            CrossoverField(msg1, msg2, plan, entry, remain_size);
+    }
+
+    void Mutator::CrossoverField(Message* msg1, const Message* msg2, const MessagePlan& plan, const FieldPlan& entry, int& remain_size){
+        # define TRY_CROSSOVER_FIELD(f1, f2, ops)   TryCrossoverField(msg1, msg2, f1, f2, ops, remain_size)
+        # define CROSSOVER_EMBEDDED(f, i, sub2, p)  EditEmbeddedMessage(msg1, f, i, remain_size, \
+                                                    [this, other = (sub2), sub_plan = (p)](Message* sub1, int& r){ MessageCrossover(sub1, other, *sub_plan, r); })
         auto ref1 = msg1->GetReflection();
         auto ref2 = msg2->GetReflection();
-        auto max_size = msg1->ByteSizeLong() + remain_size;
-        CrossoverBitset allowed_crossovers;
-        int field_count = desc1->field_count();
-        for (int i = 0; i < field_count; i++) {
-            restoreCrossoverBitset(allowed_crossovers);
-            auto field1 = desc1->field(i);
-            auto field2 = desc2->field(i);
-            if (auto oneof1 = field1->containing_oneof()) {
-                auto oneof2 = field2->containing_oneof();
-                // Handle entire oneof group on the first field.
-                if (field1->index_in_oneof() == 0) {
-                    const FieldDescriptor* current_field1 = ref1->GetOneofFieldDescriptor(*msg1, oneof1);
-                    const FieldDescriptor* current_field2 = ref2->GetOneofFieldDescriptor(*msg2, oneof2);
-                    if(!current_field1){
-                        if(current_field2){
-                            CROSSOVER_ADD;
-                            TRY_CROSSOVER_FIELD(field1, current_field2);
-                        }
-                    }else if(current_field2){
-                        CROSSOVER_REPLACE;
-                        TRY_CROSSOVER_FIELD(current_field1, current_field2);
-                        // recursive crossover for embedded message types.
-                        if(NO_CROSSOVER && IsMessageType(current_field1) && 
-                            current_field1->index_in_oneof() == current_field2->index_in_oneof())
-                            MessageCrossover(ref1->MutableMessage(msg1, current_field1), &ref2->GetMessage(*msg2, current_field2), remain_size);
-                    }
-                }
+        // message1 and message2 have the same type, so a field of the plan is valid for both of them.
+        auto field = entry.field;
+        switch (entry.kind){
+            case FieldKind::Oneof:{
+                const FieldDescriptor* current_field1 = ref1->GetOneofFieldDescriptor(*msg1, entry.oneof);
+                const FieldDescriptor* current_field2 = ref2->GetOneofFieldDescriptor(*msg2, entry.oneof);
+                if(!current_field2) break;
+                if(!current_field1)
+                    TRY_CROSSOVER_FIELD(field, current_field2, entry.unset_crossovers);
+                // recursive crossover for embedded message types.
+                else if(TRY_CROSSOVER_FIELD(current_field1, current_field2, entry.set_crossovers) == CrossoverType::None && 
+                        IsMessageType(current_field1) && current_field1->index_in_oneof() == current_field2->index_in_oneof())
+                    CROSSOVER_EMBEDDED(current_field1, -1, &ref2->GetMessage(*msg2, current_field2), plan.Embedded(current_field1));
+                break;
             }
-            else if (field1->is_repeated()) {
-                CROSSOVER_ADD;
-                CROSSOVER_REPLACE;
-                TRY_CROSSOVER_FIELD(field1, field2);
-                if(NO_CROSSOVER && IsMessageType(field1)){
-                    int field_size = min(ref1->FieldSize(*msg1, field1), ref2->FieldSize(*msg2, field2));
+            case FieldKind::Repeated:
+                if(TRY_CROSSOVER_FIELD(field, field, entry.set_crossovers) == CrossoverType::None && entry.message_plan){
+                    int field_size = min(ref1->FieldSize(*msg1, field), ref2->FieldSize(*msg2, field));
                     for(int i = 0; i < field_size; i++)
-                        MessageCrossover(ref1->MutableRepeatedMessage(msg1, field1, i), 
-                                        &ref2->GetRepeatedMessage(*msg2, field2, i), remain_size);
+                        CROSSOVER_EMBEDDED(field, i, &ref2->GetRepeatedMessage(*msg2, field, i), entry.message_plan);
                 }
-            }else{
-                if(IsMessageType(field1)){
-                    MessageCrossover(ref1->MutableMessage(msg1, field1), &ref2->GetMessage(*msg2, field2), remain_size);
-                }else if(ref2->HasField(*msg2, field2)){
-                    if(ref1->HasField(*msg1, field1)){
-                        CROSSOVER_REPLACE;
-                        TRY_CROSSOVER_FIELD(field1, field2);
-                    }else{
-                        CROSSOVER_ADD;
-                        TRY_CROSSOVER_FIELD(field1, field2);
-                    }
-                }
-            }
-            remain_size = max_size - msg1->ByteSizeLong();
+                break;
+            case FieldKind::Message:
+                CROSSOVER_EMBEDDED(field, -1, &ref2->GetMessage(*msg2, field), entry.message_plan);
+                break;
+            case FieldKind::Scalar:
+                if(!ref2->HasField(*msg2, field)) break;
+                if(ref1->HasField(*msg1, field))
+                    TRY_CROSSOVER_FIELD(field, field, entry.set_crossovers);
+                else
+                    TRY_CROSSOVER_FIELD(field, field, entry.unset_crossovers);
+                break;
         }
     }
 
-    void Mutator::TryCrossoverField(Message* msg1, const Message* msg2, const FieldDescriptor* field1, const FieldDescriptor* field2, 
-                                    CrossoverBitset& allowed_crossovers, int& remain_size){
-        int tot = allowed_crossovers.count();
-        int order = GetRandomIndex(tot);
-        int pos = allowed_crossovers._Find_first();
-        for(int i = 0; i < order; i++)
-            pos = allowed_crossovers._Find_next(pos);
-        CrossoverType crossoverType = (CrossoverType)pos;
+    CrossoverType Mutator::TryCrossoverField(Message* msg1, const Message* msg2, const FieldDescriptor* field1, const FieldDescriptor* field2, 
+                                    const CrossoverOps& allowed_crossovers, int& remain_size){
+        CrossoverType crossoverType = PickOp(allowed_crossovers);
         if(crossoverType >= CrossoverType::None)
-            return;
-        auto ref1 = msg1->GetReflection();
-        auto ref2 = msg2->GetReflection();
+            return CrossoverType::None;
         printCrossover(crossoverType, field1, msg1);
-        allowed_crossovers.reset();
-        switch (crossoverType){
-            case CrossoverType::Replace:
-                if(field1->is_repeated())
-                    ReplaceRepeatedField(msg1, msg2, field1, field2, remain_size);
-                else
-                    ReplaceSetField(msg1, msg2, field1, field2, remain_size);
-                allowed_crossovers.set((int)CrossoverType::CrossoverAdd);
-                break;
-            case CrossoverType::CrossoverAdd:
-                if(field1->is_repeated())
-                    CrossoverAddRepeatedField(msg1, msg2, field1, field2, remain_size);
-                else
-                    CrossoverAddUnsetField(msg1, msg2, field1, field2, remain_size);
-                allowed_crossovers.set((int)CrossoverType::Replace);
-                break;
-            default:
-                allowed_crossovers.set((int)CrossoverType::None);
-                break;
-        }        
+        if(auto crossover = GetCrossoverFn(crossoverType, field1))
+            crossover(msg1, msg2, field1, field2, remain_size);
+        return crossoverType;
     }
     
+    bool Mutator::SpliceDonor(Message* message, const DonorPool& pool, int& max_size) {
+        if(pool.empty()) return false;
+        splice_walk_.clear();
+        splice_sites_ = 0;
+        FindSpliceSite(*message, pool);
+        if(!splice_sites_) return false;
+        int remain_size = max_size - message->ByteSizeLong();
+        // an appended donor does not grow a repeated field beyond its domain
+        DomainScope domains(*message);
+        bool spliced = SpliceAt(message, pool, 0, remain_size);
+        max_size = remain_size;
+        return spliced;
+    }
+
+    void Mutator::FindSpliceSite(const Message& msg, const DonorPool& pool) {
+        auto desc = msg.GetDescriptor();
+        auto ref = msg.GetReflection();
+        for(int i = 0; i < desc->field_count(); i++){
+            auto field = desc->field(i);
+            if(!IsMessageType(field)) continue;
+            bool donors = pool.Has(field->message_type());
+            if(field->is_repeated()){
+                int size = ref->FieldSize(msg, field);
+                if(donors) NoteSpliceSite(field, size);
+                for(int j = 0; j < size; j++){
+                    if(donors) NoteSpliceSite(field, j);
+                    splice_walk_.push_back({field, j});
+                    FindSpliceSite(ref->GetRepeatedMessage(msg, field, j), pool);
+                    splice_walk_.pop_back();
+                }
+            }else{
+                if(donors) NoteSpliceSite(field, -1);
+                if(!ref->HasField(msg, field)) continue;
+                splice_walk_.push_back({field, -1});
+                FindSpliceSite(ref->GetMessage(msg, field), pool);
+                splice_walk_.pop_back();
+            }
+        }
+    }
+
+    void Mutator::NoteSpliceSite(const FieldDescriptor* field, int index) {
+        // the k-th site replaces the one drawn so far with probability 1/k
+        if(GetRandomIndex(splice_sites_++)) return;
+        splice_site_ = splice_walk_;
+        splice_site_.push_back({field, index});
+    }
+
+    bool Mutator::SpliceAt(Message* msg, const DonorPool& pool, size_t depth, int& remain_size) {
+        auto field = splice_site_[depth].first;
+        int index = splice_site_[depth].second;
+        if(depth + 1 < splice_site_.size()){
+            bool spliced = false;
+            EditEmbeddedMessage(msg, field, index, remain_size, [&](Message* sub, int& r){
+                spliced = SpliceAt(sub, pool, depth + 1, r);
+            });
+            return spliced;
+        }
+        const Message* donor = pool.Draw(field->message_type());
+        int donor_size = donor->ByteSizeLong();
+        auto ref = msg->GetReflection();
+        if(!field->is_repeated()){
+            int delta = EmbeddedOverhead(field, donor_size) + donor_size - SingularFieldSize(msg, field);
+            if(!FitsBudget(delta, remain_size)) return false;
+            ref->MutableMessage(msg, field)->CopyFrom(*donor);
+            remain_size -= delta;
+        }else if(index < ref->FieldSize(*msg, field)){
+            int delta = VarintSize(donor_size) + donor_size - RepeatedElementSize(msg, field, index);
+            if(!FitsBudget(delta, remain_size)) return false;
+            ref->MutableRepeatedMessage(msg, field, index)->CopyFrom(*donor);
+            remain_size -= delta;
+        }else{
+            FieldDomain domain;
+            int delta = EmbeddedOverhead(field, donor_size) + donor_size;
+            if(!RoomInDomain(FindFieldDomain(field, &domain), index) || !FitsBudget(delta, remain_size)) return false;
+            ref->AddMessage(msg, field)->CopyFrom(*donor);
+            remain_size -= delta;
+        }
+        return true;
+    }
+
     void Mutator::Seed(uint32_t value) {getRandEngine()->Seed(value); }
 }  // namespace protobuf_mutator
@@ -9,52 +9,12 @@
 #include <iomanip>
 #include "proto_util.h"
 #include "mutate_util.h"
+#include "mutation_plan.h"
+#include "field_index.h"
+#include "donor_pool.h"
 
 namespace protobuf_mutator {
 
-    /**
-     * @brief Types of mutation on field in proto3
-     * @details 
-     * 1. Field include simple field, enum field, oneof field and repeated field.
-     * 2. Simple field, enum field, oneof field need to be checked whether they are set or unset.
-     *    Unset for simple field: has_xxx() returns false and DebugString() shows nothing.
-     * 3. An optional field is considered unset when it has no value, 
-     *    while a singular field is considered unset when it has the default value. 
-     * 4. Oneof field needs to be specially handled, and it can't be repeated.
-     */
-    enum class FieldMuationType : uint8_t {
-        // 1. Add an unset field with random values.
-        // 2. Add some new fields (including simple fields, enums, oneof) with random values to a repeated field.
-        //    The total length of the newly added fields will not exceed MAX_NEW_REPEATED_SIZE.
-        MutationAdd  ,                
-        // 1. Deletes a set field.
-        // 2. Iterate each field in a repeated field and delete it with a certain probability
-        Delete       ,                
-        // Similar to the "delete" process, but byte mutation is used instead. 
-        // Not used for mutate embedded message.
-        Mutate       ,                
-        Shuffle      ,         // Shuffle the order of the fields in a repeated field.
-        None         ,         // Do nothing.
-        END = None             // used to count the number of fieldMuationType.
-    };
-
-    /**
-     * @brief Types of crossover on field in proto3
-     * @details 
-     *    After crossover the messages, do not perform recursive crossover on this message.
-     */ 
-    enum class CrossoverType : uint8_t {
-        // 1. Replace some set fields in message1 with the fields from message2.
-        // 2. Replace some fields within a repeated field in message1 with message2.
-        Replace     ,  
-        // 1. Add some new simple fields from message2 to the corresponding unset fields in message1.
-        // 2. Add some new fields from message2 to a repeated field in message1. 
-        CrossoverAdd,     
-        None        ,  // Do nothing. But recursive crossover for embedded message types.
-        END = None     // used to count the number of crossoverType
-    };
-    using MutationBitset = bitset<static_cast<int>(FieldMuationType::END) + 1>;
-    using CrossoverBitset = bitset<static_cast<int>(CrossoverType::END) + 1>;
     class Mutator {
     public:
         // seed: value to initialize random number generator.
@@ -68,8 +28,11 @@ namespace protobuf_mutator {
          * @brief Mutate a message, and the result size does not exceed max_size
          * @details Three possible operations can be performed: AddDelete, Mutate and Shuffle. 
          *          Refer to the definition of FieldMuationType.
+         *          In sampled mode (SampleOptions::fields = K > 0) only K paths of index are edited. index must have
+         *          been built from message as it is now or from the parent it is an unmodified copy of, it is built
+         *          from message if it is nullptr.
          */
-        void Mutate(Message* message, int& max_size);
+        void Mutate(Message* message, int& max_size, const FieldIndex* index = nullptr);
 
         /**
          * @brief Crossover message1 and message2, and save the resulting message in message1.
@@ -79,12 +42,62 @@ namespace protobuf_mutator {
          */
         void Crossover(Message* message1, const Message* message2, int& max_size);
 
+        /**
+         * @brief Splice a donor of pool into message, the result size does not exceed max_size.
+         * @details The site is drawn uniformly among the embedded messages of message whose type has donors, set
+         *          or not, and the ends of its repeated fields of such types. A donor of the type replaces the
+         *          message at the site or is appended. Returns false if nothing was spliced.
+         */
+        bool SpliceDonor(Message* message, const DonorPool& pool, int& max_size);
+
+        // Reflection path for one field (or oneof group) of the plan, 
+        // also used by the typed mutators for the fields they do not handle.
+        void MutateField(Message* msg, const MessagePlan& plan, const FieldPlan& entry, int& remain_size);
+        void CrossoverField(Message* msg1, const Message* msg2, const MessagePlan& plan, const FieldPlan& entry, int& remain_size);
+
+        const SampleOptions& GetSampleOptions() const { return sample_options_; }
+        void SetSampleOptions(const SampleOptions& options) { sample_options_ = options; }
+        bool Sampling() const { return sample_options_.fields > 0; }
+        // Sampled mode draws by SampleWeighting::Productive, its edits and the new queue entries feed FieldStats.
+        bool TracksFields() const { return Sampling() && sample_options_.weighting == SampleWeighting::Productive; }
+
     private:
-        void MessageMutation(Message* msg, int& remain_size);
-        void TryMutateField(Message* msg, const FieldDescriptor* field, MutationBitset& allowed_mutations, int& remain_size);
-        void MessageCrossover(Message* msg1, const Message* msg2, int& remain_size);
-        void TryCrossoverField(Message* msg1, const Message* msg2, const FieldDescriptor* field1, const FieldDescriptor* field2, CrossoverBitset& allowed_crossovers, int& remain_size);
+        void MessageMutation(Message* msg, const MessagePlan& plan, int& remain_size);
+        void TryMutateField(Message* msg, const MessagePlan& plan, const FieldPlan& entry, const MutationOps& allowed_mutations, int& remain_size);
+        void MessageCrossover(Message* msg1, const Message* msg2, const MessagePlan& plan, int& remain_size);
+        // Sampled mode: K draws of index, a path an earlier edit has removed is drawn again (at most 2K draws).
+        void MutateSampled(Message* root, const FieldIndex& index, int k, int& remain_size);
+        // Descend along chain (the nodes of the site, leaf first) and edit the site, false if nothing was edited.
+        bool MutateAt(Message* msg, const FieldIndex& index, const FieldIndex::Site& site, const int* chain, int depth, int& remain_size);
+        bool MutateSite(Message* msg, const FieldPlan& entry, int& remain_size);
+        // Size of msg, the embedded message of node, see sampled_sizes_.
+        int SampledSize(const FieldIndex& index, int node, const Message* msg) const;
+        void SetSampledSize(int node, int size);
+        // Drop the sizes of the nodes below node, their messages may have been replaced.
+        void ForgetSampledSizes(const FieldIndex& index, int node);
+        // Returns the crossover that has been performed, None if nothing happened.
+        CrossoverType TryCrossoverField(Message* msg1, const Message* msg2, const FieldDescriptor* field1, const FieldDescriptor* field2, const CrossoverOps& allowed_crossovers, int& remain_size);
+        // Reservoir sampling of the splice sites of msg into splice_site_, splice_walk_ is the path to msg.
+        void FindSpliceSite(const Message& msg, const DonorPool& pool);
+        void NoteSpliceSite(const FieldDescriptor* field, int index);
+        // Descend along splice_site_ from depth and splice a donor at its end.
+        bool SpliceAt(Message* msg, const DonorPool& pool, size_t depth, int& remain_size);
+
+        SampleOptions sample_options_ = SampleOptions::FromEnv();
+        // index of the messages Mutate() is called without one for
+        FieldIndex own_index_;
+        // Sizes of the embedded messages an edit of the current sampled mutation has changed or measured, by node.
+        // Any other message still has the size it had in the index, unless a node above it is in sampled_moved_
+        // (an edit has added, removed or moved messages there): then a descent measures that message alone, once.
+        // So an edit never measures more than the messages on its path.
+        vector<std::pair<int, int>> sampled_sizes_;
+        vector<int> sampled_moved_;
+        // (field, element index or -1) from the root; the last step of a site may be the end of a repeated field
+        vector<std::pair<const FieldDescriptor*, int>> splice_walk_, splice_site_;
+        int splice_sites_ = 0;
     };
+
+    Mutator* GetMutator();
 }  // namespace protobuf_mutator
 
 #endif  // SRC_MUTATOR_H_
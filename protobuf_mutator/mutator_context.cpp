@@ -0,0 +1,55 @@
+#include "mutator_context.h"
+
+namespace protobuf_mutator {
+    namespace {
+        // initial-exec: the mutator is usually a dlopen()ed library, a general-dynamic access would call
+        // __tls_get_addr on every random number.
+        __attribute__((tls_model("initial-exec"))) thread_local MutatorContext* bound_context = nullptr;
+
+        MutatorContext* ThreadContext() {
+            thread_local MutatorContext context;
+            return &context;
+        }
+    }
+
+    MutatorContext* GetContext() {
+        if (MutatorContext* context = bound_context) return context;
+        return bound_context = ThreadContext();
+    }
+
+    MutatorContext* BindContext(MutatorContext* context) {
+        MutatorContext* previous = bound_context;
+        bound_context = context;
+        return previous;
+    }
+
+    RandomEngine* getRandEngine() { return &GetContext()->rng; }
+    Mutator* GetMutator() { return &GetContext()->mutator; }
+    LastMutationCache* GetCache() { return &GetContext()->last_mutation; }
+    ParsedMessageCache* GetParseCache() { return &GetContext()->parse_cache; }
+    TraceLogger* GetTraceLogger() { return &GetContext()->trace; }
+    uint64_t& PickedOpCount() { return GetContext()->picked_ops; }
+    OperatorScheduler* GetScheduler() { return &GetContext()->scheduler; }
+    FieldStats* GetFieldStats() { return &GetContext()->field_stats; }
+
+    OperatorScheduler* ActiveScheduler() {
+        OperatorScheduler* scheduler = &GetContext()->scheduler;
+        return scheduler->enabled() ? scheduler : nullptr;
+    }
+
+    const MessagePlan* GetMessagePlan(const Descriptor* desc) {
+        auto& plans = GetContext()->plans;
+        auto it = plans.find(desc);
+        if (it != plans.end()) return it->second;
+        return plans[desc] = GetPlanCache()->Get(desc);
+    }
+
+    ActiveDomains* GetActiveDomains() { return &GetContext()->domains; }
+
+    const ValueDomainTable* GetValueDomains(const Descriptor* root) {
+        auto& tables = GetContext()->domain_tables;
+        auto it = tables.find(root);
+        if (it != tables.end()) return it->second;
+        return tables[root] = FindValueDomains(root);
+    }
+}  // namespace protobuf_mutator
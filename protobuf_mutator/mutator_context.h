@@ -0,0 +1,56 @@
+#ifndef SRC_MUTATOR_CONTEXT_H_
+#define SRC_MUTATOR_CONTEXT_H_
+
+#include "mutator.h"
+#include "trace_logger.h"
+#include "value_domain.h"
+#include "operator_scheduler.h"
+#include "field_stats.h"
+
+namespace protobuf_mutator {
+    /**
+     * @brief All state a mutation changes besides the messages themselves.
+     * @details One context per mutator instance. The entry points of an instance bind its context to the
+     *          calling thread with ContextScope, and getRandEngine(), GetMutator(), GetCache(), GetParseCache(),
+     *          GetTraceLogger(), PickedOpCount(), GetMessagePlan(), GetValueDomains(), GetActiveDomains(), GetScheduler(), ActiveScheduler() and GetFieldStats() all resolve to the context of their thread.
+     *          A thread that never binds one gets a context of its own, so two threads never share state.
+     */
+    class MutatorContext {
+    public:
+        MutatorContext() = default;
+        MutatorContext(const MutatorContext&) = delete;
+        MutatorContext& operator=(const MutatorContext&) = delete;
+
+        RandomEngine rng;
+        Mutator mutator;
+        LastMutationCache last_mutation;
+        ParsedMessageCache parse_cache;
+        TraceLogger trace;
+        uint64_t picked_ops = 0;
+        // Plans are built once per process and never change, this is a lock-free view on the shared cache.
+        std::unordered_map<const Descriptor*, const MessagePlan*> plans;
+        // Same for the registered value domains, a root type without a table is cached as nullptr.
+        std::unordered_map<const Descriptor*, const ValueDomainTable*> domain_tables;
+        ActiveDomains domains;
+        OperatorScheduler scheduler;
+        FieldStats field_stats;
+    };
+
+    // The context bound to the calling thread.
+    MutatorContext* GetContext();
+    // Bind context to the calling thread (nullptr for the thread's own one), returns the one bound before.
+    MutatorContext* BindContext(MutatorContext* context);
+
+    class ContextScope {
+    public:
+        explicit ContextScope(MutatorContext* context) : previous_(BindContext(context)) {}
+        ContextScope(const ContextScope&) = delete;
+        ContextScope& operator=(const ContextScope&) = delete;
+        ~ContextScope() { BindContext(previous_); }
+
+    private:
+        MutatorContext* previous_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // SRC_MUTATOR_CONTEXT_H_
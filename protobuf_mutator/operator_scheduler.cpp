@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include "operator_scheduler.h"
+
+namespace protobuf_mutator {
+    namespace {
+        const int kArmCounts[OPERATOR_GROUPS] = {2, static_cast<int>(FieldMuationType::END), static_cast<int>(CrossoverType::END)};
+        const char* const kGroupNames[OPERATOR_GROUPS] = {"stage", "mutation", "crossover"};
+        const char* const kArmNames[OPERATOR_GROUPS][MAX_ALIAS_SIZE] = {
+            {"Mutate", "Crossover"},
+            {"MutationAdd", "Delete", "Mutate", "Shuffle"},
+            {"Replace", "CrossoverAdd"},
+        };
+
+        // standard normal, Box-Muller
+        double NormalValue() {
+            double u1 = 1.0 - getRandEngine()->UniformDouble(), u2 = getRandEngine()->UniformDouble();
+            return std::sqrt(-2.0 * std::log(u1)) * std::cos(2 * M_PI * u2);
+        }
+
+        // Gamma(shape, 1) for shape >= 1, Marsaglia and Tsang
+        double GammaValue(double shape) {
+            double d = shape - 1.0 / 3, c = 1 / std::sqrt(9 * d);
+            while (true) {
+                double x = NormalValue(), v = 1 + c * x;
+                if (v <= 0) continue;
+                v = v * v * v;
+                double u = 1.0 - getRandEngine()->UniformDouble();
+                if (std::log(u) < 0.5 * x * x + d - d * v + d * std::log(v)) return d * v;
+            }
+        }
+
+        double BetaValue(double a, double b) {
+            double x = GammaValue(a), y = GammaValue(b);
+            return x / (x + y);
+        }
+    }
+
+    void AliasTable::Build(const uint8_t* values, const double* weights, int n) {
+        n_ = std::min(std::max(n, 0), MAX_ALIAS_SIZE);
+        n = n_;
+        if (!n) {
+            // an empty table always draws 0
+            prob_[0] = 1;
+            value_[0] = alias_[0] = 0;
+            return;
+        }
+        double sum = 0;
+        for (int i = 0; i < n; i++) sum += weights[i];
+        // all weights 0: draw uniformly
+        bool uniform = !(sum > 0);
+        // Vose: scaled weights below 1 are topped up by one above 1
+        double scaled[MAX_ALIAS_SIZE];
+        int small[MAX_ALIAS_SIZE], large[MAX_ALIAS_SIZE], small_count = 0, large_count = 0;
+        for (int i = 0; i < n; i++) {
+            value_[i] = alias_[i] = values[i];
+            scaled[i] = uniform ? 1 : weights[i] * n / sum;
+            if (scaled[i] < 1) small[small_count++] = i;
+            else large[large_count++] = i;
+        }
+        while (small_count && large_count) {
+            int s = small[--small_count], l = large[large_count - 1];
+            prob_[s] = scaled[s];
+            alias_[s] = values[l];
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large_count--;
+                small[small_count++] = l;
+            }
+        }
+        // what is left is 1 up to rounding
+        while (large_count) prob_[large[--large_count]] = 1;
+        while (small_count) prob_[small[--small_count]] = 1;
+    }
+
+    OperatorScheduler::OperatorScheduler() {
+        for (int g = 0; g < OPERATOR_GROUPS; g++)
+            for (int a = 0; a < kArmCounts[g]; a++)
+                arms_[g][a].weight = 1.0 / kArmCounts[g];
+        // the split of MutationOrCrossoverOnProtobuf() until the first epoch
+        arms_[static_cast<int>(OperatorGroup::Stage)][0].weight = 6.0 / 11;
+        arms_[static_cast<int>(OperatorGroup::Stage)][1].weight = 5.0 / 11;
+        BuildTables();
+    }
+
+    bool OperatorScheduler::StartFromEnv() {
+        const char* mode = getenv(SCHEDULE_ENV);
+        if (!mode || strcmp(mode, "bandit")) return false;
+        const char* stats_path = getenv(SCHEDULE_STATS_ENV);
+        Enable(stats_path ? stats_path : "");
+        return true;
+    }
+
+    void OperatorScheduler::Enable(const std::string& stats_path) {
+        enabled_ = true;
+        stats_path_ = stats_path;
+    }
+
+    int OperatorScheduler::ArmCount(OperatorGroup group) { return kArmCounts[static_cast<int>(group)]; }
+
+    const char* OperatorScheduler::ArmName(OperatorGroup group, int arm) {
+        return kArmNames[static_cast<int>(group)][arm];
+    }
+
+    void OperatorScheduler::EndMutant() {
+        for (int g = 0; g < OPERATOR_GROUPS; g++)
+            for (int a = 0; a < kArmCounts[g]; a++)
+                arms_[g][a].trials += chain_.count[g][a] > 0;
+        last_chain_ = chain_;
+        last_valid_ = true;
+        if (++stats_.mutants % SCHEDULE_EPOCH == 0) Update();
+    }
+
+    bool OperatorScheduler::Credit() {
+        if (!last_valid_) return false;
+        for (int g = 0; g < OPERATOR_GROUPS; g++)
+            for (int a = 0; a < kArmCounts[g]; a++)
+                arms_[g][a].credits += last_chain_.count[g][a] > 0;
+        // a mutant is credited once, even if AFL++ reports it again
+        last_valid_ = false;
+        stats_.credited++;
+        return true;
+    }
+
+    void OperatorScheduler::Update() {
+        for (int g = 0; g < OPERATOR_GROUPS; g++) {
+            int n = kArmCounts[g];
+            double theta[MAX_ALIAS_SIZE], sum = 0;
+            for (int a = 0; a < n; a++) {
+                const Arm& arm = arms_[g][a];
+                sum += theta[a] = BetaValue(1 + arm.credits, 1 + std::max(arm.trials - arm.credits, 0.0));
+            }
+            for (int a = 0; a < n; a++) {
+                Arm& arm = arms_[g][a];
+                arm.weight = (1 - SCHEDULE_EXPLORATION) * theta[a] / sum + SCHEDULE_EXPLORATION / n;
+                arm.trials *= SCHEDULE_DECAY;
+                arm.credits *= SCHEDULE_DECAY;
+            }
+        }
+        BuildTables();
+        stats_.epochs++;
+        WriteStats();
+    }
+
+    void OperatorScheduler::WriteStats() const {
+        if (stats_path_.empty()) return;
+        std::ofstream out(stats_path_, std::ios::trunc);
+        out << Describe();
+    }
+
+    void OperatorScheduler::BuildTables() {
+        for (int g = 0; g < OPERATOR_GROUPS; g++) {
+            int n = kArmCounts[g];
+            for (uint32_t mask = 1; mask < (1u << n); mask++) {
+                uint8_t values[MAX_ALIAS_SIZE];
+                double weights[MAX_ALIAS_SIZE];
+                int count = 0;
+                for (int a = 0; a < n; a++)
+                    if (mask & (1u << a)) {
+                        values[count] = a;
+                        weights[count++] = arms_[g][a].weight;
+                    }
+                tables_[g][mask].Build(values, weights, count);
+            }
+        }
+    }
+
+    std::string OperatorScheduler::Describe() const {
+        std::ostringstream out;
+        out << "mutants " << stats_.mutants << " credited " << stats_.credited << " epochs " << stats_.epochs << "\n";
+        char line[128];
+        snprintf(line, sizeof(line), "%-10s %-13s %12s %10s %8s\n", "group", "operator", "trials", "credits", "weight");
+        out << line;
+        for (int g = 0; g < OPERATOR_GROUPS; g++)
+            for (int a = 0; a < kArmCounts[g]; a++) {
+                const Arm& arm = arms_[g][a];
+                snprintf(line, sizeof(line), "%-10s %-13s %12.1f %10.1f %8.4f\n", kGroupNames[g], kArmNames[g][a],
+                         arm.trials, arm.credits, arm.weight);
+                out << line;
+            }
+        return out.str();
+    }
+
+    FieldMuationType ScheduleOp(OperatorScheduler* scheduler, const MutationOps& allowed) {
+        uint32_t mask = 0;
+        for (int i = 0; i < allowed.count; i++)
+            if (allowed.ops[i] != FieldMuationType::None) mask |= 1u << static_cast<int>(allowed.ops[i]);
+        return static_cast<FieldMuationType>(scheduler->Pick(OperatorGroup::Mutation, mask));
+    }
+
+    CrossoverType ScheduleOp(OperatorScheduler* scheduler, const CrossoverOps& allowed) {
+        uint32_t mask = 0;
+        for (int i = 0; i < allowed.count; i++)
+            if (allowed.ops[i] != CrossoverType::None) mask |= 1u << static_cast<int>(allowed.ops[i]);
+        return static_cast<CrossoverType>(scheduler->Pick(OperatorGroup::Crossover, mask));
+    }
+}  // namespace protobuf_mutator
@@ -0,0 +1,139 @@
+#ifndef SRC_OPERATOR_SCHEDULER_H_
+#define SRC_OPERATOR_SCHEDULER_H_
+
+#include <string>
+#include "mutation_plan.h"
+
+namespace protobuf_mutator {
+    /**
+     * Operator scheduling is opt-in, it is configured by environment variables:
+     *   PROTOBUF_MUTATOR_SCHEDULE         "bandit" learns the operator weights from the new queue entries of AFL++
+     *   PROTOBUF_MUTATOR_SCHEDULE_STATS   file the weights are written to after every epoch (see Describe())
+     */
+    #define SCHEDULE_ENV         "PROTOBUF_MUTATOR_SCHEDULE"
+    #define SCHEDULE_STATS_ENV   "PROTOBUF_MUTATOR_SCHEDULE_STATS"
+    // mutants between two updates of the weights
+    #define SCHEDULE_EPOCH       (4096)
+    // share of the weight that is spread evenly, so that no operator is ever starved
+    #define SCHEDULE_EXPLORATION (0.1)
+    // trials and credits of older epochs fade by this factor per epoch, the best operators change during a campaign
+    #define SCHEDULE_DECAY       (0.9)
+    #define MAX_ALIAS_SIZE       (4)
+
+    /**
+     * @brief Walker/Vose alias table: one of n values with the given weights in O(1), with one random number.
+     */
+    class AliasTable {
+    public:
+        // n <= MAX_ALIAS_SIZE non-negative weights, n is clamped to [0, MAX_ALIAS_SIZE]
+        void Build(const uint8_t* values, const double* weights, int n);
+        uint8_t Draw() const {
+            double u = getRandEngine()->UniformDouble() * n_;
+            int i = (int)u;
+            return u - i < prob_[i] ? value_[i] : alias_[i];
+        }
+
+    private:
+        double prob_[MAX_ALIAS_SIZE];
+        uint8_t value_[MAX_ALIAS_SIZE];
+        uint8_t alias_[MAX_ALIAS_SIZE];
+        int n_ = 0;
+    };
+
+    // The decisions the scheduler learns, each one has its own arms.
+    enum class OperatorGroup : uint8_t {
+        Stage,      // mutation or crossover pass: 0 Mutate, 1 Crossover
+        Mutation,   // FieldMuationType other than None
+        Crossover,  // CrossoverType other than None
+        END
+    };
+    #define OPERATOR_GROUPS (static_cast<int>(OperatorGroup::END))
+
+    // The operators one mutant was made with, by group and arm. Crossover and mutation passes count once per pass.
+    struct OperatorChain {
+        uint16_t count[OPERATOR_GROUPS][MAX_ALIAS_SIZE] = {};
+    };
+
+    /**
+     * @brief Online bandit over the mutation operators, fed by afl_custom_queue_new_entry().
+     * @details PickOp() draws None as often as without a scheduler, so the number of edits per mutant stays the same;
+     *          the scheduler only decides which operator is applied, among the ones allowed for the field. Every mutant
+     *          records its OperatorChain. A mutant that AFL++ adds to its queue (the caller recognizes it, see
+     *          AFLCustomHepler::QueueNewEntry()) credits every operator of its chain once;
+     *          every mutant counts as one trial of the operators it used. Every SCHEDULE_EPOCH mutants the weight of
+     *          an arm is drawn from Beta(1 + credits, 1 + trials - credits) (Thompson sampling), normalized and mixed
+     *          with SCHEDULE_EXPLORATION of even weight. Each subset of arms a field may allow has an alias table.
+     */
+    class OperatorScheduler {
+    public:
+        struct Arm {
+            double trials = 0;
+            double credits = 0;
+            double weight = 0;  // share of the arm among all arms of its group
+        };
+        struct Stats {
+            uint64_t mutants = 0;
+            uint64_t credited = 0;  // new queue entries that were mutants of this scheduler
+            uint64_t epochs = 0;
+        };
+
+        OperatorScheduler();
+        OperatorScheduler(const OperatorScheduler&) = delete;
+        OperatorScheduler& operator=(const OperatorScheduler&) = delete;
+
+        // Enable if SCHEDULE_ENV is "bandit".
+        bool StartFromEnv();
+        void Enable(const std::string& stats_path = "");
+        bool enabled() const { return enabled_; }
+
+        // Hot path: one operator of the arms in mask, recorded in the chain of the current mutant.
+        uint8_t Pick(OperatorGroup group, uint32_t mask) {
+            uint8_t arm = tables_[static_cast<int>(group)][mask].Draw();
+            chain_.count[static_cast<int>(group)][arm]++;
+            return arm;
+        }
+
+        // A new mutant begins, its chain is empty.
+        void BeginMutant() { chain_ = OperatorChain(); }
+        // The mutant is done: its operators get a trial.
+        void EndMutant();
+        // The last mutant is a new queue entry: credits its chain, once. Returns whether there was one to credit.
+        bool Credit();
+
+        const OperatorChain& LastChain() const { return last_chain_; }
+        const Arm& arm(OperatorGroup group, int arm) const { return arms_[static_cast<int>(group)][arm]; }
+        static int ArmCount(OperatorGroup group);
+        static const char* ArmName(OperatorGroup group, int arm);
+        const Stats& stats() const { return stats_; }
+        // A table of the arms: group, operator, trials, credits and weight.
+        std::string Describe() const;
+        // Describe() into the SCHEDULE_STATS_ENV file, if there is one.
+        void WriteStats() const;
+
+        // Draw new weights from the trials and credits so far and rebuild the alias tables.
+        void Update();
+
+    private:
+        void BuildTables();
+
+        bool enabled_ = false;
+        std::string stats_path_;
+        Arm arms_[OPERATOR_GROUPS][MAX_ALIAS_SIZE];
+        AliasTable tables_[OPERATOR_GROUPS][1 << MAX_ALIAS_SIZE];
+        OperatorChain chain_, last_chain_;
+        bool last_valid_ = false;
+        Stats stats_;
+    };
+
+    // The scheduler of the context of the calling thread, see mutator_context.h.
+    OperatorScheduler* GetScheduler();
+
+    // Mutation or crossover for the next pass: 5 in 11 crossovers without a scheduler, the learned share with one.
+    inline bool PickCrossover() {
+        if (OperatorScheduler* scheduler = ActiveScheduler())
+            return scheduler->Pick(OperatorGroup::Stage, 0b11) == 1;
+        return GetRandomIndex(10) > 5;
+    }
+}  // namespace protobuf_mutator
+
+#endif  // SRC_OPERATOR_SCHEDULER_H_
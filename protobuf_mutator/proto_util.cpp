@@ -1,21 +1,132 @@
 #include "proto_util.h"
 #include "mutator.h"
+#include "operator_scheduler.h"
 namespace protobuf_mutator {
 
-    LastMutationCache* GetCache() {
-        static LastMutationCache cache;
-        return &cache;
+    uint64_t ParsedMessageCache::Key(const InputReader& input) {
+        uint64_t hash = std::hash<std::string_view>()({reinterpret_cast<const char*>(input.data()), (size_t)input.size()});
+        return hash ^ input.binary();
     }
 
-    Mutator* GetMutator() {
-        static Mutator mutator;
-        return &mutator;
+    ParsedMessageCache::ParsedMessageCache(size_t max_entries, size_t max_bytes)
+        : max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+    ParsedMessageCache::~ParsedMessageCache() = default;
+
+    const Message* ParsedMessageCache::Indexed(Entry& entry, const FieldIndex** index) {
+        if (index) {
+            if (!entry.index) entry.index.reset(new FieldIndex);
+            if (!entry.index->Root()) entry.index->Build(*entry.message, GetMutator()->GetSampleOptions().weighting);
+            *index = entry.index.get();
+        }
+        return entry.message.get();
     }
 
-    int MutateMessage(const InputReader& input, OutputWriter* output, Message* message) {
-        input.Read(message);
+    const Message* ParsedMessageCache::Load(const InputReader& input, const Message& prototype, const FieldIndex** index) {
+        uint64_t key = Key(input);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            Entry& entry = *it->second;
+            if (entry.message->GetDescriptor() == prototype.GetDescriptor() && entry.data.size() == (size_t)input.size() &&
+                std::equal(entry.data.begin(), entry.data.end(), reinterpret_cast<const char*>(input.data()))) {
+                stats_.hits++;
+                lru_.splice(lru_.begin(), lru_, it->second);
+                return Indexed(entry, index);
+            }
+        }
+        stats_.misses++;
+        if (max_entries_ == 0) {
+            // disabled, parse into the only entry without keeping it
+            if (lru_.empty()) lru_.emplace_front();
+            auto& message = lru_.front().message;
+            if (!message || message->GetDescriptor() != prototype.GetDescriptor()) message.reset(prototype.New());
+            if (lru_.front().index) lru_.front().index->Clear();
+            return input.Read(message.get()) ? Indexed(lru_.front(), index) : nullptr;
+        }
+
+        // Reuse an entry instead of allocating a new one: the one with the same key (a hash collision),
+        // or the least recently used one once the cache is full.
+        std::list<Entry>::iterator node;
+        if (it != index_.end())
+            node = it->second;
+        else if (lru_.size() >= max_entries_) {
+            node = std::prev(lru_.end());
+            stats_.evictions++;
+        } else
+            node = lru_.emplace(lru_.begin());
+        if (node->message) {
+            index_.erase(node->key);
+            bytes_ -= node->bytes;
+            lru_.splice(lru_.begin(), lru_, node);
+        }
+        if (!node->message || node->message->GetDescriptor() != prototype.GetDescriptor())
+            node->message.reset(prototype.New());
+        if (!input.Read(node->message.get())) {
+            lru_.erase(node);
+            return nullptr;
+        }
+        node->key = key;
+        node->data.assign(reinterpret_cast<const char*>(input.data()), input.size());
+        node->bytes = node->data.capacity() + node->message->SpaceUsedLong();
+        bytes_ += node->bytes;
+        index_[key] = node;
+        if (node->index) node->index->Clear();
+        EvictOverLimits();
+        return Indexed(*node, index);
+    }
+
+    void ParsedMessageCache::EvictOverLimits() {
+        // the most recently used entry is kept even if it is over the memory limit alone
+        while (!lru_.empty() && (lru_.size() > max_entries_ || (bytes_ > max_bytes_ && lru_.size() > 1))) {
+            index_.erase(lru_.back().key);
+            bytes_ -= lru_.back().bytes;
+            stats_.evictions++;
+            lru_.pop_back();
+        }
+    }
+
+    void ParsedMessageCache::SetLimits(size_t max_entries, size_t max_bytes) {
+        Clear();
+        max_entries_ = max_entries;
+        max_bytes_ = max_bytes;
+    }
+
+    void ParsedMessageCache::Clear() {
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+    ParsedMessageCache::Stats ParsedMessageCache::stats() const {
+        Stats stats = stats_;
+        stats.entries = index_.size();
+        stats.bytes = bytes_;
+        return stats;
+    }
+
+    // Parse the input through the parse cache, message is cleared if it can not be parsed.
+    // index receives the FieldIndex of the input in sampled mode, it is left as it is otherwise.
+    static bool ReadCached(const InputReader& input, Message* message, const FieldIndex** index = nullptr) {
+        if (auto parsed = GetParseCache()->Load(input, *message, GetMutator()->Sampling() ? index : nullptr)) {
+            // CopyFrom() without its debug check, which walks both messages with reflection
+            message->Clear();
+            message->MergeFrom(*parsed);
+            return true;
+        }
+        message->Clear();
+        return false;
+    }
+
+    // Start a mutant from the parsed parent of a batch, CopyFrom() without its debug check.
+    static void CopyParent(const Message& parent, Message* message) {
+        message->Clear();
+        message->MergeFrom(parent);
+    }
+
+    // message holds the loaded input
+    static int MutateLoaded(OutputWriter* output, Message* message, const FieldIndex* index = nullptr) {
         int max_size = output->size(), test_size = max_size;
-        GetMutator()->Mutate(message, max_size);
+        GetMutator()->Mutate(message, max_size, index);
         if (int new_size = output->Write(*message)) {
             // cout<<"mutate:"<<new_size<<" "<<max_size<<endl;
             assert(new_size <= test_size);
@@ -25,12 +136,16 @@ namespace protobuf_mutator {
         return 0;
     }
 
-    int CrossOverMessages(const InputReader& input1, const InputReader& input2, 
-                            OutputWriter* output, Message* message1, Message* message2) {
-        input1.Read(message1);
-        input2.Read(message2);
+    // message1 holds the loaded first input
+    static int CrossOverLoaded(const InputReader& input2, OutputWriter* output, Message* message1, Message* message2) {
+        // message2 is only read, so the cached message is used as it is
+        const Message* parsed2 = GetParseCache()->Load(input2, *message2);
+        if (!parsed2) {
+            message2->Clear();
+            parsed2 = message2;
+        }
         int max_size = output->size(), test_size = max_size;
-        GetMutator()->Crossover(message1, message2, max_size);
+        GetMutator()->Crossover(message1, parsed2, max_size);
         if (int new_size = output->Write(*message1)) {
             // cout<<"cross:"<<new_size<<" "<<max_size<<endl;
             assert(new_size <= test_size);
@@ -40,6 +155,30 @@ namespace protobuf_mutator {
         return 0;
     }
 
+    // message holds the loaded input
+    static int SpliceLoaded(const DonorPool& pool, OutputWriter* output, Message* message) {
+        int max_size = output->size(), test_size = max_size;
+        if (!GetMutator()->SpliceDonor(message, pool, max_size)) return 0;
+        if (int new_size = output->Write(*message)) {
+            assert(new_size <= test_size);
+            GetCache()->Store(output->data(), new_size, message);
+            return new_size;
+        }
+        return 0;
+    }
+
+    int MutateMessage(const InputReader& input, OutputWriter* output, Message* message) {
+        const FieldIndex* index = nullptr;
+        ReadCached(input, message, &index);
+        return MutateLoaded(output, message, index);
+    }
+
+    int CrossOverMessages(const InputReader& input1, const InputReader& input2, 
+                            OutputWriter* output, Message* message1, Message* message2) {
+        ReadCached(input1, message1);
+        return CrossOverLoaded(input2, output, message1, message2);
+    }
+
     int CustomProtoMutate(bool binary, uint8_t* data, int size, int max_size, Message* message) {
         if(binary) {
             BinaryInputReader b_input(data, size);
@@ -67,9 +206,139 @@ namespace protobuf_mutator {
         }
     }
 
+    int CustomProtoMutate(bool binary, const Message& parent, uint8_t* out, int max_size, Message* message,
+                          const FieldIndex* index) {
+        CopyParent(parent, message);
+        if (binary) {
+            BinaryOutputWriter b_output(out, max_size);
+            return MutateLoaded(&b_output, message, index);
+        }
+        TextOutputWriter t_output(out, max_size);
+        return MutateLoaded(&t_output, message, index);
+    }
+
+    int CustomProtoCrossOver(bool binary, const Message& parent, const uint8_t* data2, int size2,
+                    uint8_t* out, int max_out_size, Message* message1, Message* message2) {
+        CopyParent(parent, message1);
+        if (binary) {
+            BinaryOutputWriter b_output(out, max_out_size);
+            return CrossOverLoaded(BinaryInputReader(data2, size2), &b_output, message1, message2);
+        }
+        TextOutputWriter t_output(out, max_out_size);
+        return CrossOverLoaded(TextInputReader(data2, size2), &t_output, message1, message2);
+    }
+
+    int CustomProtoSplice(bool binary, const Message& parent, const DonorPool& pool, uint8_t* out, int max_out_size,
+                          Message* message) {
+        CopyParent(parent, message);
+        if (binary) {
+            BinaryOutputWriter b_output(out, max_out_size);
+            return SpliceLoaded(pool, &b_output, message);
+        }
+        TextOutputWriter t_output(out, max_out_size);
+        return SpliceLoaded(pool, &t_output, message);
+    }
+
+    int MutateBatch(bool binary, const Message& parent, int n, int max_size, OutputBuffer* out_buffers,
+                    int* out_sizes, Message* mutant) {
+        std::unique_ptr<Message> owned;
+        if (!mutant) {
+            owned.reset(parent.New());
+            mutant = owned.get();
+        }
+        // sampled mode: the paths of parent are indexed once for all mutants
+        FieldIndex index;
+        if (GetMutator()->Sampling()) index.Build(parent, GetMutator()->GetSampleOptions().weighting);
+        int written = 0;
+        for (int i = 0; i < n; i++) {
+            uint8_t* out = out_buffers[i].Reserve(max_size);
+            out_sizes[i] = out ? CustomProtoMutate(binary, parent, out, max_size, mutant, index.Root() ? &index : nullptr) : 0;
+            written += out_sizes[i] > 0;
+        }
+        return written;
+    }
+
+    StackOptions StackOptions::FromEnv() {
+        StackOptions options;
+        if (const char* passes = getenv(STACK_PASSES_ENV))
+            options.max_passes = std::max(1, atoi(passes));
+        if (const char* dist = getenv(STACK_DIST_ENV))
+            options.distribution = strcmp(dist, "uniform") ? StackDistribution::PowerOfTwo : StackDistribution::Uniform;
+        return options;
+    }
+
+    int DrawStackPasses(const StackOptions& options) {
+        if (options.max_passes <= 1) return 1;
+        if (options.distribution == StackDistribution::Uniform)
+            return 1 + GetRandomIndex(options.max_passes - 1);
+        int max_exp = 0;
+        while ((2 << max_exp) <= options.max_passes) max_exp++;
+        return 1 << GetRandomIndex(max_exp);
+    }
+
+    // message1 holds the loaded first input, input2 is parsed on the first crossover pass
+    static int StackLoaded(const InputReader& input2, OutputWriter* output, Message* message1, Message* message2,
+                           const StackOptions& options, StackEffect* effect, const FieldIndex* index) {
+        int passes = DrawStackPasses(options), crossovers = 0;
+        uint64_t picked = PickedOpCount();
+        const Message* parsed2 = nullptr;
+        for (int i = 0; i < passes; i++) {
+            int max_size = output->size();
+            // the same odds as MutationOrCrossoverOnProtobuf()
+            if (input2.size() && PickCrossover()) {
+                if (!parsed2 && !(parsed2 = GetParseCache()->Load(input2, *message2))) {
+                    message2->Clear();
+                    parsed2 = message2;
+                }
+                GetMutator()->Crossover(message1, parsed2, max_size);
+                crossovers++;
+            } else
+                GetMutator()->Mutate(message1, max_size, index);
+            // the index only describes the message before the first pass
+            index = nullptr;
+        }
+        if (effect) {
+            effect->passes = passes;
+            effect->crossovers = crossovers;
+            effect->changed_fields = PickedOpCount() - picked;
+        }
+        // one serialization for the whole stack
+        if (int new_size = output->Write(*message1)) {
+            GetCache()->Store(output->data(), new_size, message1);
+            return new_size;
+        }
+        return 0;
+    }
+
+    int CustomProtoStack(bool binary, const uint8_t* data1, int size1, const uint8_t* data2, int size2,
+            uint8_t* out, int max_out_size, Message* message1, Message* message2, const StackOptions& options, StackEffect* effect) {
+        const FieldIndex* index = nullptr;
+        if (binary) {
+            ReadCached(BinaryInputReader(data1, size1), message1, &index);
+            BinaryOutputWriter b_output(out, max_out_size);
+            return StackLoaded(BinaryInputReader(data2, size2), &b_output, message1, message2, options, effect, index);
+        }
+        ReadCached(TextInputReader(data1, size1), message1, &index);
+        TextOutputWriter t_output(out, max_out_size);
+        return StackLoaded(TextInputReader(data2, size2), &t_output, message1, message2, options, effect, index);
+    }
+
+    int CustomProtoStack(bool binary, const Message& parent, const uint8_t* data2, int size2,
+            uint8_t* out, int max_out_size, Message* message1, Message* message2, const StackOptions& options, StackEffect* effect,
+            const FieldIndex* index) {
+        CopyParent(parent, message1);
+        if (binary) {
+            BinaryOutputWriter b_output(out, max_out_size);
+            return StackLoaded(BinaryInputReader(data2, size2), &b_output, message1, message2, options, effect, index);
+        }
+        TextOutputWriter t_output(out, max_out_size);
+        return StackLoaded(TextInputReader(data2, size2), &t_output, message1, message2, options, effect, index);
+    }
+
     bool LoadProtoInput(bool binary, const uint8_t* data, int size, Message* input) {
         if (GetCache()->LoadIfSame(data, size, input)) return true;
-        return binary ? ParseBinaryMessage(data, size, input) : ParseTextMessage(data, size, input);
+        if (binary) return ReadCached(BinaryInputReader(data, size), input);
+        return ReadCached(TextInputReader(data, size), input);
     }
 
     bool ParseBinaryMessage(const string& data, Message* output) {
@@ -82,7 +351,13 @@ namespace protobuf_mutator {
     }
 
     bool ParseBinaryMessage(const uint8_t* data, int size, Message* output) {
-        return ParseBinaryMessage({(char*)(data), (size_t)size}, output);
+        // parse in place, no temporary string
+        output->Clear();
+        if (!output->ParseFromArray(data, size)) {
+            output->Clear();
+            return false;
+        }
+        return true;
     }
 
     string SaveMessageAsBinary(const Message& message) {
@@ -92,12 +367,11 @@ namespace protobuf_mutator {
     }
 
     int SaveMessageAsBinary(const Message& message, uint8_t* data, int max_size) {
-        string result = SaveMessageAsBinary(message);
-        if (result.size() <= max_size) {
-            memcpy(data, result.data(), result.size());
-            return result.size();
-        }
-        return 0;
+        // one size computation, then the message is written straight into data
+        size_t size = message.ByteSizeLong();
+        if (size > (size_t)max_size) return 0;
+        message.SerializeWithCachedSizesToArray(data);
+        return size;
     }
 
     bool ParseTextMessage(const string& data, Message* output) {
@@ -123,12 +397,35 @@ namespace protobuf_mutator {
     }
 
     int SaveMessageAsText(const Message& message, uint8_t* data, int max_size) {
-        string result = SaveMessageAsText(message);
-        if (result.size() <= max_size) {
-            memcpy(data, result.data(), result.size());
-            return result.size();
+        // The text size is not known in advance, printing fails once data is full.
+        protobuf::io::ArrayOutputStream output(data, max_size);
+        if (!TextFormat::Print(message, &output)) return 0;
+        return output.ByteCount();
+    }
+
+    uint8_t* OutputBuffer::Reserve(size_t size) {
+        if (size <= capacity_) return data_;
+        // next power of two, so that a growing output only reallocates a few times
+        size_t capacity = capacity_ ? capacity_ : 1;
+        while (capacity < size) capacity *= 2;
+        uint8_t* data = static_cast<uint8_t*>(malloc(capacity));
+        if (!data) {
+            perror("OutputBuffer reserve");
+            return nullptr;
         }
-        return 0;
+        free(data_);
+        data_ = data;
+        capacity_ = capacity;
+        grow_count_++;
+        return data_;
+    }
+
+    int SerializeToBuffer(const Message& message, OutputBuffer* output) {
+        size_t size = message.ByteSizeLong();
+        uint8_t* data = output->Reserve(size);
+        if (!data) return 0;
+        message.SerializeWithCachedSizesToArray(data);
+        return size;
     }
 
 }  // namespace protobuf_mutator
@@ -10,13 +10,17 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <bitset>
+#include <list>
+#include <unordered_map>
 #include "google/protobuf/any.pb.h"
 #include "google/protobuf/descriptor.pb.h"
 #include "google/protobuf/message.h"
 #include "google/protobuf/text_format.h"
 #include "google/protobuf/util/message_differencer.h"
 #include "google/protobuf/wire_format.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 
 
 namespace protobuf_mutator {
@@ -32,6 +36,8 @@ namespace protobuf_mutator {
     using protobuf::OneofDescriptor;
     using protobuf::Reflection;
     using protobuf::util::MessageDifferencer;
+    class FieldIndex;  // field_index.h
+    class DonorPool;   // donor_pool.h
     int CustomProtoMutate(bool binary, uint8_t* data, int size, int max_size, Message* input);
     int CustomProtoCrossOver(bool binary, const uint8_t* data1, int size1, const uint8_t* data2, 
             int size2, uint8_t* out, int max_out_size, Message* input1, Message* input2);
@@ -54,6 +60,8 @@ namespace protobuf_mutator {
         virtual ~InputReader() = default;
 
         virtual bool Read(Message* message) const = 0;
+        // the same bytes mean different messages in the binary and the text format
+        virtual bool binary() const = 0;
 
         const uint8_t* data() const { return data_; }
         int size() const { return size_; }
@@ -82,6 +90,7 @@ namespace protobuf_mutator {
     public:
         using InputReader::InputReader;
         bool Read(Message* message) const override { return ParseTextMessage(data(), size(), message); }
+        bool binary() const override { return false; }
     };
 
     class TextOutputWriter : public OutputWriter {
@@ -94,6 +103,7 @@ namespace protobuf_mutator {
         public:
         using InputReader::InputReader;
         bool Read(Message* message) const override { return ParseBinaryMessage(data(), size(), message); }
+        bool binary() const override { return true; }
     };
 
     class BinaryOutputWriter : public OutputWriter {
@@ -104,25 +114,211 @@ namespace protobuf_mutator {
 
     class LastMutationCache {
     public:
+        LastMutationCache() = default;
+        LastMutationCache(const LastMutationCache&) = delete;
+        LastMutationCache& operator=(const LastMutationCache&) = delete;
+        ~LastMutationCache() { Reset(); }
+
         void Store(const uint8_t* data, int size, Message* message) {
-            if (!message_) message_.reset(message->New());
-            message->GetReflection()->Swap(message, message_.get());
+            // Created on the arena of the message, so that Swap() only exchanges pointers.
+            if (!message_) message_ = message->New(message->GetArena());
+            message->GetReflection()->Swap(message, message_);
             data_.assign(data, data + size);
+            stored_ = true;
         }
 
         bool LoadIfSame(const uint8_t* data, int size, Message* message) {
-            if (!message_ || size != data_.size() || !std::equal(data_.begin(), data_.end(), data))
+            if (!stored_ || size != data_.size() || !std::equal(data_.begin(), data_.end(), data))
             return false;
 
-            message->GetReflection()->Swap(message, message_.get());
-            message_.reset();
+            message->GetReflection()->Swap(message, message_);
+            // message_ is kept and reused by the next Store()
+            stored_ = false;
             return true;
         }
 
+        // Drop the cached message, must be called before the arena it lives on is reset.
+        void Reset() {
+            if (message_ && !message_->GetArena()) delete message_;
+            message_ = nullptr;
+            stored_ = false;
+        }
+
     private:
         std::vector<uint8_t> data_;
-        std::unique_ptr<Message> message_;
+        Message* message_ = nullptr;  // owned unless it is on an arena
+        bool stored_ = false;
+    };
+
+    LastMutationCache* GetCache();
+
+    /**
+     * @brief Output buffer that grows on demand, so that a serialized message always fits.
+     * @details The capacity grows to the next power of two, a growing output reallocates a few times
+     *          and then never again. The content is not preserved when the buffer grows.
+     */
+    class OutputBuffer {
+    public:
+        // an empty buffer allocates on its first Reserve()
+        explicit OutputBuffer(size_t initial_capacity = 0) {
+            Reserve(initial_capacity);
+            grow_count_ = 0;
+        }
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+        ~OutputBuffer() { free(data_); }
+
+        // Room for at least size bytes, nullptr if the memory can not be allocated.
+        uint8_t* Reserve(size_t size);
+        uint8_t* data() const { return data_; }
+        size_t capacity() const { return capacity_; }
+        uint64_t grow_count() const { return grow_count_; }
+
+    private:
+        uint8_t* data_ = nullptr;
+        size_t capacity_ = 0;
+        uint64_t grow_count_ = 0;
+    };
+
+    // Serialize the whole message into output, which grows if needed. Returns the size.
+    int SerializeToBuffer(const Message& message, OutputBuffer* output);
+
+    // Batch mode: AFL++ fuzzes a queue entry many times in a row, the caller parses it once into parent
+    // and every mutant starts from a copy of parent instead of a parse of the serialized input.
+    // index: the FieldIndex of parent for sampled mode, see Mutator::Mutate().
+    int CustomProtoMutate(bool binary, const Message& parent, uint8_t* out, int max_size, Message* input,
+            const FieldIndex* index = nullptr);
+    int CustomProtoCrossOver(bool binary, const Message& parent, const uint8_t* data2, int size2,
+            uint8_t* out, int max_out_size, Message* input1, Message* input2);
+    // A donor of pool spliced into a copy of parent, see Mutator::SpliceDonor(). 0 if nothing was spliced.
+    int CustomProtoSplice(bool binary, const Message& parent, const DonorPool& pool, uint8_t* out, int max_out_size,
+            Message* input);
+
+    /**
+     * @brief n mutants of one parsed parent, mutant i is written into out_buffers[i].
+     * @param out_sizes size of every mutant, 0 if it did not fit max_size
+     * @param mutant message the mutants are built in, allocated once per call if nullptr
+     * @return the number of mutants written
+     */
+    int MutateBatch(bool binary, const Message& parent, int n, int max_size, OutputBuffer* out_buffers,
+                    int* out_sizes, Message* mutant = nullptr);
+
+    /**
+     * Stacked mode, configured by environment variables:
+     *   PROTOBUF_MUTATOR_STACK        K, the maximum number of passes per mutant (default 1, one pass)
+     *   PROTOBUF_MUTATOR_STACK_DIST   distribution of the number of passes: "pow2" (default) or "uniform"
+     */
+    #define STACK_PASSES_ENV "PROTOBUF_MUTATOR_STACK"
+    #define STACK_DIST_ENV   "PROTOBUF_MUTATOR_STACK_DIST"
+
+    enum class StackDistribution {
+        PowerOfTwo,  // 1, 2, 4, ... up to K, every power equally likely, like the havoc stage of AFL++
+        Uniform      // 1 to K
+    };
+
+    struct StackOptions {
+        int max_passes = 1;
+        StackDistribution distribution = StackDistribution::PowerOfTwo;
+        static StackOptions FromEnv();
+    };
+
+    // What one stack did to its mutant.
+    struct StackEffect {
+        int passes = 0;
+        int crossovers = 0;
+        int changed_fields = 0;  // field operations applied (picked operations other than None)
+    };
+
+    struct StackStats {
+        uint64_t stacks = 0;
+        uint64_t passes = 0;
+        uint64_t changed_fields = 0;
+        uint64_t unchanged = 0;  // stacks that did not change a field, their mutant is the parent
+        void Add(const StackEffect& effect) {
+            stacks++;
+            passes += effect.passes;
+            changed_fields += effect.changed_fields;
+            unchanged += effect.changed_fields == 0;
+        }
     };
+
+    // Number of passes of the next stack.
+    int DrawStackPasses(const StackOptions& options);
+
+    /**
+     * @brief Up to K mutation and crossover passes on the input, then one serialization.
+     * @details Every pass is a crossover with data2 as often as MutationOrCrossoverOnProtobuf() picks one,
+     *          only mutations are applied if data2 is empty. data1 is not modified.
+     */
+    int CustomProtoStack(bool binary, const uint8_t* data1, int size1, const uint8_t* data2, int size2,
+            uint8_t* out, int max_out_size, Message* input1, Message* input2, const StackOptions& options, StackEffect* effect);
+    // Only the first pass uses the index of parent, a later one indexes the message it gets.
+    int CustomProtoStack(bool binary, const Message& parent, const uint8_t* data2, int size2,
+            uint8_t* out, int max_out_size, Message* input1, Message* input2, const StackOptions& options, StackEffect* effect,
+            const FieldIndex* index = nullptr);
+
+    #define PARSE_CACHE_MAX_ENTRIES (256)
+    #define PARSE_CACHE_MAX_BYTES   (64 << 20)
+
+    /**
+     * @brief Bounded LRU of parsed inputs, keyed by a hash of the serialized bytes.
+     * @details AFL++ fuzzes a queue entry many times in a row and draws splice partners from a small set,
+     *          so most inputs have been parsed before. An entry holds its bytes as well, a hit is only
+     *          taken when they are equal, so a hash collision costs a parse but never returns a wrong message.
+     *          Both the number of entries and the memory they use (bytes + SpaceUsedLong of the message) are capped.
+     */
+    class ParsedMessageCache {
+    public:
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            size_t entries = 0;
+            size_t bytes = 0;
+            double HitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+        };
+
+        // out of line, an entry holds a FieldIndex which is only declared here
+        explicit ParsedMessageCache(size_t max_entries = PARSE_CACHE_MAX_ENTRIES, size_t max_bytes = PARSE_CACHE_MAX_BYTES);
+        ~ParsedMessageCache();
+
+        /**
+         * @brief Parsed form of the input, parsed and cached on a miss.
+         * @param prototype message of the type to parse
+         * @param index if not nullptr, receives the FieldIndex of the message for sampled mode. It is built on the
+         *              first request after a parse and stays valid as long as the message; it is not counted in max_bytes.
+         * @return nullptr if the input can not be parsed. The message stays valid until the next Load().
+         */
+        const Message* Load(const InputReader& input, const Message& prototype, const FieldIndex** index = nullptr);
+
+        // max_entries == 0 disables the cache, Load() then parses every input.
+        void SetLimits(size_t max_entries, size_t max_bytes);
+        void Clear();
+        Stats stats() const;
+        void ResetStats() { stats_ = Stats(); }
+
+    private:
+        struct Entry {
+            uint64_t key;
+            string data;
+            std::unique_ptr<Message> message;
+            size_t bytes;
+            std::unique_ptr<FieldIndex> index;  // nullptr until it is requested
+        };
+        static const Message* Indexed(Entry& entry, const FieldIndex** index);
+        static uint64_t Key(const InputReader& input);
+        void EvictOverLimits();
+
+        // front is the most recently used entry
+        std::list<Entry> lru_;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+        size_t max_entries_;
+        size_t max_bytes_;
+        size_t bytes_ = 0;
+        Stats stats_;
+    };
+
+    ParsedMessageCache* GetParseCache();
 }  // namespace protobuf_mutator
 
 
@@ -0,0 +1,107 @@
+#ifndef SRC_REPEATED_KERNELS_H_
+#define SRC_REPEATED_KERNELS_H_
+
+#include <algorithm>
+#include <google/protobuf/reflection.h>
+#include "mutate_util.h"
+
+namespace protobuf_mutator {
+    /**
+     * Bulk edits of a repeated field. Field is anything with size(), SwapElements(i, j) and RemoveLast():
+     * RepeatedField<T> / RepeatedPtrField<T> in the typed mutators, MutableRepeatedFieldRef<T> through reflection.
+     * Elements are only moved by swaps, which is a pointer swap for messages, so every kernel is O(n) at most.
+     */
+
+    // Pick cnt distinct indices of [0, len) in random order: Floyd's algorithm, then a shuffle of the picks.
+    // O(cnt^2) draws and compares instead of a shuffle of all len indices, an edit only touches a few elements.
+    inline void SampleIndices(int len, int cnt, int* idx) {
+        for (int j = len - cnt, k = 0; j < len; j++, k++) {
+            int t = GetRandomIndex(j);
+            idx[k] = std::find(idx, idx + k, t) != idx + k ? j : t;
+        }
+        RandomShuffle(idx, idx + cnt);
+    }
+
+    // Remove the elements at the ascending indices idx[0, cnt) in one pass, the others keep their order.
+    template<class Field>
+    inline void EraseSorted(Field& field, const int* idx, int cnt) {
+        if (cnt == 0) return;
+        int len = field.size(), write = idx[0];
+        for (int read = idx[0], k = 0; read < len; read++) {
+            if (k < cnt && read == idx[k]) {
+                k++;
+                continue;
+            }
+            field.SwapElements(read, write++);
+        }
+        while (cnt--) field.RemoveLast();
+    }
+
+    // Remove the cnt elements from pos on, the others keep their order.
+    template<class Field>
+    inline void EraseRange(Field& field, int pos, int cnt) {
+        for (int read = pos + cnt, len = field.size(); read < len; read++)
+            field.SwapElements(read, read - cnt);
+        while (cnt--) field.RemoveLast();
+    }
+
+    // Fisher-Yates by swaps, the same draws as RandomShuffle() over the elements.
+    template<class Field>
+    inline void ShuffleElements(Field& field) {
+        for (int i = field.size() - 1; i > 0; i--)
+            field.SwapElements(i, (int)getRandEngine()->Bounded((uint64_t)i + 1));
+    }
+
+    /**
+     * @brief Length of the longest prefix of a range splice that fits the budget, charged to size and remain_size.
+     * @details elem_size(i) is the encoded size of the i-th element of the range (tag excluded).
+     */
+    template<class ElemSize>
+    inline int FitRange(int count, RepeatedFieldSize& size, int& remain_size, ElemSize elem_size) {
+        int n = 0;
+        for (; n < count; n++) {
+            int delta = size.AddDelta(elem_size(n));
+            if (remain_size < delta) break;
+            remain_size -= size.Add(elem_size(n));
+        }
+        return n;
+    }
+
+    // Call visit(MutableRepeatedFieldRef<T>) with the element type of a repeated field, strings are not supported.
+    template<class Visit>
+    inline void VisitRepeatedField(Message* msg, const FieldDescriptor* field, Visit visit) {
+        auto ref = msg->GetReflection();
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_ENUM:
+                visit(ref->GetMutableRepeatedFieldRef<int32_t>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                visit(ref->GetMutableRepeatedFieldRef<int64_t>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                visit(ref->GetMutableRepeatedFieldRef<uint32_t>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                visit(ref->GetMutableRepeatedFieldRef<uint64_t>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                visit(ref->GetMutableRepeatedFieldRef<double>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                visit(ref->GetMutableRepeatedFieldRef<float>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                visit(ref->GetMutableRepeatedFieldRef<bool>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                visit(ref->GetMutableRepeatedFieldRef<Message>(msg, field));
+                break;
+            case FieldDescriptor::CPPTYPE_STRING:
+                // not support
+                break;
+        }
+    }
+}  // namespace protobuf_mutator
+
+#endif  // SRC_REPEATED_KERNELS_H_
@@ -0,0 +1,105 @@
+#include "trace_logger.h"
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+
+namespace protobuf_mutator {
+    namespace {
+        std::atomic<int> started_loggers{0};
+    }
+
+    TraceRing::TraceRing(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) capacity_ *= 2;
+        mask_ = capacity_ - 1;
+        data_.reset(new uint8_t[capacity_]);
+    }
+
+    void TraceRing::Copy(size_t pos, const void* src, size_t size) {
+        size_t begin = pos & mask_;
+        size_t first = std::min(size, capacity_ - begin);
+        memcpy(data_.get() + begin, src, first);
+        memcpy(data_.get(), static_cast<const uint8_t*>(src) + first, size - first);
+    }
+
+    bool TraceRing::Push(const void* header, size_t header_size, const void* payload, size_t payload_size) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (capacity_ - (head - tail) < header_size + payload_size) return false;
+        Copy(head, header, header_size);
+        Copy(head + header_size, payload, payload_size);
+        // the record becomes visible to the consumer as a whole
+        head_.store(head + header_size + payload_size, std::memory_order_release);
+        return true;
+    }
+
+    bool TraceLogger::StartFromEnv(const google::protobuf::Descriptor* root) {
+        const char* dir = getenv(TRACE_DIR_ENV);
+        if (!dir || !*dir) return false;
+        Options options;
+        options.dir = dir;
+        if (const char* sample = getenv(TRACE_SAMPLE_ENV))
+            options.sample_every = std::max(1, atoi(sample));
+        return Start(options, root);
+    }
+
+    bool TraceLogger::Start(const Options& options, const google::protobuf::Descriptor* root) {
+        Stop();
+        // one file per instance, so that parallel instances sharing a directory do not collide
+        int instance = started_loggers++;
+        path_ = options.dir + "/trace_" + std::to_string(getpid()) + (instance ? "." + std::to_string(instance) : "") + ".bin";
+        file_ = fopen(path_.c_str(), "wb");
+        if (!file_) {
+            perror("TraceLogger start");
+            return false;
+        }
+        TraceFileHeader header;
+        strncpy(header.message_type, root->full_name().c_str(), sizeof(header.message_type) - 1);
+        fwrite(&header, sizeof(header), 1, file_);
+
+        sample_every_ = std::max<uint32_t>(1, options.sample_every);
+        sample_count_ = 0;
+        stats_ = Stats();
+        ring_.reset(new TraceRing(options.ring_size));
+        running_ = true;
+        writer_ = std::thread(&TraceLogger::WriterLoop, this);
+        enabled_ = true;
+        return true;
+    }
+
+    void TraceLogger::Stop() {
+        if (!enabled_) return;
+        enabled_ = false;
+        running_ = false;
+        writer_.join();
+        fclose(file_);
+        file_ = nullptr;
+    }
+
+    void TraceLogger::Push(TraceKind kind, uint64_t sequence, const uint8_t* data, size_t size) {
+        TraceRecordHeader header;
+        header.size = size;
+        header.kind = kind;
+        header.reserved = 0;
+        header.sequence = sequence;
+        header.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (ring_->Push(&header, sizeof(header), data, size))
+            stats_.recorded++;
+        else
+            stats_.dropped++;
+    }
+
+    void TraceLogger::WriterLoop() {
+        auto write = [this](const uint8_t* data, size_t size) { fwrite(data, 1, size, file_); };
+        while (running_.load(std::memory_order_acquire)) {
+            if (ring_->Drain(write)) continue;
+            // Nothing to write: make the file complete for readers, then wait for new records
+            fflush(file_);
+            std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_WRITER_SLEEP_MS));
+        }
+        // records pushed before Stop()
+        ring_->Drain(write);
+        fflush(file_);
+    }
+}  // namespace protobuf_mutator
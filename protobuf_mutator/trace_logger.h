@@ -0,0 +1,146 @@
+#ifndef SRC_TRACE_LOGGER_H_
+#define SRC_TRACE_LOGGER_H_
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include "google/protobuf/descriptor.h"
+
+namespace protobuf_mutator {
+    /**
+     * Tracing is opt-in, it is configured by environment variables:
+     *   PROTOBUF_MUTATOR_TRACE_DIR      enables tracing, every instance writes <dir>/trace_<pid>[.<n>].bin
+     *   PROTOBUF_MUTATOR_TRACE_SAMPLE   record one of N messages (default 1, every message)
+     * The files are decoded to text offline by tools/trace_decoder.
+     */
+    #define TRACE_DIR_ENV       "PROTOBUF_MUTATOR_TRACE_DIR"
+    #define TRACE_SAMPLE_ENV    "PROTOBUF_MUTATOR_TRACE_SAMPLE"
+    #define TRACE_RING_SIZE     (4 << 20)
+    // how long the writer sleeps when there is nothing to write
+    #define TRACE_WRITER_SLEEP_MS (10)
+
+    // ----------------------Trace file format------------------------
+    // A TraceFileHeader, then records until the end of the file.
+    // A record is a TraceRecordHeader followed by size bytes of payload. Integers are in host byte order.
+    #define TRACE_VERSION (1)
+    struct TraceFileHeader {
+        char magic[4] = {'P', 'M', 'T', 'R'};
+        uint32_t version = TRACE_VERSION;
+        char message_type[56] = {};  // full name of the message type of the payloads, '\0' terminated
+    };
+
+    enum class TraceKind : uint16_t {
+        PostProcessed = 1,  // payload: the binary serialized message written by afl_custom_post_process
+    };
+
+    struct TraceRecordHeader {
+        uint32_t size;
+        TraceKind kind;
+        uint16_t reserved;
+        uint64_t sequence;  // number of the message in its process
+        uint64_t time_ns;   // steady clock
+    };
+    static_assert(sizeof(TraceFileHeader) == 64 && sizeof(TraceRecordHeader) == 24, "trace format changed");
+
+    /**
+     * @brief Lock-free ring of bytes with a single producer and a single consumer.
+     * @details The producer never waits: a record that does not fit is dropped as a whole.
+     */
+    class TraceRing {
+    public:
+        // capacity is rounded up to a power of two
+        explicit TraceRing(size_t capacity);
+
+        // Producer: append header and payload as one record, false if there is not enough room.
+        bool Push(const void* header, size_t header_size, const void* payload, size_t payload_size);
+
+        // Consumer: hand the readable bytes to write(const uint8_t*, size_t) in at most two pieces
+        // and release them. Returns the number of bytes drained.
+        template<class Write>
+        size_t Drain(Write write) {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t head = head_.load(std::memory_order_acquire);
+            if (head == tail) return 0;
+            size_t begin = tail & mask_, size = head - tail;
+            size_t first = std::min(size, capacity_ - begin);
+            write(data_.get() + begin, first);
+            if (first < size) write(data_.get(), size - first);
+            tail_.store(head, std::memory_order_release);
+            return size;
+        }
+
+    private:
+        void Copy(size_t pos, const void* src, size_t size);
+
+        std::unique_ptr<uint8_t[]> data_;
+        size_t capacity_;
+        size_t mask_;
+        // positions only grow, the index in data_ is position & mask_
+        alignas(64) std::atomic<size_t> head_{0};  // written by the producer
+        alignas(64) std::atomic<size_t> tail_{0};  // written by the consumer
+    };
+
+    /**
+     * @brief Sampled trace of messages, recorded on the hot path and written to disk by a background thread.
+     */
+    class TraceLogger {
+    public:
+        struct Options {
+            std::string dir;
+            uint32_t sample_every = 1;
+            size_t ring_size = TRACE_RING_SIZE;
+        };
+        struct Stats {
+            uint64_t recorded = 0;     // pushed to the ring
+            uint64_t sampled_out = 0;  // skipped by sampling
+            uint64_t dropped = 0;      // the ring was full
+        };
+
+        TraceLogger() = default;
+        TraceLogger(const TraceLogger&) = delete;
+        TraceLogger& operator=(const TraceLogger&) = delete;
+        ~TraceLogger() { Stop(); }
+
+        // Start if TRACE_DIR_ENV is set, payloads are messages of type root.
+        bool StartFromEnv(const google::protobuf::Descriptor* root);
+        bool Start(const Options& options, const google::protobuf::Descriptor* root);
+        // Write what is left in the ring and close the file.
+        void Stop();
+
+        // Hot path: only a counter is touched unless the message is sampled.
+        void Record(TraceKind kind, uint64_t sequence, const uint8_t* data, size_t size) {
+            if (!enabled_) return;
+            if (++sample_count_ < sample_every_) {
+                stats_.sampled_out++;
+                return;
+            }
+            sample_count_ = 0;
+            Push(kind, sequence, data, size);
+        }
+
+        bool enabled() const { return enabled_; }
+        const std::string& path() const { return path_; }
+        const Stats& stats() const { return stats_; }
+
+    private:
+        void Push(TraceKind kind, uint64_t sequence, const uint8_t* data, size_t size);
+        void WriterLoop();
+
+        bool enabled_ = false;
+        uint32_t sample_every_ = 1;
+        uint32_t sample_count_ = 0;
+        Stats stats_;
+        std::string path_;
+        FILE* file_ = nullptr;
+        std::unique_ptr<TraceRing> ring_;
+        std::atomic<bool> running_{false};
+        std::thread writer_;
+    };
+
+    // The logger of the calling thread's context, see mutator_context.h.
+    TraceLogger* GetTraceLogger();
+}  // namespace protobuf_mutator
+
+#endif  // SRC_TRACE_LOGGER_H_
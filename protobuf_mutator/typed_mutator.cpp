@@ -0,0 +1,52 @@
+#include "typed_mutator.h"
+#include "mutator.h"
+
+namespace protobuf_mutator {
+    namespace {
+        struct TypedMutatorRegistry {
+            std::unordered_map<const Descriptor*, TypedMutatorEntry> entries;
+            bool enabled = true;
+        };
+        // Function-local static, so that registration from static initializers of other units is safe.
+        TypedMutatorRegistry* GetRegistry() {
+            static TypedMutatorRegistry registry;
+            return &registry;
+        }
+
+        const FieldPlan& FindFieldPlan(const MessagePlan& plan, int field_index) {
+            for (const auto& entry : plan.fields)
+                if (entry.field->index() == field_index) return entry;
+            assert(false && "field is not the first field of a plan entry");
+            return plan.fields.front();
+        }
+    }
+
+    bool RegisterTypedMutator(const Descriptor* desc, const TypedMutatorEntry& entry) {
+        return GetRegistry()->entries.emplace(desc, entry).second;
+    }
+
+    const TypedMutatorEntry* FindTypedMutator(const Descriptor* desc) {
+        auto registry = GetRegistry();
+        if (!registry->enabled) return nullptr;
+        auto it = registry->entries.find(desc);
+        return it == registry->entries.end() ? nullptr : &it->second;
+    }
+
+    void SetTypedMutatorsEnabled(bool enabled) { GetRegistry()->enabled = enabled; }
+    bool TypedMutatorsEnabled() { return GetRegistry()->enabled; }
+
+    void FallbackFieldMutation(Message* msg, int field_index, int& remain_size) {
+        const MessagePlan& plan = *GetMessagePlan(msg->GetDescriptor());
+        GetMutator()->MutateField(msg, plan, FindFieldPlan(plan, field_index), remain_size);
+    }
+
+    void FallbackFieldCrossover(Message* msg1, const Message* msg2, int field_index, int& remain_size) {
+        const MessagePlan& plan = *GetMessagePlan(msg1->GetDescriptor());
+        GetMutator()->CrossoverField(msg1, msg2, plan, FindFieldPlan(plan, field_index), remain_size);
+    }
+
+    void FallbackFieldCreate(Message* msg, int field_index, int& remain_size) {
+        const MessagePlan& plan = *GetMessagePlan(msg->GetDescriptor());
+        CreateRandomField(msg, plan, FindFieldPlan(plan, field_index), remain_size);
+    }
+}  // namespace protobuf_mutator
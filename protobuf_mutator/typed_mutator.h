@@ -0,0 +1,555 @@
+#ifndef SRC_TYPED_MUTATOR_H_
+#define SRC_TYPED_MUTATOR_H_
+
+#include <cstring>
+#include "mutate_util.h"
+#include "mutation_plan.h"
+#include "repeated_kernels.h"
+#include "value_domain.h"
+
+namespace protobuf_mutator {
+    /**
+     * @brief Reflection-free mutator of one message type, specialized by the code that
+     *        protoc-gen-typed_mutator generates (<proto>.typed_mutator.h/.cc).
+     * @details The generated functions call the generated accessors directly and draw the
+     *          same random numbers in the same order as the reflection path, so a seeded run
+     *          produces the same messages on both paths.
+     */
+    template<class T>
+    struct TypedMutator;
+    // static void Mutate(T* msg, int& remain_size);
+    // static void Crossover(T* msg1, const T& msg2, int& remain_size);
+    // static void CreateRandom(T* msg, int& remain_size);
+
+    // ----------------------Registry------------------------
+    struct TypedMutatorEntry {
+        void (*mutate)(Message* msg, int& remain_size);
+        void (*crossover)(Message* msg1, const Message* msg2, int& remain_size);
+        void (*create)(Message* msg, int& remain_size);
+    };
+
+    template<class T>
+    TypedMutatorEntry MakeTypedMutatorEntry() {
+        return {
+            [](Message* msg, int& r) { TypedMutator<T>::Mutate(static_cast<T*>(msg), r); },
+            [](Message* msg1, const Message* msg2, int& r) { TypedMutator<T>::Crossover(static_cast<T*>(msg1), *static_cast<const T*>(msg2), r); },
+            [](Message* msg, int& r) { TypedMutator<T>::CreateRandom(static_cast<T*>(msg), r); }
+        };
+    }
+
+    // Called by the generated code during static initialization.
+    bool RegisterTypedMutator(const Descriptor* desc, const TypedMutatorEntry& entry);
+    // nullptr if no typed mutator is linked for the type or they are disabled, then the reflection path is used.
+    const TypedMutatorEntry* FindTypedMutator(const Descriptor* desc);
+    // Typed mutators are enabled by default, disable them to force the reflection path.
+    void SetTypedMutatorsEnabled(bool enabled);
+    bool TypedMutatorsEnabled();
+
+    // Reflection path for a field that the generator does not type (string, map, message of another file).
+    // field_index is FieldDescriptor::index() of the field, or of the first field of its oneof group.
+    void FallbackFieldMutation(Message* msg, int field_index, int& remain_size);
+    void FallbackFieldCrossover(Message* msg1, const Message* msg2, int field_index, int& remain_size);
+    void FallbackFieldCreate(Message* msg, int field_index, int& remain_size);
+
+    // ----------------------Allowed operations------------------------
+    // Same lists as MutationPlanCache::Get() builds for every kind of field, None included.
+    inline constexpr MutationOps kUnsetMutations{{FieldMuationType::MutationAdd, FieldMuationType::None}, 2};
+    inline constexpr MutationOps kScalarSetMutations{{FieldMuationType::Delete, FieldMuationType::Mutate, FieldMuationType::None}, 3};
+    inline constexpr MutationOps kOneofSetMutations{{FieldMuationType::Mutate, FieldMuationType::None}, 2};
+    inline constexpr MutationOps kRepeatedMutations{{FieldMuationType::MutationAdd, FieldMuationType::Delete,
+                                                     FieldMuationType::Mutate, FieldMuationType::Shuffle, FieldMuationType::None}, 5};
+    inline constexpr MutationOps kRepeatedMessageMutations{{FieldMuationType::MutationAdd, FieldMuationType::Delete,
+                                                            FieldMuationType::Shuffle, FieldMuationType::None}, 4};
+    inline constexpr CrossoverOps kUnsetCrossovers{{CrossoverType::CrossoverAdd, CrossoverType::None}, 2};
+    inline constexpr CrossoverOps kSetCrossovers{{CrossoverType::Replace, CrossoverType::None}, 2};
+    inline constexpr CrossoverOps kRepeatedCrossovers{{CrossoverType::Replace, CrossoverType::CrossoverAdd, CrossoverType::None}, 3};
+
+    // ----------------------Field traits------------------------
+    /**
+     * Every field gets a generated traits struct, the kernels below only use these members:
+     *   using MessageType;                          message that owns the field
+     *   static constexpr FieldDescriptor::Type kType;
+     *   static constexpr int kTagSize;
+     *   static constexpr int kIndex;                FieldDescriptor::index() of the field
+     * singular scalar (enum as int):    ValueType, kHasPresence, Has, Get, Set, Clear, [kEnumCount, kEnumValues]
+     * repeated scalar:                  ValueType, kPacked, Get, Mutable (RepeatedField<ValueType>)
+     * singular message:                 SubType, Has, Get, Mutable, Clear
+     * repeated message:                 SubType, Get, Mutable (RepeatedPtrField<SubType>)
+     * A oneof group gets a traits struct with MessageType, kMemberCount, Current() (index of the member
+     * that is set, -1 if none) and Visit(index, visit), which calls visit(FieldTag<member traits>()).
+     */
+    template<class F>
+    struct FieldTag { using Field = F; };
+    template<class F>
+    using MessageOf = typename F::MessageType;
+    template<class F>
+    inline constexpr bool kIsMessageField = F::kType == FieldDescriptor::TYPE_MESSAGE;
+
+    // Same draws as AddUnsetField() and AddRepeatedField().
+    template<class F>
+    inline typename F::ValueType RandomValue() {
+        using T = typename F::ValueType;
+        if constexpr (F::kType == FieldDescriptor::TYPE_ENUM)
+            return F::kEnumValues[GetRandomIndex(F::kEnumCount - 1)];
+        else if constexpr (std::is_same<T, bool>::value)
+            return GetRandomIndex(1);
+        else if constexpr (std::is_same<T, double>::value || std::is_same<T, float>::value)
+            // small real number
+            return GetRandomNum(-1.0, 1.0);
+        else if constexpr (std::is_same<T, int32_t>::value)
+            return GetRandomNum(INT32_MIN, INT32_MAX);
+        else if constexpr (std::is_same<T, int64_t>::value)
+            return GetRandomNum(INT64_MIN, INT64_MAX);
+        else if constexpr (std::is_same<T, uint32_t>::value)
+            return GetRandomIndex(UINT32_MAX);
+        else
+            return GetRandomIndex(UINT64_MAX);
+    }
+
+    // FindFieldDomain() of the field, the descriptor is only looked up while a mutation has domains.
+    template<class F>
+    inline const FieldDomain* TypedFieldDomain(FieldDomain* domain) {
+        if (!GetActiveDomains()->table) return nullptr;
+        return FindFieldDomain(MessageOf<F>::descriptor()->field(F::kIndex), domain);
+    }
+
+    // Number of values of an enum field, 0 for other types (see MutateFittingValue()).
+    template<class F>
+    constexpr int TypedEnumCount() {
+        if constexpr (F::kType == FieldDescriptor::TYPE_ENUM)
+            return F::kEnumCount;
+        else
+            return 0;
+    }
+
+    // ----------------------Size accounting------------------------
+    // Encoded size of a singular field, tag included, 0 if it is not set.
+    template<class F>
+    inline int TypedFieldSize(const MessageOf<F>& msg) {
+        if (!F::Has(msg)) return 0;
+        if constexpr (kIsMessageField<F>) {
+            int len = GetMessageSize(&F::Get(msg));
+            return F::kTagSize + VarintSize(len) + len;
+        } else
+            return F::kTagSize + WireValueSize(F::kType, F::Get(msg));
+    }
+
+    // Typed ScalarFieldSize(): encoded size of the scalar field once it holds value.
+    template<class F>
+    inline int TypedScalarSize(typename F::ValueType value) {
+        if (!F::kHasPresence && !IsNonZero(value)) return 0;
+        return F::kTagSize + WireValueSize(F::kType, value);
+    }
+
+    // Encoded size of an element of a repeated field, tag excluded.
+    template<class F, class Container>
+    inline int TypedElementSize(const Container& field, int index) {
+        if constexpr (kIsMessageField<F>) {
+            int len = GetMessageSize(&field.Get(index));
+            return VarintSize(len) + len;
+        } else
+            return WireValueSize(F::kType, field.Get(index));
+    }
+
+    template<class F>
+    inline RepeatedFieldSize TypedRepeatedSize(const MessageOf<F>& msg) {
+        const auto& field = F::Get(msg);
+        int payload = 0;
+        if constexpr (!kIsMessageField<F>) {
+            if (F::kPacked) {
+                if (constexpr int fixed_size = FixedTypeSize(F::kType))
+                    payload = field.size() * fixed_size;
+                else
+                    for (auto value : field) payload += WireValueSize(F::kType, value);
+            }
+            return RepeatedFieldSize(F::kPacked, F::kTagSize, field.size(), payload);
+        } else
+            return RepeatedFieldSize(false, F::kTagSize, field.size(), payload);
+    }
+
+    /**
+     * @brief Typed EditEmbeddedMessage(): run edit(sub, remain_size) and charge the change of
+     *        the tag and length prefix. present must be read before the sub message is created.
+     */
+    template<class Sub, class Edit>
+    inline void TypedEditEmbedded(bool present, int tag_size, Sub* sub, int& remain_size, Edit edit) {
+        int old_size = GetMessageSize(sub);
+        int overhead = present ? tag_size + VarintSize(old_size) : 0;
+        int sub_remain = remain_size - EmbeddedReserve(tag_size, old_size, overhead, remain_size);
+        int old_remain = sub_remain;
+        edit(sub, sub_remain);
+        int len = old_remain - sub_remain;
+        remain_size -= len + tag_size + VarintSize(old_size + len) - overhead;
+    }
+
+    // ----------------------Singular fields------------------------
+    // Set a message field (or oneof member) to a random message, old_size is the size of the member it replaces.
+    template<class F>
+    void TypedCreateOneofMessage(MessageOf<F>* msg, int old_size, int& remain_size) {
+        // the old member is replaced, so its bytes are available to the new one
+        int msg_remain_size = EmbeddedBudget(F::kTagSize, remain_size + old_size);
+        if (msg_remain_size < 0) return;
+        int old_remain = msg_remain_size;
+        TypedMutator<typename F::SubType>::CreateRandom(F::Mutable(msg), msg_remain_size);
+        int len = old_remain - msg_remain_size;
+        remain_size -= F::kTagSize + VarintSize(len) + len - old_size;
+    }
+
+    // AddUnsetField() of a scalar field or a oneof scalar member.
+    template<class F>
+    void TypedAddUnsetField(MessageOf<F>* msg, int& remain_size) {
+        int old_size = TypedFieldSize<F>(*msg);
+        if constexpr (kIsMessageField<F>) {
+            TypedCreateOneofMessage<F>(msg, old_size, remain_size);
+        } else {
+            // the size of a new value is known before it is set, values are drawn until one fits
+            typename F::ValueType value;
+            FieldDomain domain_storage;
+            const FieldDomain* domain = TypedFieldDomain<F>(&domain_storage);
+            if (!DrawFittingDomainValue(&value, domain, [] { return RandomValue<F>(); }, [&](auto candidate) {
+                    return FitsBudget(TypedScalarSize<F>(candidate) - old_size, remain_size);
+                }))
+                return;
+            F::Set(msg, value);
+            remain_size -= TypedScalarSize<F>(value) - old_size;
+        }
+    }
+
+    template<class F>
+    void TypedDeleteSetField(MessageOf<F>* msg, int& remain_size) {
+        if (!CanDeleteSimpleField()) return;
+        remain_size += TypedFieldSize<F>(*msg);
+        F::Clear(msg);
+    }
+
+    // MutateSetField() of a scalar field, old_size is the size before the edit
+    // (of another member if the edit switches a oneof group).
+    template<class F>
+    void TypedMutateSetField(MessageOf<F>* msg, int old_size, int& remain_size) {
+        auto now = F::Get(*msg);
+        int enum_count = TypedEnumCount<F>();
+        FieldDomain domain_storage;
+        const FieldDomain* domain = TypedFieldDomain<F>(&domain_storage);
+        if (!MutateFittingValue(&now, enum_count, domain, [&](auto candidate) {
+                return FitsBudget(TypedScalarSize<F>(candidate) - old_size, remain_size);
+            }))
+            return;
+        F::Set(msg, now);
+        remain_size -= TypedScalarSize<F>(now) - old_size;
+    }
+
+    // ReplaceSetField() / CrossoverAddUnsetField(): copy the field of message2, old_size is the size it replaces.
+    template<class F>
+    void TypedCopySetField(MessageOf<F>* msg1, const MessageOf<F>& msg2, int old_size, int& remain_size) {
+        int delta = TypedFieldSize<F>(msg2) - old_size;
+        if (remain_size < delta) return;
+        if constexpr (kIsMessageField<F>)
+            F::Mutable(msg1)->CopyFrom(F::Get(msg2));
+        else
+            F::Set(msg1, F::Get(msg2));
+        remain_size -= delta;
+    }
+
+    template<class F>
+    void TypedScalarMutation(MessageOf<F>* msg, int& remain_size) {
+        if (!F::Has(*msg)) {
+            if (PickOp(kUnsetMutations) == FieldMuationType::MutationAdd)
+                TypedAddUnsetField<F>(msg, remain_size);
+            return;
+        }
+        switch (PickOp(kScalarSetMutations)) {
+            case FieldMuationType::Delete:
+                TypedDeleteSetField<F>(msg, remain_size);
+                break;
+            case FieldMuationType::Mutate:
+                TypedMutateSetField<F>(msg, TypedFieldSize<F>(*msg), remain_size);
+                break;
+            default:
+                break;
+        }
+    }
+
+    template<class F>
+    void TypedScalarCrossover(MessageOf<F>* msg1, const MessageOf<F>& msg2, int& remain_size) {
+        if (!F::Has(msg2)) return;
+        // Replace a set field or add an unset one, both copy the value of message2
+        if (F::Has(*msg1) ? PickOp(kSetCrossovers) == CrossoverType::Replace
+                          : PickOp(kUnsetCrossovers) == CrossoverType::CrossoverAdd)
+            TypedCopySetField<F>(msg1, msg2, TypedFieldSize<F>(*msg1), remain_size);
+    }
+
+    // Embedded message should be mutated recursively
+    template<class F>
+    void TypedMessageMutation(MessageOf<F>* msg, int& remain_size) {
+        bool present = F::Has(*msg);
+        TypedEditEmbedded(present, F::kTagSize, F::Mutable(msg), remain_size,
+                          [](typename F::SubType* sub, int& r) { TypedMutator<typename F::SubType>::Mutate(sub, r); });
+    }
+
+    template<class F>
+    void TypedMessageCrossover(MessageOf<F>* msg1, const MessageOf<F>& msg2, int& remain_size) {
+        bool present = F::Has(*msg1);
+        TypedEditEmbedded(present, F::kTagSize, F::Mutable(msg1), remain_size,
+                          [&msg2](typename F::SubType* sub, int& r) { TypedMutator<typename F::SubType>::Crossover(sub, F::Get(msg2), r); });
+    }
+
+    // ----------------------Oneof groups------------------------
+    // AddUnsetField() of a oneof group that is not set.
+    template<class O>
+    void TypedAddOneofMember(MessageOf<O>* msg, int& remain_size) {
+        O::Visit(GetRandomIndex(O::kMemberCount - 1), [&](auto tag) {
+            using F = typename decltype(tag)::Field;
+            if constexpr (kIsMessageField<F>)
+                TypedCreateOneofMessage<F>(msg, 0, remain_size);
+            else
+                TypedAddUnsetField<F>(msg, remain_size);
+        });
+    }
+
+    // CreateRandomField() of a oneof group: a message member is created directly,
+    // otherwise AddUnsetField() picks the member again.
+    template<class O>
+    void TypedCreateOneofMember(MessageOf<O>* msg, int& remain_size) {
+        bool created = false;
+        O::Visit(GetRandomIndex(O::kMemberCount - 1), [&](auto tag) {
+            using F = typename decltype(tag)::Field;
+            if constexpr (kIsMessageField<F>) {
+                TypedCreateOneofMessage<F>(msg, 0, remain_size);
+                created = true;
+            }
+        });
+        if (!created) TypedAddOneofMember<O>(msg, remain_size);
+    }
+
+    template<class O>
+    void TypedOneofMutation(MessageOf<O>* msg, int& remain_size) {
+        int index = O::Current(*msg);
+        if (index < 0) {
+            if (PickOp(kUnsetMutations) == FieldMuationType::MutationAdd)
+                TypedAddOneofMember<O>(msg, remain_size);
+            return;
+        }
+        // do not delete oneof field
+        if (PickOp(kOneofSetMutations) != FieldMuationType::Mutate) return;
+        int old_size = 0;
+        O::Visit(index, [&](auto tag) { old_size = TypedFieldSize<typename decltype(tag)::Field>(*msg); });
+        int new_index = index;
+        MutateValue(&new_index);
+        new_index = NotNegMod(new_index, O::kMemberCount);
+        // If the index does not change, then mutate the field itself
+        if (new_index == index) {
+            O::Visit(index, [&](auto tag) {
+                using F = typename decltype(tag)::Field;
+                if constexpr (kIsMessageField<F>) TypedMessageMutation<F>(msg, remain_size);
+            });
+            return;
+        }
+        O::Visit(new_index, [&](auto tag) {
+            using F = typename decltype(tag)::Field;
+            if constexpr (kIsMessageField<F>)
+                TypedCreateOneofMessage<F>(msg, old_size, remain_size);
+            else
+                TypedMutateSetField<F>(msg, old_size, remain_size);
+        });
+    }
+
+    template<class O>
+    void TypedOneofCrossover(MessageOf<O>* msg1, const MessageOf<O>& msg2, int& remain_size) {
+        int index2 = O::Current(msg2);
+        if (index2 < 0) return;
+        int index1 = O::Current(*msg1);
+        if (index1 < 0) {
+            if (PickOp(kUnsetCrossovers) == CrossoverType::CrossoverAdd)
+                O::Visit(index2, [&](auto tag) { TypedCopySetField<typename decltype(tag)::Field>(msg1, msg2, 0, remain_size); });
+            return;
+        }
+        if (PickOp(kSetCrossovers) == CrossoverType::Replace) {
+            int old_size = 0;
+            O::Visit(index1, [&](auto tag) { old_size = TypedFieldSize<typename decltype(tag)::Field>(*msg1); });
+            O::Visit(index2, [&](auto tag) { TypedCopySetField<typename decltype(tag)::Field>(msg1, msg2, old_size, remain_size); });
+        }
+        // recursive crossover for embedded message types.
+        else if (index1 == index2)
+            O::Visit(index1, [&](auto tag) {
+                using F = typename decltype(tag)::Field;
+                if constexpr (kIsMessageField<F>) TypedMessageCrossover<F>(msg1, msg2, remain_size);
+            });
+    }
+
+    // ----------------------Repeated fields------------------------
+    template<class F>
+    void TypedAddRepeatedField(MessageOf<F>* msg, int& remain_size, int min_new_size) {
+        // newLen in [min_new_size, MAX_NEW_REPEATED_SIZE]
+        auto newLen = GetRandomNum(min_new_size, MAX_NEW_REPEATED_SIZE);
+        auto field = F::Mutable(msg);
+        auto size = TypedRepeatedSize<F>(*msg);
+        FieldDomain domain_storage;
+        const FieldDomain* domain = TypedFieldDomain<F>(&domain_storage);
+        newLen = std::min(newLen, RoomInDomain(domain, field->size()));
+        for (int i = 1; i <= newLen; i++) {
+            int elem_size;
+            if constexpr (kIsMessageField<F>) {
+                // the content is created within the budget left after the tag and the length prefix
+                int msg_remain_size = EmbeddedBudget(F::kTagSize, remain_size);
+                if (msg_remain_size < 0) return;
+                int old_remain = msg_remain_size;
+                TypedMutator<typename F::SubType>::CreateRandom(field->Add(), msg_remain_size);
+                int len = old_remain - msg_remain_size;
+                elem_size = VarintSize(len) + len;
+            } else {
+                // the size of a new element is known before it is added, values are drawn until one fits
+                typename F::ValueType value;
+                if (!DrawFittingDomainValue(&value, domain, [] { return RandomValue<F>(); }, [&](auto candidate) {
+                        return FitsBudget(size.AddDelta(WireValueSize(F::kType, candidate)), remain_size);
+                    }))
+                    return;
+                field->Add(value);
+                elem_size = WireValueSize(F::kType, value);
+            }
+            remain_size -= size.Add(elem_size);
+        }
+    }
+
+    template<class F>
+    void TypedDeleteRepeatedField(MessageOf<F>* msg, int& remain_size) {
+        auto field = F::Mutable(msg);
+        int len = field->size();
+        if (len <= MAX_NEW_REPEATED_SIZE) return;
+        auto cnt = GetRandomIndex(min(len / 2, MAX_NEW_REPEATED_SIZE / 2));
+        if (cnt == 0) return;
+        int idx[MAX_NEW_REPEATED_SIZE / 2];
+        SampleIndices(len, cnt, idx);
+        std::sort(idx, idx + cnt);
+        auto size = TypedRepeatedSize<F>(*msg);
+        for (int i = 0; i < cnt; i++) remain_size -= size.Remove(TypedElementSize<F>(*field, idx[i]));
+        EraseSorted(*field, idx, cnt);
+    }
+
+    template<class F>
+    void TypedMutateRepeatedField(MessageOf<F>* msg, int& remain_size) {
+        auto field = F::Mutable(msg);
+        int len = field->size();
+        auto size = TypedRepeatedSize<F>(*msg);
+        int enum_count = TypedEnumCount<F>();
+        FieldDomain domain_storage;
+        const FieldDomain* domain = TypedFieldDomain<F>(&domain_storage);
+        for (int i = 0; i < len; i++) {
+            if (!CanMutate()) continue;
+            auto now = field->Get(i);
+            // the change of the element (and of a packed length prefix) is predicted before it is set
+            int old_elem = WireValueSize(F::kType, now);
+            if (!MutateFittingValue(&now, enum_count, domain, [&](auto candidate) {
+                    return FitsBudget(size.ResizeDelta(old_elem, WireValueSize(F::kType, candidate)), remain_size);
+                }))
+                continue;
+            field->Set(i, now);
+            remain_size -= size.Resize(old_elem, WireValueSize(F::kType, now));
+        }
+    }
+
+    // Shuffling only reorders the elements, so the encoded size does not change.
+    template<class F>
+    void TypedShuffleRepeatedField(MessageOf<F>* msg) {
+        auto field = F::Mutable(msg);
+        if constexpr (kIsMessageField<F>)
+            ShuffleElements(*field);
+        else
+            RandomShuffle(field->begin(), field->end());
+    }
+
+    template<class F>
+    void TypedRepeatedMutation(MessageOf<F>* msg, int& remain_size) {
+        switch (PickOp(kIsMessageField<F> ? kRepeatedMessageMutations : kRepeatedMutations)) {
+            case FieldMuationType::MutationAdd:
+                TypedAddRepeatedField<F>(msg, remain_size, 1);
+                break;
+            case FieldMuationType::Delete:
+                TypedDeleteRepeatedField<F>(msg, remain_size);
+                break;
+            case FieldMuationType::Mutate:
+                if constexpr (!kIsMessageField<F>) TypedMutateRepeatedField<F>(msg, remain_size);
+                break;
+            case FieldMuationType::Shuffle:
+                TypedShuffleRepeatedField<F>(msg);
+                break;
+            default:
+                break;
+        }
+        // Embedded message should be mutated recursively
+        if constexpr (kIsMessageField<F>) {
+            auto field = F::Mutable(msg);
+            for (int i = 0; i < field->size(); i++)
+                TypedEditEmbedded(true, F::kTagSize, field->Mutable(i), remain_size,
+                                  [](typename F::SubType* sub, int& r) { TypedMutator<typename F::SubType>::Mutate(sub, r); });
+        }
+    }
+
+    template<class F>
+    void TypedReplaceRepeatedField(MessageOf<F>* msg1, const MessageOf<F>& msg2, int& remain_size) {
+        auto field1 = F::Mutable(msg1);
+        const auto& field2 = F::Get(msg2);
+        int len1 = field1->size(), len2 = field2.size();
+        if (len1 == 0 || len2 == 0) return;
+        auto size = TypedRepeatedSize<F>(*msg1);
+        auto cnt = GetRandomIndex(min(len1 - 1, MAX_REPLACE_REPEATED_SIZE));
+        int idx1[MAX_REPLACE_REPEATED_SIZE];
+        SampleIndices(len1, cnt, idx1);
+        for (int i = 0; i < cnt; i++) {
+            auto idx2 = GetRandomIndex(len2 - 1);
+            // The new element has the same encoded size as its source in message2
+            int old_elem = TypedElementSize<F>(*field1, idx1[i]);
+            int new_elem = TypedElementSize<F>(field2, idx2);
+            if (remain_size < size.ResizeDelta(old_elem, new_elem))
+                continue;
+            if constexpr (kIsMessageField<F>)
+                field1->Mutable(idx1[i])->CopyFrom(field2.Get(idx2));
+            else
+                field1->Set(idx1[i], field2.Get(idx2));
+            remain_size -= size.Resize(old_elem, new_elem);
+        }
+    }
+
+    template<class F>
+    void TypedCrossoverAddRepeatedField(MessageOf<F>* msg1, const MessageOf<F>& msg2, int& remain_size) {
+        auto field1 = F::Mutable(msg1);
+        const auto& field2 = F::Get(msg2);
+        int len2 = field2.size();
+        auto newLen = GetRandomIndex(min(len2, MAX_NEW_REPEATED_SIZE));
+        FieldDomain domain;
+        newLen = std::min(newLen, RoomInDomain(TypedFieldDomain<F>(&domain), field1->size()));
+        if (newLen == 0) return;
+        // range splice, see CrossoverAddRepeatedField()
+        int begin = GetRandomIndex(len2 - newLen);
+        auto size = TypedRepeatedSize<F>(*msg1);
+        int end = begin + FitRange(newLen, size, remain_size, [&](int i) { return TypedElementSize<F>(field2, begin + i); });
+        if constexpr (kIsMessageField<F>) {
+            for (int i = begin; i < end; i++) field1->Add()->CopyFrom(field2.Get(i));
+        } else
+            field1->Add(field2.begin() + begin, field2.begin() + end);
+    }
+
+    template<class F>
+    void TypedRepeatedCrossover(MessageOf<F>* msg1, const MessageOf<F>& msg2, int& remain_size) {
+        switch (PickOp(kRepeatedCrossovers)) {
+            case CrossoverType::Replace:
+                TypedReplaceRepeatedField<F>(msg1, msg2, remain_size);
+                return;
+            case CrossoverType::CrossoverAdd:
+                TypedCrossoverAddRepeatedField<F>(msg1, msg2, remain_size);
+                return;
+            default:
+                break;
+        }
+        // recursive crossover for embedded message types.
+        if constexpr (kIsMessageField<F>) {
+            auto field1 = F::Mutable(msg1);
+            const auto& field2 = F::Get(msg2);
+            int field_size = min(field1->size(), field2.size());
+            for (int i = 0; i < field_size; i++)
+                TypedEditEmbedded(true, F::kTagSize, field1->Mutable(i), remain_size,
+                                  [&field2, i](typename F::SubType* sub, int& r) { TypedMutator<typename F::SubType>::Crossover(sub, field2.Get(i), r); });
+        }
+    }
+}  // namespace protobuf_mutator
+
+#endif  // SRC_TYPED_MUTATOR_H_
@@ -0,0 +1,79 @@
+#include <mutex>
+#include "value_domain.h"
+
+namespace protobuf_mutator {
+    namespace {
+        std::mutex registry_mutex;
+
+        // Function-local static, so that registration from static initializers of other units is safe.
+        std::unordered_map<const Descriptor*, std::unique_ptr<ValueDomainTable>>* GetRegistry() {
+            static std::unordered_map<const Descriptor*, std::unique_ptr<ValueDomainTable>> tables;
+            return &tables;
+        }
+    }
+
+    int ValueDomainTable::AddSource(const vector<const FieldDescriptor*>& path) {
+        auto it = std::find(sources_.begin(), sources_.end(), path);
+        if (it != sources_.end()) return it - sources_.begin();
+        if (sources_.size() == MAX_DOMAIN_SOURCES) return -1;
+        sources_.push_back(path);
+        return sources_.size() - 1;
+    }
+
+    void ValueDomainTable::TakeSizes(const Message& root, uint32_t* sizes) const {
+        for (size_t i = 0; i < sources_.size(); i++) {
+            const Message* parent = &root;
+            const auto& path = sources_[i];
+            for (size_t j = 0; j + 1 < path.size(); j++)
+                parent = &parent->GetReflection()->GetMessage(*parent, path[j]);
+            sizes[i] = parent->GetReflection()->FieldSize(*parent, path.back());
+        }
+    }
+
+    void RegisterValueDomains(std::unique_ptr<ValueDomainTable> table) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto& entry = (*GetRegistry())[table->Root()];
+        if (!entry) entry = std::move(table);
+    }
+
+    const ValueDomainTable* FindValueDomains(const Descriptor* root) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto tables = GetRegistry();
+        auto it = tables->find(root);
+        return it == tables->end() ? nullptr : it->second.get();
+    }
+
+    DomainScope::DomainScope(const Message& root) {
+        ActiveDomains* active = GetActiveDomains();
+        previous_ = active->table;
+        const ValueDomainTable* table = GetValueDomains(root.GetDescriptor());
+        active->table = table && !table->Empty() ? table : nullptr;
+        if (active->table) table->TakeSizes(root, active->sizes);
+    }
+
+    const FieldDomain* FindFieldDomain(const FieldDescriptor* field, FieldDomain* domain) {
+        const ActiveDomains* active = GetActiveDomains();
+        if (!active->table) return nullptr;
+        const ValueDomain* found = active->table->Find(field);
+        if (!found) return nullptr;
+        domain->has_range = found->has_range;
+        domain->min = found->min;
+        domain->max = found->max;
+        if (found->source >= 0) {
+            uint32_t size = active->sizes[found->source];
+            // the intersection with a range, an index into an empty field (or an empty intersection) is free
+            double lo = domain->has_range ? std::max(domain->min, 0.0) : 0;
+            double hi = domain->has_range ? std::min(domain->max, (double)size - 1) : (double)size - 1;
+            if (size && lo <= hi) {
+                domain->has_range = true;
+                domain->min = lo;
+                domain->max = hi;
+            }
+        }
+        domain->power_of_two = found->power_of_two;
+        domain->enum_in = found->enum_in.data();
+        domain->enum_count = found->enum_in.size();
+        domain->max_size = found->max_size;
+        return domain;
+    }
+}  // namespace protobuf_mutator
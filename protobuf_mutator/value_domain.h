@@ -0,0 +1,249 @@
+#ifndef SRC_VALUE_DOMAIN_H_
+#define SRC_VALUE_DOMAIN_H_
+
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include "mutate_util.h"
+
+namespace protobuf_mutator {
+    // index_into paths of one root type
+    #define MAX_DOMAIN_SOURCES (8)
+
+    // ----------------------Value kernels------------------------
+    // Shared with the constraints that post-processing applies (postprocess/typed_constraints.h), a value drawn
+    // inside a domain is left as it is by them.
+
+    // clampToRange() of openfhe_ckks_postprocess.h for every field type
+    template<class T>
+    inline typename std::enable_if<std::is_integral<T>::value, T>::type ClampValue(T value, T lo, T hi) {
+        if(lo <= value && value <= hi)
+            return value;
+        return NotNegMod(value, (T)(hi - lo + 1)) + lo;
+    }
+
+    template<class T>
+    inline typename std::enable_if<std::is_floating_point<T>::value, T>::type ClampValue(T value, T lo, T hi) {
+        if(lo <= value && value <= hi)
+            return value;
+        T len = hi - lo;
+        T integer = floor(value);
+        T decimal = value - integer;
+        return fmod(fmod(integer, len) + len, len) + lo + decimal;
+    }
+
+    // the largest power of two that is not above value, like reduceToPowerOfTwo()
+    template<class T>
+    inline T ReduceToPowerOfTwo(T value) {
+        if((value & (value - 1)) == 0) return value;
+        T res = 1;
+        while (value >>= 1) res <<= 1;
+        return res;
+    }
+
+    // ----------------------Value domains------------------------
+    /**
+     * @brief The values one field may take, the FieldConstraint options of proto/constraints.proto as the mutator
+     *        sees them: values are drawn and mutated inside the domain instead of being clamped into it afterwards.
+     */
+    struct ValueDomain {
+        bool has_range = false;
+        double min = 0, max = 0;            // inclusive
+        bool power_of_two = false;          // unsigned fields only
+        vector<int32_t> enum_in;            // allowed enum numbers, empty for all
+        int source = -1;                    // index_into: position of the path in ValueDomainTable, -1 for none
+        uint32_t max_size = UINT32_MAX;     // repeated fields: no element is added beyond it
+    };
+
+    /**
+     * @brief A ValueDomain with the index_into size of the message that is being mutated filled in: an index
+     *        is a range [0, size - 1]. An index into an empty field is not restricted, there is nothing to point to.
+     */
+    struct FieldDomain {
+        bool has_range = false;
+        double min = 0, max = 0;
+        bool power_of_two = false;
+        const int32_t* enum_in = nullptr;
+        int enum_count = 0;
+        uint32_t max_size = UINT32_MAX;
+
+        // whether the values are restricted at all, a domain that only has max_size draws like a field without one
+        bool HasValues() const { return has_range || power_of_two || enum_count; }
+    };
+
+    /**
+     * @brief The value domains of the fields below one root type.
+     * @details A domain belongs to a field of a message type, it holds wherever that type occurs below the root.
+     *          index_into paths start at the root, their sizes are taken once per mutation (see DomainScope).
+     *          A table never changes once it is registered.
+     */
+    class ValueDomainTable {
+    public:
+        explicit ValueDomainTable(const Descriptor* root) : root_(root) {}
+
+        const Descriptor* Root() const { return root_; }
+        // Position of a path from the root (the last field is repeated), -1 if there are MAX_DOMAIN_SOURCES already.
+        int AddSource(const vector<const FieldDescriptor*>& path);
+        void Set(const FieldDescriptor* field, const ValueDomain& domain) { domains_[field] = domain; }
+        // nullptr if the field has no domain
+        const ValueDomain* Find(const FieldDescriptor* field) const {
+            auto it = domains_.find(field);
+            return it == domains_.end() ? nullptr : &it->second;
+        }
+        bool Empty() const { return domains_.empty(); }
+        // the size of every path in root, a message of the root type
+        void TakeSizes(const Message& root, uint32_t* sizes) const;
+
+    private:
+        const Descriptor* root_;
+        std::unordered_map<const FieldDescriptor*, ValueDomain> domains_;
+        vector<vector<const FieldDescriptor*>> sources_;
+    };
+
+    // Register the table of its root type before the first mutation of that type, a type keeps its first table.
+    void RegisterValueDomains(std::unique_ptr<ValueDomainTable> table);
+    // nullptr if no table is registered for the root type.
+    const ValueDomainTable* FindValueDomains(const Descriptor* root);
+
+    // The table of the mutation that runs on the calling thread and the sizes of its index_into paths,
+    // see mutator_context.h.
+    struct ActiveDomains {
+        const ValueDomainTable* table = nullptr;
+        uint32_t sizes[MAX_DOMAIN_SOURCES];
+    };
+    ActiveDomains* GetActiveDomains();
+    // Table lookup through the context of the calling thread.
+    const ValueDomainTable* GetValueDomains(const Descriptor* root);
+
+    /**
+     * @brief Mutator::Mutate() and Crossover() stay inside the domains of their root message while the scope lives.
+     * @details The sizes of the index_into paths are taken when the scope begins, an edit that resizes a source
+     *          later in the same mutation is caught by post-processing.
+     */
+    class DomainScope {
+    public:
+        explicit DomainScope(const Message& root);
+        DomainScope(const DomainScope&) = delete;
+        DomainScope& operator=(const DomainScope&) = delete;
+        ~DomainScope() { GetActiveDomains()->table = previous_; }
+
+    private:
+        const ValueDomainTable* previous_;
+    };
+
+    // The domain of field in the active mutation, filled into *domain and returned; nullptr if there is none.
+    const FieldDomain* FindFieldDomain(const FieldDescriptor* field, FieldDomain* domain);
+
+    // ----------------------Drawing inside a domain------------------------
+    // exponents of the powers of two of T in the range of the domain, false if there is none
+    template<class T>
+    inline bool PowerOfTwoExponents(const FieldDomain& domain, int* lo, int* hi) {
+        *lo = 0;
+        *hi = sizeof(T) * 8 - 1;
+        if (domain.has_range) {
+            while (*lo <= *hi && std::ldexp(1.0, *lo) < domain.min) (*lo)++;
+            while (*hi >= *lo && std::ldexp(1.0, *hi) > domain.max) (*hi)--;
+        }
+        return *lo <= *hi;
+    }
+
+    // a uniform value of the range, both ends included for integers
+    template<class T>
+    inline T RangeValue(const FieldDomain& domain) {
+        if constexpr (std::is_floating_point<T>::value)
+            return (T)GetRandomNum(domain.min, domain.max);
+        else
+            return GetRandomNum((T)domain.min, (T)domain.max);
+    }
+
+    /**
+     * @brief A random value of the domain, which must have HasValues(): an allowed enum number, a power of two
+     *        of the range (uniform exponent) or a uniform value of the range.
+     */
+    template<class T>
+    inline T DomainValue(const FieldDomain& domain) {
+        // no constraint applies to a bool
+        if constexpr (std::is_same<T, bool>::value) {
+            return GetRandomIndex(1);
+        } else {
+            if (domain.enum_count)
+                return (T)domain.enum_in[GetRandomIndex(domain.enum_count - 1)];
+            if constexpr (std::is_unsigned<T>::value) {
+                int lo, hi;
+                if (domain.power_of_two && PowerOfTwoExponents<T>(domain, &lo, &hi))
+                    return (T)1 << GetRandomNum(lo, hi);
+            }
+            return domain.has_range ? RangeValue<T>(domain) : T();
+        }
+    }
+
+    /**
+     * @brief Mutate *value into another value of the domain, which must have HasValues().
+     * @details An enum number or a power of two is replaced by another allowed one. A value of a range gets the
+     *          bit flips of MutateValue(): an integer is folded back into the range like ClampValue(), a real number
+     *          that leaves it is flipped again. After 10 flips that do not give another value of the range it is
+     *          drawn uniformly. A value outside the domain is folded into it first.
+     */
+    template<class T>
+    inline void MutateInDomain(T* value, const FieldDomain& domain) {
+        if constexpr (std::is_same<T, bool>::value) {
+            *value = !*value;
+        } else {
+            if (domain.enum_count) {
+                if (domain.enum_count == 1) { *value = (T)domain.enum_in[0]; return; }
+                // one draw among the other values: the old one is swapped for the last
+                T now = (T)domain.enum_in[GetRandomIndex(domain.enum_count - 2)];
+                *value = now == *value ? (T)domain.enum_in[domain.enum_count - 1] : now;
+                return;
+            }
+            if constexpr (std::is_unsigned<T>::value) {
+                int lo, hi;
+                if (domain.power_of_two && PowerOfTwoExponents<T>(domain, &lo, &hi)) {
+                    if (lo == hi) { *value = (T)1 << lo; return; }
+                    T now = (T)1 << GetRandomNum(lo, hi - 1);
+                    *value = now == *value ? (T)1 << hi : now;
+                    return;
+                }
+            }
+            if (!domain.has_range) return;
+            T lo = (T)domain.min, hi = (T)domain.max;
+            T old = ClampValue(*value, lo, hi);
+            for (int i = 0; i < 10; i++) {
+                T now = flipBit(old);
+                // a real number is not folded: fmod() of a flipped exponent is slow, and an infinity or NaN
+                // can not be folded at all
+                if constexpr (std::is_integral<T>::value) now = ClampValue(now, lo, hi);
+                if (now != old && lo <= now && now <= hi) { *value = now; return; }
+            }
+            *value = RangeValue<T>(domain);
+        }
+    }
+
+    // DrawFittingValue() of new values: inside the domain if there is one, draw() otherwise.
+    template<class T, class Draw, class Fits>
+    inline bool DrawFittingDomainValue(T* value, const FieldDomain* domain, Draw draw, Fits fits) {
+        if (domain && domain->HasValues())
+            return DrawFittingValue(value, [domain] { return DomainValue<T>(*domain); }, fits);
+        return DrawFittingValue(value, draw, fits);
+    }
+
+    // MutateFittingValue() inside the domain if there is one.
+    template<class T, class Fits>
+    inline bool MutateFittingValue(T* value, int enum_count, const FieldDomain* domain, Fits fits) {
+        if (!domain || !domain->HasValues()) return MutateFittingValue(value, enum_count, fits);
+        T old = *value;
+        return DrawFittingValue(value, [old, domain] {
+            T now = old;
+            MutateInDomain(&now, *domain);
+            return now;
+        }, fits);
+    }
+
+    // Elements a repeated field of count elements may still get.
+    inline int RoomInDomain(const FieldDomain* domain, int count) {
+        if (!domain || domain->max_size == UINT32_MAX) return INT32_MAX;
+        return std::max((int64_t)domain->max_size - count, (int64_t)0);
+    }
+}  // namespace protobuf_mutator
+
+#endif  // SRC_VALUE_DOMAIN_H_
@@ -0,0 +1,73 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include "typed_mutator_generator.h"
+
+namespace protobuf_mutator {
+    using google::protobuf::DescriptorPool;
+    using google::protobuf::FileDescriptorSet;
+
+    // Write one generated file to dir/name, false on error.
+    template<class Generate>
+    bool WriteFile(const std::string& dir, const std::string& name, Generate generate) {
+        std::string path = dir + "/" + name;
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+        google::protobuf::io::FileOutputStream output(fd);
+        {
+            google::protobuf::io::Printer printer(&output, '$');
+            generate(&printer);
+            if (printer.failed()) {
+                fprintf(stderr, "failed to write %s\n", path.c_str());
+                output.Close();
+                return false;
+            }
+        }
+        return output.Close();
+    }
+}  // namespace protobuf_mutator
+
+/**
+ * @brief typed_mutator_gen <descriptor set> <proto file> <output dir>: the generator of protoc-gen-typed_mutator
+ *        without the plugin protocol, for machines without libprotoc.
+ * @details The descriptor set comes from protoc --include_imports --descriptor_set_out. Its field options are
+ *          parsed with the generated extensions, constraints.pb is linked in for (protobuf_mutator.constraint).
+ */
+int main(int argc, char* argv[]) {
+    using namespace protobuf_mutator;
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <descriptor set> <proto file> <output dir>\n", argv[0]);
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    FileDescriptorSet set;
+    if (!in || !set.ParseFromString(data)) {
+        fprintf(stderr, "%s: not a descriptor set\n", argv[1]);
+        return 1;
+    }
+    // --include_imports lists every file after its dependencies
+    DescriptorPool pool;
+    for (const auto& file : set.file())
+        if (!pool.BuildFile(file)) {
+            fprintf(stderr, "%s: can not build %s\n", argv[1], file.name().c_str());
+            return 1;
+        }
+    auto file = pool.FindFileByName(argv[2]);
+    if (!file) {
+        fprintf(stderr, "%s: %s is not in the descriptor set\n", argv[1], argv[2]);
+        return 1;
+    }
+    TypedMutatorGenerator generator(file);
+    bool ok = WriteFile(argv[3], generator.HeaderName(), [&](auto printer) { generator.GenerateHeader(printer); }) &&
+              WriteFile(argv[3], generator.SourceName(), [&](auto printer) { generator.GenerateSource(printer); });
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#include <memory>
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/compiler/plugin.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include "typed_mutator_generator.h"
+
+namespace protobuf_mutator {
+    using google::protobuf::FileDescriptor;
+    using google::protobuf::compiler::CodeGenerator;
+    using google::protobuf::compiler::GeneratorContext;
+
+    /**
+     * @brief protoc plugin: protoc --plugin=protoc-gen-typed_mutator --typed_mutator_out=<dir> xxx.proto
+     *        writes xxx.typed_mutator.h and xxx.typed_mutator.cc next to xxx.pb.h.
+     */
+    class TypedMutatorCodeGenerator : public CodeGenerator {
+    public:
+        // proto3 optional fields have explicit presence, the generated traits use their has_ accessors.
+        uint64_t GetSupportedFeatures() const override { return FEATURE_PROTO3_OPTIONAL; }
+
+        bool Generate(const FileDescriptor* file, const std::string& /*parameter*/,
+                      GeneratorContext* context, std::string* error) const override {
+            TypedMutatorGenerator generator(file);
+            {
+                std::unique_ptr<google::protobuf::io::ZeroCopyOutputStream> output(context->Open(generator.HeaderName()));
+                google::protobuf::io::Printer printer(output.get(), '$');
+                generator.GenerateHeader(&printer);
+                if (printer.failed()) {
+                    *error = "failed to write " + generator.HeaderName();
+                    return false;
+                }
+            }
+            std::unique_ptr<google::protobuf::io::ZeroCopyOutputStream> output(context->Open(generator.SourceName()));
+            google::protobuf::io::Printer printer(output.get(), '$');
+            generator.GenerateSource(&printer);
+            if (printer.failed()) {
+                *error = "failed to write " + generator.SourceName();
+                return false;
+            }
+            return true;
+        }
+    };
+}  // namespace protobuf_mutator
+
+int main(int argc, char* argv[]) {
+    protobuf_mutator::TypedMutatorCodeGenerator generator;
+    return google::protobuf::compiler::PluginMain(argc, argv, &generator);
+}
@@ -0,0 +1,553 @@
+#include "typed_mutator_generator.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <set>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/wire_format.h>
+#include "constraints.pb.h"
+
+namespace protobuf_mutator {
+    using google::protobuf::Descriptor;
+    using google::protobuf::EnumDescriptor;
+    using google::protobuf::FieldDescriptor;
+    using google::protobuf::FileDescriptor;
+    using google::protobuf::OneofDescriptor;
+    using google::protobuf::io::Printer;
+    using google::protobuf::internal::WireFormat;
+    using std::string;
+    using Vars = std::map<string, string>;
+
+    namespace {
+        // ----------------------Names of the generated C++ code------------------------
+        string StripProto(const string& name) {
+            return name.size() > 6 && name.compare(name.size() - 6, 6, ".proto") == 0 ? name.substr(0, name.size() - 6) : name;
+        }
+
+        string Replace(string s, const string& from, const string& to) {
+            for (size_t pos = s.find(from); pos != string::npos; pos = s.find(from, pos + to.size()))
+                s.replace(pos, from.size(), to);
+            return s;
+        }
+
+        // "OpenFHE.APISequence.OneAPI" -> "APISequence_OneAPI", as protoc names nested types
+        template<class Desc>
+        string FlatName(const Desc* desc) {
+            const string& package = desc->file()->package();
+            string name = package.empty() ? desc->full_name() : desc->full_name().substr(package.size() + 1);
+            return Replace(name, ".", "_");
+        }
+
+        template<class Desc>
+        string QualifiedName(const Desc* desc) {
+            const string& package = desc->file()->package();
+            return (package.empty() ? "" : "::" + Replace(package, ".", "::")) + "::" + FlatName(desc);
+        }
+
+        // accessor name: the field name in lower case, with "_" appended to C++ keywords
+        string FieldName(const FieldDescriptor* field) {
+            static const std::set<string> kKeywords = {
+                "and", "bool", "break", "case", "catch", "char", "class", "const", "continue", "default", "delete",
+                "do", "double", "else", "enum", "explicit", "extern", "false", "float", "for", "friend", "goto",
+                "if", "inline", "int", "long", "namespace", "new", "not", "operator", "or", "private", "protected",
+                "public", "register", "return", "short", "signed", "sizeof", "static", "struct", "switch", "template",
+                "this", "throw", "true", "try", "typedef", "typename", "union", "unsigned", "using", "virtual",
+                "void", "volatile", "while", "xor"};
+            string name = field->name();
+            for (auto& c : name) c = tolower(c);
+            return kKeywords.count(name) ? name + "_" : name;
+        }
+
+        // "addTwoList" -> "AddTwoList", as protoc names the oneof case constants
+        string CamelName(const string& name) {
+            string result;
+            bool cap_next = true;
+            for (char c : name) {
+                if ('a' <= c && c <= 'z') {
+                    result += cap_next ? char(c - 'a' + 'A') : c;
+                    cap_next = false;
+                } else if ('A' <= c && c <= 'Z') {
+                    result += c;
+                    cap_next = false;
+                } else if ('0' <= c && c <= '9') {
+                    result += c;
+                    cap_next = true;
+                } else
+                    cap_next = true;
+            }
+            return result;
+        }
+
+        string Upper(string s) {
+            for (auto& c : s) c = toupper(c);
+            return s;
+        }
+
+        string TraitsName(const FieldDescriptor* field) { return FlatName(field->containing_type()) + "_" + field->name(); }
+        string TraitsName(const OneofDescriptor* oneof) { return FlatName(oneof->containing_type()) + "_" + oneof->name() + "_oneof"; }
+
+        // Enum fields are handled as int, as reflection (GetEnumValue) does.
+        string ValueType(const FieldDescriptor* field) {
+            switch (field->cpp_type()) {
+                case FieldDescriptor::CPPTYPE_INT32:  return "int32_t";
+                case FieldDescriptor::CPPTYPE_INT64:  return "int64_t";
+                case FieldDescriptor::CPPTYPE_UINT32: return "uint32_t";
+                case FieldDescriptor::CPPTYPE_UINT64: return "uint64_t";
+                case FieldDescriptor::CPPTYPE_DOUBLE: return "double";
+                case FieldDescriptor::CPPTYPE_FLOAT:  return "float";
+                case FieldDescriptor::CPPTYPE_BOOL:   return "bool";
+                case FieldDescriptor::CPPTYPE_ENUM:   return "int";
+                default:                              return "";
+            }
+        }
+
+        // ----------------------Constraints------------------------
+        // The same checks as ConstraintEngine::AddFieldActions(), a constraint the engine ignores is not generated.
+        template<class T>
+        bool RangeFits(double min, double max) {
+            return min >= (double)std::numeric_limits<T>::lowest() && max <= (double)std::numeric_limits<T>::max();
+        }
+
+        bool RangeFits(FieldDescriptor::CppType type, double min, double max) {
+            switch (type) {
+                case FieldDescriptor::CPPTYPE_INT32:
+                case FieldDescriptor::CPPTYPE_ENUM:   return RangeFits<int32_t>(min, max);
+                case FieldDescriptor::CPPTYPE_INT64:  return RangeFits<int64_t>(min, max);
+                case FieldDescriptor::CPPTYPE_UINT32: return RangeFits<uint32_t>(min, max);
+                case FieldDescriptor::CPPTYPE_UINT64: return RangeFits<uint64_t>(min, max);
+                case FieldDescriptor::CPPTYPE_FLOAT:  return RangeFits<float>(min, max);
+                case FieldDescriptor::CPPTYPE_DOUBLE: return true;
+                default:                              return false;
+            }
+        }
+
+        bool IsIntegral(FieldDescriptor::CppType type) {
+            return type == FieldDescriptor::CPPTYPE_INT32 || type == FieldDescriptor::CPPTYPE_INT64 ||
+                   type == FieldDescriptor::CPPTYPE_UINT32 || type == FieldDescriptor::CPPTYPE_UINT64;
+        }
+
+        // a double literal that converts back to the same value
+        string DoubleLiteral(double value) {
+            if (value == std::numeric_limits<double>::infinity()) return "std::numeric_limits<double>::infinity()";
+            if (value == -std::numeric_limits<double>::infinity()) return "-std::numeric_limits<double>::infinity()";
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", value);
+            return buffer;
+        }
+
+        // "msg.evaldata().alldatalists_size()" for the index_into path "evalData.allDataLists" from desc, "0" if the
+        // path is not the one of a repeated field, like ConstraintEngine::AddSource()
+        string SourceSize(const Descriptor* desc, const string& path) {
+            string access = "msg";
+            for (size_t begin = 0; begin <= path.size(); ) {
+                size_t end = std::min(path.find('.', begin), path.size());
+                const FieldDescriptor* field = desc ? desc->FindFieldByName(path.substr(begin, end - begin)) : nullptr;
+                if (!field) return "0";
+                if (end == path.size())
+                    return field->is_repeated() ? access + "." + FieldName(field) + "_size()" : "0";
+                // only the last field may be repeated
+                if (field->is_repeated() || field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) return "0";
+                access += "." + FieldName(field) + "()";
+                desc = field->message_type();
+                begin = end + 1;
+            }
+            return "0";
+        }
+
+        void CollectMessages(const Descriptor* desc, std::vector<const Descriptor*>* messages) {
+            if (desc->options().map_entry()) return;
+            messages->push_back(desc);
+            for (int i = 0; i < desc->nested_type_count(); i++)
+                CollectMessages(desc->nested_type(i), messages);
+        }
+    }
+
+    TypedMutatorGenerator::TypedMutatorGenerator(const FileDescriptor* file)
+        : file_(file), base_name_(StripProto(file->name())) {
+        for (int i = 0; i < file->message_type_count(); i++)
+            CollectMessages(file->message_type(i), &messages_);
+        for (auto desc : messages_)
+            PlanConstraints(desc);
+    }
+
+    bool TypedMutatorGenerator::IsTyped(const FieldDescriptor* field) const {
+        if (field->is_map() || field->is_extension()) return false;
+        switch (field->type()) {
+            case FieldDescriptor::TYPE_STRING:
+            case FieldDescriptor::TYPE_BYTES:
+            case FieldDescriptor::TYPE_GROUP:
+                // not support
+                return false;
+            case FieldDescriptor::TYPE_MESSAGE:
+                return field->message_type()->file() == file_;
+            default:
+                return true;
+        }
+    }
+
+    bool TypedMutatorGenerator::IsTyped(const OneofDescriptor* oneof) const {
+        for (int i = 0; i < oneof->field_count(); i++)
+            if (!IsTyped(oneof->field(i))) return false;
+        return true;
+    }
+
+    TypedMutatorGenerator::ConstraintPlan TypedMutatorGenerator::PlanConstraints(const Descriptor* desc) {
+        auto it = constraint_plans_.find(desc);
+        // A type that is being planned is recursive: the engine does not constrain its recursive occurrences,
+        // the generated code would, so it is left to the engine.
+        if (it != constraint_plans_.end()) return it->second;
+        constraint_plans_[desc] = ConstraintPlan::Reflection;
+        ConstraintPlan plan = ConstraintPlan::None;
+        // Same order as ConstraintEngine::Compile(): the actions of every field by index, the embedded message
+        // after them, a oneof group at the position of its first constrained member.
+        std::vector<string> chunks;
+        std::map<const OneofDescriptor*, std::pair<size_t, string>> oneof_cases;
+        for (int i = 0; i < desc->field_count(); i++) {
+            auto field = desc->field(i);
+            string calls = ConstraintCalls(field);
+            if (!calls.empty()) {
+                plan = std::max(plan, IsTyped(field) ? ConstraintPlan::Typed : ConstraintPlan::Reflection);
+                chunks.push_back(calls);
+            }
+            if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) continue;
+            ConstraintPlan embedded = PlanConstraints(field->message_type());
+            if (embedded == ConstraintPlan::None) continue;
+            auto oneof = field->real_containing_oneof();
+            bool typed = embedded == ConstraintPlan::Typed && field->message_type()->file() == file_ &&
+                         (oneof ? IsTyped(oneof) : IsTyped(field));
+            plan = std::max(plan, typed ? ConstraintPlan::Typed : ConstraintPlan::Reflection);
+            if (!typed) continue;
+            if (oneof) {
+                auto group = oneof_cases.find(oneof);
+                if (group == oneof_cases.end()) {
+                    group = oneof_cases.emplace(oneof, std::make_pair(chunks.size(), string())).first;
+                    chunks.emplace_back();
+                }
+                group->second.second += "            case " + std::to_string(field->index_in_oneof()) + ": ConstrainMessage<" +
+                                        TraitsName(field) + ">(msg, sizes); break;\n";
+            } else {
+                chunks.push_back("        " + string(field->is_repeated() ? "ConstrainRepeatedMessage<" : "ConstrainMessage<") +
+                                 TraitsName(field) + ">(msg, sizes);\n");
+            }
+        }
+        for (const auto& group : oneof_cases)
+            chunks[group.second.first] = "        switch (" + TraitsName(group.first) + "::Current(*msg)) {\n" +
+                                         group.second.second + "        }\n";
+        if (plan == ConstraintPlan::Typed) {
+            string body;
+            for (const auto& chunk : chunks) body += chunk;
+            constraint_bodies_[desc] = body;
+        }
+        constraint_plans_[desc] = plan;
+        return plan;
+    }
+
+    string TypedMutatorGenerator::ConstraintCalls(const FieldDescriptor* field) {
+        const auto& options = field->options();
+        if (!options.HasExtension(constraint)) return "";
+        const FieldConstraint& c = options.GetExtension(constraint);
+        auto type = field->cpp_type();
+        string calls, traits = TraitsName(field);
+        auto call = [&](const string& kernel, const string& args) {
+            calls += "        " + kernel + "<" + traits + ">(msg" + args + ");\n";
+        };
+        if (c.has_max_size() && field->is_repeated())
+            call("ConstrainMaxSize", ", " + std::to_string(c.max_size()));
+        if (c.enum_in_size() && type == FieldDescriptor::CPPTYPE_ENUM) {
+            string allowed;
+            for (int value : c.enum_in())
+                allowed += (allowed.empty() ? "" : ", ") + std::to_string(value);
+            call("ConstrainEnumIn", ", {" + allowed + "}");
+        }
+        if (c.has_min() && c.has_max() && c.min() <= c.max() && RangeFits(type, c.min(), c.max()))
+            call("ConstrainRange", ", " + DoubleLiteral(c.min()) + ", " + DoubleLiteral(c.max()));
+        if (c.power_of_two() && (type == FieldDescriptor::CPPTYPE_UINT32 || type == FieldDescriptor::CPPTYPE_UINT64))
+            call("ConstrainPowerOfTwo", "");
+        if (!c.index_into().empty() && IsIntegral(type)) {
+            auto source = std::find(index_sources_.begin(), index_sources_.end(), c.index_into());
+            if (source == index_sources_.end())
+                source = index_sources_.insert(source, c.index_into());
+            call("ConstrainIndexInto", ", sizes[" + std::to_string(source - index_sources_.begin()) + "]");
+        }
+        return calls;
+    }
+
+    std::vector<const Descriptor*> TypedMutatorGenerator::TypedConstraintMessages() const {
+        std::vector<const Descriptor*> messages;
+        for (auto desc : messages_)
+            if (constraint_bodies_.count(desc)) messages.push_back(desc);
+        return messages;
+    }
+
+    void TypedMutatorGenerator::GenerateConstraints(Printer* printer) const {
+        auto messages = TypedConstraintMessages();
+        if (messages.empty()) return;
+        printer->Print("    // ----------------------Typed constraints------------------------\n");
+        for (auto desc : messages)
+            printer->Print(
+                "    template<>\n"
+                "    struct TypedConstraints<$cls$> {\n"
+                "        static void Sizes(const $cls$& msg, uint32_t* sizes);\n"
+                "        static void Apply($cls$* msg, const uint32_t* sizes);\n"
+                "    };\n",
+                "cls", QualifiedName(desc));
+        printer->Print("\n");
+        for (auto desc : messages) {
+            string sizes;
+            for (size_t i = 0; i < index_sources_.size(); i++)
+                sizes += "        sizes[" + std::to_string(i) + "] = " + SourceSize(desc, index_sources_[i]) +
+                         ";  // " + index_sources_[i] + "\n";
+            printer->Print(
+                "    void TypedConstraints<$cls$>::Sizes([[maybe_unused]] const $cls$& msg, uint32_t* sizes) {\n"
+                "$sizes$"
+                "    }\n"
+                "\n"
+                "    inline void TypedConstraints<$cls$>::Apply($cls$* msg, [[maybe_unused]] const uint32_t* sizes) {\n"
+                "$body$"
+                "    }\n"
+                "\n",
+                "cls", QualifiedName(desc), "sizes", sizes, "body", constraint_bodies_.at(desc));
+        }
+        printer->Print(
+            "namespace {\n"
+            "    [[maybe_unused]] const bool kConstraintsRegistered = [] {\n");
+        for (auto desc : messages)
+            printer->Print("        RegisterTypedConstraints($cls$::descriptor(), MakeTypedConstraintsEntry<$cls$>($count$));\n",
+                           "cls", QualifiedName(desc), "count", std::to_string(index_sources_.size()));
+        printer->Print(
+            "        return true;\n"
+            "    }();\n"
+            "}  // namespace\n");
+    }
+
+    void TypedMutatorGenerator::GenerateHeader(Printer* printer) const {
+        Vars vars = {{"source", file_->name()}, {"guard", Upper(Replace(Replace(base_name_, "/", "_"), ".", "_")) + "_TYPED_MUTATOR_H_"},
+                     {"pb_header", base_name_ + ".pb.h"}};
+        printer->Print(vars,
+            "// Generated by protoc-gen-typed_mutator.  DO NOT EDIT!\n"
+            "// source: $source$\n"
+            "\n"
+            "#ifndef $guard$\n"
+            "#define $guard$\n"
+            "\n"
+            "#include \"$pb_header$\"\n"
+            "#include \"protobuf_mutator/typed_mutator.h\"\n"
+            "\n"
+            "namespace protobuf_mutator {\n");
+        for (auto desc : messages_) {
+            printer->Print(
+                "    template<>\n"
+                "    struct TypedMutator<$cls$> {\n"
+                "        static void Mutate($cls$* msg, int& remain_size);\n"
+                "        static void Crossover($cls$* msg1, const $cls$& msg2, int& remain_size);\n"
+                "        static void CreateRandom($cls$* msg, int& remain_size);\n"
+                "    };\n",
+                "cls", QualifiedName(desc));
+        }
+        printer->Print(vars,
+            "}  // namespace protobuf_mutator\n"
+            "\n"
+            "#endif  // $guard$\n");
+    }
+
+    void TypedMutatorGenerator::GenerateFieldTraits(Printer* printer, const FieldDescriptor* field) const {
+        Vars vars = {
+            {"traits", TraitsName(field)},
+            {"cls", QualifiedName(field->containing_type())},
+            {"name", FieldName(field)},
+            {"type", "FieldDescriptor::TYPE_" + Upper(FieldDescriptor::TypeName(field->type()))},
+            {"tag_size", std::to_string(WireFormat::TagSize(field->number(), field->type()))},
+            {"index", std::to_string(field->index())},
+        };
+        printer->Print(vars,
+            "    struct $traits$ {\n"
+            "        using MessageType = $cls$;\n"
+            "        static constexpr FieldDescriptor::Type kType = $type$;\n"
+            "        static constexpr int kTagSize = $tag_size$;\n"
+            "        static constexpr int kIndex = $index$;\n");
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            vars["sub"] = QualifiedName(field->message_type());
+            if (field->is_repeated())
+                printer->Print(vars,
+                    "        using SubType = $sub$;\n"
+                    "        static const ::google::protobuf::RepeatedPtrField<SubType>& Get(const MessageType& m) { return m.$name$(); }\n"
+                    "        static ::google::protobuf::RepeatedPtrField<SubType>* Mutable(MessageType* m) { return m->mutable_$name$(); }\n");
+            else
+                printer->Print(vars,
+                    "        using SubType = $sub$;\n"
+                    "        static bool Has(const MessageType& m) { return m.has_$name$(); }\n"
+                    "        static const SubType& Get(const MessageType& m) { return m.$name$(); }\n"
+                    "        static SubType* Mutable(MessageType* m) { return m->mutable_$name$(); }\n"
+                    "        static void Clear(MessageType* m) { m->clear_$name$(); }\n");
+            printer->Print("    };\n");
+            return;
+        }
+        vars["value_type"] = ValueType(field);
+        printer->Print(vars, "        using ValueType = $value_type$;\n");
+        if (auto enum_type = field->enum_type()) {
+            string values;
+            for (int i = 0; i < enum_type->value_count(); i++)
+                values += (i ? ", " : "") + std::to_string(enum_type->value(i)->number());
+            vars["enum_count"] = std::to_string(enum_type->value_count());
+            vars["enum_values"] = values;
+            vars["enum_cls"] = QualifiedName(enum_type);
+            printer->Print(vars,
+                "        static constexpr int kEnumCount = $enum_count$;\n"
+                "        static constexpr int kEnumValues[] = {$enum_values$};\n");
+        }
+        if (field->is_repeated()) {
+            vars["packed"] = field->is_packed() ? "true" : "false";
+            printer->Print(vars,
+                "        static constexpr bool kPacked = $packed$;\n"
+                "        static const ::google::protobuf::RepeatedField<ValueType>& Get(const MessageType& m) { return m.$name$(); }\n"
+                "        static ::google::protobuf::RepeatedField<ValueType>* Mutable(MessageType* m) { return m->mutable_$name$(); }\n"
+                "    };\n");
+            return;
+        }
+        // proto3 fields without presence are set when they are not zero
+        printer->Print(vars, field->has_presence() ?
+            "        static constexpr bool kHasPresence = true;\n"
+            "        static bool Has(const MessageType& m) { return m.has_$name$(); }\n" :
+            "        static constexpr bool kHasPresence = false;\n"
+            "        static bool Has(const MessageType& m) { return IsNonZero(m.$name$()); }\n");
+        if (field->enum_type())
+            printer->Print(vars,
+                "        static ValueType Get(const MessageType& m) { return static_cast<int>(m.$name$()); }\n"
+                "        static void Set(MessageType* m, ValueType v) { m->set_$name$(static_cast<$enum_cls$>(v)); }\n");
+        else
+            printer->Print(vars,
+                "        static ValueType Get(const MessageType& m) { return m.$name$(); }\n"
+                "        static void Set(MessageType* m, ValueType v) { m->set_$name$(v); }\n");
+        printer->Print(vars,
+            "        static void Clear(MessageType* m) { m->clear_$name$(); }\n"
+            "    };\n");
+    }
+
+    void TypedMutatorGenerator::GenerateOneofTraits(Printer* printer, const OneofDescriptor* oneof) const {
+        Vars vars = {
+            {"traits", TraitsName(oneof)},
+            {"cls", QualifiedName(oneof->containing_type())},
+            {"oneof", oneof->name()},
+            {"count", std::to_string(oneof->field_count())},
+        };
+        printer->Print(vars,
+            "    struct $traits$ {\n"
+            "        using MessageType = $cls$;\n"
+            "        static constexpr int kMemberCount = $count$;\n"
+            "        static int Current(const MessageType& m) {\n");
+        // the oneof of a proto3 optional field has no case accessor
+        if (oneof->is_synthetic())
+            printer->Print("            return m.has_$name$() ? 0 : -1;\n", "name", FieldName(oneof->field(0)));
+        else {
+            printer->Print(vars, "            switch (m.$oneof$_case()) {\n");
+            for (int i = 0; i < oneof->field_count(); i++)
+                printer->Print(vars, ("                case $cls$::k" + CamelName(oneof->field(i)->name()) + ": return " +
+                                      std::to_string(i) + ";\n").c_str());
+            printer->Print(
+                "                default: return -1;\n"
+                "            }\n");
+        }
+        printer->Print(
+            "        }\n"
+            "        template<class V>\n"
+            "        static void Visit(int index, V&& visit) {\n"
+            "            switch (index) {\n");
+        for (int i = 0; i < oneof->field_count(); i++)
+            printer->Print("                case $index$: visit(FieldTag<$member$>()); break;\n",
+                           "index", std::to_string(i), "member", TraitsName(oneof->field(i)));
+        printer->Print(
+            "            }\n"
+            "        }\n"
+            "    };\n");
+    }
+
+    void TypedMutatorGenerator::GenerateFunctions(Printer* printer, const Descriptor* desc) const {
+        // Same order as MessagePlan: every field by index, a oneof group at the position of its first field.
+        string mutate, crossover, create;
+        for (int i = 0; i < desc->field_count(); i++) {
+            auto field = desc->field(i);
+            auto oneof = field->containing_oneof();
+            if (oneof && field->index_in_oneof() != 0) continue;
+            bool typed = oneof ? IsTyped(oneof) : IsTyped(field);
+            string kernel, traits = oneof ? TraitsName(oneof) : TraitsName(field);
+            if (!typed) {
+                string index = std::to_string(i);
+                mutate += "        FallbackFieldMutation(msg, " + index + ", remain_size);\n";
+                crossover += "        FallbackFieldCrossover(msg1, &msg2, " + index + ", remain_size);\n";
+                create += "        FallbackFieldCreate(msg, " + index + ", remain_size);\n";
+                continue;
+            }
+            if (oneof) {
+                mutate += "        TypedOneofMutation<" + traits + ">(msg, remain_size);\n";
+                crossover += "        TypedOneofCrossover<" + traits + ">(msg1, msg2, remain_size);\n";
+                create += "        TypedCreateOneofMember<" + traits + ">(msg, remain_size);\n";
+            } else if (field->is_repeated()) {
+                mutate += "        TypedRepeatedMutation<" + traits + ">(msg, remain_size);\n";
+                crossover += "        TypedRepeatedCrossover<" + traits + ">(msg1, msg2, remain_size);\n";
+                create += "        TypedAddRepeatedField<" + traits + ">(msg, remain_size, MIN_CREATE_REPEATED_SIZE);\n";
+            } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+                mutate += "        TypedMessageMutation<" + traits + ">(msg, remain_size);\n";
+                crossover += "        TypedMessageCrossover<" + traits + ">(msg1, msg2, remain_size);\n";
+                create += "        TypedAddUnsetField<" + traits + ">(msg, remain_size);\n";
+            } else {
+                mutate += "        TypedScalarMutation<" + traits + ">(msg, remain_size);\n";
+                crossover += "        TypedScalarCrossover<" + traits + ">(msg1, msg2, remain_size);\n";
+                create += "        TypedAddUnsetField<" + traits + ">(msg, remain_size);\n";
+            }
+        }
+        Vars vars = {{"cls", QualifiedName(desc)}, {"mutate", mutate}, {"crossover", crossover}, {"create", create}};
+        printer->Print(vars,
+            "    void TypedMutator<$cls$>::Mutate($cls$* msg, int& remain_size) {\n"
+            "$mutate$"
+            "    }\n"
+            "\n"
+            "    void TypedMutator<$cls$>::Crossover($cls$* msg1, const $cls$& msg2, int& remain_size) {\n"
+            "$crossover$"
+            "    }\n"
+            "\n"
+            "    void TypedMutator<$cls$>::CreateRandom($cls$* msg, int& remain_size) {\n"
+            "$create$"
+            "    }\n"
+            "\n");
+    }
+
+    void TypedMutatorGenerator::GenerateSource(Printer* printer) const {
+        printer->Print(
+            "// Generated by protoc-gen-typed_mutator.  DO NOT EDIT!\n"
+            "// source: $source$\n"
+            "\n"
+            "#include \"$header$\"\n",
+            "source", file_->name(), "header", HeaderName());
+        if (!constraint_bodies_.empty())
+            printer->Print("#include \"typed_constraints.h\"\n");
+        printer->Print(
+            "\n"
+            "namespace protobuf_mutator {\n"
+            "namespace {\n");
+        for (auto desc : messages_) {
+            printer->Print("    // $name$\n", "name", desc->full_name());
+            for (int i = 0; i < desc->field_count(); i++)
+                if (IsTyped(desc->field(i))) GenerateFieldTraits(printer, desc->field(i));
+            for (int i = 0; i < desc->oneof_decl_count(); i++)
+                if (IsTyped(desc->oneof_decl(i))) GenerateOneofTraits(printer, desc->oneof_decl(i));
+            printer->Print("\n");
+        }
+        printer->Print("}  // namespace\n\n");
+        for (auto desc : messages_)
+            GenerateFunctions(printer, desc);
+        printer->Print(
+            "namespace {\n"
+            "    [[maybe_unused]] const bool kRegistered = [] {\n");
+        for (auto desc : messages_)
+            printer->Print("        RegisterTypedMutator($cls$::descriptor(), MakeTypedMutatorEntry<$cls$>());\n",
+                           "cls", QualifiedName(desc));
+        printer->Print(
+            "        return true;\n"
+            "    }();\n"
+            "}  // namespace\n"
+            "\n");
+        GenerateConstraints(printer);
+        printer->Print("}  // namespace protobuf_mutator\n");
+    }
+}  // namespace protobuf_mutator
@@ -0,0 +1,62 @@
+#ifndef TYPED_MUTATOR_GENERATOR_H_
+#define TYPED_MUTATOR_GENERATOR_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/printer.h>
+
+namespace protobuf_mutator {
+    /**
+     * @brief Emits <proto>.typed_mutator.h/.cc, a TypedMutator specialization for every message of a proto file.
+     * @details The generated code only holds traits (generated accessors of every field) and the field order,
+     *          the operations themselves are the kernels of protobuf_mutator/typed_mutator.h.
+     *          Fields that can not be typed (string, bytes, map, message of another file) use the reflection path.
+     *          Message types with (protobuf_mutator.constraint) options below them get a TypedConstraints
+     *          specialization as well (postprocess/typed_constraints.h), if all of their constraints can be typed.
+     *          Only depends on libprotobuf and constraints.pb, so that it can be run without the plugin protocol as well.
+     */
+    class TypedMutatorGenerator {
+    public:
+        explicit TypedMutatorGenerator(const google::protobuf::FileDescriptor* file);
+
+        // "openfhe_ckks.typed_mutator.h" for "openfhe_ckks.proto"
+        std::string HeaderName() const { return base_name_ + ".typed_mutator.h"; }
+        std::string SourceName() const { return base_name_ + ".typed_mutator.cc"; }
+
+        void GenerateHeader(google::protobuf::io::Printer* printer) const;
+        void GenerateSource(google::protobuf::io::Printer* printer) const;
+
+    private:
+        void GenerateFieldTraits(google::protobuf::io::Printer* printer, const google::protobuf::FieldDescriptor* field) const;
+        void GenerateOneofTraits(google::protobuf::io::Printer* printer, const google::protobuf::OneofDescriptor* oneof) const;
+        void GenerateFunctions(google::protobuf::io::Printer* printer, const google::protobuf::Descriptor* desc) const;
+
+        // A field is typed if the kernels support its type, and for a message type, if it has a typed mutator as well.
+        bool IsTyped(const google::protobuf::FieldDescriptor* field) const;
+        bool IsTyped(const google::protobuf::OneofDescriptor* oneof) const;
+
+        // ----------------------Typed constraints------------------------
+        // Whether desc gets typed constraints: something below it is constrained, and every constrained type
+        // below it is a typed, non-recursive message type of this file.
+        enum class ConstraintPlan { None, Typed, Reflection };
+        ConstraintPlan PlanConstraints(const google::protobuf::Descriptor* desc);
+        // the kernel calls of the constraint of a field, in the order of ConstraintEngine
+        std::string ConstraintCalls(const google::protobuf::FieldDescriptor* field);
+        std::vector<const google::protobuf::Descriptor*> TypedConstraintMessages() const;
+        void GenerateConstraints(google::protobuf::io::Printer* printer) const;
+
+        const google::protobuf::FileDescriptor* file_;
+        std::string base_name_;
+        // all message types of the file (nested ones included), map entries excluded
+        std::vector<const google::protobuf::Descriptor*> messages_;
+        std::map<const google::protobuf::Descriptor*, ConstraintPlan> constraint_plans_;
+        // body of TypedConstraints<T>::Apply() of the types planned Typed
+        std::map<const google::protobuf::Descriptor*, std::string> constraint_bodies_;
+        // index_into paths of the file, sizes[i] of the generated code is the size of the i-th
+        std::vector<std::string> index_sources_;
+    };
+}  // namespace protobuf_mutator
+
+#endif  // TYPED_MUTATOR_GENERATOR_H_
@@ -0,0 +1,405 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "postprocess/postprocess.h"
+#include "protobuf_mutator/repeated_kernels.h"
+#include "proto/proto_setting.h"
+
+using namespace protobuf_mutator;
+
+/**
+ * @brief Structure-aware minimizer of a crashing Root.
+ * usage: proto_minimize [-j jobs] [-t timeout ms] [-e exit status] [-o output] [-P] <crash input> -- <target> [args]
+ * @details Delta debugging over the message instead of its bytes. Every round lists the reductions of the current
+ *          message, most promising first: chunks of a repeated field (apiList, allDataLists, dataList, ...) in a
+ *          binary-search schedule, outer fields first; fields reset to their default; numbers simplified to 0, 1 or
+ *          a power of two. The reductions are tried in order, jobs at a time, each by a worker that runs the target in
+ *          a process of its own with a timeout. The first one that still crashes becomes the current message and the
+ *          next round begins; the tool stops once no single reduction reproduces the crash.
+ *          A crash is a termination by the signal of the original input, or with the -e exit status (sanitizers that
+ *          do not abort). @@ in the arguments of the target is replaced by the input file, otherwise it is stdin.
+ *          Candidates go through PostProcessInput() like the fuzzer's mutants do, unless -P is given. The output
+ *          (default <crash input>.min) is in the format of the input, a text dump is written next to it.
+ */
+namespace {
+    using Path = vector<std::pair<const FieldDescriptor*, int>>;
+
+    struct Options {
+        int jobs = std::max(1u, std::thread::hardware_concurrency());
+        int timeout_ms = 5000;
+        int crash_status = -1;
+        bool post_process = true;
+        string input, output;
+        vector<string> target;
+    };
+
+    struct Reduction {
+        enum Kind { Remove, Clear, Simplify } kind;
+        Path path;                      // the message of the field from the root
+        const FieldDescriptor* field;
+        int pos;                        // Remove: first element; Simplify: element of a repeated field, -1 if singular
+        int count;                      // Remove: number of elements
+        double real;                    // Simplify: the new value of a floating point field
+        uint64_t integer;               // Simplify: the new value of an integer field
+    };
+
+    // How the target ended.
+    struct Outcome {
+        bool timed_out = false;
+        int signal = 0;                 // 0 if it exited
+        int status = 0;
+    };
+
+    // 0, 1, powers of two from the smallest, anything else: a simplification goes down this order, so the rounds end.
+    bool Simpler(uint64_t to, uint64_t magnitude, bool negative) {
+        auto rank = [](uint64_t v) { return v < 2 ? (int)v : (v & (v - 1)) == 0 ? 2 : 3; };
+        int from = negative ? 3 : rank(magnitude);
+        return rank(to) < from || (from == 2 && rank(to) == 2 && to < magnitude);
+    }
+
+    bool Simpler(double to, double magnitude, bool negative) {
+        auto rank = [](double v) {
+            int exp;
+            // powers of two below 1 are not simpler than other fractions
+            return v == 0 ? 0 : v == 1 ? 1 : std::frexp(v, &exp) == 0.5 && v > 1 ? 2 : 3;
+        };
+        int from = negative ? 3 : rank(magnitude);
+        return rank(to) < from || (from == 2 && rank(to) == 2 && to < magnitude);
+    }
+
+    void AddSimplifications(const Path& path, const FieldDescriptor* field, int index, const Message& msg,
+                            vector<Reduction>& out) {
+        auto ref = msg.GetReflection();
+        # define VALUE(Type) (index < 0 ? ref->Get##Type(msg, field) : ref->GetRepeated##Type(msg, field, index))
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_INT64:
+            case FieldDescriptor::CPPTYPE_UINT32:
+            case FieldDescriptor::CPPTYPE_UINT64: {
+                bool is_signed = field->cpp_type() == FieldDescriptor::CPPTYPE_INT32 ||
+                                 field->cpp_type() == FieldDescriptor::CPPTYPE_INT64;
+                int64_t value = field->cpp_type() == FieldDescriptor::CPPTYPE_INT32  ? VALUE(Int32)
+                              : field->cpp_type() == FieldDescriptor::CPPTYPE_INT64  ? VALUE(Int64)
+                              : field->cpp_type() == FieldDescriptor::CPPTYPE_UINT32 ? (int64_t)VALUE(UInt32)
+                                                                                     : (int64_t)VALUE(UInt64);
+                bool negative = is_signed && value < 0;
+                uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+                uint64_t power = magnitude ? 1ull << (63 - __builtin_clzll(magnitude)) : 0;
+                for (uint64_t to : {(uint64_t)0, (uint64_t)1, power, power / 2}) {
+                    // 2^63 is not a value of a signed field
+                    if (is_signed && to > (uint64_t)INT64_MAX) continue;
+                    if (Simpler(to, magnitude, negative))
+                        out.push_back({Reduction::Simplify, path, field, index, 0, 0, to});
+                }
+                break;
+            }
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+            case FieldDescriptor::CPPTYPE_FLOAT: {
+                double value = field->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE ? VALUE(Double) : VALUE(Float);
+                if (std::isnan(value) || std::isinf(value)) {
+                    out.push_back({Reduction::Simplify, path, field, index, 0, 0.0, 0});
+                    break;
+                }
+                int exp;
+                std::frexp(std::fabs(value), &exp);
+                double power = std::ldexp(0.5, exp);
+                for (double to : {0.0, 1.0, power, power / 2})
+                    if (Simpler(to, std::fabs(value), value < 0))
+                        out.push_back({Reduction::Simplify, path, field, index, 0, to, 0});
+                break;
+            }
+            default:
+                // enums and bools are only reset, strings are left as they are
+                break;
+        }
+        # undef VALUE
+    }
+
+    // The reductions of msg and of its embedded messages: removals first, then resets, then simplifications.
+    void ListReductions(const Message& msg, Path& path, vector<Reduction> (&out)[3]) {
+        auto desc = msg.GetDescriptor();
+        auto ref = msg.GetReflection();
+        for (int i = 0; i < desc->field_count(); i++) {
+            auto field = desc->field(i);
+            if (field->is_repeated()) {
+                int size = ref->FieldSize(msg, field);
+                if (!size || field->cpp_type() == FieldDescriptor::CPPTYPE_STRING) continue;
+                // the whole field, halves, quarters, ... down to single elements
+                std::set<std::pair<int, int>> chunks;
+                for (int chunk = size; chunk > 0; chunk /= 2)
+                    for (int pos = 0; pos < size; pos += chunk)
+                        if (chunks.insert({pos, std::min(chunk, size - pos)}).second)
+                            out[0].push_back({Reduction::Remove, path, field, pos, std::min(chunk, size - pos), 0, 0});
+                for (int j = 0; j < size; j++) {
+                    if (IsMessageType(field)) {
+                        path.push_back({field, j});
+                        ListReductions(ref->GetRepeatedMessage(msg, field, j), path, out);
+                        path.pop_back();
+                    } else {
+                        AddSimplifications(path, field, j, msg, out[2]);
+                    }
+                }
+            } else if (ref->HasField(msg, field)) {
+                out[1].push_back({Reduction::Clear, path, field, -1, 0, 0, 0});
+                if (IsMessageType(field)) {
+                    path.push_back({field, -1});
+                    ListReductions(ref->GetMessage(msg, field), path, out);
+                    path.pop_back();
+                } else {
+                    AddSimplifications(path, field, -1, msg, out[2]);
+                }
+            }
+        }
+    }
+
+    void Apply(const Reduction& r, Message* root) {
+        Message* msg = root;
+        for (const auto& step : r.path)
+            msg = step.second >= 0 ? msg->GetReflection()->MutableRepeatedMessage(msg, step.first, step.second)
+                                   : msg->GetReflection()->MutableMessage(msg, step.first);
+        auto ref = msg->GetReflection();
+        auto field = r.field;
+        switch (r.kind) {
+            case Reduction::Remove:
+                VisitRepeatedField(msg, field, [&](auto f) { EraseRange(f, r.pos, r.count); });
+                break;
+            case Reduction::Clear:
+                ref->ClearField(msg, field);
+                break;
+            case Reduction::Simplify:
+                # define SET_VALUE(Type, value)                                      \
+                    (r.pos < 0 ? ref->Set##Type(msg, field, value)                   \
+                               : ref->SetRepeated##Type(msg, field, r.pos, value))
+                switch (field->cpp_type()) {
+                    case FieldDescriptor::CPPTYPE_INT32:  SET_VALUE(Int32, (int32_t)r.integer); break;
+                    case FieldDescriptor::CPPTYPE_INT64:  SET_VALUE(Int64, (int64_t)r.integer); break;
+                    case FieldDescriptor::CPPTYPE_UINT32: SET_VALUE(UInt32, (uint32_t)r.integer); break;
+                    case FieldDescriptor::CPPTYPE_UINT64: SET_VALUE(UInt64, r.integer); break;
+                    case FieldDescriptor::CPPTYPE_DOUBLE: SET_VALUE(Double, r.real); break;
+                    case FieldDescriptor::CPPTYPE_FLOAT:  SET_VALUE(Float, (float)r.real); break;
+                    default: break;
+                }
+                # undef SET_VALUE
+                break;
+        }
+    }
+
+    /**
+     * @brief Runs the target on one input at a time, in a process of its own. One per job.
+     */
+    class Worker {
+    public:
+        Worker(const Options& options, int id) : options_(options) {
+            const char* dir = getenv("TMPDIR");
+            path_ = string(dir ? dir : "/tmp") + "/proto_minimize_" + std::to_string(getpid()) + "_" + std::to_string(id);
+        }
+        ~Worker() { unlink(path_.c_str()); }
+
+        Outcome Run(const string& data) {
+            Outcome outcome;
+            {
+                std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+                file.write(data.data(), data.size());
+            }
+            vector<string> args = options_.target;
+            bool file_arg = false;
+            for (auto& arg : args)
+                if (arg == "@@") {
+                    arg = path_;
+                    file_arg = true;
+                }
+            // Run() is called by several threads at once: everything the child needs is built before fork(),
+            // the child only calls async-signal-safe functions.
+            vector<char*> argv;
+            for (auto& arg : args) argv.push_back(&arg[0]);
+            argv.push_back(nullptr);
+            const char* input = file_arg ? nullptr : path_.c_str();
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(1);
+            }
+            if (pid == 0) {
+                int null = open("/dev/null", O_RDWR);
+                int in = input ? open(input, O_RDONLY) : null;
+                if (null < 0 || in < 0) _exit(127);
+                dup2(in, 0);
+                dup2(null, 1);
+                dup2(null, 2);
+                execvp(argv[0], argv.data());
+                _exit(127);
+            }
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.timeout_ms);
+            int status = 0;
+            while (waitpid(pid, &status, WNOHANG) == 0) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    kill(pid, SIGKILL);
+                    waitpid(pid, &status, 0);
+                    outcome.timed_out = true;
+                    return outcome;
+                }
+                usleep(200);
+            }
+            if (WIFSIGNALED(status)) outcome.signal = WTERMSIG(status);
+            else outcome.status = WEXITSTATUS(status);
+            return outcome;
+        }
+
+    private:
+        const Options& options_;
+        string path_;
+    };
+
+    class Minimizer {
+    public:
+        explicit Minimizer(const Options& options) : options_(options) {
+            for (int i = 0; i < options.jobs; i++) workers_.emplace_back(new Worker(options, i));
+        }
+
+        // The bytes the target reads for msg.
+        string Encode(const Root& msg) {
+            string data = msg.SerializeAsString();
+            if (!options_.post_process) return data;
+            unsigned char* out;
+            int size = PostProcessInput((const unsigned char*)data.data(), data.size(), &post_input_, &out, &post_out_,
+                                        &post_state_);
+            return string((const char*)out, size);
+        }
+
+        bool Crashes(const Outcome& outcome) const {
+            if (outcome.timed_out) return false;
+            if (options_.crash_status >= 0) return !outcome.signal && outcome.status == options_.crash_status;
+            return outcome.signal && outcome.signal == expected_.signal;
+        }
+
+        bool Start(const Root& msg) {
+            expected_ = workers_[0]->Run(Encode(msg));
+            executions_++;
+            return options_.crash_status >= 0 ? Crashes(expected_) : expected_.signal && !expected_.timed_out;
+        }
+
+        // One round: the first reduction of current that still crashes, in the order of ListReductions().
+        bool Round(Root* current) {
+            vector<Reduction> lists[3];
+            Path path;
+            ListReductions(*current, path, lists);
+            vector<Reduction> reductions;
+            for (auto& list : lists) reductions.insert(reductions.end(), list.begin(), list.end());
+            string now = current->SerializeAsString();
+            vector<Root> candidates(options_.jobs);
+            vector<string> inputs(options_.jobs);
+            vector<Outcome> outcomes(options_.jobs);
+            for (size_t next = 0; next < reductions.size(); ) {
+                // the next jobs candidates that differ from the current message
+                int batch = 0;
+                for (; batch < options_.jobs && next < reductions.size(); next++) {
+                    candidates[batch].CopyFrom(*current);
+                    Apply(reductions[next], &candidates[batch]);
+                    if (candidates[batch].SerializeAsString() == now) continue;
+                    inputs[batch] = Encode(candidates[batch]);
+                    batch++;
+                }
+                vector<std::thread> threads;
+                for (int i = 0; i < batch; i++)
+                    threads.emplace_back([&, i] { outcomes[i] = workers_[i]->Run(inputs[i]); });
+                for (auto& thread : threads) thread.join();
+                executions_ += batch;
+                for (int i = 0; i < batch; i++)
+                    if (Crashes(outcomes[i])) {
+                        current->Swap(&candidates[i]);
+                        return true;
+                    }
+            }
+            return false;
+        }
+
+        uint64_t executions() const { return executions_; }
+        const Outcome& expected() const { return expected_; }
+
+    private:
+        const Options& options_;
+        vector<std::unique_ptr<Worker>> workers_;
+        Root post_input_;
+        OutputBuffer post_out_;
+        PostProcessState post_state_;
+        Outcome expected_;
+        uint64_t executions_ = 0;
+    };
+
+    int Usage(const char* name) {
+        fprintf(stderr, "usage: %s [-j jobs] [-t timeout ms] [-e exit status] [-o output] [-P] <crash input> -- "
+                        "<target> [args, @@ is the input file]\n", name);
+        return 1;
+    }
+
+    size_t ApiCount(const Root& msg) { return msg.apisequence().apilist_size(); }
+}
+
+int main(int argc, char *argv[]){
+    Options options;
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "--"); i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) options.jobs = std::max(1, atoi(argv[++i]));
+        else if (arg == "-t" && i + 1 < argc) options.timeout_ms = std::max(1, atoi(argv[++i]));
+        else if (arg == "-e" && i + 1 < argc) options.crash_status = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc) options.output = argv[++i];
+        else if (arg == "-P") options.post_process = false;
+        else if (arg[0] != '-' && options.input.empty()) options.input = arg;
+        else return Usage(argv[0]);
+    }
+    for (i++; i < argc; i++) options.target.push_back(argv[i]);
+    if (options.input.empty() || options.target.empty()) return Usage(argv[0]);
+    if (options.output.empty()) options.output = options.input + ".min";
+
+    std::ifstream in(options.input, std::ios::binary);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    string data = buffer.str();
+    Root msg;
+    bool binary = msg.ParseFromString(data);
+    if (!binary && !ParseTextMessage(data, &msg)) {
+        fprintf(stderr, "%s: not a %s\n", options.input.c_str(), Root::descriptor()->full_name().c_str());
+        return 1;
+    }
+
+    Minimizer minimizer(options);
+    if (!minimizer.Start(msg)) {
+        fprintf(stderr, "%s: the target does not crash on the input\n", options.input.c_str());
+        return 1;
+    }
+    fprintf(stderr, "crash: %s %d, %zu bytes, %zu APIs\n", minimizer.expected().signal ? "signal" : "exit status",
+            minimizer.expected().signal ? minimizer.expected().signal : minimizer.expected().status,
+            msg.ByteSizeLong(), ApiCount(msg));
+    size_t original_size = msg.ByteSizeLong(), original_apis = ApiCount(msg);
+    auto start = std::chrono::steady_clock::now();
+    int rounds = 0;
+    while (minimizer.Round(&msg)) {
+        rounds++;
+        fprintf(stderr, "round %d: %zu bytes, %zu APIs, %lu executions\n", rounds, msg.ByteSizeLong(), ApiCount(msg),
+                (unsigned long)minimizer.executions());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream out(options.output, std::ios::binary | std::ios::trunc);
+    out << (binary ? msg.SerializeAsString() : SaveMessageAsText(msg));
+    std::ofstream text(options.output + ".txt", std::ios::trunc);
+    text << msg.DebugString();
+    fprintf(stderr, "%zu -> %zu bytes, %zu -> %zu APIs in %d reductions, %lu executions in %.1f s (%.0f/s, -j %d)\n",
+            original_size, msg.ByteSizeLong(), original_apis, ApiCount(msg), rounds,
+            (unsigned long)minimizer.executions(), seconds, minimizer.executions() / std::max(seconds, 1e-9),
+            options.jobs);
+    fprintf(stderr, "written to %s and %s.txt\n", options.output.c_str(), options.output.c_str());
+    return 0;
+}
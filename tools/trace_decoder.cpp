@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "protobuf_mutator/trace_logger.h"
+#include "proto/proto_setting.h"
+
+using namespace protobuf_mutator;
+
+/**
+ * @brief Print a trace written by TraceLogger as text, in the format proto_bout.txt used to have.
+ * usage: trace_decoder <trace_<pid>.bin> [output file]
+ */
+int main(int argc, char *argv[]){
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [output file]\n", argv[0]);
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TraceFileHeader().magic, sizeof(header.magic))) {
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        return 1;
+    }
+    if (header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: trace version %u, expected %u\n", argv[1], header.version, TRACE_VERSION);
+        return 1;
+    }
+    header.message_type[sizeof(header.message_type) - 1] = '\0';
+    if (Root::descriptor()->full_name() != header.message_type) {
+        fprintf(stderr, "%s: messages are %s, this decoder reads %s\n", argv[1], header.message_type,
+                Root::descriptor()->full_name().c_str());
+        return 1;
+    }
+
+    TraceRecordHeader record;
+    std::vector<uint8_t> payload;
+    Root msg;
+    size_t records = 0, bad = 0;
+    while (fread(&record, sizeof(record), 1, in) == 1) {
+        payload.resize(record.size);
+        if (fread(payload.data(), 1, record.size, in) != record.size) {
+            // the writer was stopped in the middle of a record
+            fprintf(stderr, "%s: truncated record %lu\n", argv[1], (unsigned long)record.sequence);
+            break;
+        }
+        records++;
+        if (record.kind != TraceKind::PostProcessed || !msg.ParseFromArray(payload.data(), payload.size())) {
+            bad++;
+            continue;
+        }
+        fprintf(out, "================%lu================\n", (unsigned long)record.sequence);
+        fputs(msg.DebugString().c_str(), out);
+    }
+    fprintf(stderr, "%zu records, %zu could not be decoded\n", records, bad);
+    fclose(in);
+    if (out != stdout) fclose(out);
+    return 0;
+}